@@ -0,0 +1,114 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compares lexing many small scripts one at a time against
+ * scallop_lang_batch_lex() at increasing thread counts.
+ *
+ * Usage: bench_scallop_lang_batch [SCRIPTS [THREADS]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "scallop-lang/batch.h"
+#include "scallop-lang/lex.h"
+
+static const char script[] =
+	"cd /usr/src/project\n"
+	"echo 'building' \"$target\"; make -j4 all\n"
+	"cp build/*.o /tmp/objects # copy outputs\n"
+	"test -f build/done && echo done\n";
+
+static double now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static size_t lex_one(struct libadt_const_lptr value)
+{
+	size_t tokens = 0;
+	struct scallop_lang_lex token = scallop_lang_lex_init(value);
+	for (;;) {
+		token = scallop_lang_lex_next(token);
+		if (
+			token.type == scallop_lang_classifier_end
+			|| token.type == scallop_lang_classifier_unexpected
+		)
+			return tokens;
+		tokens++;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const size_t scripts = argc > 1 ? strtoul(argv[1], NULL, 10) : 50000;
+	const long cores = argc > 2
+		? atol(argv[2])
+		: sysconf(_SC_NPROCESSORS_ONLN);
+
+	struct scallop_lang_batch_input *const inputs = calloc(
+		scripts,
+		sizeof(*inputs)
+	);
+	if (!inputs)
+		return 1;
+	for (size_t i = 0; i < scripts; i++)
+		inputs[i].script = (struct libadt_const_lptr) {
+			.buffer = script,
+			.size = 1,
+			.length = (ssize_t)strlen(script),
+		};
+
+	double start = now();
+	size_t tokens = 0;
+	for (size_t i = 0; i < scripts; i++)
+		tokens += lex_one(inputs[i].script);
+	const double sequential = now() - start;
+	printf("%-12s %12.2f ms %12zu tokens\n", "sequential", sequential * 1e3, tokens);
+
+	for (long threads = 1; threads <= cores; threads *= 2) {
+		struct scallop_lang_batch batch = { 0 };
+		start = now();
+		if (scallop_lang_batch_lex(inputs, scripts, (size_t)threads, &batch)) {
+			perror("scallop_lang_batch_lex");
+			return 1;
+		}
+		const double elapsed = now() - start;
+
+		tokens = 0;
+		for (size_t i = 0; i < batch.length; i++)
+			tokens += batch.results[i].tokens_length;
+		printf(
+			"%3ld threads  %12.2f ms %12zu tokens %8.2fx\n",
+			threads,
+			elapsed * 1e3,
+			tokens,
+			sequential / elapsed
+		);
+		scallop_lang_batch_free(&batch);
+	}
+
+	free(inputs);
+	return 0;
+}
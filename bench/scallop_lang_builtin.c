@@ -0,0 +1,129 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compares the latency of running trivial commands as builtins
+ * against spawning the equivalent programs.
+ *
+ * Usage: bench_scallop_lang_builtin [ITERATIONS]
+ */
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "scallop-lang/builtin.h"
+
+#include <libadt/str.h>
+
+extern char **environ;
+
+static double now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static double bench_builtin(
+	const struct scallop_lang_builtin_context *context,
+	char *const argv[],
+	size_t argc,
+	long iterations
+)
+{
+	const double start = now();
+	for (long i = 0; i < iterations; i++) {
+		const struct scallop_lang_builtin *const builtin
+			= scallop_lang_builtin_find_name(argv[0]);
+		builtin->run(context, argc, argv);
+	}
+	return (now() - start) / (double)iterations;
+}
+
+static double bench_spawn(int out, char *const argv[], long iterations)
+{
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+
+	const double start = now();
+	for (long i = 0; i < iterations; i++) {
+		pid_t pid = 0;
+		if (posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ)) {
+			perror(argv[0]);
+			exit(1);
+		}
+		int status = 0;
+		waitpid(pid, &status, 0);
+	}
+	const double result = (now() - start) / (double)iterations;
+
+	posix_spawn_file_actions_destroy(&actions);
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	const long iterations = argc > 1 ? atol(argv[1]) : 1000;
+	const int null = open("/dev/null", O_WRONLY);
+	const struct scallop_lang_builtin_context context = {
+		.in = -1,
+		.out = null,
+		.err = null,
+	};
+
+	char *true_argv[] = { "true", NULL };
+	char *echo_argv[] = { "echo", "Hello,", "world!", NULL };
+	char *test_argv[] = { "test", "2", "-lt", "10", NULL };
+
+	struct {
+		const char *name;
+		char **argv;
+		size_t argc;
+	} commands[] = {
+		{ "true", true_argv, 1 },
+		{ "echo", echo_argv, 3 },
+		{ "test", test_argv, 4 },
+	};
+
+	printf("%-8s %14s %14s %10s\n", "command", "builtin (ns)", "spawn (ns)", "speedup");
+	for (size_t i = 0; i < sizeof(commands) / sizeof(*commands); i++) {
+		const double builtin = bench_builtin(
+			&context,
+			commands[i].argv,
+			commands[i].argc,
+			iterations * 1000
+		);
+		const double spawn = bench_spawn(null, commands[i].argv, iterations);
+		printf(
+			"%-8s %14.1f %14.1f %9.0fx\n",
+			commands[i].name,
+			builtin * 1e9,
+			spawn * 1e9,
+			spawn / builtin
+		);
+	}
+
+	close(null);
+	return 0;
+}
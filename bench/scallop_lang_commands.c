@@ -0,0 +1,120 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Resolves commands LOOKUPS times across THREADS threads, first by
+ * probing each directory of $PATH as execvp(3) does, then through a
+ * command cache.
+ *
+ * Usage: bench_scallop_lang_commands [LOOKUPS [THREADS]]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "scallop-lang/commands.h"
+
+static const char *const names[] = { "sh", "cat", "env", "sort", "true" };
+#define NAMES_LENGTH (sizeof(names) / sizeof(*names))
+
+static const char *path;
+static long lookups;
+static struct scallop_lang_commands commands;
+
+static double now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static int probe(const char *name)
+{
+	char buffer[4096];
+	for (const char *directory = path;;) {
+		const size_t length = strcspn(directory, ":");
+		snprintf(buffer, sizeof(buffer), "%.*s/%s", (int)length, directory, name);
+		if (access(buffer, X_OK) == 0)
+			return 0;
+		if (!directory[length])
+			return -1;
+		directory += length + 1;
+	}
+}
+
+static void *run_probe(void *unused)
+{
+	(void)unused;
+	for (long i = 0; i < lookups; i++)
+		probe(names[i % NAMES_LENGTH]);
+	return NULL;
+}
+
+static void *run_cached(void *unused)
+{
+	(void)unused;
+	for (long i = 0; i < lookups; i++) {
+		const struct scallop_lang_commands_command *const command
+			= scallop_lang_commands_find(&commands, names[i % NAMES_LENGTH]);
+		if (command)
+			scallop_lang_commands_release(command);
+	}
+	return NULL;
+}
+
+static double measure(void *(*run)(void *), long threads)
+{
+	pthread_t *const ids = calloc((size_t)threads, sizeof(*ids));
+	const double start = now();
+	for (long i = 0; i < threads; i++)
+		pthread_create(&ids[i], NULL, run, NULL);
+	for (long i = 0; i < threads; i++)
+		pthread_join(ids[i], NULL);
+	const double elapsed = now() - start;
+	free(ids);
+	return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	lookups = argc > 1 ? atol(argv[1]) : 200000;
+	const long threads = argc > 2 ? atol(argv[2]) : 4;
+	path = getenv("PATH") ? getenv("PATH") : "/bin:/usr/bin";
+
+	if (scallop_lang_commands_init(&commands, path)) {
+		perror("scallop_lang_commands_init");
+		return 1;
+	}
+
+	const double probe_time = measure(run_probe, threads);
+	const double cached_time = measure(run_cached, threads);
+	const double total = (double)lookups * (double)threads;
+
+	printf("%-10s %12s %14s\n", "", "ms", "lookups/s");
+	printf("%-10s %12.2f %14.0f\n", "probe", probe_time * 1e3, total / probe_time);
+	printf("%-10s %12.2f %14.0f\n", "cached", cached_time * 1e3, total / cached_time);
+
+	scallop_lang_commands_free(&commands);
+	return 0;
+}
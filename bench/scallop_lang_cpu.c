@@ -0,0 +1,116 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ * Lexes a synthetic script of LINES lines under every kernel tier
+ * the processor supports, and reports the throughput of each.
+ *
+ * Usage: bench_scallop_lang_cpu [LINES [ROUNDS]]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "scallop-lang/cpu.h"
+#include "scallop-lang/lex.h"
+
+static const char *const lines[] = {
+	"/usr/local/bin/compile --output build/objects/module.o src/module.c\n",
+	"echo 'a single quoted argument that goes on for a while' $HOME\n",
+	"printf \"first then second\" \"$first_argument\" \"$second_argument\"\n",
+	"# A comment explaining the next step at some considerable length\n",
+	"cp -r build/release/bin/scallop /opt/scallop/bin/scallop-latest\n",
+};
+
+static double now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static size_t lex_all(struct libadt_const_lptr script)
+{
+	size_t count = 0;
+	struct scallop_lang_lex token = scallop_lang_lex_init(script);
+	do {
+		token = scallop_lang_lex_next(token);
+		count++;
+	} while (
+		token.type != scallop_lang_classifier_end
+		&& token.type != scallop_lang_classifier_unexpected
+	);
+	return count;
+}
+
+int main(int argc, char **argv)
+{
+	const long line_count = argc > 1 ? atol(argv[1]) : 100000;
+	const long rounds = argc > 2 ? atol(argv[2]) : 5;
+
+	size_t length = 0;
+	for (long i = 0; i < line_count; i++)
+		length += strlen(lines[i % (sizeof(lines) / sizeof(*lines))]);
+
+	char *const buffer = malloc(length ? length : 1);
+	if (!buffer) {
+		perror("malloc");
+		return 1;
+	}
+	char *end = buffer;
+	for (long i = 0; i < line_count; i++) {
+		const char *const line = lines[i % (sizeof(lines) / sizeof(*lines))];
+		memcpy(end, line, strlen(line));
+		end += strlen(line);
+	}
+	const struct libadt_const_lptr script = {
+		.buffer = buffer,
+		.size = 1,
+		.length = (ssize_t)length,
+	};
+
+	printf("%-8s %10s %12s %10s\n", "tier", "tokens", "best ms", "MB/s");
+	const enum scallop_lang_cpu_tier supported = scallop_lang_cpu_supported();
+	for (enum scallop_lang_cpu_tier tier = SCALLOP_LANG_CPU_GENERIC; tier <= supported; tier++) {
+		scallop_lang_cpu_select(tier);
+
+		size_t tokens = 0;
+		double best = 0;
+		for (long round = 0; round < rounds; round++) {
+			const double start = now();
+			tokens = lex_all(script);
+			const double time = now() - start;
+			if (!round || time < best)
+				best = time;
+		}
+
+		printf(
+			"%-8s %10zu %12.2f %10.1f\n",
+			scallop_lang_cpu_tier_name(tier),
+			tokens,
+			best * 1e3,
+			best > 0 ? (double)length / best / 1e6 : 0.0
+		);
+	}
+
+	free(buffer);
+	return 0;
+}
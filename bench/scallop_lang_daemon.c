@@ -0,0 +1,145 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compares the latency of starting scallop-lex for each script
+ * against forwarding each invocation to a running daemon.
+ *
+ * Usage: bench_scallop_lang_daemon [RUNS]
+ */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+static const char script[] =
+	"cd /usr/src/project\n"
+	"echo 'building' \"$target\"; make -j4 all\n"
+	"cp build/*.o /tmp/objects # copy outputs\n"
+	"test -f build/done; echo done\n";
+
+static double now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static pid_t spawn(char *const argv[])
+{
+	const pid_t pid = fork();
+	if (pid == 0) {
+		const int null = open("/dev/null", O_WRONLY);
+		dup2(null, STDOUT_FILENO);
+		execv(argv[0], argv);
+		_exit(127);
+	}
+	return pid;
+}
+
+static int run(char *const argv[])
+{
+	int status = 0;
+	const pid_t pid = spawn(argv);
+	if (pid < 0 || waitpid(pid, &status, 0) < 0)
+		return -1;
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static int wait_for(const char *path)
+{
+	struct sockaddr_un address = { .sun_family = AF_UNIX };
+	snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+	for (int attempt = 0; attempt < 500; attempt++) {
+		const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+			return -1;
+		const int result = connect(fd, (struct sockaddr *)&address, sizeof(address));
+		close(fd);
+		if (result == 0)
+			return 0;
+		usleep(10000);
+	}
+	return -1;
+}
+
+static double measure(const char *name, char *const argv[], size_t runs)
+{
+	const double start = now();
+	for (size_t i = 0; i < runs; i++) {
+		if (run(argv) != 0) {
+			fprintf(stderr, "%s: failed\n", name);
+			exit(1);
+		}
+	}
+	const double elapsed = (now() - start) / (double)runs;
+	printf("%-8s %10.1f us per invocation\n", name, elapsed * 1e6);
+	return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	const size_t runs = argc > 1 ? strtoul(argv[1], NULL, 10) : 500;
+
+	char directory[] = "/tmp/scallop-bench-XXXXXX";
+	if (!mkdtemp(directory))
+		return 1;
+	char path[64];
+	char socket_path[64];
+	snprintf(path, sizeof(path), "%s/script", directory);
+	snprintf(socket_path, sizeof(socket_path), "%s/socket", directory);
+
+	FILE *const file = fopen(path, "w");
+	if (!file)
+		return 1;
+	fputs(script, file);
+	fclose(file);
+
+	char listen[80];
+	char connect[80];
+	snprintf(listen, sizeof(listen), "--listen=%s", socket_path);
+	snprintf(connect, sizeof(connect), "--connect=%s", socket_path);
+
+	char *const daemon_argv[] = { SCALLOP_LEX, listen, NULL };
+	char *const cold_argv[] = { SCALLOP_LEX, path, NULL };
+	char *const client_argv[] = { SCALLOP_LEX, connect, path, NULL };
+
+	const pid_t daemon = spawn(daemon_argv);
+	if (daemon < 0 || wait_for(socket_path)) {
+		perror("scallop-lex --listen");
+		return 1;
+	}
+
+	const double cold = measure("cold", cold_argv, runs);
+	const double client = measure("client", client_argv, runs);
+	printf("%-8s %10.2fx\n", "speedup", cold / client);
+
+	kill(daemon, SIGTERM);
+	waitpid(daemon, NULL, 0);
+	unlink(socket_path);
+	unlink(path);
+	rmdir(directory);
+	return 0;
+}
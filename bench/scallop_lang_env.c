@@ -0,0 +1,155 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ * Forks SCOPES scopes from an environment of VARIABLES variables,
+ * setting one variable in each and building its envp, and compares
+ * time and memory against copying the environment for each scope.
+ *
+ * Memory is measured with mallinfo2(3), so it's only meaningful
+ * without sanitizers, which replace malloc.
+ *
+ * Usage: bench_scallop_lang_env [VARIABLES [SCOPES]]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "scallop-lang/env.h"
+
+static double now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static size_t allocated(void)
+{
+	return mallinfo2().uordblks;
+}
+
+/*
+ * A scope as a plain copy of every "NAME=VALUE" string.
+ */
+static char **copy_scope(char *const *envp, size_t length, const char *extra)
+{
+	char **const scope = malloc((length + 2) * sizeof(*scope));
+	if (!scope)
+		return NULL;
+	for (size_t i = 0; i < length; i++)
+		scope[i] = strdup(envp[i]);
+	scope[length] = strdup(extra);
+	scope[length + 1] = NULL;
+	return scope;
+}
+
+static void free_scope(char **scope)
+{
+	for (char **pair = scope; *pair; pair++)
+		free(*pair);
+	free(scope);
+}
+
+int main(int argc, char **argv)
+{
+	const long variables = argc > 1 ? atol(argv[1]) : 5000;
+	const long scopes = argc > 2 ? atol(argv[2]) : 5000;
+
+	char **const envp = calloc((size_t)variables + 1, sizeof(*envp));
+	char ***const copies = calloc((size_t)scopes, sizeof(*copies));
+	struct scallop_lang_env *const forks = calloc((size_t)scopes, sizeof(*forks));
+	if (!envp || !copies || !forks) {
+		perror("calloc");
+		return 1;
+	}
+	for (long i = 0; i < variables; i++) {
+		char pair[128];
+		snprintf(pair, sizeof(pair), "VARIABLE_%ld=some value number %ld", i, i);
+		envp[i] = strdup(pair);
+	}
+
+	struct scallop_lang_env base = { 0 };
+	if (scallop_lang_env_init(&base, envp)) {
+		perror("scallop_lang_env_init");
+		return 1;
+	}
+
+	size_t before = allocated();
+	double start = now();
+	for (long i = 0; i < scopes; i++) {
+		char extra[64];
+		snprintf(extra, sizeof(extra), "BRANCH=%ld", i);
+		copies[i] = copy_scope(envp, (size_t)variables, extra);
+	}
+	const double copy_time = now() - start;
+	const size_t copy_memory = allocated() - before;
+
+	before = allocated();
+	start = now();
+	for (long i = 0; i < scopes; i++) {
+		char value[32];
+		snprintf(value, sizeof(value), "%ld", i);
+		scallop_lang_env_fork(&base, &forks[i]);
+		scallop_lang_env_set(&forks[i], "BRANCH", value);
+	}
+	const double fork_time = now() - start;
+	const size_t fork_memory = allocated() - before;
+
+	// Each changed scope is a new version, with its own envp
+	before = allocated();
+	start = now();
+	for (long i = 0; i < scopes; i++)
+		scallop_lang_env_envp(&forks[i]);
+	const double envp_time = now() - start;
+	const size_t envp_memory = allocated() - before;
+
+	// Forking without changing shares the envp of the base
+	before = allocated();
+	start = now();
+	scallop_lang_env_envp(&base);
+	for (long i = 0; i < scopes; i++) {
+		struct scallop_lang_env shared = { 0 };
+		scallop_lang_env_fork(&base, &shared);
+		scallop_lang_env_envp(&shared);
+		scallop_lang_env_free(&shared);
+	}
+	const double shared_time = now() - start;
+
+	printf("%-22s %12s %14s\n", "", "ms", "bytes");
+	printf("%-22s %12.2f %14zu\n", "copy", copy_time * 1e3, copy_memory);
+	printf("%-22s %12.2f %14zu\n", "fork + set", fork_time * 1e3, fork_memory);
+	printf("%-22s %12.2f %14zu\n", "envp of each fork", envp_time * 1e3, envp_memory);
+	printf("%-22s %12.2f %14s\n", "fork + shared envp", shared_time * 1e3, "-");
+
+	for (long i = 0; i < scopes; i++) {
+		free_scope(copies[i]);
+		scallop_lang_env_free(&forks[i]);
+	}
+	scallop_lang_env_free(&base);
+	for (long i = 0; i < variables; i++)
+		free(envp[i]);
+	free(envp);
+	free(copies);
+	free(forks);
+	return 0;
+}
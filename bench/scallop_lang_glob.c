@@ -0,0 +1,161 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compares scallop_lang_glob_expand() against glob(3) on a
+ * synthetic tree of DIRECTORIES * DIRECTORIES directories with
+ * FILES files each.
+ *
+ * Usage: bench_scallop_lang_glob [DIRECTORIES [FILES [THREADS]]]
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "scallop-lang/glob.h"
+
+static double now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static void make_tree(const char *root, long directories, long files)
+{
+	char path[4096];
+	for (long i = 0; i < directories; i++) {
+		snprintf(path, sizeof(path), "%s/d%ld", root, i);
+		mkdir(path, 0700);
+		for (long j = 0; j < directories; j++) {
+			snprintf(path, sizeof(path), "%s/d%ld/s%ld", root, i, j);
+			mkdir(path, 0700);
+			for (long k = 0; k < files; k++) {
+				snprintf(
+					path,
+					sizeof(path),
+					"%s/d%ld/s%ld/f%ld.%s",
+					root,
+					i,
+					j,
+					k,
+					k % 4 ? "c" : "h"
+				);
+				close(open(path, O_WRONLY | O_CREAT, 0600));
+			}
+		}
+	}
+}
+
+static int remove_entry(
+	const char *path,
+	const struct stat *info,
+	int type,
+	struct FTW *ftw
+)
+{
+	(void)info;
+	(void)type;
+	(void)ftw;
+	return remove(path);
+}
+
+static void bench_pattern(const char *root, const char *pattern, long threads)
+{
+	char word[4096];
+	snprintf(word, sizeof(word), "%s/%s", root, pattern);
+
+	double start = now();
+	glob_t libc = { 0 };
+	glob(word, 0, NULL, &libc);
+	const double libc_time = now() - start;
+
+	start = now();
+	struct scallop_lang_glob compiled = { 0 };
+	struct scallop_lang_glob_matches single = { 0 };
+	scallop_lang_glob_compile(
+		(struct libadt_const_lptr) {
+			.buffer = word,
+			.size = 1,
+			.length = (ssize_t)strlen(word),
+		},
+		&compiled
+	);
+	scallop_lang_glob_expand(&compiled, 1, &single);
+	const double single_time = now() - start;
+
+	start = now();
+	struct scallop_lang_glob_matches parallel = { 0 };
+	scallop_lang_glob_expand(&compiled, (size_t)threads, &parallel);
+	const double parallel_time = now() - start;
+
+	printf(
+		"%-16s %8zu %8zu %12.2f %12.2f %12.2f\n",
+		pattern,
+		libc.gl_pathc,
+		parallel.length,
+		libc_time * 1e3,
+		single_time * 1e3,
+		parallel_time * 1e3
+	);
+
+	globfree(&libc);
+	scallop_lang_glob_matches_free(&single);
+	scallop_lang_glob_matches_free(&parallel);
+	scallop_lang_glob_free(&compiled);
+}
+
+int main(int argc, char **argv)
+{
+	const long directories = argc > 1 ? atol(argv[1]) : 30;
+	const long files = argc > 2 ? atol(argv[2]) : 200;
+	const long threads = argc > 3 ? atol(argv[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+
+	char root[] = "/tmp/scallop-glob-bench-XXXXXX";
+	if (!mkdtemp(root)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	make_tree(root, directories, files);
+
+	printf(
+		"%-16s %8s %8s %12s %12s %9s%ld\n",
+		"pattern",
+		"glob(3)",
+		"scallop",
+		"glob(3) ms",
+		"1 thread ms",
+		"threads ms x",
+		threads
+	);
+	bench_pattern(root, "d*/s*/*.c", threads);
+	bench_pattern(root, "d1*/s*/f1*", threads);
+	bench_pattern(root, "*/s1/f?.h", threads);
+
+	nftw(root, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+	return 0;
+}
@@ -0,0 +1,215 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ * Runs a block of sleep commands on a few runners, first in script
+ * order to record how long each takes, then again in script order
+ * and longest first, with the costs from the history. Prints the
+ * makespan each order was predicted to take, from the history, and
+ * the makespan it actually took.
+ *
+ * The last command is the longest, which is the worst case for
+ * running in order.
+ *
+ * Usage: bench_scallop_lang_history [COMMANDS [RUNNERS]]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "scallop-lang/cache.h"
+#include "scallop-lang/deps.h"
+#include "scallop-lang/history.h"
+#include "scallop-lang/jobs.h"
+
+typedef struct scallop_lang_jobs_job job_t;
+
+static const struct scallop_lang_deps_command commands[] = {
+	{ "sleep", "-*" },
+};
+
+static double now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+/*
+ * Runs the jobs, recording each command in the history, and returns
+ * the makespan.
+ */
+static double run(
+	job_t *jobs,
+	size_t length,
+	size_t runners,
+	struct scallop_lang_history *history
+)
+{
+	const struct scallop_lang_jobs_options options = { .max_running = runners };
+	const double start = now();
+	if (scallop_lang_jobs_run(jobs, length, &options)) {
+		perror("scallop_lang_jobs_run");
+		exit(1);
+	}
+	const double makespan = now() - start;
+
+	for (size_t i = 0; i < length; i++) {
+		struct scallop_lang_cache_fingerprint fingerprint
+			= scallop_lang_cache_fingerprint_init();
+		scallop_lang_cache_add_words(&fingerprint, jobs[i].argv);
+		if (scallop_lang_history_add(history, fingerprint.hash, jobs[i].wall, jobs[i].cpu)) {
+			perror("scallop_lang_history_add");
+			exit(1);
+		}
+	}
+	return makespan;
+}
+
+int main(int argc, char **argv)
+{
+	const size_t length = argc > 1 ? (size_t)atol(argv[1]) : 12;
+	const size_t runners = argc > 2 ? (size_t)atol(argv[2]) : 4;
+	if (!length || !runners) {
+		fprintf(stderr, "Usage: %s [COMMANDS [RUNNERS]]\n", argv[0]);
+		return 1;
+	}
+
+	char directory[] = "/tmp/scallop-history-XXXXXX";
+	char path[64];
+	if (!mkdtemp(directory)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	snprintf(path, sizeof(path), "%s/history", directory);
+
+	// Short commands of a few lengths, then one as long as a
+	// runner's share of them
+	char (*const durations)[16] = calloc(length, sizeof(*durations));
+	char *(*const arguments)[3] = calloc(length, sizeof(*arguments));
+	job_t *const jobs = calloc(length, sizeof(*jobs));
+	size_t size = 1;
+	if (!durations || !arguments || !jobs) {
+		perror("calloc");
+		return 1;
+	}
+	double total = 0;
+	for (size_t i = 0; i + 1 < length; i++)
+		total += 0.05 * (double)(i % 3 + 1);
+	for (size_t i = 0; i < length; i++) {
+		const double duration = i + 1 < length
+			? 0.05 * (double)(i % 3 + 1)
+			: total / (double)runners + 0.05;
+		snprintf(durations[i], sizeof(*durations), "%.3f", duration);
+		arguments[i][0] = "sleep";
+		arguments[i][1] = durations[i];
+		jobs[i] = (job_t) { .argv = arguments[i], .block = -1 };
+		size += strlen("sleep ; ") + strlen(durations[i]);
+	}
+
+	char *const text = calloc(size, 1);
+	if (!text) {
+		perror("calloc");
+		return 1;
+	}
+	for (size_t i = 0; i < length; i++) {
+		strcat(text, "sleep ");
+		strcat(text, durations[i]);
+		strcat(text, "; ");
+	}
+	const struct libadt_const_lptr script = {
+		.buffer = text,
+		.size = 1,
+		.length = (ssize_t)strlen(text),
+	};
+	const struct libadt_const_lptr commands_lptr = {
+		.buffer = commands,
+		.size = sizeof(*commands),
+		.length = sizeof(commands) / sizeof(*commands),
+	};
+
+	struct scallop_lang_deps deps = { 0 };
+	struct scallop_lang_history history = { 0 };
+	double *const costs = calloc(length, sizeof(*costs));
+	if (
+		!costs
+		|| scallop_lang_deps_analyze(script, commands_lptr, NULL, &deps)
+		|| scallop_lang_history_open(&history, path)
+	) {
+		perror("setup");
+		return 1;
+	}
+
+	// Without history, every command costs the same
+	run(jobs, length, runners, &history);
+	if (scallop_lang_history_save(&history)) {
+		perror("scallop_lang_history_save");
+		return 1;
+	}
+
+	// The statements are keyed by their script, and the runs by
+	// their arguments, which give the same keys
+	for (size_t i = 0; i < deps.statements_length; i++) {
+		struct scallop_lang_cache_fingerprint fingerprint
+			= scallop_lang_cache_fingerprint_init();
+		if (scallop_lang_cache_add_statement(&fingerprint, deps.statements[i].value)) {
+			perror("scallop_lang_cache_add_statement");
+			return 1;
+		}
+		costs[i] = scallop_lang_history_estimate(&history, fingerprint.hash, 0);
+	}
+	scallop_lang_deps_schedule(&deps, costs);
+
+	if (scallop_lang_deps_place(&deps, runners)) {
+		perror("scallop_lang_deps_place");
+		return 1;
+	}
+	const double in_order_predicted = deps.makespan;
+	const double in_order = run(jobs, length, runners, &history);
+
+	if (scallop_lang_deps_place_critical(&deps, runners)) {
+		perror("scallop_lang_deps_place_critical");
+		return 1;
+	}
+	const double critical_predicted = deps.makespan;
+	for (size_t i = 0; i < length; i++)
+		jobs[i].cost = costs[i];
+	const double critical = run(jobs, length, runners, &history);
+
+	printf("%zu commands on %zu runners\n\n", length, runners);
+	printf("%-24s %12s %12s\n", "makespan, s", "predicted", "actual");
+	printf("%-24s %12.3f %12.3f\n", "in order", in_order_predicted, in_order);
+	printf("%-24s %12.3f %12.3f\n", "longest first", critical_predicted, critical);
+	printf("%-24s %12.3f\n", "critical path", deps.critical_path);
+	printf("%-24s %12.3f\n", "total / runners", deps.total_cost / (double)runners);
+
+	scallop_lang_history_close(&history);
+	scallop_lang_deps_free(&deps);
+	unlink(path);
+	rmdir(directory);
+	free(costs);
+	free(text);
+	free(jobs);
+	free(arguments);
+	free(durations);
+	return 0;
+}
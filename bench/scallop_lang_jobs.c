@@ -0,0 +1,149 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ * Runs FACTOR times as many CPU-bound commands as there are CPUs,
+ * all at once, then limited to one per CPU, then limited and pinned
+ * to cores, then through a jobserver with a token for each CPU
+ * after the first, as under make -jCPUS. Prints the makespan and
+ * the CPU time the commands took in each case.
+ *
+ * Oversubscribed commands are switched between more often, and
+ * their caches are shared with more commands, so each takes more
+ * CPU time for the same work.
+ *
+ * Usage: bench_scallop_lang_jobs [FACTOR [LOOPS]]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "scallop-lang/jobs.h"
+
+typedef struct scallop_lang_jobs_job job_t;
+typedef struct scallop_lang_jobs_options options_t;
+
+static double now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static void run(const char *name, job_t *jobs, size_t length, const options_t *options)
+{
+	const double start = now();
+	if (scallop_lang_jobs_run(jobs, length, options)) {
+		perror("scallop_lang_jobs_run");
+		exit(1);
+	}
+	const double makespan = now() - start;
+
+	double cpu = 0;
+	for (size_t i = 0; i < length; i++)
+		cpu += jobs[i].cpu;
+	printf("%-24s %12.3f %12.3f\n", name, makespan, cpu);
+}
+
+int main(int argc, char **argv)
+{
+	const size_t factor = argc > 1 ? (size_t)atol(argv[1]) : 4;
+	const long loops = argc > 2 ? atol(argv[2]) : 200000;
+	if (!factor || loops <= 0) {
+		fprintf(stderr, "Usage: %s [FACTOR [LOOPS]]\n", argv[0]);
+		return 1;
+	}
+
+	struct scallop_lang_topology topology = { 0 };
+	if (
+		scallop_lang_topology_init(&topology, NULL)
+		|| scallop_lang_topology_restrict(&topology)
+	) {
+		perror("scallop_lang_topology_init");
+		return 1;
+	}
+	size_t cpus = 0;
+	for (size_t i = 0; i < topology.cores_length; i++)
+		cpus += topology.cores[i].cpus_length;
+
+	char script[128];
+	snprintf(
+		script,
+		sizeof(script),
+		"i=0; while [ $i -lt %ld ]; do i=$((i + 1)); done",
+		loops
+	);
+	char *const busy[] = { "sh", "-c", script, NULL };
+
+	const size_t length = factor * cpus;
+	job_t *const jobs = calloc(length, sizeof(*jobs));
+	if (!jobs) {
+		perror("calloc");
+		return 1;
+	}
+	for (size_t i = 0; i < length; i++)
+		jobs[i] = (job_t) { .argv = busy, .block = -1 };
+
+	// A pipe standing in for make's, with a token for each CPU
+	// after the first
+	int fds[2];
+	if (pipe(fds)) {
+		perror("pipe");
+		return 1;
+	}
+	for (size_t i = 1; i < cpus; i++) {
+		if (write(fds[1], "+", 1) != 1) {
+			perror("write");
+			return 1;
+		}
+	}
+	char makeflags[64];
+	snprintf(makeflags, sizeof(makeflags), "-j%zu --jobserver-auth=%d,%d", cpus, fds[0], fds[1]);
+	struct scallop_lang_jobserver jobserver = { 0 };
+	if (scallop_lang_jobserver_init(&jobserver, makeflags)) {
+		perror("scallop_lang_jobserver_init");
+		return 1;
+	}
+
+	printf(
+		"%zu commands on %zu CPUs in %zu cores\n\n",
+		length,
+		cpus,
+		topology.cores_length
+	);
+	printf("%-24s %12s %12s\n", "", "makespan, s", "CPU time, s");
+
+	const options_t unlimited = { 0 };
+	const options_t limited = { .max_running = cpus };
+	const options_t pinned = { .max_running = cpus, .topology = &topology };
+	const options_t shared = { .jobserver = &jobserver };
+	run("all at once", jobs, length, &unlimited);
+	run("one per CPU", jobs, length, &limited);
+	run("one per CPU, pinned", jobs, length, &pinned);
+	run("jobserver", jobs, length, &shared);
+
+	scallop_lang_jobserver_free(&jobserver);
+	close(fds[0]);
+	close(fds[1]);
+	scallop_lang_topology_free(&topology);
+	free(jobs);
+}
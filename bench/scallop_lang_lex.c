@@ -0,0 +1,220 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ * Compares lexing a wide character script in place against
+ * encoding it to UTF-8 and lexing the multibyte result, as hosts
+ * holding decoded text had to. Each is run on a synthetic script
+ * of LINES lines, mixing ASCII and non-ASCII text.
+ *
+ * Then compares collecting the normalized words of the multibyte
+ * script with scallop_lang_lex_next_normalized() against
+ * scallop_lang_lex_next() followed by a measuring and a copying
+ * scallop_lang_lex_normalize_word().
+ *
+ * Usage: bench_scallop_lang_lex [LINES [ROUNDS]]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wchar.h>
+
+#include "scallop-lang/lex.h"
+
+static const wchar_t *const lines[] = {
+	L"echo 'résumé du café' \"$utilisateur\" naïve\n",
+	L"cp /données/entrée/fichier.txt /données/sortie/\n",
+	L"# заметка о сборке проекта\n",
+	L"printf \"日本語のテキスト\" build/release/scallop\n",
+};
+
+static double now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static size_t lex_all(struct scallop_lang_lex token)
+{
+	size_t count = 0;
+	do {
+		token = scallop_lang_lex_next(token);
+		count++;
+	} while (
+		token.type != scallop_lang_classifier_end
+		&& token.type != scallop_lang_classifier_unexpected
+	);
+	return count;
+}
+
+static size_t normalize_separately(struct libadt_const_lptr script, char **buffer, size_t *capacity)
+{
+	size_t total = 0;
+	struct scallop_lang_lex token = scallop_lang_lex_init(script);
+	for (;;) {
+		token = scallop_lang_lex_next(token);
+		if (
+			token.type == scallop_lang_classifier_end
+			|| token.type == scallop_lang_classifier_unexpected
+		)
+			return total;
+		if (!scallop_lang_classifier_is_word(token.type))
+			continue;
+
+		const ssize_t length = scallop_lang_lex_normalize_word(
+			token.value,
+			(struct libadt_lptr) { 0 }
+		);
+		if ((size_t)length + 1 > *capacity) {
+			char *const larger = realloc(*buffer, (size_t)length + 1);
+			if (!larger)
+				return total;
+			*buffer = larger;
+			*capacity = (size_t)length + 1;
+		}
+		scallop_lang_lex_normalize_word(
+			token.value,
+			(struct libadt_lptr) {
+				.buffer = *buffer,
+				.size = 1,
+				.length = length,
+			}
+		);
+		total += (size_t)length;
+	}
+}
+
+static size_t normalize_fused(struct libadt_const_lptr script, struct scallop_lang_lex_words *words)
+{
+	size_t total = 0;
+	struct scallop_lang_lex token = scallop_lang_lex_init(script);
+	for (;;) {
+		words->length = 0;
+		token = scallop_lang_lex_next_normalized(token, words);
+		if (
+			token.type == scallop_lang_classifier_end
+			|| token.type == scallop_lang_classifier_unexpected
+		)
+			return total;
+		if (scallop_lang_classifier_is_word(token.type))
+			total += words->word_length;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const long line_count = argc > 1 ? atol(argv[1]) : 100000;
+	const long rounds = argc > 2 ? atol(argv[2]) : 5;
+	if (!setlocale(LC_ALL, "C.UTF-8")) {
+		fprintf(stderr, "C.UTF-8 locale unavailable\n");
+		return 1;
+	}
+
+	const size_t line_total = sizeof(lines) / sizeof(*lines);
+	size_t length = 0;
+	for (long i = 0; i < line_count; i++)
+		length += wcslen(lines[(size_t)i % line_total]);
+
+	wchar_t *const wide = malloc((length + 1) * sizeof(*wide));
+	char *const bytes = malloc(length * MB_CUR_MAX + 1);
+	if (!wide || !bytes) {
+		perror("malloc");
+		return 1;
+	}
+	wchar_t *end = wide;
+	for (long i = 0; i < line_count; i++) {
+		const wchar_t *const line = lines[(size_t)i % line_total];
+		wmemcpy(end, line, wcslen(line));
+		end += wcslen(line);
+	}
+	*end = L'\0';
+
+	double wide_best = 0, encoded_best = 0, multibyte_best = 0;
+	size_t wide_tokens = 0, multibyte_tokens = 0, byte_length = 0;
+	for (long round = 0; round < rounds; round++) {
+		double start = now();
+		wide_tokens = lex_all(scallop_lang_lex_init_wide(wide, length));
+		const double wide_time = now() - start;
+
+		start = now();
+		byte_length = wcstombs(bytes, wide, length * MB_CUR_MAX + 1);
+		const double encode_time = now() - start;
+
+		start = now();
+		multibyte_tokens = lex_all(scallop_lang_lex_init((struct libadt_const_lptr) {
+			.buffer = bytes,
+			.size = 1,
+			.length = (ssize_t)byte_length,
+		}));
+		const double multibyte_time = now() - start;
+
+		if (!round || wide_time < wide_best)
+			wide_best = wide_time;
+		if (!round || multibyte_time < multibyte_best)
+			multibyte_best = multibyte_time;
+		if (!round || encode_time + multibyte_time < encoded_best)
+			encoded_best = encode_time + multibyte_time;
+	}
+
+	printf("%-20s %10s %12s\n", "input", "tokens", "best ms");
+	printf("%-20s %10zu %12.2f\n", "wide", wide_tokens, wide_best * 1e3);
+	printf("%-20s %10zu %12.2f\n", "multibyte", multibyte_tokens, multibyte_best * 1e3);
+	printf("%-20s %10zu %12.2f\n", "encode + multibyte", multibyte_tokens, encoded_best * 1e3);
+	printf("%zu characters, %zu bytes\n", length, byte_length);
+
+	const struct libadt_const_lptr script = {
+		.buffer = bytes,
+		.size = 1,
+		.length = (ssize_t)byte_length,
+	};
+	char *word = NULL;
+	size_t word_capacity = 0;
+	struct scallop_lang_lex_words words = { 0 };
+	double separate_best = 0, fused_best = 0;
+	size_t separate_total = 0, fused_total = 0;
+	for (long round = 0; round < rounds; round++) {
+		double start = now();
+		separate_total = normalize_separately(script, &word, &word_capacity);
+		const double separate_time = now() - start;
+
+		start = now();
+		fused_total = normalize_fused(script, &words);
+		const double fused_time = now() - start;
+
+		if (!round || separate_time < separate_best)
+			separate_best = separate_time;
+		if (!round || fused_time < fused_best)
+			fused_best = fused_time;
+	}
+
+	printf("\n%-20s %10s %12s\n", "words", "characters", "best ms");
+	printf("%-20s %10zu %12.2f\n", "measure + copy", separate_total, separate_best * 1e3);
+	printf("%-20s %10zu %12.2f\n", "fused", fused_total, fused_best * 1e3);
+
+	free(word);
+	scallop_lang_lex_words_free(&words);
+
+	free(wide);
+	free(bytes);
+	return 0;
+}
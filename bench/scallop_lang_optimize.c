@@ -0,0 +1,197 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Expands every statement of a generated script RUNS times, as a
+ * long-running script re-running a block would, without and with
+ * the optimization passes, and prints what each pass changed.
+ *
+ * Substitutions run their builtins through a pipe, as an
+ * interpreter would.
+ *
+ * Usage: bench_scallop_lang_optimize [STATEMENTS [RUNS]]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "scallop-lang/builtin.h"
+#include "scallop-lang/optimize.h"
+
+typedef struct scallop_lang_script_block block_t;
+typedef struct scallop_lang_script_context context_t;
+typedef struct scallop_lang_script_frame frame_t;
+
+static double now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static const char *get_variable(void *user, const char *name)
+{
+	(void)user;
+	return strcmp(name, "name") == 0 ? "value" : NULL;
+}
+
+static char *substitute(void *user, const block_t *block);
+
+static const context_t context = {
+	.get_variable = get_variable,
+	.substitute = substitute,
+};
+
+static char *substitute(void *user, const block_t *block)
+{
+	(void)user;
+	frame_t frame = { 0 };
+	if (scallop_lang_script_enter(block, &context, &frame))
+		return NULL;
+
+	int fds[2];
+	if (pipe(fds)) {
+		scallop_lang_script_leave(&frame);
+		return NULL;
+	}
+	const struct scallop_lang_builtin_context builtin_context = {
+		.in = -1,
+		.out = fds[1],
+		.err = fds[1],
+	};
+	for (size_t i = 0; i < block->statements_length; i++) {
+		char **const arguments = scallop_lang_script_arguments(
+			&frame,
+			&block->statements[i],
+			&context
+		);
+		if (!arguments)
+			continue;
+		size_t argc = 0;
+		while (arguments[argc])
+			argc++;
+		const struct scallop_lang_builtin *const builtin
+			= scallop_lang_builtin_find_name(arguments[0]);
+		if (builtin)
+			builtin->run(&builtin_context, argc, arguments);
+		scallop_lang_script_arguments_free(arguments);
+	}
+	close(fds[1]);
+	scallop_lang_script_leave(&frame);
+
+	char *const output = calloc(4096, 1);
+	ssize_t length = output ? read(fds[0], output, 4095) : -1;
+	close(fds[0]);
+	if (length < 0) {
+		free(output);
+		return NULL;
+	}
+	while (length && output[length - 1] == '\n')
+		output[--length] = '\0';
+	return output;
+}
+
+static double run(const struct scallop_lang_script *script, long runs)
+{
+	const double start = now();
+	for (long i = 0; i < runs; i++) {
+		frame_t frame = { 0 };
+		if (scallop_lang_script_enter(script->root, &context, &frame))
+			return -1;
+		for (size_t j = 0; j < script->root->statements_length; j++)
+			scallop_lang_script_arguments_free(scallop_lang_script_arguments(
+				&frame,
+				&script->root->statements[j],
+				&context
+			));
+		scallop_lang_script_leave(&frame);
+	}
+	return (now() - start) / (double)runs;
+}
+
+int main(int argc, char **argv)
+{
+	const long statements = argc > 1 ? atol(argv[1]) : 200;
+	const long runs = argc > 2 ? atol(argv[2]) : 200;
+
+	static const char *const lines[] = {
+		"cp \"$name\".txt 'backup dir'/[echo $name].txt\n",
+		"grep -e \"pattern here\" --color never input.log\n",
+		"echo [echo build] [echo $name] out/\"$name\"-[echo release]\n",
+		"tar -czf archive.tar.gz 'some dir' \\\"quoted\\\" [echo $name]\n",
+	};
+	const size_t lines_length = sizeof(lines) / sizeof(*lines);
+
+	size_t size = 1;
+	for (long i = 0; i < statements; i++)
+		size += strlen(lines[(size_t)i % lines_length]);
+	char *const text = calloc(size, 1);
+	if (!text) {
+		perror("calloc");
+		return 1;
+	}
+	for (long i = 0; i < statements; i++)
+		strcat(text, lines[(size_t)i % lines_length]);
+	const struct libadt_const_lptr script_text = {
+		.buffer = text,
+		.size = 1,
+		.length = (ssize_t)strlen(text),
+	};
+
+	struct scallop_lang_script plain = { 0 };
+	struct scallop_lang_script optimized = { 0 };
+	struct scallop_lang_optimize_stats stats = { 0 };
+	if (
+		scallop_lang_script_build(script_text, &plain)
+		|| scallop_lang_script_build(script_text, &optimized)
+	) {
+		perror("scallop_lang_script_build");
+		return 1;
+	}
+
+	const double start = now();
+	if (scallop_lang_optimize(&optimized, SCALLOP_LANG_OPTIMIZE_ALL, &stats)) {
+		perror("scallop_lang_optimize");
+		return 1;
+	}
+	const double optimize_time = now() - start;
+
+	const double plain_time = run(&plain, runs);
+	const double optimized_time = run(&optimized, runs);
+
+	printf("%-24s %12s\n", "", "ms per run");
+	printf("%-24s %12.3f\n", "unoptimized", plain_time * 1e3);
+	printf("%-24s %12.3f\n", "optimized", optimized_time * 1e3);
+	printf("%-24s %12.3f\n", "optimizing, once", optimize_time * 1e3);
+	printf("\n");
+	printf("%-24s %12zu\n", "words normalized", stats.words_normalized);
+	printf("%-24s %12zu\n", "literals shared", stats.literals_shared);
+	printf("%-24s %12zu\n", "substitutions folded", stats.substitutions_folded);
+	printf("%-24s %12zu\n", "substitutions hoisted", stats.substitutions_hoisted);
+	printf("%-24s %12zu\n", "slices merged", stats.slices_merged);
+
+	scallop_lang_script_free(&plain);
+	scallop_lang_script_free(&optimized);
+	free(text);
+	return 0;
+}
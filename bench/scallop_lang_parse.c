@@ -0,0 +1,129 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ * Compares scallop_lang_parse() against a bare scallop_lang_lex_next()
+ * loop over a synthetic script of MEGABYTES megabytes, mapped from a
+ * temporary file with mmap(2).
+ *
+ * Usage: bench_scallop_lang_parse [MEGABYTES]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "scallop-lang/lex.h"
+#include "scallop-lang/parse.h"
+
+static const char chunk[] =
+	"build --release src/main.c src/parse.c\n"
+	"for file [ls src] { echo 'compiling' $file; cc -c $file }\n"
+	"# keep the archive small\n"
+	"tar cf out.tar [find build -name '*.o']; rm -r build\n";
+
+static double now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static int count(void *user, const struct scallop_lang_parse_event *event)
+{
+	(void)event;
+	(*(size_t *)user)++;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const long megabytes = argc > 1 ? atol(argv[1]) : 256;
+
+	char path[] = "/tmp/scallop-parse-bench-XXXXXX";
+	const int fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	unlink(path);
+
+	FILE *const file = fdopen(fd, "w+");
+	size_t length = 0;
+	while (length < (size_t)megabytes * 1024 * 1024) {
+		fputs(chunk, file);
+		length += sizeof(chunk) - 1;
+	}
+	fflush(file);
+
+	const char *const mapping = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	if (mapping == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	const struct libadt_const_lptr script = {
+		.buffer = mapping,
+		.size = 1,
+		.length = (ssize_t)length,
+	};
+
+	double start = now();
+	size_t tokens = 0;
+	struct scallop_lang_lex lex = scallop_lang_lex_init(script);
+	do {
+		lex = scallop_lang_lex_next(lex);
+		tokens++;
+	} while (
+		lex.type != scallop_lang_classifier_end
+		&& lex.type != scallop_lang_classifier_unexpected
+	);
+	const double lex_time = now() - start;
+
+	start = now();
+	size_t events = 0;
+	const int result = scallop_lang_parse(script, count, &events);
+	const double parse_time = now() - start;
+	if (result) {
+		perror("scallop_lang_parse");
+		return 1;
+	}
+
+	printf("%-8s %12s %10s %10s\n", "", "count", "ms", "MB/s");
+	printf(
+		"%-8s %12zu %10.0f %10.1f\n",
+		"lex",
+		tokens,
+		lex_time * 1e3,
+		(double)length / lex_time / 1e6
+	);
+	printf(
+		"%-8s %12zu %10.0f %10.1f\n",
+		"parse",
+		events,
+		parse_time * 1e3,
+		(double)length / parse_time / 1e6
+	);
+
+	munmap((void *)mapping, length);
+	fclose(file);
+	return 0;
+}
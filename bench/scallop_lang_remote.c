@@ -0,0 +1,127 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures the overhead of scheduling jobs over workers, by running
+ * trivial commands through local worker processes and comparing
+ * against running them directly with scallop_lang_jobs_run().
+ *
+ * Usage: bench_scallop_lang_remote [JOBS [WORKERS]]
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "scallop-lang/jobs.h"
+#include "scallop-lang/remote.h"
+
+static double now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	const size_t length = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+	const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+	const size_t workers = argc > 2
+		? strtoul(argv[2], NULL, 10)
+		: (size_t)(processors > 0 ? processors : 1);
+
+	char *const command[] = { "true", NULL };
+	struct scallop_lang_jobs_job *const local = calloc(length, sizeof(*local));
+	struct scallop_lang_remote_job *const jobs = calloc(length, sizeof(*jobs));
+	int *const sockets = calloc(workers, sizeof(*sockets));
+	pid_t *const pids = calloc(workers, sizeof(*pids));
+	if (!local || !jobs || !sockets || !pids)
+		return 1;
+
+	for (size_t i = 0; i < length; i++) {
+		local[i] = (struct scallop_lang_jobs_job) { .argv = command, .block = -1 };
+		jobs[i].statement = (struct libadt_const_lptr) {
+			.buffer = "true",
+			.size = 1,
+			.length = 4,
+		};
+	}
+
+	// Each worker runs one job at a time, like a single-slot node
+	for (size_t i = 0; i < workers; i++) {
+		int pair[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair))
+			return 1;
+		pids[i] = fork();
+		if (pids[i] == 0) {
+			for (size_t j = 0; j < i; j++)
+				close(sockets[j]);
+			close(pair[0]);
+			const int directory = open("/tmp", O_RDONLY | O_DIRECTORY);
+			_exit(scallop_lang_remote_serve(pair[1], directory, 1) ? 1 : 0);
+		}
+		close(pair[1]);
+		sockets[i] = pair[0];
+	}
+
+	const struct scallop_lang_jobs_options options = { .max_running = workers };
+	double start = now();
+	if (scallop_lang_jobs_run(local, length, &options) != 0) {
+		perror("scallop_lang_jobs_run");
+		return 1;
+	}
+	const double direct = now() - start;
+
+	struct scallop_lang_remote remote = { 0 };
+	if (scallop_lang_remote_init(&remote, sockets, workers)) {
+		perror("scallop_lang_remote_init");
+		return 1;
+	}
+	start = now();
+	if (scallop_lang_remote_run(&remote, jobs, length, NULL) != 0) {
+		perror("scallop_lang_remote_run");
+		return 1;
+	}
+	const double distributed = now() - start;
+	scallop_lang_remote_free(&remote);
+
+	printf("%zu jobs, %zu workers\n", length, workers);
+	printf("%-8s %10.1f us per job\n", "direct", direct / (double)length * 1e6);
+	printf("%-8s %10.1f us per job\n", "workers", distributed / (double)length * 1e6);
+	printf(
+		"%-8s %10.1f us per job\n",
+		"overhead",
+		(distributed - direct) / (double)length * 1e6
+	);
+
+	for (size_t i = 0; i < workers; i++) {
+		close(sockets[i]);
+		waitpid(pids[i], NULL, 0);
+	}
+	free(local);
+	free(jobs);
+	free(sockets);
+	free(pids);
+	return 0;
+}
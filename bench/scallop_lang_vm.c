@@ -0,0 +1,260 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ * Runs a generated script of builtins RUNS times by walking its tree,
+ * as an interpreter would, and as a compiled program, each without
+ * and with the optimization passes.
+ *
+ * Both capture substitutions in a temporary file, set variables in
+ * the same store, and write to /dev/null.
+ *
+ * Usage: bench_scallop_lang_vm [STATEMENTS [RUNS]]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "scallop-lang/builtin.h"
+#include "scallop-lang/optimize.h"
+#include "scallop-lang/vm.h"
+
+typedef struct scallop_lang_script_block block_t;
+typedef struct scallop_lang_script_context context_t;
+typedef struct scallop_lang_script_frame frame_t;
+
+typedef struct {
+	struct scallop_lang_env env;
+	int out;
+} interpreter_t;
+
+static double now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static const char *get_variable(void *user, const char *name)
+{
+	const interpreter_t *const interpreter = user;
+	return scallop_lang_env_get(&interpreter->env, name);
+}
+
+static int set_variable(void *user, const char *name, const char *value)
+{
+	interpreter_t *const interpreter = user;
+	return scallop_lang_env_set(&interpreter->env, name, value);
+}
+
+static char *substitute(void *user, const block_t *block);
+
+static int run_block(interpreter_t *interpreter, const block_t *block)
+{
+	const context_t context = {
+		.get_variable = get_variable,
+		.substitute = substitute,
+		.user = interpreter,
+	};
+	frame_t frame = { 0 };
+	if (scallop_lang_script_enter(block, &context, &frame))
+		return -1;
+
+	const struct scallop_lang_builtin_context builtin_context = {
+		.in = -1,
+		.out = interpreter->out,
+		.err = interpreter->out,
+		.set_variable = set_variable,
+		.user = interpreter,
+	};
+	for (size_t i = 0; i < block->statements_length; i++) {
+		char **const arguments = scallop_lang_script_arguments(
+			&frame,
+			&block->statements[i],
+			&context
+		);
+		if (!arguments)
+			continue;
+		size_t argc = 0;
+		while (arguments[argc])
+			argc++;
+		const struct scallop_lang_builtin *const builtin
+			= scallop_lang_builtin_find_name(arguments[0]);
+		if (builtin)
+			builtin->run(&builtin_context, argc, arguments);
+		scallop_lang_script_arguments_free(arguments);
+	}
+	scallop_lang_script_leave(&frame);
+	return 0;
+}
+
+static char *substitute(void *user, const block_t *block)
+{
+	interpreter_t *const interpreter = user;
+	FILE *const capture = tmpfile();
+	if (!capture)
+		return NULL;
+
+	const int out = interpreter->out;
+	interpreter->out = fileno(capture);
+	const int result = run_block(interpreter, block);
+	interpreter->out = out;
+
+	char *const output = calloc(4096, 1);
+	const size_t length = output && !result
+		? (size_t)pread(fileno(capture), output, 4095, 0)
+		: 0;
+	fclose(capture);
+	if (!output || length > 4095) {
+		free(output);
+		return NULL;
+	}
+	for (size_t end = length; end && output[end - 1] == '\n';)
+		output[--end] = '\0';
+	return output;
+}
+
+static double interpret(const struct scallop_lang_script *script, int out, long runs)
+{
+	interpreter_t interpreter = { .out = out };
+	if (scallop_lang_env_init(&interpreter.env, NULL))
+		return -1;
+
+	const double start = now();
+	for (long i = 0; i < runs; i++)
+		if (run_block(&interpreter, script->root))
+			return -1;
+	const double time = (now() - start) / (double)runs;
+
+	scallop_lang_env_free(&interpreter.env);
+	return time;
+}
+
+static double execute(const struct scallop_lang_vm_program *program, int out, long runs)
+{
+	struct scallop_lang_vm_options options = {
+		.in = -1,
+		.out = out,
+		.err = out,
+	};
+	struct scallop_lang_env env = { 0 };
+	if (scallop_lang_env_init(&env, NULL))
+		return -1;
+	options.env = &env;
+
+	const double start = now();
+	for (long i = 0; i < runs; i++)
+		if (scallop_lang_vm_run(program, &options, NULL))
+			return -1;
+	const double time = (now() - start) / (double)runs;
+
+	scallop_lang_env_free(&env);
+	return time;
+}
+
+int main(int argc, char **argv)
+{
+	const long statements = argc > 1 ? atol(argv[1]) : 200;
+	const long runs = argc > 2 ? atol(argv[2]) : 200;
+
+	static const char *const lines[] = {
+		"set name [echo value]\n",
+		"test -n \"$name\"\n",
+		"echo \"$name\".txt 'backup dir'/[echo $name].txt\n",
+		"echo [echo build] [echo $name] out/\"$name\"-[echo release]\n",
+		"echo -n plain words with no variables at all\n",
+	};
+	const size_t lines_length = sizeof(lines) / sizeof(*lines);
+
+	size_t size = 1;
+	for (long i = 0; i < statements; i++)
+		size += strlen(lines[(size_t)i % lines_length]);
+	char *const text = calloc(size, 1);
+	if (!text) {
+		perror("calloc");
+		return 1;
+	}
+	for (long i = 0; i < statements; i++)
+		strcat(text, lines[(size_t)i % lines_length]);
+	const struct libadt_const_lptr script_text = {
+		.buffer = text,
+		.size = 1,
+		.length = (ssize_t)strlen(text),
+	};
+
+	struct scallop_lang_script plain = { 0 };
+	struct scallop_lang_script optimized = { 0 };
+	if (
+		scallop_lang_script_build(script_text, &plain)
+		|| scallop_lang_script_build(script_text, &optimized)
+		|| scallop_lang_optimize(&optimized, SCALLOP_LANG_OPTIMIZE_ALL, NULL)
+	) {
+		perror("scallop_lang_script_build");
+		return 1;
+	}
+
+	struct scallop_lang_vm_program plain_program = { 0 };
+	struct scallop_lang_vm_program optimized_program = { 0 };
+	const double start = now();
+	if (scallop_lang_vm_compile(&plain, &plain_program)) {
+		perror("scallop_lang_vm_compile");
+		return 1;
+	}
+	const double compile_time = now() - start;
+	if (scallop_lang_vm_compile(&optimized, &optimized_program)) {
+		perror("scallop_lang_vm_compile");
+		return 1;
+	}
+
+	const int out = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	if (out < 0) {
+		perror("/dev/null");
+		return 1;
+	}
+
+	printf("%-24s %12s %12s\n", "ms per run", "unoptimized", "optimized");
+	printf(
+		"%-24s %12.3f %12.3f\n",
+		"tree walking",
+		interpret(&plain, out, runs) * 1e3,
+		interpret(&optimized, out, runs) * 1e3
+	);
+	printf(
+		"%-24s %12.3f %12.3f\n",
+		"bytecode",
+		execute(&plain_program, out, runs) * 1e3,
+		execute(&optimized_program, out, runs) * 1e3
+	);
+	printf("%-24s %12.3f\n", "compiling, once", compile_time * 1e3);
+	printf("\n");
+	printf("%-24s %12zu\n", "instructions", plain_program.code_length);
+	printf("%-24s %12zu\n", "constants", plain_program.constants_length);
+
+	close(out);
+	scallop_lang_vm_free(&plain_program);
+	scallop_lang_vm_free(&optimized_program);
+	scallop_lang_script_free(&plain);
+	scallop_lang_script_free(&optimized);
+	free(text);
+	return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ * A standalone driver for libFuzzer targets, for compilers without
+ * libFuzzer and for running saved inputs as tests.
+ *
+ * Usage: fuzz_TARGET [-runs=N] [-seed=N] [-max_len=N] [PATH]...
+ *
+ * Each PATH is a file to run, or a directory of files to run. With
+ * no PATH, or with -runs, N random inputs are run as well, built
+ * from runs of the characters the lexer treats specially, so long
+ * tokens and long alternations of short ones are both likely.
+ * A random input that fails is printed before the target aborts.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+int LLVMFuzzerInitialize(int *argc, char ***argv);
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+#define DEFAULT_RUNS 10000
+#define DEFAULT_MAX_LENGTH 4096
+
+static const char *const pieces[] = {
+	"a", "word", "-_.:/", " ", "\t", ";", "\n", "\r\n", "'", "\"", "\\",
+	"{", "}", "[", "]", "#", "*", "?", "$", "$name", "\"$", "\\'",
+	"\xc3\xa9", "\xe2\x82\xac", "\xc3", "\x80", "\0", "=",
+};
+
+static int run_file(const char *path)
+{
+	FILE *const file = fopen(path, "rb");
+	if (!file) {
+		perror(path);
+		return -1;
+	}
+
+	uint8_t *data = NULL;
+	size_t length = 0, capacity = 0;
+	for (;;) {
+		if (length == capacity) {
+			capacity = capacity ? capacity * 2 : 4096;
+			uint8_t *const larger = realloc(data, capacity);
+			if (!larger) {
+				perror(path);
+				free(data);
+				fclose(file);
+				return -1;
+			}
+			data = larger;
+		}
+		const size_t amount = fread(data + length, 1, capacity - length, file);
+		length += amount;
+		if (amount == 0)
+			break;
+	}
+	fclose(file);
+
+	fprintf(stderr, "running %s (%zu bytes)\n", path, length);
+	LLVMFuzzerTestOneInput(data, length);
+	free(data);
+	return 0;
+}
+
+static int run_path(const char *path)
+{
+	struct stat info = { 0 };
+	if (stat(path, &info)) {
+		perror(path);
+		return -1;
+	}
+	if (!S_ISDIR(info.st_mode))
+		return run_file(path);
+
+	DIR *const directory = opendir(path);
+	if (!directory) {
+		perror(path);
+		return -1;
+	}
+
+	int result = 0;
+	for (struct dirent *entry; (entry = readdir(directory));) {
+		if (entry->d_name[0] == '.')
+			continue;
+
+		char child[4096];
+		snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+		if (run_path(child))
+			result = -1;
+	}
+	closedir(directory);
+	return result;
+}
+
+static void print_input(const uint8_t *data, size_t length)
+{
+	fprintf(stderr, "input: \"");
+	for (size_t i = 0; i < length; i++) {
+		if (data[i] >= 0x20 && data[i] < 0x7f && data[i] != '"' && data[i] != '\\')
+			fputc(data[i], stderr);
+		else
+			fprintf(stderr, "\\x%02x", data[i]);
+	}
+	fprintf(stderr, "\"\n");
+}
+
+static void run_random(long runs, unsigned seed, size_t max_length)
+{
+	uint8_t *const data = malloc(max_length ? max_length : 1);
+	if (!data) {
+		perror("malloc");
+		exit(1);
+	}
+
+	srand(seed);
+	const size_t piece_count = sizeof(pieces) / sizeof(*pieces);
+	for (long run = 0; run < runs; run++) {
+		const size_t length = max_length ? (size_t)rand() % (max_length + 1) : 0;
+		size_t used = 0;
+		while (used < length) {
+			const char *const piece = pieces[(size_t)rand() % piece_count];
+			const size_t piece_length = piece[0] ? strlen(piece) : 1;
+
+			// Repeat pieces, sometimes for long runs
+			size_t repeat = (size_t)rand() % 4 ? 1 : (size_t)rand() % (length / 4 + 1) + 1;
+			for (; repeat && used + piece_length <= length; repeat--) {
+				memcpy(data + used, piece, piece_length);
+				used += piece_length;
+			}
+			if (used + piece_length > length)
+				break;
+		}
+
+		// Printed ahead of time, since a slow input aborts
+		if (getenv("SCALLOP_LANG_FUZZ_VERBOSE"))
+			print_input(data, used);
+		LLVMFuzzerTestOneInput(data, used);
+	}
+	free(data);
+}
+
+int main(int argc, char **argv)
+{
+	LLVMFuzzerInitialize(&argc, &argv);
+
+	long runs = -1;
+	unsigned seed = 1;
+	size_t max_length = DEFAULT_MAX_LENGTH;
+	int paths = 0;
+	int result = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "-runs=", 6) == 0)
+			runs = atol(argv[i] + 6);
+		else if (strncmp(argv[i], "-seed=", 6) == 0)
+			seed = (unsigned)atol(argv[i] + 6);
+		else if (strncmp(argv[i], "-max_len=", 9) == 0)
+			max_length = (size_t)atol(argv[i] + 9);
+		else if (argv[i][0] == '-')
+			fprintf(stderr, "ignoring %s\n", argv[i]);
+		else {
+			paths++;
+			if (run_path(argv[i]))
+				result = 1;
+		}
+	}
+
+	if (runs < 0)
+		runs = paths ? 0 : DEFAULT_RUNS;
+	run_random(runs, seed, max_length);
+	return result;
+}
@@ -0,0 +1,149 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ * A libFuzzer target for the lexer, which fails on inputs that make
+ * it do more work per byte than SCALLOP_LANG_FUZZ_STEPS_PER_BYTE
+ * (by default DEFAULT_STEPS_PER_BYTE), counting every character it
+ * classifies. Any crash or sanitizer error fails it as well.
+ *
+ * Each input is run through scallop_lang_lex_next_raw(),
+ * scallop_lang_lex_next(), scallop_lang_lex_normalize_word() on
+ * every word, and scallop_lang_lex_next_normalized(), each checked
+ * separately.
+ *
+ * Build with -DBUILD_FUZZERS=ON. With clang, this links against
+ * libFuzzer; otherwise it's linked with driver.c, which runs saved
+ * inputs or random ones.
+ */
+
+#include <locale.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scallop-lang/lex.h"
+
+#define DEFAULT_STEPS_PER_BYTE 8
+
+// Steps allowed regardless of length, for the end of the script
+// and the lookahead at the last token
+#define STEPS_SLACK 16
+
+static size_t steps_per_byte = DEFAULT_STEPS_PER_BYTE;
+
+int LLVMFuzzerInitialize(int *argc, char ***argv);
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	(void)argc;
+	(void)argv;
+
+	// Multibyte input decodes as UTF-8, instead of failing at
+	// the first byte outside ASCII
+	if (!setlocale(LC_ALL, "C.UTF-8"))
+		setlocale(LC_ALL, "");
+
+	const char *const limit = getenv("SCALLOP_LANG_FUZZ_STEPS_PER_BYTE");
+	if (limit && atol(limit) > 0)
+		steps_per_byte = (size_t)atol(limit);
+	return 0;
+}
+
+static void check(const char *name, size_t size)
+{
+	const size_t limit = steps_per_byte * size + STEPS_SLACK;
+	if (scallop_lang_lex_steps <= limit)
+		return;
+
+	fprintf(
+		stderr,
+		"%s: %zu steps for %zu bytes, over the limit of %zu\n",
+		name,
+		scallop_lang_lex_steps,
+		size,
+		limit
+	);
+	abort();
+}
+
+static bool is_last(struct scallop_lang_lex token)
+{
+	return token.type == scallop_lang_classifier_end
+		|| token.type == scallop_lang_classifier_unexpected;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	const struct libadt_const_lptr script = {
+		.buffer = data,
+		.size = 1,
+		.length = (ssize_t)size,
+	};
+
+	scallop_lang_lex_steps = 0;
+	struct scallop_lang_lex token = scallop_lang_lex_init(script);
+	do
+		token = scallop_lang_lex_next_raw(token);
+	while (!is_last(token));
+	check("scallop_lang_lex_next_raw", size);
+
+	scallop_lang_lex_steps = 0;
+	token = scallop_lang_lex_init(script);
+	do
+		token = scallop_lang_lex_next(token);
+	while (!is_last(token));
+	check("scallop_lang_lex_next", size);
+
+	// Normalizing is checked against the length of the words alone,
+	// measuring each one and then copying it
+	size_t words_size = 0;
+	size_t normalize_steps = 0;
+	char small[256];
+	token = scallop_lang_lex_init(script);
+	for (;;) {
+		token = scallop_lang_lex_next(token);
+		if (is_last(token))
+			break;
+		if (!scallop_lang_classifier_is_word(token.type))
+			continue;
+
+		scallop_lang_lex_steps = 0;
+		scallop_lang_lex_normalize_word(token.value, (struct libadt_lptr) { 0 });
+		scallop_lang_lex_normalize_word(
+			token.value,
+			libadt_lptr_init_array(small)
+		);
+		normalize_steps += scallop_lang_lex_steps;
+		words_size += (size_t)token.value.length;
+	}
+	scallop_lang_lex_steps = normalize_steps;
+	check("scallop_lang_lex_normalize_word", words_size);
+
+	scallop_lang_lex_steps = 0;
+	struct scallop_lang_lex_words words = { 0 };
+	token = scallop_lang_lex_init(script);
+	do {
+		words.length = 0;
+		token = scallop_lang_lex_next_normalized(token, &words);
+	} while (!is_last(token));
+	scallop_lang_lex_words_free(&words);
+	check("scallop_lang_lex_next_normalized", size);
+
+	return 0;
+}
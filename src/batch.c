@@ -0,0 +1,369 @@
+#include "scallop-lang/batch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "scallop-lang/lex.h"
+
+typedef struct scallop_lang_batch batch_t;
+typedef struct scallop_lang_batch_input input_t;
+typedef struct scallop_lang_batch_result result_t;
+typedef struct scallop_lang_batch_token token_t;
+typedef struct scallop_lang_batch_arena arena_t;
+
+/*
+ * Arenas
+ */
+
+// Large enough to hold many small scripts and their tokens
+#define ARENA_BLOCK_SIZE (256 * 1024)
+#define ARENA_ALIGNMENT _Alignof(max_align_t)
+
+struct scallop_lang_batch_arena {
+	arena_t *next;
+	size_t used;
+	size_t capacity;
+	max_align_t data[];
+};
+
+static void *arena_alloc(arena_t **arena, size_t size)
+{
+	if (size > SIZE_MAX - ARENA_ALIGNMENT) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+	arena_t *block = *arena;
+	if (!block || block->capacity - block->used < size) {
+		const size_t capacity = size > ARENA_BLOCK_SIZE
+			? size
+			: ARENA_BLOCK_SIZE;
+		block = malloc(sizeof(*block) + capacity);
+		if (!block)
+			return NULL;
+
+		block->next = *arena;
+		block->used = 0;
+		block->capacity = capacity;
+		*arena = block;
+	}
+
+	void *const result = (unsigned char *)block->data + block->used;
+	block->used += size;
+	return result;
+}
+
+static void arena_free(arena_t *arena)
+{
+	while (arena) {
+		arena_t *const next = arena->next;
+		free(arena);
+		arena = next;
+	}
+}
+
+/*
+ * Workers
+ */
+
+typedef struct {
+	const input_t *inputs;
+	result_t *results;
+	size_t length;
+	atomic_size_t next;
+	atomic_bool failed;
+} shared_t;
+
+typedef struct {
+	size_t index;
+	int fd;
+	int error;
+} pending_t;
+
+typedef struct {
+	shared_t *shared;
+	arena_t *arena;
+
+	// Scratch buffers, reused between scripts
+	char *text;
+	size_t text_capacity;
+	token_t *tokens;
+	size_t tokens_capacity;
+} worker_t;
+
+static int reserve(void **array, size_t *capacity, size_t length, size_t size)
+{
+	if (length <= *capacity)
+		return 0;
+
+	size_t new_capacity = *capacity ? *capacity : 64;
+	while (new_capacity < length)
+		new_capacity *= 2;
+	if (new_capacity > SIZE_MAX / size) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	void *const result = realloc(*array, new_capacity * size);
+	if (!result)
+		return -1;
+
+	*array = result;
+	*capacity = new_capacity;
+	return 0;
+}
+
+/*
+ * Claims the next input, and opens it if it's a file, so the kernel
+ * can read it in while the previous input is lexed.
+ */
+static pending_t claim(shared_t *shared)
+{
+	pending_t pending = {
+		.index = atomic_fetch_add(&shared->next, 1),
+		.fd = -1,
+	};
+	if (pending.index >= shared->length)
+		return pending;
+
+	const input_t *const input = &shared->inputs[pending.index];
+	if (!input->path)
+		return pending;
+
+	pending.fd = open(input->path, O_RDONLY | O_CLOEXEC);
+	if (pending.fd < 0) {
+		pending.error = errno;
+		return pending;
+	}
+	posix_fadvise(pending.fd, 0, 0, POSIX_FADV_WILLNEED);
+	return pending;
+}
+
+/*
+ * Reads a whole file into the worker's scratch text.
+ *
+ * \returns The length read, or -1 with errno set.
+ */
+static ssize_t read_file(worker_t *worker, int fd)
+{
+	struct stat info = { 0 };
+	if (fstat(fd, &info))
+		return -1;
+
+	// Regular files are usually read in a single call
+	size_t capacity = S_ISREG(info.st_mode) && info.st_size > 0
+		? (size_t)info.st_size + 1
+		: 4096;
+	size_t length = 0;
+	for (;;) {
+		if (reserve(
+			(void **)&worker->text,
+			&worker->text_capacity,
+			capacity,
+			1
+		))
+			return -1;
+
+		const ssize_t amount = read(
+			fd,
+			worker->text + length,
+			worker->text_capacity - length
+		);
+		if (amount < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (amount == 0)
+			return (ssize_t)length;
+
+		length += (size_t)amount;
+		if (length == worker->text_capacity)
+			capacity = worker->text_capacity * 2;
+	}
+}
+
+static int lex_script(worker_t *worker, result_t *result)
+{
+	const struct libadt_const_lptr script = result->script;
+	size_t length = 0;
+
+	struct scallop_lang_lex token = scallop_lang_lex_init(script);
+	for (;;) {
+		token = scallop_lang_lex_next(token);
+		if (token.type == scallop_lang_classifier_end)
+			break;
+
+		const size_t offset = (size_t)(
+			(const char *)token.value.buffer
+			- (const char *)script.buffer
+		);
+		if (token.type == scallop_lang_classifier_unexpected) {
+			result->error = EINVAL;
+			result->error_offset = offset;
+			break;
+		}
+
+		if (reserve(
+			(void **)&worker->tokens,
+			&worker->tokens_capacity,
+			length + 1,
+			sizeof(*worker->tokens)
+		))
+			return -1;
+
+		worker->tokens[length++] = (token_t) {
+			.type = token.type,
+			.offset = offset,
+			.length = (size_t)token.value.length,
+		};
+	}
+
+	if (!length)
+		return 0;
+
+	result->tokens = arena_alloc(&worker->arena, length * sizeof(*result->tokens));
+	if (!result->tokens)
+		return -1;
+	memcpy(result->tokens, worker->tokens, length * sizeof(*result->tokens));
+	result->tokens_length = length;
+	return 0;
+}
+
+static int process(worker_t *worker, pending_t pending)
+{
+	const input_t *const input = &worker->shared->inputs[pending.index];
+	result_t *const result = &worker->shared->results[pending.index];
+
+	if (!input->path) {
+		result->script = input->script;
+		return lex_script(worker, result);
+	}
+
+	if (pending.error) {
+		result->error = pending.error;
+		return 0;
+	}
+
+	const ssize_t length = read_file(worker, pending.fd);
+	if (length < 0) {
+		if (errno == ENOMEM)
+			return -1;
+		result->error = errno;
+		return 0;
+	}
+
+	char *const text = arena_alloc(&worker->arena, (size_t)length + 1);
+	if (!text)
+		return -1;
+	memcpy(text, worker->text, (size_t)length);
+	text[length] = '\0';
+
+	result->script = (struct libadt_const_lptr) {
+		.buffer = text,
+		.size = 1,
+		.length = length,
+	};
+	return lex_script(worker, result);
+}
+
+static void *worker_run(void *argument)
+{
+	worker_t *const worker = argument;
+	shared_t *const shared = worker->shared;
+
+	pending_t current = claim(shared);
+	while (current.index < shared->length) {
+		const pending_t next = claim(shared);
+
+		if (!atomic_load(&shared->failed) && process(worker, current))
+			atomic_store(&shared->failed, true);
+		if (current.fd >= 0)
+			close(current.fd);
+
+		current = next;
+	}
+	return NULL;
+}
+
+int scallop_lang_batch_lex(
+	const input_t *inputs,
+	size_t length,
+	size_t threads,
+	batch_t *out
+)
+{
+	*out = (batch_t) { 0 };
+	if (!threads)
+		threads = 1;
+	if (threads > length && length)
+		threads = length;
+
+	shared_t shared = {
+		.inputs = inputs,
+		.length = length,
+	};
+	atomic_init(&shared.next, 0);
+	atomic_init(&shared.failed, false);
+
+	out->results = calloc(length ? length : 1, sizeof(*out->results));
+	out->_arenas = calloc(threads, sizeof(*out->_arenas));
+	worker_t *const workers = calloc(threads, sizeof(*workers));
+	pthread_t *const ids = calloc(threads, sizeof(*ids));
+	if (!out->results || !out->_arenas || !workers || !ids) {
+		free(workers);
+		free(ids);
+		scallop_lang_batch_free(out);
+		return -1;
+	}
+	out->length = length;
+	out->_arenas_length = threads;
+	shared.results = out->results;
+
+	for (size_t i = 0; i < threads; i++)
+		workers[i].shared = &shared;
+
+	// Workers take inputs until none are left, so fewer threads
+	// than asked for still lex the whole batch
+	size_t started = 1;
+	for (; started < threads; started++)
+		if (pthread_create(&ids[started], NULL, worker_run, &workers[started]))
+			break;
+	worker_run(&workers[0]);
+	for (size_t i = 1; i < started; i++)
+		pthread_join(ids[i], NULL);
+
+	for (size_t i = 0; i < threads; i++) {
+		out->_arenas[i] = workers[i].arena;
+		free(workers[i].text);
+		free(workers[i].tokens);
+	}
+	free(workers);
+	free(ids);
+
+	if (atomic_load(&shared.failed)) {
+		scallop_lang_batch_free(out);
+		errno = ENOMEM;
+		return -1;
+	}
+	return 0;
+}
+
+void scallop_lang_batch_free(batch_t *batch)
+{
+	for (size_t i = 0; i < batch->_arenas_length; i++)
+		arena_free(batch->_arenas[i]);
+	free(batch->_arenas);
+	free(batch->results);
+	*batch = (batch_t) { 0 };
+}
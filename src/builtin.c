@@ -0,0 +1,334 @@
+#include "scallop-lang/builtin.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "scallop-lang/lex.h"
+
+typedef struct scallop_lang_builtin_context context_t;
+typedef struct scallop_lang_builtin builtin_t;
+
+static int write_all(int fd, const char *buffer, size_t length)
+{
+	while (length) {
+		const ssize_t amount = write(fd, buffer, length);
+		if (amount < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buffer += amount;
+		length -= (size_t)amount;
+	}
+	return 0;
+}
+
+static void report(const context_t *context, const char *format, ...)
+{
+	char buffer[PATH_MAX + 64];
+	va_list args;
+	va_start(args, format);
+	const int length = vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+
+	if (length > 0)
+		write_all(
+			context->err,
+			buffer,
+			(size_t)length < sizeof(buffer) ? (size_t)length : sizeof(buffer) - 1
+		);
+}
+
+static int builtin_true(const context_t *context, size_t argc, char *const argv[])
+{
+	(void)context;
+	(void)argc;
+	(void)argv;
+	return 0;
+}
+
+static int builtin_false(const context_t *context, size_t argc, char *const argv[])
+{
+	(void)context;
+	(void)argc;
+	(void)argv;
+	return 1;
+}
+
+static int builtin_echo(const context_t *context, size_t argc, char *const argv[])
+{
+	const bool newline = !(argc > 1 && strcmp(argv[1], "-n") == 0);
+	const size_t first = newline ? 1 : 2;
+
+	size_t length = newline;
+	for (size_t i = first; i < argc; i++)
+		length += strlen(argv[i]) + (i > first);
+
+	// Build the whole line first, so it's written atomically
+	// for reasonable lengths
+	char small[512];
+	char *const buffer = length <= sizeof(small) ? small : malloc(length);
+	if (!buffer)
+		return 1;
+
+	char *cursor = buffer;
+	for (size_t i = first; i < argc; i++) {
+		if (i > first)
+			*cursor++ = ' ';
+		const size_t word_length = strlen(argv[i]);
+		memcpy(cursor, argv[i], word_length);
+		cursor += word_length;
+	}
+	if (newline)
+		*cursor++ = '\n';
+
+	const int result = write_all(context->out, buffer, length) ? 1 : 0;
+	if (buffer != small)
+		free(buffer);
+	return result;
+}
+
+static bool is_unary_test(const char *op)
+{
+	static const char *const ops[] = {
+		"-e", "-f", "-d", "-r", "-w", "-x", "-s", "-n", "-z",
+	};
+	for (size_t i = 0; i < sizeof(ops) / sizeof(*ops); i++)
+		if (strcmp(op, ops[i]) == 0)
+			return true;
+	return false;
+}
+
+static bool is_binary_test(const char *op)
+{
+	static const char *const ops[] = {
+		"=", "!=", "-eq", "-ne", "-lt", "-le", "-gt", "-ge",
+	};
+	for (size_t i = 0; i < sizeof(ops) / sizeof(*ops); i++)
+		if (strcmp(op, ops[i]) == 0)
+			return true;
+	return false;
+}
+
+static int test_unary(const char *op, const char *operand)
+{
+	struct stat info = { 0 };
+
+	switch (op[1]) {
+		case 'n':
+			return operand[0] ? 0 : 1;
+		case 'z':
+			return operand[0] ? 1 : 0;
+		case 'r':
+			return access(operand, R_OK) == 0 ? 0 : 1;
+		case 'w':
+			return access(operand, W_OK) == 0 ? 0 : 1;
+		case 'x':
+			return access(operand, X_OK) == 0 ? 0 : 1;
+	}
+
+	if (stat(operand, &info))
+		return 1;
+
+	switch (op[1]) {
+		case 'f':
+			return S_ISREG(info.st_mode) ? 0 : 1;
+		case 'd':
+			return S_ISDIR(info.st_mode) ? 0 : 1;
+		case 's':
+			return info.st_size > 0 ? 0 : 1;
+		default:
+			return 0;
+	}
+}
+
+static bool parse_integer(const char *string, long long *out)
+{
+	char *end = NULL;
+	errno = 0;
+	*out = strtoll(string, &end, 10);
+	return errno == 0 && end != string && *end == '\0';
+}
+
+static int test_binary(
+	const context_t *context,
+	const char *left,
+	const char *op,
+	const char *right
+)
+{
+	if (strcmp(op, "=") == 0)
+		return strcmp(left, right) == 0 ? 0 : 1;
+	if (strcmp(op, "!=") == 0)
+		return strcmp(left, right) != 0 ? 0 : 1;
+
+	long long a = 0, b = 0;
+	if (!parse_integer(left, &a) || !parse_integer(right, &b)) {
+		report(context, "test: integer expression expected\n");
+		return 2;
+	}
+
+	bool result = false;
+	if (strcmp(op, "-eq") == 0)
+		result = a == b;
+	else if (strcmp(op, "-ne") == 0)
+		result = a != b;
+	else if (strcmp(op, "-lt") == 0)
+		result = a < b;
+	else if (strcmp(op, "-le") == 0)
+		result = a <= b;
+	else if (strcmp(op, "-gt") == 0)
+		result = a > b;
+	else
+		result = a >= b;
+	return result ? 0 : 1;
+}
+
+static int test_evaluate(const context_t *context, size_t argc, char *const argv[])
+{
+	if (argc == 0)
+		return 1;
+	if (argc == 1)
+		return argv[0][0] ? 0 : 1;
+	if (argc == 3 && is_binary_test(argv[1]))
+		return test_binary(context, argv[0], argv[1], argv[2]);
+
+	if (strcmp(argv[0], "!") == 0) {
+		const int result = test_evaluate(context, argc - 1, argv + 1);
+		return result == 2 ? 2 : !result;
+	}
+
+	if (argc == 2 && is_unary_test(argv[0]))
+		return test_unary(argv[0], argv[1]);
+
+	report(context, "test: invalid expression\n");
+	return 2;
+}
+
+static int builtin_test(const context_t *context, size_t argc, char *const argv[])
+{
+	return test_evaluate(context, argc - 1, argv + 1);
+}
+
+static int builtin_cd(const context_t *context, size_t argc, char *const argv[])
+{
+	const char *const directory = argc > 1 ? argv[1] : getenv("HOME");
+	if (!directory) {
+		report(context, "cd: HOME not set\n");
+		return 1;
+	}
+
+	if (chdir(directory)) {
+		report(context, "cd: %s: %s\n", directory, strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+static int builtin_pwd(const context_t *context, size_t argc, char *const argv[])
+{
+	(void)argc;
+	(void)argv;
+
+	char buffer[PATH_MAX + 1];
+	if (!getcwd(buffer, PATH_MAX)) {
+		report(context, "pwd: %s\n", strerror(errno));
+		return 1;
+	}
+
+	const size_t length = strlen(buffer);
+	buffer[length] = '\n';
+	return write_all(context->out, buffer, length + 1) ? 1 : 0;
+}
+
+static int builtin_set(const context_t *context, size_t argc, char *const argv[])
+{
+	if (argc != 3) {
+		report(context, "set: usage: set NAME VALUE\n");
+		return 2;
+	}
+
+	if (!context->set_variable) {
+		report(context, "set: variables are not supported\n");
+		return 1;
+	}
+
+	return context->set_variable(context->user, argv[1], argv[2]) ? 1 : 0;
+}
+
+static int builtin_hash(const context_t *context, size_t argc, char *const argv[])
+{
+	const bool reset = argc > 1 && strcmp(argv[1], "-r") == 0;
+	if (!context->commands) {
+		report(context, "hash: commands are not cached\n");
+		return 1;
+	}
+	if (reset)
+		scallop_lang_commands_reset(context->commands);
+
+	int result = 0;
+	for (size_t i = reset ? 2 : 1; i < argc; i++) {
+		const struct scallop_lang_commands_command *const command
+			= scallop_lang_commands_find(context->commands, argv[i]);
+		if (!command) {
+			report(context, "hash: %s: not found\n", argv[i]);
+			result = 1;
+			continue;
+		}
+		scallop_lang_commands_release(command);
+	}
+	return result;
+}
+
+// Sorted by name, for bsearch()
+static const builtin_t builtins[] = {
+	{ "cd", builtin_cd },
+	{ "echo", builtin_echo },
+	{ "false", builtin_false },
+	{ "hash", builtin_hash },
+	{ "pwd", builtin_pwd },
+	{ "set", builtin_set },
+	{ "test", builtin_test },
+	{ "true", builtin_true },
+};
+
+// Long enough for the longest builtin name
+#define NAME_MAX_LENGTH 8
+
+static int compare_builtin(const void *name, const void *builtin)
+{
+	return strcmp(name, ((const builtin_t *)builtin)->name);
+}
+
+const builtin_t *scallop_lang_builtin_find_name(const char *name)
+{
+	return bsearch(
+		name,
+		builtins,
+		sizeof(builtins) / sizeof(*builtins),
+		sizeof(*builtins),
+		compare_builtin
+	);
+}
+
+const builtin_t *scallop_lang_builtin_find(struct libadt_const_lptr word)
+{
+	char name[NAME_MAX_LENGTH + 1] = { 0 };
+	const ssize_t length = scallop_lang_lex_normalize_word(
+		word,
+		libadt_lptr_truncate(libadt_lptr_init_array(name), NAME_MAX_LENGTH)
+	);
+
+	if (length < 0 || length > NAME_MAX_LENGTH)
+		return NULL;
+	name[length] = '\0';
+	return scallop_lang_builtin_find_name(name);
+}
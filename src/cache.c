@@ -0,0 +1,377 @@
+#include "scallop-lang/cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "scallop-lang/lex.h"
+
+typedef struct scallop_lang_cache cache_t;
+typedef struct scallop_lang_cache_entry entry_t;
+typedef struct scallop_lang_cache_fingerprint fingerprint_t;
+
+// FNV-1a, 64-bit
+#define HASH_OFFSET 0xcbf29ce484222325ULL
+#define HASH_PRIME 0x100000001b3ULL
+
+// The check hash multiplies by the 64-bit golden ratio and folds
+// the high bits down, so its collisions are unrelated to FNV's
+#define CHECK_OFFSET 0x6a09e667f3bcc908ULL
+#define CHECK_PRIME 0x9e3779b97f4a7c15ULL
+
+// The size of reads when hashing file contents
+#define READ_BUFFER_SIZE (64 * 1024)
+
+static const char entry_magic[8] = "SCLCACH2";
+
+typedef struct {
+	char magic[8];
+	int32_t status;
+	uint64_t check;
+	uint64_t out_length;
+	uint64_t err_length;
+} header_t;
+
+/*
+ * Fingerprints
+ */
+
+static void hash_bytes(fingerprint_t *fingerprint, const void *data, size_t length)
+{
+	const unsigned char *const bytes = data;
+	uint64_t hash = fingerprint->hash;
+	uint64_t check = fingerprint->check;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= bytes[i];
+		hash *= HASH_PRIME;
+		check = (check + bytes[i]) * CHECK_PRIME;
+		check ^= check >> 29;
+	}
+	fingerprint->hash = hash;
+	fingerprint->check = check;
+}
+
+/*
+ * Hashes a tag and length before the data, so adjacent fields
+ * can't run into each other.
+ */
+static void hash_field(fingerprint_t *fingerprint, char tag, const void *data, size_t length)
+{
+	const uint64_t size = length;
+	hash_bytes(fingerprint, &tag, 1);
+	hash_bytes(fingerprint, &size, sizeof(size));
+	hash_bytes(fingerprint, data, length);
+}
+
+fingerprint_t scallop_lang_cache_fingerprint_init(void)
+{
+	return (fingerprint_t) { .hash = HASH_OFFSET, .check = CHECK_OFFSET };
+}
+
+int scallop_lang_cache_add_statement(
+	fingerprint_t *fingerprint,
+	struct libadt_const_lptr statement
+)
+{
+	struct scallop_lang_lex_words words = { 0 };
+	struct scallop_lang_lex token = scallop_lang_lex_init(statement);
+	errno = 0;
+	for (;;) {
+		words.length = 0;
+		token = scallop_lang_lex_next_normalized(token, &words);
+		if (token.type == scallop_lang_classifier_end)
+			break;
+		if (token.type == scallop_lang_classifier_unexpected) {
+			// Anything but running out of memory is a bad script
+			scallop_lang_lex_words_free(&words);
+			if (errno != ENOMEM)
+				errno = EINVAL;
+			return -1;
+		}
+
+		if (token.type == scallop_lang_classifier_statement_separator) {
+			hash_field(fingerprint, ';', NULL, 0);
+			continue;
+		}
+		if (!scallop_lang_classifier_is_word(token.type))
+			continue;
+
+		hash_field(
+			fingerprint,
+			'w',
+			words.buffer + words.word,
+			words.word_length * statement.size
+		);
+	}
+
+	scallop_lang_lex_words_free(&words);
+	return 0;
+}
+
+void scallop_lang_cache_add_words(fingerprint_t *fingerprint, char *const argv[])
+{
+	for (; *argv; argv++)
+		hash_field(fingerprint, 'w', *argv, strlen(*argv));
+}
+
+static int hash_content(fingerprint_t *fingerprint, int fd)
+{
+	char *const buffer = malloc(READ_BUFFER_SIZE);
+	if (!buffer)
+		return -1;
+
+	for (;;) {
+		const ssize_t amount = read(fd, buffer, READ_BUFFER_SIZE);
+		if (amount < 0 && errno == EINTR)
+			continue;
+		if (amount < 0) {
+			free(buffer);
+			return -1;
+		}
+		if (amount == 0)
+			break;
+		hash_bytes(fingerprint, buffer, (size_t)amount);
+	}
+
+	free(buffer);
+	return 0;
+}
+
+int scallop_lang_cache_add_file(
+	fingerprint_t *fingerprint,
+	const char *path,
+	enum scallop_lang_cache_file_mode mode
+)
+{
+	hash_field(fingerprint, 'f', path, strlen(path));
+
+	const int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		if (errno != ENOENT && errno != ENOTDIR)
+			return -1;
+		hash_field(fingerprint, '-', NULL, 0);
+		return 0;
+	}
+
+	struct stat info = { 0 };
+	if (fstat(fd, &info)) {
+		close(fd);
+		return -1;
+	}
+
+	const int64_t size = (int64_t)info.st_size;
+	hash_field(fingerprint, 's', &size, sizeof(size));
+
+	int result = 0;
+	if (mode == SCALLOP_LANG_CACHE_CONTENT) {
+		hash_field(fingerprint, 'c', NULL, 0);
+		result = hash_content(fingerprint, fd);
+	} else {
+		const int64_t mtime[2] = {
+			(int64_t)info.st_mtim.tv_sec,
+			(int64_t)info.st_mtim.tv_nsec,
+		};
+		hash_field(fingerprint, 'm', mtime, sizeof(mtime));
+	}
+
+	close(fd);
+	return result;
+}
+
+void scallop_lang_cache_add_variable(
+	fingerprint_t *fingerprint,
+	const char *name,
+	const char *value
+)
+{
+	hash_field(fingerprint, 'v', name, strlen(name));
+	if (value)
+		hash_field(fingerprint, '=', value, strlen(value));
+	else
+		hash_field(fingerprint, '-', NULL, 0);
+}
+
+/*
+ * Storage
+ */
+
+int scallop_lang_cache_open(cache_t *cache, const char *directory)
+{
+	*cache = (cache_t) { 0 };
+	if (mkdir(directory, 0700) && errno != EEXIST)
+		return -1;
+
+	cache->directory = strdup(directory);
+	return cache->directory ? 0 : -1;
+}
+
+static int entry_path(const cache_t *cache, fingerprint_t fingerprint, char *path, size_t size)
+{
+	const int length = snprintf(
+		path,
+		size,
+		"%s/%016llx",
+		cache->directory,
+		(unsigned long long)fingerprint.hash
+	);
+	if (length < 0 || (size_t)length >= size) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	return 0;
+}
+
+static int read_all(int fd, char *buffer, size_t length)
+{
+	while (length) {
+		const ssize_t amount = read(fd, buffer, length);
+		if (amount < 0 && errno == EINTR)
+			continue;
+		if (amount <= 0)
+			return -1;
+		buffer += amount;
+		length -= (size_t)amount;
+	}
+	return 0;
+}
+
+static int write_all(int fd, const char *buffer, size_t length)
+{
+	while (length) {
+		const ssize_t amount = write(fd, buffer, length);
+		if (amount < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buffer += amount;
+		length -= (size_t)amount;
+	}
+	return 0;
+}
+
+int scallop_lang_cache_lookup(
+	const cache_t *cache,
+	fingerprint_t fingerprint,
+	entry_t *out
+)
+{
+	*out = (entry_t) { 0 };
+
+	char path[PATH_MAX];
+	if (entry_path(cache, fingerprint, path, sizeof(path)))
+		return -1;
+
+	const int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return errno == ENOENT ? 0 : -1;
+
+	struct stat info = { 0 };
+	if (fstat(fd, &info)) {
+		close(fd);
+		return -1;
+	}
+
+	// Damaged entries, and entries of another fingerprint whose
+	// hash collides with this one, count as misses, and are
+	// replaced by the next store
+	header_t header = { 0 };
+	const uint64_t size = (uint64_t)info.st_size;
+	const bool valid = size >= sizeof(header)
+		&& read_all(fd, (char *)&header, sizeof(header)) == 0
+		&& memcmp(header.magic, entry_magic, sizeof(entry_magic)) == 0
+		&& header.check == fingerprint.check
+		&& header.out_length <= size - sizeof(header)
+		&& header.err_length == size - sizeof(header) - header.out_length;
+	if (!valid) {
+		close(fd);
+		return 0;
+	}
+
+	out->status = header.status;
+	out->out_length = (size_t)header.out_length;
+	out->err_length = (size_t)header.err_length;
+	out->out = malloc(out->out_length + 1);
+	out->err = malloc(out->err_length + 1);
+	if (!out->out || !out->err) {
+		close(fd);
+		scallop_lang_cache_entry_free(out);
+		return -1;
+	}
+
+	const bool complete = read_all(fd, out->out, out->out_length) == 0
+		&& read_all(fd, out->err, out->err_length) == 0;
+	close(fd);
+	if (!complete) {
+		scallop_lang_cache_entry_free(out);
+		return 0;
+	}
+
+	out->out[out->out_length] = '\0';
+	out->err[out->err_length] = '\0';
+	return 1;
+}
+
+int scallop_lang_cache_store(
+	const cache_t *cache,
+	fingerprint_t fingerprint,
+	const entry_t *entry
+)
+{
+	if (entry->status != 0)
+		return 0;
+
+	char path[PATH_MAX];
+	char temporary[PATH_MAX + 8];
+	if (entry_path(cache, fingerprint, path, sizeof(path)))
+		return -1;
+	snprintf(temporary, sizeof(temporary), "%s.XXXXXX", path);
+
+	const int fd = mkstemp(temporary);
+	if (fd < 0)
+		return -1;
+
+	header_t header = {
+		.status = entry->status,
+		.check = fingerprint.check,
+		.out_length = entry->out_length,
+		.err_length = entry->err_length,
+	};
+	memcpy(header.magic, entry_magic, sizeof(entry_magic));
+
+	const bool written = write_all(fd, (const char *)&header, sizeof(header)) == 0
+		&& write_all(fd, entry->out, entry->out_length) == 0
+		&& write_all(fd, entry->err, entry->err_length) == 0;
+	if (close(fd) || !written || rename(temporary, path)) {
+		unlink(temporary);
+		return -1;
+	}
+	return 0;
+}
+
+int scallop_lang_cache_replay(const entry_t *entry, int out, int err)
+{
+	if (write_all(out, entry->out, entry->out_length))
+		return -1;
+	return write_all(err, entry->err, entry->err_length);
+}
+
+void scallop_lang_cache_entry_free(entry_t *entry)
+{
+	free(entry->out);
+	free(entry->err);
+	*entry = (entry_t) { 0 };
+}
+
+void scallop_lang_cache_close(cache_t *cache)
+{
+	free(cache->directory);
+	*cache = (cache_t) { 0 };
+}
@@ -20,6 +20,8 @@ typedef enum {
 	CLASS_BEGIN_SQUARE_BLOCK,
 	CLASS_END_SQUARE_BLOCK,
 	CLASS_LINE_COMMENT,
+	CLASS_GLOB,
+	CLASS_VARIABLE,
 
 	CLASS_UNKNOWN,
 } CHARACTER_CLASS;
@@ -66,6 +68,11 @@ static CHARACTER_CLASS get_class(wint_t c)
 			return CLASS_END_SQUARE_BLOCK;
 		case L'#':
 			return CLASS_LINE_COMMENT;
+		case L'*':
+		case L'?':
+			return CLASS_GLOB;
+		case L'$':
+			return CLASS_VARIABLE;
 		case WEOF:
 			return CLASS_EOF;
 	}
@@ -100,6 +107,10 @@ static classifier_fn *default_context(wint_t input)
 			return scallop_lang_classifier_square_block;
 		case CLASS_END_SQUARE_BLOCK:
 			return scallop_lang_classifier_square_block_end;
+		case CLASS_GLOB:
+			return scallop_lang_classifier_glob;
+		case CLASS_VARIABLE:
+			return scallop_lang_classifier_variable;
 		default:
 			return scallop_lang_classifier_unexpected;
 	}
@@ -126,11 +137,18 @@ static classifier_fn *double_quote_context(wint_t input)
 			return scallop_lang_classifier_unexpected;
 		case CLASS_DOUBLE_QUOTE:
 			return scallop_lang_classifier_double_quote_end;
+		case CLASS_VARIABLE:
+			return scallop_lang_classifier_double_quote_variable;
 		default:
 			return scallop_lang_classifier_double_quote_word;
 	}
 }
 
+static bool is_variable_name(wint_t c)
+{
+	return c != WEOF && (iswalnum(c) || c == L'_');
+}
+
 static void_fn *classifier_end_impl(wint_t c)
 {
 	(void)c;
@@ -238,6 +256,40 @@ void_fn *scallop_lang_classifier_square_block_end(wint_t input)
 	return (void_fn *)default_context(input);
 }
 
+void_fn *scallop_lang_classifier_glob(wint_t input)
+{
+	return (void_fn *)default_context(input);
+}
+
+void_fn *scallop_lang_classifier_variable(wint_t input)
+{
+	if (!is_variable_name(input))
+		return (void_fn *)scallop_lang_classifier_unexpected;
+	return (void_fn *)scallop_lang_classifier_variable_name;
+}
+
+void_fn *scallop_lang_classifier_variable_name(wint_t input)
+{
+	if (is_variable_name(input))
+		return (void_fn *)scallop_lang_classifier_variable_name;
+	return (void_fn *)default_context(input);
+}
+
+void_fn *scallop_lang_classifier_double_quote_variable(wint_t input)
+{
+	// Without a name, the '$' is just part of the string
+	if (!is_variable_name(input))
+		return (void_fn *)double_quote_context(input);
+	return (void_fn *)scallop_lang_classifier_double_quote_variable_name;
+}
+
+void_fn *scallop_lang_classifier_double_quote_variable_name(wint_t input)
+{
+	if (is_variable_name(input))
+		return (void_fn *)scallop_lang_classifier_double_quote_variable_name;
+	return (void_fn *)double_quote_context(input);
+}
+
 void_fn *scallop_lang_classifier_line_comment(wint_t input)
 {
 	// We have to treat input specially here, since
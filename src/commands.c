@@ -0,0 +1,488 @@
+// For O_PATH and execvpe()
+#define _GNU_SOURCE
+
+#include "scallop-lang/commands.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+typedef struct scallop_lang_commands commands_t;
+typedef struct scallop_lang_commands_command command_t;
+typedef struct scallop_lang_commands_entry entry_t;
+
+// The search path execvp(3) uses without $PATH
+#define DEFAULT_PATH "/bin:/usr/bin"
+
+#define INITIAL_BUCKETS 64
+
+// The changes to a directory that can make a name in it resolve
+// differently
+#define WATCH_MASK ( \
+	IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO \
+	| IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR \
+)
+
+// The events after which nothing in a directory can be trusted
+#define FORGET_ALL_MASK (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)
+
+struct scallop_lang_commands_entry {
+	// First, so commands can be converted back to entries
+	command_t command;
+
+	atomic_size_t references;
+	entry_t *next;
+	uint32_t hash;
+
+	// 0 if the command was found, or the errno for looking it up
+	int error;
+
+	// The name, followed by the path if the command was found
+	char name[];
+};
+
+static void entry_reference(entry_t *entry)
+{
+	atomic_fetch_add_explicit(&entry->references, 1, memory_order_relaxed);
+}
+
+static void entry_release(entry_t *entry)
+{
+	if (atomic_fetch_sub_explicit(&entry->references, 1, memory_order_acq_rel) != 1)
+		return;
+	if (entry->command.fd >= 0)
+		close(entry->command.fd);
+	free(entry);
+}
+
+/*
+ * Searches the directories for a command, as execvp(3) does.
+ * Returns a new entry, which records the error if nothing was
+ * found, or NULL if it couldn't be allocated.
+ */
+static entry_t *resolve(const commands_t *commands, const char *name, uint32_t hash)
+{
+	const size_t name_length = strlen(name);
+	size_t longest = 0;
+	for (size_t i = 0; i < commands->_directories_length; i++) {
+		const size_t length = strlen(commands->_directories[i]);
+		if (length > longest)
+			longest = length;
+	}
+
+	// Room for the name, then the longest path, which is "./NAME"
+	// for an empty directory
+	entry_t *const entry = malloc(
+		sizeof(*entry) + (name_length + 1) + (longest + 2 + name_length + 1)
+	);
+	if (!entry)
+		return NULL;
+	*entry = (entry_t) {
+		.command = { .fd = -1 },
+		.hash = hash,
+		.error = ENOENT,
+	};
+	atomic_init(&entry->references, 1);
+	memcpy(entry->name, name, name_length + 1);
+
+	char *const path = entry->name + name_length + 1;
+	for (size_t i = 0; i < commands->_directories_length; i++) {
+		// An empty directory is the working directory
+		const char *const directory = commands->_directories[i][0]
+			? commands->_directories[i]
+			: ".";
+		const size_t directory_length = strlen(directory);
+		memcpy(path, directory, directory_length);
+		path[directory_length] = '/';
+		memcpy(path + directory_length + 1, name, name_length + 1);
+
+		const int fd = open(path, O_PATH | O_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EACCES)
+				entry->error = EACCES;
+			continue;
+		}
+
+		struct stat info = { 0 };
+		const bool executable = !fstat(fd, &info)
+			&& S_ISREG(info.st_mode)
+			&& !faccessat(AT_FDCWD, path, X_OK, AT_EACCESS);
+		if (!executable) {
+			// Like execvp(3), keep looking, but report this
+			// if nothing else is found
+			close(fd);
+			entry->error = EACCES;
+			continue;
+		}
+
+		entry->command.path = path;
+		entry->command.fd = fd;
+		entry->error = 0;
+		break;
+	}
+	return entry;
+}
+
+// Must be called with the cache locked
+static entry_t *lookup(const commands_t *commands, const char *name, uint32_t hash)
+{
+	entry_t *entry = commands->_buckets[hash & (commands->_buckets_length - 1)];
+	for (; entry; entry = entry->next)
+		if (entry->hash == hash && strcmp(entry->name, name) == 0)
+			return entry;
+	return NULL;
+}
+
+// Must be called with the cache locked for writing
+static int grow(commands_t *commands)
+{
+	const size_t length = commands->_buckets_length * 2;
+	entry_t **const buckets = calloc(length, sizeof(*buckets));
+	if (!buckets)
+		return -1;
+
+	for (size_t i = 0; i < commands->_buckets_length; i++) {
+		for (entry_t *entry = commands->_buckets[i], *next; entry; entry = next) {
+			next = entry->next;
+			entry_t **const bucket = &buckets[entry->hash & (length - 1)];
+			entry->next = *bucket;
+			*bucket = entry;
+		}
+	}
+
+	free(commands->_buckets);
+	commands->_buckets = buckets;
+	commands->_buckets_length = length;
+	return 0;
+}
+
+// Must be called with the cache locked for writing
+static int insert(commands_t *commands, entry_t *entry)
+{
+	const bool full = commands->_length + 1 > commands->_buckets_length / 4 * 3;
+	if (full && grow(commands))
+		return -1;
+
+	entry_t **const bucket = &commands->_buckets[
+		entry->hash & (commands->_buckets_length - 1)
+	];
+	entry->next = *bucket;
+	*bucket = entry;
+	commands->_length++;
+	entry_reference(entry);
+	return 0;
+}
+
+// Must be called with the cache locked for writing
+static void forget(commands_t *commands, const char *name)
+{
+	const uint32_t hash = _scallop_hash(name, strlen(name));
+	entry_t **link = &commands->_buckets[hash & (commands->_buckets_length - 1)];
+	for (; *link; link = &(*link)->next) {
+		entry_t *const entry = *link;
+		if (entry->hash == hash && strcmp(entry->name, name) == 0) {
+			*link = entry->next;
+			commands->_length--;
+			commands->_generation++;
+			entry_release(entry);
+			return;
+		}
+	}
+}
+
+// Must be called with the cache locked for writing
+static void forget_all(commands_t *commands)
+{
+	for (size_t i = 0; i < commands->_buckets_length; i++) {
+		for (entry_t *entry = commands->_buckets[i], *next; entry; entry = next) {
+			next = entry->next;
+			entry_release(entry);
+		}
+		commands->_buckets[i] = NULL;
+	}
+	commands->_length = 0;
+	commands->_generation++;
+}
+
+static int watch(const commands_t *commands, size_t i)
+{
+	const char *const directory = commands->_directories[i];
+	return inotify_add_watch(
+		commands->_inotify,
+		directory[0] ? directory : ".",
+		WATCH_MASK
+	);
+}
+
+/*
+ * True if a directory should be watched but isn't, because it
+ * didn't exist or was removed. Must be called with the cache locked.
+ */
+static bool any_unwatched(const commands_t *commands)
+{
+	if (commands->_inotify < 0)
+		return false;
+	for (size_t i = 0; i < commands->_directories_length; i++)
+		if (commands->_watches[i] < 0)
+			return true;
+	return false;
+}
+
+/*
+ * Watches the directories that aren't watched, if they exist now.
+ * Nothing cached can be trusted once one does, since it may hold
+ * commands that weren't seen. Must be called with the cache locked
+ * for writing.
+ */
+static void watch_unwatched(commands_t *commands)
+{
+	if (commands->_inotify < 0)
+		return;
+
+	bool added = false;
+	for (size_t i = 0; i < commands->_directories_length; i++) {
+		if (commands->_watches[i] < 0) {
+			commands->_watches[i] = watch(commands, i);
+			added = added || commands->_watches[i] >= 0;
+		}
+	}
+	if (added)
+		forget_all(commands);
+}
+
+static const command_t *result(entry_t *entry)
+{
+	if (!entry->error)
+		return &entry->command;
+	errno = entry->error;
+	entry_release(entry);
+	return NULL;
+}
+
+int scallop_lang_commands_init(commands_t *commands, const char *path)
+{
+	*commands = (commands_t) { ._inotify = -1 };
+	if (!path)
+		path = DEFAULT_PATH;
+
+	const int error = pthread_rwlock_init(&commands->_lock, NULL);
+	if (error) {
+		errno = error;
+		return -1;
+	}
+
+	size_t count = 1;
+	for (const char *c = path; *c; c++)
+		count += *c == ':';
+
+	commands->_buckets = calloc(INITIAL_BUCKETS, sizeof(*commands->_buckets));
+	commands->_directories = calloc(count, sizeof(*commands->_directories));
+	commands->_watches = calloc(count, sizeof(*commands->_watches));
+	if (!commands->_buckets || !commands->_directories || !commands->_watches)
+		goto error;
+	commands->_buckets_length = INITIAL_BUCKETS;
+
+	for (const char *directory = path;;) {
+		const size_t length = strcspn(directory, ":");
+		char *const copy = strndup(directory, length);
+		if (!copy)
+			goto error;
+		commands->_directories[commands->_directories_length++] = copy;
+		if (!directory[length])
+			break;
+		directory += length + 1;
+	}
+
+	// Without inotify, the cache still works until it's reset
+	commands->_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	for (size_t i = 0; i < commands->_directories_length; i++)
+		commands->_watches[i] = commands->_inotify < 0 ? -1 : watch(commands, i);
+	return 0;
+
+error:
+	scallop_lang_commands_free(commands);
+	errno = ENOMEM;
+	return -1;
+}
+
+const command_t *scallop_lang_commands_find(commands_t *commands, const char *name)
+{
+	if (!name[0] || strchr(name, '/')) {
+		errno = EINVAL;
+		return NULL;
+	}
+	const uint32_t hash = _scallop_hash(name, strlen(name));
+
+	pthread_rwlock_rdlock(&commands->_lock);
+	entry_t *entry = lookup(commands, name, hash);
+	if (entry)
+		entry_reference(entry);
+	uint64_t generation = commands->_generation;
+	const bool unwatched = any_unwatched(commands);
+	pthread_rwlock_unlock(&commands->_lock);
+
+	if (entry)
+		return result(entry);
+
+	// A directory that was missing may have been created since,
+	// and nothing would tell us about it
+	if (unwatched) {
+		pthread_rwlock_wrlock(&commands->_lock);
+		watch_unwatched(commands);
+		generation = commands->_generation;
+		pthread_rwlock_unlock(&commands->_lock);
+	}
+
+	// Searched without the lock, so lookups of cached commands
+	// aren't held up by it
+	entry = resolve(commands, name, hash);
+	if (!entry)
+		return NULL;
+
+	pthread_rwlock_wrlock(&commands->_lock);
+	entry_t *const existing = lookup(commands, name, hash);
+	if (existing) {
+		entry_reference(existing);
+		entry_release(entry);
+		entry = existing;
+	} else if (generation == commands->_generation) {
+		// A command that wasn't found may yet be created in a
+		// directory that isn't watched, so it's looked up again
+		// every time until they all are. If inserting fails, the
+		// command just isn't cached.
+		if (!entry->error || !any_unwatched(commands))
+			insert(commands, entry);
+	}
+	pthread_rwlock_unlock(&commands->_lock);
+	return result(entry);
+}
+
+void scallop_lang_commands_release(const command_t *command)
+{
+	if (command)
+		entry_release((entry_t *)command);
+}
+
+int scallop_lang_commands_exec(
+	const command_t *command,
+	char *const argv[],
+	char *const envp[]
+)
+{
+	fexecve(command->fd, argv, envp);
+
+	// Interpreters can't open a script through a descriptor that's
+	// closed on exec, and files that aren't executable formats are
+	// run by the shell. execvpe() handles both by path, which
+	// always contains '/', so $PATH isn't searched again.
+	if (errno == ENOENT || errno == ENOEXEC)
+		execvpe(command->path, argv, envp);
+	return -1;
+}
+
+const command_t *scallop_lang_commands_prepare(commands_t *commands, char *const argv[])
+{
+	if (!commands || strchr(argv[0], '/'))
+		return NULL;
+	return scallop_lang_commands_find(commands, argv[0]);
+}
+
+int scallop_lang_commands_run(
+	const command_t *command,
+	char *const argv[],
+	char *const envp[]
+)
+{
+	if (command)
+		return scallop_lang_commands_exec(command, argv, envp);
+	execvpe(argv[0], argv, envp);
+	return -1;
+}
+
+int scallop_lang_commands_fd(const commands_t *commands)
+{
+	return commands->_inotify;
+}
+
+int scallop_lang_commands_update(commands_t *commands)
+{
+	if (commands->_inotify < 0)
+		return 0;
+
+	_Alignas(struct inotify_event) char buffer[4096];
+	for (;;) {
+		const ssize_t amount = read(commands->_inotify, buffer, sizeof(buffer));
+		if (amount < 0 && errno == EINTR)
+			continue;
+		if (amount < 0 && errno != EAGAIN)
+			return -1;
+
+		if (amount < 0) {
+			// Directories that were replaced rather than removed,
+			// or created since, can be watched again
+			pthread_rwlock_wrlock(&commands->_lock);
+			watch_unwatched(commands);
+			pthread_rwlock_unlock(&commands->_lock);
+			return 0;
+		}
+
+		pthread_rwlock_wrlock(&commands->_lock);
+		for (ssize_t offset = 0; offset < amount;) {
+			const struct inotify_event *const event = (const void *)(buffer + offset);
+			offset += (ssize_t)(sizeof(*event) + event->len);
+
+			if (event->mask & IN_MOVE_SELF) {
+				// The watch follows the directory to its new
+				// name, which isn't on the path, and then
+				// reports IN_IGNORED
+				inotify_rm_watch(commands->_inotify, event->wd);
+			}
+			if (event->mask & IN_IGNORED) {
+				for (size_t i = 0; i < commands->_directories_length; i++)
+					if (commands->_watches[i] == event->wd)
+						commands->_watches[i] = -1;
+			}
+
+			// Changes to the directory itself have no name
+			if ((event->mask & FORGET_ALL_MASK) || !event->len)
+				forget_all(commands);
+			else
+				forget(commands, event->name);
+		}
+		pthread_rwlock_unlock(&commands->_lock);
+	}
+}
+
+void scallop_lang_commands_reset(commands_t *commands)
+{
+	pthread_rwlock_wrlock(&commands->_lock);
+	forget_all(commands);
+	pthread_rwlock_unlock(&commands->_lock);
+}
+
+void scallop_lang_commands_free(commands_t *commands)
+{
+	if (commands->_buckets)
+		forget_all(commands);
+	free(commands->_buckets);
+
+	if (commands->_directories)
+		for (size_t i = 0; i < commands->_directories_length; i++)
+			free(commands->_directories[i]);
+	free(commands->_directories);
+	free(commands->_watches);
+
+	if (commands->_inotify >= 0)
+		close(commands->_inotify);
+	pthread_rwlock_destroy(&commands->_lock);
+	*commands = (commands_t) { ._inotify = -1 };
+}
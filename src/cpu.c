@@ -0,0 +1,405 @@
+#include "scallop-lang/cpu.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_X86 1
+#include <immintrin.h>
+#define TARGET(features) __attribute__((target(features)))
+#endif
+
+typedef struct scallop_lang_cpu_kernels kernels_t;
+typedef enum scallop_lang_cpu_tier tier_t;
+
+static const char *const tier_names[] = {
+	[SCALLOP_LANG_CPU_GENERIC] = "generic",
+	[SCALLOP_LANG_CPU_SSE2] = "sse2",
+	[SCALLOP_LANG_CPU_SSE42] = "sse4.2",
+	[SCALLOP_LANG_CPU_AVX2] = "avx2",
+	[SCALLOP_LANG_CPU_AVX512] = "avx512",
+};
+
+#define TIERS (sizeof(tier_names) / sizeof(*tier_names))
+
+/*
+ * Generic
+ */
+
+static bool is_alpha(unsigned char c)
+{
+	return (unsigned char)((c | 0x20) - 'a') < 26;
+}
+
+static bool is_word(unsigned char c)
+{
+	// '-', '.', '/', the digits and ':' are contiguous
+	return is_alpha(c) || (c >= '-' && c <= ':') || c == '_';
+}
+
+static bool is_name(unsigned char c)
+{
+	return is_alpha(c) || (c >= '0' && c <= '9') || c == '_';
+}
+
+static size_t word_length_generic(const char *text, size_t length)
+{
+	size_t i = 0;
+	while (i < length && is_word((unsigned char)text[i]))
+		i++;
+	return i;
+}
+
+static size_t name_length_generic(const char *text, size_t length)
+{
+	size_t i = 0;
+	while (i < length && is_name((unsigned char)text[i]))
+		i++;
+	return i;
+}
+
+static size_t scan_generic(const char *text, size_t length, char first, char second)
+{
+	size_t i = 0;
+	for (; i < length; i++) {
+		const unsigned char c = (unsigned char)text[i];
+		if (c == 0 || c >= 0x80 || c == (unsigned char)first || c == (unsigned char)second)
+			break;
+	}
+	return i;
+}
+
+#ifdef CPU_X86
+
+/*
+ * SSE2
+ *
+ * Bytes are compared as signed, so anything that isn't ASCII is
+ * below every range.
+ */
+
+TARGET("sse2") static inline __m128i in_range_sse2(__m128i x, char low, char high)
+{
+	return _mm_and_si128(
+		_mm_cmpgt_epi8(x, _mm_set1_epi8((char)(low - 1))),
+		_mm_cmplt_epi8(x, _mm_set1_epi8((char)(high + 1)))
+	);
+}
+
+TARGET("sse2") static inline __m128i alpha_sse2(__m128i x)
+{
+	return in_range_sse2(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'z');
+}
+
+TARGET("sse2") static size_t word_length_sse2(const char *text, size_t length)
+{
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16) {
+		const __m128i x = _mm_loadu_si128((const __m128i *)(text + i));
+		const __m128i word = _mm_or_si128(
+			_mm_or_si128(alpha_sse2(x), in_range_sse2(x, '-', ':')),
+			_mm_cmpeq_epi8(x, _mm_set1_epi8('_'))
+		);
+		const unsigned mask = (unsigned)_mm_movemask_epi8(word);
+		if (mask != 0xffff)
+			return i + (size_t)__builtin_ctz(~mask);
+	}
+	return i + word_length_generic(text + i, length - i);
+}
+
+TARGET("sse2") static size_t name_length_sse2(const char *text, size_t length)
+{
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16) {
+		const __m128i x = _mm_loadu_si128((const __m128i *)(text + i));
+		const __m128i name = _mm_or_si128(
+			_mm_or_si128(alpha_sse2(x), in_range_sse2(x, '0', '9')),
+			_mm_cmpeq_epi8(x, _mm_set1_epi8('_'))
+		);
+		const unsigned mask = (unsigned)_mm_movemask_epi8(name);
+		if (mask != 0xffff)
+			return i + (size_t)__builtin_ctz(~mask);
+	}
+	return i + name_length_generic(text + i, length - i);
+}
+
+TARGET("sse2") static size_t scan_sse2(const char *text, size_t length, char first, char second)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i a = _mm_set1_epi8(first);
+	const __m128i b = _mm_set1_epi8(second);
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16) {
+		const __m128i x = _mm_loadu_si128((const __m128i *)(text + i));
+		const __m128i stop = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(x, a), _mm_cmpeq_epi8(x, b)),
+			_mm_cmpeq_epi8(x, zero)
+		);
+		// The sign bits of x mark bytes that aren't ASCII
+		const unsigned mask = (unsigned)(_mm_movemask_epi8(stop) | _mm_movemask_epi8(x));
+		if (mask)
+			return i + (size_t)__builtin_ctz(mask);
+	}
+	return i + scan_generic(text + i, length - i, first, second);
+}
+
+/*
+ * SSE4.2
+ *
+ * PCMPISTRI compares against character ranges directly. With
+ * negative polarity, the index is of the first byte outside every
+ * range, and a NUL ends the data, so it stops there too.
+ */
+
+#define RANGES_MODE (_SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT)
+
+TARGET("sse4.2") static size_t ranges_sse42(__m128i ranges, const char *text, size_t length)
+{
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16) {
+		const __m128i x = _mm_loadu_si128((const __m128i *)(text + i));
+		const int index = _mm_cmpistri(ranges, x, RANGES_MODE);
+		if (index < 16)
+			return i + (size_t)index;
+	}
+	return i;
+}
+
+TARGET("sse4.2") static size_t word_length_sse42(const char *text, size_t length)
+{
+	const __m128i ranges = _mm_setr_epi8(
+		'-', ':', 'A', 'Z', '_', '_', 'a', 'z',
+		0, 0, 0, 0, 0, 0, 0, 0
+	);
+	// A stop found in the blocks is also where the tail stops
+	const size_t i = ranges_sse42(ranges, text, length);
+	return i + word_length_generic(text + i, length - i);
+}
+
+TARGET("sse4.2") static size_t name_length_sse42(const char *text, size_t length)
+{
+	const __m128i ranges = _mm_setr_epi8(
+		'0', '9', 'A', 'Z', '_', '_', 'a', 'z',
+		0, 0, 0, 0, 0, 0, 0, 0
+	);
+	// A stop found in the blocks is also where the tail stops
+	const size_t i = ranges_sse42(ranges, text, length);
+	return i + name_length_generic(text + i, length - i);
+}
+
+TARGET("sse4.2") static size_t scan_sse42(const char *text, size_t length, char first, char second)
+{
+	// Every ASCII character but the two stops, as up to three
+	// ranges. A range whose low end is above its high end is empty.
+	const char low = first < second ? first : second;
+	const char high = first < second ? second : first;
+	const __m128i ranges = _mm_setr_epi8(
+		1, (char)(low - 1),
+		(char)(low + 1), (char)(high - 1),
+		(char)(high + 1), 0x7f,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+	);
+	// A stop found in the blocks is also where the tail stops
+	const size_t i = ranges_sse42(ranges, text, length);
+	return i + scan_generic(text + i, length - i, first, second);
+}
+
+/*
+ * AVX2
+ */
+
+TARGET("avx2") static inline __m256i in_range_avx2(__m256i x, char low, char high)
+{
+	return _mm256_and_si256(
+		_mm256_cmpgt_epi8(x, _mm256_set1_epi8((char)(low - 1))),
+		_mm256_cmpgt_epi8(_mm256_set1_epi8((char)(high + 1)), x)
+	);
+}
+
+TARGET("avx2") static inline __m256i alpha_avx2(__m256i x)
+{
+	return in_range_avx2(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), 'a', 'z');
+}
+
+TARGET("avx2") static size_t word_length_avx2(const char *text, size_t length)
+{
+	size_t i = 0;
+	for (; i + 32 <= length; i += 32) {
+		const __m256i x = _mm256_loadu_si256((const __m256i *)(text + i));
+		const __m256i word = _mm256_or_si256(
+			_mm256_or_si256(alpha_avx2(x), in_range_avx2(x, '-', ':')),
+			_mm256_cmpeq_epi8(x, _mm256_set1_epi8('_'))
+		);
+		const unsigned mask = (unsigned)_mm256_movemask_epi8(word);
+		if (mask != 0xffffffffu)
+			return i + (size_t)__builtin_ctz(~mask);
+	}
+	return i + word_length_generic(text + i, length - i);
+}
+
+TARGET("avx2") static size_t name_length_avx2(const char *text, size_t length)
+{
+	size_t i = 0;
+	for (; i + 32 <= length; i += 32) {
+		const __m256i x = _mm256_loadu_si256((const __m256i *)(text + i));
+		const __m256i name = _mm256_or_si256(
+			_mm256_or_si256(alpha_avx2(x), in_range_avx2(x, '0', '9')),
+			_mm256_cmpeq_epi8(x, _mm256_set1_epi8('_'))
+		);
+		const unsigned mask = (unsigned)_mm256_movemask_epi8(name);
+		if (mask != 0xffffffffu)
+			return i + (size_t)__builtin_ctz(~mask);
+	}
+	return i + name_length_generic(text + i, length - i);
+}
+
+TARGET("avx2") static size_t scan_avx2(const char *text, size_t length, char first, char second)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i a = _mm256_set1_epi8(first);
+	const __m256i b = _mm256_set1_epi8(second);
+	size_t i = 0;
+	for (; i + 32 <= length; i += 32) {
+		const __m256i x = _mm256_loadu_si256((const __m256i *)(text + i));
+		const __m256i stop = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(x, a), _mm256_cmpeq_epi8(x, b)),
+			_mm256_cmpeq_epi8(x, zero)
+		);
+		const unsigned mask = (unsigned)(_mm256_movemask_epi8(stop) | _mm256_movemask_epi8(x));
+		if (mask)
+			return i + (size_t)__builtin_ctz(mask);
+	}
+	return i + scan_generic(text + i, length - i, first, second);
+}
+
+/*
+ * AVX-512
+ *
+ * Comparisons produce bit masks directly, so no movemask is
+ * needed.
+ */
+
+TARGET("avx512f,avx512bw") static inline __mmask64 in_range_avx512(__m512i x, char low, char high)
+{
+	return _mm512_cmpgt_epi8_mask(x, _mm512_set1_epi8((char)(low - 1)))
+		& _mm512_cmplt_epi8_mask(x, _mm512_set1_epi8((char)(high + 1)));
+}
+
+TARGET("avx512f,avx512bw") static inline __mmask64 alpha_avx512(__m512i x)
+{
+	return in_range_avx512(_mm512_or_si512(x, _mm512_set1_epi8(0x20)), 'a', 'z');
+}
+
+TARGET("avx512f,avx512bw") static size_t word_length_avx512(const char *text, size_t length)
+{
+	size_t i = 0;
+	for (; i + 64 <= length; i += 64) {
+		const __m512i x = _mm512_loadu_si512((const void *)(text + i));
+		const __mmask64 word = alpha_avx512(x)
+			| in_range_avx512(x, '-', ':')
+			| _mm512_cmpeq_epi8_mask(x, _mm512_set1_epi8('_'));
+		if (~word)
+			return i + (size_t)__builtin_ctzll(~word);
+	}
+	return i + word_length_avx2(text + i, length - i);
+}
+
+TARGET("avx512f,avx512bw") static size_t name_length_avx512(const char *text, size_t length)
+{
+	size_t i = 0;
+	for (; i + 64 <= length; i += 64) {
+		const __m512i x = _mm512_loadu_si512((const void *)(text + i));
+		const __mmask64 name = alpha_avx512(x)
+			| in_range_avx512(x, '0', '9')
+			| _mm512_cmpeq_epi8_mask(x, _mm512_set1_epi8('_'));
+		if (~name)
+			return i + (size_t)__builtin_ctzll(~name);
+	}
+	return i + name_length_avx2(text + i, length - i);
+}
+
+TARGET("avx512f,avx512bw") static size_t scan_avx512(const char *text, size_t length, char first, char second)
+{
+	const __m512i a = _mm512_set1_epi8(first);
+	const __m512i b = _mm512_set1_epi8(second);
+	size_t i = 0;
+	for (; i + 64 <= length; i += 64) {
+		const __m512i x = _mm512_loadu_si512((const void *)(text + i));
+		const __mmask64 stop = _mm512_cmpeq_epi8_mask(x, a)
+			| _mm512_cmpeq_epi8_mask(x, b)
+			| _mm512_cmpeq_epi8_mask(x, _mm512_setzero_si512())
+			| _mm512_movepi8_mask(x);
+		if (stop)
+			return i + (size_t)__builtin_ctzll(stop);
+	}
+	return i + scan_avx2(text + i, length - i, first, second);
+}
+
+#endif // CPU_X86
+
+/*
+ * Dispatch
+ */
+
+static const kernels_t tiers[] = {
+	{ SCALLOP_LANG_CPU_GENERIC, word_length_generic, name_length_generic, scan_generic },
+#ifdef CPU_X86
+	{ SCALLOP_LANG_CPU_SSE2, word_length_sse2, name_length_sse2, scan_sse2 },
+	{ SCALLOP_LANG_CPU_SSE42, word_length_sse42, name_length_sse42, scan_sse42 },
+	{ SCALLOP_LANG_CPU_AVX2, word_length_avx2, name_length_avx2, scan_avx2 },
+	{ SCALLOP_LANG_CPU_AVX512, word_length_avx512, name_length_avx512, scan_avx512 },
+#endif
+};
+
+struct scallop_lang_cpu_kernels scallop_lang_cpu = {
+	SCALLOP_LANG_CPU_GENERIC,
+	word_length_generic,
+	name_length_generic,
+	scan_generic,
+};
+
+tier_t scallop_lang_cpu_supported(void)
+{
+#ifdef CPU_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+		return SCALLOP_LANG_CPU_AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return SCALLOP_LANG_CPU_AVX2;
+	if (__builtin_cpu_supports("sse4.2"))
+		return SCALLOP_LANG_CPU_SSE42;
+	if (__builtin_cpu_supports("sse2"))
+		return SCALLOP_LANG_CPU_SSE2;
+#endif
+	return SCALLOP_LANG_CPU_GENERIC;
+}
+
+int scallop_lang_cpu_select(tier_t tier)
+{
+	if ((size_t)tier >= TIERS || tier > scallop_lang_cpu_supported()) {
+		errno = ENOTSUP;
+		return -1;
+	}
+	scallop_lang_cpu = tiers[tier];
+	return 0;
+}
+
+const char *scallop_lang_cpu_tier_name(tier_t tier)
+{
+	return (size_t)tier < TIERS ? tier_names[tier] : "unknown";
+}
+
+__attribute__((constructor)) static void cpu_init(void)
+{
+	tier_t tier = scallop_lang_cpu_supported();
+
+	// A tier the processor lacks falls back to the best it has
+	const char *const requested = getenv("SCALLOP_LANG_CPU");
+	for (size_t i = 0; requested && i < TIERS; i++)
+		if (strcmp(requested, tier_names[i]) == 0 && (tier_t)i < tier)
+			tier = (tier_t)i;
+
+	scallop_lang_cpu = tiers[tier];
+}
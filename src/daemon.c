@@ -0,0 +1,585 @@
+#include "scallop-lang/daemon.h"
+
+#include <errno.h>
+#include <langinfo.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "scallop-lang/lex.h"
+
+typedef struct scallop_lang_daemon_cache cache_t;
+typedef struct scallop_lang_daemon_request request_t;
+typedef struct scallop_lang_daemon_script script_t;
+typedef struct scallop_lang_batch_token token_t;
+
+#define REQUEST_MAGIC 0x53434c52u
+#define STATUS_MAGIC 0x53434c53u
+
+// The largest request accepted, to bound allocations
+#define PAYLOAD_MAX (16 * 1024 * 1024)
+
+// The working directory, then the standard file descriptors
+#define PASSED_FDS (SCALLOP_LANG_DAEMON_FDS + 1)
+
+typedef struct {
+	uint32_t magic;
+	uint32_t argc;
+	uint32_t envc;
+	uint32_t reserved;
+	uint64_t payload_length;
+} header_t;
+
+typedef struct {
+	uint32_t magic;
+	int32_t status;
+} status_t;
+
+static int read_all(int fd, char *buffer, size_t length)
+{
+	while (length) {
+		const ssize_t amount = read(fd, buffer, length);
+		if (amount < 0 && errno == EINTR)
+			continue;
+		if (amount < 0)
+			return -1;
+		if (amount == 0) {
+			errno = ECONNRESET;
+			return -1;
+		}
+		buffer += amount;
+		length -= (size_t)amount;
+	}
+	return 0;
+}
+
+static int write_all(int fd, const char *buffer, size_t length)
+{
+	while (length) {
+		const ssize_t amount = write(fd, buffer, length);
+		if (amount < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buffer += amount;
+		length -= (size_t)amount;
+	}
+	return 0;
+}
+
+/*
+ * Protocol
+ */
+
+static size_t strings_length(char *const strings[], size_t *count)
+{
+	size_t length = 0;
+	*count = 0;
+	for (; strings[*count]; (*count)++)
+		length += strlen(strings[*count]) + 1;
+	return length;
+}
+
+static char *strings_copy(char *cursor, char *const strings[], size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		const size_t length = strlen(strings[i]) + 1;
+		memcpy(cursor, strings[i], length);
+		cursor += length;
+	}
+	return cursor;
+}
+
+int scallop_lang_daemon_send_request(
+	int socket,
+	char *const argv[],
+	char *const envp[],
+	const char *cwd,
+	int cwd_fd,
+	const int fds[SCALLOP_LANG_DAEMON_FDS]
+)
+{
+	size_t argc = 0, envc = 0;
+	const size_t argv_length = strings_length(argv, &argc);
+	const size_t envp_length = strings_length(envp, &envc);
+	const size_t cwd_length = strlen(cwd) + 1;
+	const size_t payload_length = argv_length + envp_length + cwd_length;
+	if (payload_length > PAYLOAD_MAX) {
+		errno = E2BIG;
+		return -1;
+	}
+
+	char *const payload = malloc(payload_length);
+	if (!payload)
+		return -1;
+	char *cursor = strings_copy(payload, argv, argc);
+	cursor = strings_copy(cursor, envp, envc);
+	memcpy(cursor, cwd, cwd_length);
+
+	header_t header = {
+		.magic = REQUEST_MAGIC,
+		.argc = (uint32_t)argc,
+		.envc = (uint32_t)envc,
+		.payload_length = payload_length,
+	};
+
+	// The descriptors travel with the header
+	union {
+		struct cmsghdr header;
+		char buffer[CMSG_SPACE(sizeof(int) * PASSED_FDS)];
+	} control = { 0 };
+	struct iovec vector = {
+		.iov_base = &header,
+		.iov_len = sizeof(header),
+	};
+	struct msghdr message = {
+		.msg_iov = &vector,
+		.msg_iovlen = 1,
+		.msg_control = control.buffer,
+		.msg_controllen = sizeof(control.buffer),
+	};
+
+	struct cmsghdr *const cmsg = CMSG_FIRSTHDR(&message);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * PASSED_FDS);
+	int passed[PASSED_FDS] = { cwd_fd };
+	memcpy(passed + 1, fds, sizeof(int) * SCALLOP_LANG_DAEMON_FDS);
+	memcpy(CMSG_DATA(cmsg), passed, sizeof(passed));
+
+	ssize_t sent = 0;
+	do {
+		sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+	} while (sent < 0 && errno == EINTR);
+
+	const bool success = sent >= 0
+		&& write_all(
+			socket,
+			(const char *)&header + sent,
+			sizeof(header) - (size_t)sent
+		) == 0
+		&& write_all(socket, payload, payload_length) == 0;
+	free(payload);
+	return success ? 0 : -1;
+}
+
+/*
+ * Splits count null-terminated strings from the payload into a
+ * null-terminated array pointing into it.
+ */
+static char **strings_split(char **cursor, const char *end, size_t count)
+{
+	char **const strings = calloc(count + 1, sizeof(*strings));
+	if (!strings)
+		return NULL;
+
+	for (size_t i = 0; i < count; i++) {
+		char *const terminator = memchr(*cursor, '\0', (size_t)(end - *cursor));
+		if (!terminator) {
+			free(strings);
+			errno = EPROTO;
+			return NULL;
+		}
+		strings[i] = *cursor;
+		*cursor = terminator + 1;
+	}
+	return strings;
+}
+
+int scallop_lang_daemon_receive_request(int socket, request_t *out)
+{
+	*out = (request_t) { .cwd_fd = -1 };
+	for (size_t i = 0; i < SCALLOP_LANG_DAEMON_FDS; i++)
+		out->fds[i] = -1;
+
+	header_t header = { 0 };
+	union {
+		struct cmsghdr header;
+		char buffer[CMSG_SPACE(sizeof(int) * PASSED_FDS)];
+	} control = { 0 };
+	struct iovec vector = {
+		.iov_base = &header,
+		.iov_len = sizeof(header),
+	};
+	struct msghdr message = {
+		.msg_iov = &vector,
+		.msg_iovlen = 1,
+		.msg_control = control.buffer,
+		.msg_controllen = sizeof(control.buffer),
+	};
+
+	ssize_t received = 0;
+	do {
+		received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+	} while (received < 0 && errno == EINTR);
+	if (received <= 0) {
+		if (received == 0)
+			errno = ECONNRESET;
+		return -1;
+	}
+
+	// Descriptors that aren't the expected set are closed, so
+	// a malformed request can't leak them
+	bool has_fds = false;
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+	for (; cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		if (!has_fds && cmsg->cmsg_len == CMSG_LEN(sizeof(int) * PASSED_FDS)) {
+			int passed[PASSED_FDS];
+			memcpy(passed, CMSG_DATA(cmsg), sizeof(passed));
+			out->cwd_fd = passed[0];
+			memcpy(out->fds, passed + 1, sizeof(out->fds));
+			has_fds = true;
+			continue;
+		}
+
+		const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (size_t i = 0; i < count; i++) {
+			int fd = -1;
+			memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(fd));
+			close(fd);
+		}
+	}
+
+	const bool valid = has_fds
+		&& !(message.msg_flags & MSG_CTRUNC)
+		&& read_all(
+			socket,
+			(char *)&header + received,
+			sizeof(header) - (size_t)received
+		) == 0
+		&& header.magic == REQUEST_MAGIC
+		&& header.argc > 0
+		&& header.payload_length <= PAYLOAD_MAX
+		// Every string takes at least its terminator
+		&& (uint64_t)header.argc + header.envc < header.payload_length;
+	if (!valid)
+		goto error_protocol;
+
+	out->_payload = malloc(header.payload_length);
+	if (!out->_payload)
+		goto error;
+	if (read_all(socket, out->_payload, header.payload_length))
+		goto error;
+
+	char *cursor = out->_payload;
+	const char *const end = out->_payload + header.payload_length;
+	out->argv = strings_split(&cursor, end, header.argc);
+	if (!out->argv)
+		goto error;
+	out->argc = header.argc;
+	out->envp = strings_split(&cursor, end, header.envc);
+	if (!out->envp)
+		goto error;
+
+	// The rest is the working directory path
+	if (cursor == end || end[-1] != '\0')
+		goto error_protocol;
+	out->cwd = cursor;
+	return 0;
+
+error_protocol:
+	errno = EPROTO;
+error:
+	scallop_lang_daemon_request_free(out);
+	return -1;
+}
+
+void scallop_lang_daemon_request_free(request_t *request)
+{
+	free(request->argv);
+	free(request->envp);
+	free(request->_payload);
+	if (request->cwd_fd >= 0)
+		close(request->cwd_fd);
+	for (size_t i = 0; i < SCALLOP_LANG_DAEMON_FDS; i++)
+		if (request->fds[i] >= 0)
+			close(request->fds[i]);
+	*request = (request_t) { .cwd_fd = -1 };
+	for (size_t i = 0; i < SCALLOP_LANG_DAEMON_FDS; i++)
+		request->fds[i] = -1;
+}
+
+int scallop_lang_daemon_send_status(int socket, int status)
+{
+	const status_t message = {
+		.magic = STATUS_MAGIC,
+		.status = status,
+	};
+	return write_all(socket, (const char *)&message, sizeof(message));
+}
+
+int scallop_lang_daemon_receive_status(int socket, int *status)
+{
+	status_t message = { 0 };
+	if (read_all(socket, (char *)&message, sizeof(message)))
+		return -1;
+	if (message.magic != STATUS_MAGIC) {
+		errno = EPROTO;
+		return -1;
+	}
+	*status = message.status;
+	return 0;
+}
+
+/*
+ * Script cache
+ */
+
+int scallop_lang_daemon_cache_init(cache_t *cache)
+{
+	*cache = (cache_t) {
+		.max_scripts = SCALLOP_LANG_DAEMON_CACHE_SCRIPTS,
+		.max_bytes = SCALLOP_LANG_DAEMON_CACHE_BYTES,
+	};
+	return pthread_mutex_init(&cache->_mutex, NULL) ? -1 : 0;
+}
+
+static void script_free(script_t *script)
+{
+	free((void *)script->script.buffer);
+	free(script->tokens);
+	free(script->_codeset);
+	free(script);
+}
+
+// Must be called with the cache locked
+static void script_unreference(script_t *script)
+{
+	if (--script->_references == 0)
+		script_free(script);
+}
+
+static size_t script_bytes(const script_t *script)
+{
+	return (size_t)script->script.length
+		+ script->tokens_length * sizeof(*script->tokens);
+}
+
+/*
+ * Drops the least recently used scripts that only the cache holds,
+ * until it's within its limits or every script left is in use.
+ * Must be called with the cache locked.
+ */
+static void evict(cache_t *cache)
+{
+	while (
+		cache->_scripts_length > cache->max_scripts
+		|| cache->_bytes > cache->max_bytes
+	) {
+		size_t oldest = cache->_scripts_length;
+		for (size_t i = 0; i < cache->_scripts_length; i++) {
+			const script_t *const script = cache->_scripts[i];
+			const bool older = oldest == cache->_scripts_length
+				|| script->_used < cache->_scripts[oldest]->_used;
+			if (script->_references == 1 && older)
+				oldest = i;
+		}
+		if (oldest == cache->_scripts_length)
+			return;
+
+		script_t *const script = cache->_scripts[oldest];
+		cache->_bytes -= script_bytes(script);
+		cache->_scripts[oldest] = cache->_scripts[--cache->_scripts_length];
+		script_unreference(script);
+	}
+}
+
+static int read_script(int fd, size_t size, char **out)
+{
+	char *const text = malloc(size ? size : 1);
+	if (!text)
+		return -1;
+
+	size_t length = 0;
+	while (length < size) {
+		const ssize_t amount = pread(fd, text + length, size - length, (off_t)length);
+		if (amount < 0 && errno == EINTR)
+			continue;
+		if (amount < 0) {
+			free(text);
+			return -1;
+		}
+		// The file shrank while reading, so the size is stale
+		if (amount == 0) {
+			free(text);
+			errno = EAGAIN;
+			return -1;
+		}
+		length += (size_t)amount;
+	}
+
+	*out = text;
+	return 0;
+}
+
+static int lex_script(script_t *script, bool raw)
+{
+	size_t capacity = 0;
+	struct scallop_lang_lex token = scallop_lang_lex_init(script->script);
+	for (;;) {
+		token = raw
+			? scallop_lang_lex_next_raw(token)
+			: scallop_lang_lex_next(token);
+
+		if (script->tokens_length == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			token_t *const tokens = realloc(script->tokens, capacity * sizeof(*tokens));
+			if (!tokens)
+				return -1;
+			script->tokens = tokens;
+		}
+
+		script->tokens[script->tokens_length++] = (token_t) {
+			.type = token.type,
+			.offset = (size_t)(
+				(const char *)token.value.buffer
+				- (const char *)script->script.buffer
+			),
+			.length = (size_t)token.value.length,
+		};
+
+		const bool last = token.type == scallop_lang_classifier_end
+			|| token.type == scallop_lang_classifier_unexpected;
+		if (last)
+			return 0;
+	}
+}
+
+static bool same_file(const script_t *script, const struct stat *info, bool raw, const char *codeset)
+{
+	return script->_device == info->st_dev
+		&& script->_inode == info->st_ino
+		&& script->_raw == raw
+		&& strcmp(script->_codeset, codeset) == 0;
+}
+
+static bool same_version(const script_t *script, const struct stat *info)
+{
+	return script->_size == info->st_size
+		&& script->_mtime.tv_sec == info->st_mtim.tv_sec
+		&& script->_mtime.tv_nsec == info->st_mtim.tv_nsec;
+}
+
+const script_t *scallop_lang_daemon_cache_get(cache_t *cache, int fd, bool raw)
+{
+	struct stat info = { 0 };
+	if (fstat(fd, &info))
+		return NULL;
+	if (!S_ISREG(info.st_mode)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	const char *const codeset = nl_langinfo(CODESET);
+
+	pthread_mutex_lock(&cache->_mutex);
+	for (size_t i = 0; i < cache->_scripts_length; i++) {
+		script_t *const script = cache->_scripts[i];
+		if (same_file(script, &info, raw, codeset) && same_version(script, &info)) {
+			script->_references++;
+			script->_used = ++cache->_clock;
+			pthread_mutex_unlock(&cache->_mutex);
+			return script;
+		}
+	}
+	pthread_mutex_unlock(&cache->_mutex);
+
+	// Lex without holding the lock, so other scripts can be served
+	script_t *const script = calloc(1, sizeof(*script));
+	if (!script)
+		return NULL;
+	*script = (script_t) {
+		._device = info.st_dev,
+		._inode = info.st_ino,
+		._size = info.st_size,
+		._mtime = info.st_mtim,
+		._raw = raw,
+		._codeset = strdup(codeset),
+		// One for the cache, one for the caller
+		._references = 2,
+	};
+
+	char *text = NULL;
+	if (!script->_codeset || read_script(fd, (size_t)info.st_size, &text)) {
+		script_free(script);
+		return NULL;
+	}
+	script->script = (struct libadt_const_lptr) {
+		.buffer = text,
+		.size = 1,
+		.length = (ssize_t)info.st_size,
+	};
+	if (lex_script(script, raw)) {
+		script_free(script);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&cache->_mutex);
+	if (script_bytes(script) > cache->max_bytes) {
+		script->_references = 1;
+		pthread_mutex_unlock(&cache->_mutex);
+		return script;
+	}
+
+	size_t i = 0;
+	for (; i < cache->_scripts_length; i++)
+		if (same_file(cache->_scripts[i], &info, raw, codeset))
+			break;
+
+	if (i == cache->_scripts_length) {
+		if (cache->_scripts_length == cache->_scripts_capacity) {
+			const size_t capacity = cache->_scripts_capacity
+				? cache->_scripts_capacity * 2
+				: 16;
+			script_t **const scripts = realloc(
+				cache->_scripts,
+				capacity * sizeof(*scripts)
+			);
+			if (!scripts) {
+				// Still usable, just not cached
+				script->_references = 1;
+				pthread_mutex_unlock(&cache->_mutex);
+				return script;
+			}
+			cache->_scripts = scripts;
+			cache->_scripts_capacity = capacity;
+		}
+		cache->_scripts_length++;
+	} else {
+		cache->_bytes -= script_bytes(cache->_scripts[i]);
+		script_unreference(cache->_scripts[i]);
+	}
+	cache->_scripts[i] = script;
+	cache->_bytes += script_bytes(script);
+	script->_used = ++cache->_clock;
+	evict(cache);
+	pthread_mutex_unlock(&cache->_mutex);
+	return script;
+}
+
+void scallop_lang_daemon_cache_release(cache_t *cache, const script_t *script)
+{
+	pthread_mutex_lock(&cache->_mutex);
+	script_unreference((script_t *)script);
+
+	// Scripts in use when the cache went over its limits can be
+	// dropped now
+	evict(cache);
+	pthread_mutex_unlock(&cache->_mutex);
+}
+
+void scallop_lang_daemon_cache_free(cache_t *cache)
+{
+	for (size_t i = 0; i < cache->_scripts_length; i++)
+		script_unreference(cache->_scripts[i]);
+	free(cache->_scripts);
+	pthread_mutex_destroy(&cache->_mutex);
+	*cache = (cache_t) { 0 };
+}
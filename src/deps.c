@@ -0,0 +1,649 @@
+#include "scallop-lang/deps.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scallop-lang/lex.h"
+#include "internal.h"
+
+typedef struct scallop_lang_deps_statement statement_t;
+typedef struct scallop_lang_deps_access access_t;
+typedef struct scallop_lang_deps_command command_t;
+
+typedef struct {
+	char **buffer;
+	size_t length;
+	size_t capacity;
+} words_t;
+
+static void words_clear(words_t *words)
+{
+	for (size_t i = 0; i < words->length; i++)
+		free(words->buffer[i]);
+	words->length = 0;
+}
+
+static int words_push(words_t *words, struct libadt_const_lptr word)
+{
+	const ssize_t length = scallop_lang_lex_normalize_word(
+		word,
+		(struct libadt_lptr) { 0 }
+	);
+	if (length < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (_scallop_grow(
+		(void **)&words->buffer,
+		&words->capacity,
+		words->length,
+		sizeof(*words->buffer)
+	))
+		return -1;
+
+	char *const result = calloc((size_t)length + 1, 1);
+	if (!result)
+		return -1;
+
+	scallop_lang_lex_normalize_word(
+		word,
+		(struct libadt_lptr) {
+			.buffer = result,
+			.size = 1,
+			.length = length,
+		}
+	);
+	words->buffer[words->length++] = result;
+	return 0;
+}
+
+/*
+ * True if word refers to a variable outside single quotes, or
+ * contains an unquoted glob, so the paths it names aren't known
+ * until the statement runs.
+ */
+static bool expands(struct libadt_const_lptr word)
+{
+	scallop_lang_classifier_fn
+		*current = (scallop_lang_classifier_fn *)scallop_lang_classifier_begin;
+	size_t read_amount = 0;
+	for (
+		;
+		libadt_const_lptr_in_bounds(word);
+		word = libadt_const_lptr_index(word, (ssize_t)read_amount)
+	) {
+		wchar_t c = 0;
+		read_amount = _scallop_decode(&c, word);
+		if (read_amount == (size_t)-1 || read_amount == (size_t)-2)
+			return true;
+
+		current = (scallop_lang_classifier_fn *)current((wint_t)c);
+		if (current == scallop_lang_classifier_variable
+			|| current == scallop_lang_classifier_double_quote_variable
+			|| current == scallop_lang_classifier_glob)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Joins word onto cwd if it's relative, then removes empty
+ * and "." components. ".." components are kept, since they
+ * can't be resolved without following symlinks.
+ */
+static char *file_name(const char *cwd, const char *word)
+{
+	const bool join = cwd && word[0] != '/';
+	const size_t length = strlen(word) + (join ? strlen(cwd) + 1 : 0);
+	char *const result = malloc(length + 1);
+	if (!result)
+		return NULL;
+
+	if (join) {
+		strcpy(result, cwd);
+		strcat(result, "/");
+		strcat(result, word);
+	} else {
+		strcpy(result, word);
+	}
+
+	const bool absolute = result[0] == '/';
+	char *write = result + absolute;
+	for (const char *read = result; *read;) {
+		while (*read == '/')
+			read++;
+
+		const char *const component = read;
+		while (*read && *read != '/')
+			read++;
+
+		const size_t component_length = (size_t)(read - component);
+		const bool skip = component_length == 0
+			|| (component_length == 1 && component[0] == '.');
+		if (skip)
+			continue;
+
+		if (write > result + absolute)
+			*write++ = '/';
+		memmove(write, component, component_length);
+		write += component_length;
+	}
+	*write = '\0';
+
+	return result;
+}
+
+static bool has_parent_component(const char *name)
+{
+	for (const char *c = strstr(name, ".."); c; c = strstr(c + 1, "..")) {
+		const bool starts = c == name || c[-1] == '/';
+		const bool ends = c[2] == '\0' || c[2] == '/';
+		if (starts && ends)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Files overlap if they're the same file, or one is a directory
+ * containing the other.
+ */
+static bool files_overlap(const char *a, const char *b)
+{
+	if (has_parent_component(a) || has_parent_component(b))
+		return true;
+	if ((a[0] == '/') != (b[0] == '/'))
+		return true;
+
+	const size_t a_length = strlen(a);
+	const size_t b_length = strlen(b);
+	const char *const shorter = a_length <= b_length ? a : b;
+	const char *const longer = a_length <= b_length ? b : a;
+	const size_t length = a_length <= b_length ? a_length : b_length;
+
+	if (strncmp(shorter, longer, length) != 0)
+		return false;
+
+	return length == 0
+		|| longer[length] == '\0'
+		|| longer[length] == '/'
+		|| shorter[length - 1] == '/';
+}
+
+static bool accesses_conflict(const access_t *a, const access_t *b)
+{
+	if (a->resource != b->resource)
+		return false;
+	if (!a->write && !b->write)
+		return false;
+
+	if (a->resource == SCALLOP_LANG_DEPS_VARIABLE)
+		return strcmp(a->name, b->name) == 0;
+	return files_overlap(a->name, b->name);
+}
+
+static bool depends(const statement_t *a, const statement_t *b)
+{
+	if (a->opaque || b->opaque)
+		return true;
+
+	for (size_t i = 0; i < a->accesses_length; i++)
+		for (size_t j = 0; j < b->accesses_length; j++)
+			if (accesses_conflict(&a->accesses[i], &b->accesses[j]))
+				return true;
+	return false;
+}
+
+static char role_of(const char *arguments, size_t index, size_t count)
+{
+	const char *const star = strchr(arguments, '*');
+	if (!star)
+		return index < strlen(arguments) ? arguments[index] : '-';
+
+	const size_t before = star > arguments
+		? (size_t)(star - arguments) - 1
+		: 0;
+	const char repeated = star > arguments ? star[-1] : '-';
+	const char *const after = star + 1;
+	const size_t after_length = strlen(after);
+
+	if (index < before)
+		return arguments[index];
+
+	const size_t from_end = count - 1 - index;
+	if (from_end < after_length)
+		return after[after_length - 1 - from_end];
+	return repeated;
+}
+
+static const command_t *find_command(
+	struct libadt_const_lptr commands,
+	const char *name
+)
+{
+	for (
+		;
+		libadt_const_lptr_in_bounds(commands);
+		commands = libadt_const_lptr_index(commands, 1)
+	) {
+		const command_t *const command = libadt_const_lptr_raw(commands);
+		if (strcmp(command->name, name) == 0)
+			return command;
+	}
+	return NULL;
+}
+
+static int add_access(
+	statement_t *statement,
+	size_t *capacity,
+	enum scallop_lang_deps_resource resource,
+	bool write,
+	char *name
+)
+{
+	if (!name)
+		return -1;
+
+	if (_scallop_grow(
+		(void **)&statement->accesses,
+		capacity,
+		statement->accesses_length,
+		sizeof(*statement->accesses)
+	)) {
+		free(name);
+		return -1;
+	}
+
+	statement->accesses[statement->accesses_length++] = (access_t) {
+		.resource = resource,
+		.write = write,
+		.name = name,
+	};
+	return 0;
+}
+
+static int describe_statement(
+	statement_t *statement,
+	const words_t *words,
+	struct libadt_const_lptr commands,
+	const char *cwd
+)
+{
+	if (statement->opaque)
+		return 0;
+
+	const command_t *const command = find_command(
+		commands,
+		words->buffer[0]
+	);
+	if (!command) {
+		statement->opaque = true;
+		return 0;
+	}
+
+	size_t capacity = 0;
+	const size_t count = words->length - 1;
+	for (size_t i = 0; i < count; i++) {
+		const char *const word = words->buffer[i + 1];
+		int error = 0;
+
+		switch (role_of(command->arguments, i, count)) {
+			case 'r':
+			case 'w':
+			case 'm':
+				error = add_access(
+					statement,
+					&capacity,
+					SCALLOP_LANG_DEPS_FILE,
+					role_of(command->arguments, i, count) != 'r',
+					file_name(cwd, word)
+				);
+				break;
+			case 'v':
+			case 'V':
+				error = add_access(
+					statement,
+					&capacity,
+					SCALLOP_LANG_DEPS_VARIABLE,
+					role_of(command->arguments, i, count) == 'V',
+					strdup(word)
+				);
+				break;
+			default:
+				break;
+		}
+
+		if (error)
+			return -1;
+	}
+	return 0;
+}
+
+static int link_statements(struct scallop_lang_deps *deps)
+{
+	for (size_t i = 0; i < deps->statements_length; i++) {
+		statement_t *const statement = &deps->statements[i];
+		size_t capacity = 0;
+
+		for (size_t j = 0; j < i; j++) {
+			if (!depends(&deps->statements[j], statement))
+				continue;
+
+			if (_scallop_grow(
+				(void **)&statement->predecessors,
+				&capacity,
+				statement->predecessors_length,
+				sizeof(*statement->predecessors)
+			))
+				return -1;
+			statement->predecessors[statement->predecessors_length++] = j;
+		}
+	}
+	return 0;
+}
+
+int scallop_lang_deps_analyze(
+	struct libadt_const_lptr script,
+	struct libadt_const_lptr commands,
+	const char *cwd,
+	struct scallop_lang_deps *out
+)
+{
+	*out = (struct scallop_lang_deps) { 0 };
+
+	size_t capacity = 0;
+	size_t depth = 0;
+	words_t words = { 0 };
+	statement_t current = { 0 };
+	const char *begin = NULL;
+	const char *end = NULL;
+	struct scallop_lang_lex lex = scallop_lang_lex_init(script);
+
+	for (;;) {
+		lex = scallop_lang_lex_next(lex);
+
+		if (lex.type == scallop_lang_classifier_unexpected) {
+			errno = EINVAL;
+			goto error;
+		}
+
+		const bool is_end = lex.type == scallop_lang_classifier_end;
+		const bool is_separator = is_end
+			|| (depth == 0
+				&& lex.type == scallop_lang_classifier_statement_separator);
+
+		if (is_separator) {
+			if (is_end && depth > 0) {
+				errno = EINVAL;
+				goto error;
+			}
+
+			if (begin) {
+				current.value = libadt_const_lptr_truncate(
+					libadt_const_lptr_index(
+						script,
+						begin - (const char *)script.buffer
+					),
+					(size_t)(end - begin)
+				);
+
+				if (_scallop_grow(
+					(void **)&out->statements,
+					&capacity,
+					out->statements_length,
+					sizeof(*out->statements)
+				))
+					goto error;
+				out->statements[out->statements_length++] = current;
+
+				if (describe_statement(
+					&out->statements[out->statements_length - 1],
+					&words,
+					commands,
+					cwd
+				))
+					goto error;
+			}
+
+			words_clear(&words);
+			current = (statement_t) { 0 };
+			begin = end = NULL;
+
+			if (is_end)
+				break;
+			continue;
+		}
+
+		const bool is_block = lex.type == scallop_lang_classifier_curly_block
+			|| lex.type == scallop_lang_classifier_square_block;
+		const bool is_block_end = lex.type == scallop_lang_classifier_curly_block_end
+			|| lex.type == scallop_lang_classifier_square_block_end;
+		const bool is_word = lex.type == scallop_lang_classifier_word;
+
+		if (is_block) {
+			depth += (size_t)lex.value.length;
+			current.opaque = true;
+		} else if (is_block_end) {
+			if ((size_t)lex.value.length > depth) {
+				errno = EINVAL;
+				goto error;
+			}
+			depth -= (size_t)lex.value.length;
+		} else if (is_word) {
+			if (depth == 0 && expands(lex.value))
+				current.opaque = true;
+			if (depth == 0 && !current.opaque && words_push(&words, lex.value))
+				goto error;
+		} else {
+			continue;
+		}
+
+		if (!begin)
+			begin = lex.value.buffer;
+		end = (const char *)lex.value.buffer + lex.value.length;
+	}
+
+	free(words.buffer);
+
+	const size_t length = out->statements_length;
+	out->order = calloc(length ? length : 1, sizeof(*out->order));
+	out->groups = calloc(length + 1, sizeof(*out->groups));
+	if (!out->order || !out->groups)
+		goto error_words_freed;
+
+	if (link_statements(out))
+		goto error_words_freed;
+
+	scallop_lang_deps_schedule(out, NULL);
+	return 0;
+
+error:
+	words_clear(&words);
+	free(words.buffer);
+error_words_freed:
+	scallop_lang_deps_free(out);
+	return -1;
+}
+
+void scallop_lang_deps_schedule(
+	struct scallop_lang_deps *deps,
+	const double *costs
+)
+{
+	deps->critical_path = 0;
+	deps->total_cost = 0;
+	deps->groups_length = 0;
+
+	for (size_t i = 0; i < deps->statements_length; i++) {
+		statement_t *const statement = &deps->statements[i];
+		double start = 0;
+		size_t group = 0;
+
+		for (size_t j = 0; j < statement->predecessors_length; j++) {
+			const statement_t *const predecessor
+				= &deps->statements[statement->predecessors[j]];
+			if (predecessor->finish > start)
+				start = predecessor->finish;
+			if (predecessor->group + 1 > group)
+				group = predecessor->group + 1;
+		}
+
+		statement->cost = costs ? costs[i] : 1;
+		statement->finish = start + statement->cost;
+		statement->group = group;
+
+		deps->total_cost += statement->cost;
+		if (statement->finish > deps->critical_path)
+			deps->critical_path = statement->finish;
+		if (group + 1 > deps->groups_length)
+			deps->groups_length = group + 1;
+	}
+
+	// Predecessors come first, so going backwards finishes each
+	// statement's chain before it's added to its predecessors
+	for (size_t i = 0; i < deps->statements_length; i++)
+		deps->statements[i].remaining = deps->statements[i].cost;
+	for (size_t i = deps->statements_length; i-- > 0;) {
+		const statement_t *const statement = &deps->statements[i];
+		for (size_t j = 0; j < statement->predecessors_length; j++) {
+			statement_t *const predecessor
+				= &deps->statements[statement->predecessors[j]];
+			const double remaining = predecessor->cost + statement->remaining;
+			if (remaining > predecessor->remaining)
+				predecessor->remaining = remaining;
+		}
+	}
+
+	// Counting sort of the statements by group, keeping
+	// statements within a group in script order
+	memset(deps->groups, 0, (deps->groups_length + 1) * sizeof(*deps->groups));
+	for (size_t i = 0; i < deps->statements_length; i++)
+		deps->groups[deps->statements[i].group + 1]++;
+	for (size_t i = 0; i < deps->groups_length; i++)
+		deps->groups[i + 1] += deps->groups[i];
+	for (size_t i = 0; i < deps->statements_length; i++) {
+		const size_t group = deps->statements[i].group;
+		deps->order[deps->groups[group]++] = i;
+	}
+	for (size_t i = deps->groups_length; i > 0; i--)
+		deps->groups[i] = deps->groups[i - 1];
+	deps->groups[0] = 0;
+}
+
+/*
+ * Tests if a ready statement should be placed before the best one
+ * found so far, when placing critical path first.
+ */
+static bool more_critical(const statement_t *statement, const statement_t *best)
+{
+	if (statement->remaining != best->remaining)
+		return statement->remaining > best->remaining;
+	return statement->cost > best->cost;
+}
+
+static int place(struct scallop_lang_deps *deps, size_t workers, bool critical)
+{
+	if (!workers) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	double *const free_at = calloc(workers, sizeof(*free_at));
+	bool *const placed = calloc(
+		deps->statements_length ? deps->statements_length : 1,
+		sizeof(*placed)
+	);
+	if (!free_at || !placed) {
+		free(free_at);
+		free(placed);
+		return -1;
+	}
+
+	deps->makespan = 0;
+	for (size_t count = 0; count < deps->statements_length; count++) {
+		size_t worker = 0;
+		for (size_t i = 1; i < workers; i++)
+			if (free_at[i] < free_at[worker])
+				worker = i;
+
+		// Prefer a statement which is ready by the time the worker
+		// is free, otherwise the one ready soonest: the first in
+		// script order, or the most critical
+		size_t best = deps->statements_length;
+		double best_ready = 0;
+		for (size_t i = 0; i < deps->statements_length; i++) {
+			if (placed[i])
+				continue;
+
+			const statement_t *const statement = &deps->statements[i];
+			bool runnable = true;
+			double ready = 0;
+			for (size_t j = 0; runnable && j < statement->predecessors_length; j++) {
+				const size_t p = statement->predecessors[j];
+				const statement_t *const predecessor = &deps->statements[p];
+				runnable = placed[p];
+				if (predecessor->start + predecessor->cost > ready)
+					ready = predecessor->start + predecessor->cost;
+			}
+			if (!runnable)
+				continue;
+
+			if (ready < free_at[worker])
+				ready = free_at[worker];
+			const bool better = best == deps->statements_length
+				|| ready < best_ready
+				|| (
+					critical
+					&& ready == best_ready
+					&& more_critical(statement, &deps->statements[best])
+				);
+			if (better) {
+				best = i;
+				best_ready = ready;
+			}
+			if (!critical && ready == free_at[worker])
+				break;
+		}
+
+		statement_t *const statement = &deps->statements[best];
+		statement->start = best_ready;
+		statement->worker = worker;
+		placed[best] = true;
+
+		free_at[worker] = statement->start + statement->cost;
+		if (free_at[worker] > deps->makespan)
+			deps->makespan = free_at[worker];
+	}
+
+	free(free_at);
+	free(placed);
+	return 0;
+}
+
+int scallop_lang_deps_place(struct scallop_lang_deps *deps, size_t workers)
+{
+	return place(deps, workers, false);
+}
+
+int scallop_lang_deps_place_critical(struct scallop_lang_deps *deps, size_t workers)
+{
+	return place(deps, workers, true);
+}
+
+void scallop_lang_deps_free(struct scallop_lang_deps *deps)
+{
+	for (size_t i = 0; i < deps->statements_length; i++) {
+		statement_t *const statement = &deps->statements[i];
+		for (size_t j = 0; j < statement->accesses_length; j++)
+			free(statement->accesses[j].name);
+		free(statement->accesses);
+		free(statement->predecessors);
+	}
+	free(deps->statements);
+	free(deps->order);
+	free(deps->groups);
+	*deps = (struct scallop_lang_deps) { 0 };
+}
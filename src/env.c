@@ -0,0 +1,626 @@
+#include "scallop-lang/env.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+typedef struct scallop_lang_env env_t;
+typedef struct scallop_lang_env_version version_t;
+
+// Each level of the trie is indexed by this many bits of the hash
+#define LEVEL_BITS 5
+#define LEVEL_MASK ((1u << LEVEL_BITS) - 1)
+
+/*
+ * Leaves, nodes and versions are shared between versions, and
+ * freed when the last reference to them is released.
+ */
+typedef struct {
+	atomic_size_t references;
+} counted_t;
+
+typedef struct leaf {
+	counted_t counted;
+	uint32_t hash;
+	size_t name_length;
+
+	// The next leaf with the same hash, which is rare enough that
+	// these chains are copied whenever they change
+	struct leaf *next;
+
+	// "NAME=VALUE", as it's passed in envp
+	char pair[];
+} leaf_t;
+
+typedef struct {
+	counted_t counted;
+
+	// The slots present, by hash bits, and which of those hold
+	// leaves rather than nodes
+	uint32_t present;
+	uint32_t leaves;
+
+	// The present slots, in order
+	void *slots[];
+} node_t;
+
+struct scallop_lang_env_version {
+	counted_t counted;
+	node_t *root;
+	size_t length;
+
+	// Built on first use
+	_Atomic(char **) envp;
+};
+
+/*
+ * References
+ */
+
+static void *retain(void *object)
+{
+	counted_t *const counted = object;
+	atomic_fetch_add_explicit(&counted->references, 1, memory_order_relaxed);
+	return object;
+}
+
+static bool drop(void *object)
+{
+	counted_t *const counted = object;
+	return atomic_fetch_sub_explicit(
+		&counted->references,
+		1,
+		memory_order_acq_rel
+	) == 1;
+}
+
+static void leaf_release(leaf_t *leaf)
+{
+	while (leaf && drop(leaf)) {
+		leaf_t *const next = leaf->next;
+		free(leaf);
+		leaf = next;
+	}
+}
+
+static unsigned slot_count(const node_t *node)
+{
+	return (unsigned)__builtin_popcount(node->present);
+}
+
+static void node_release(node_t *node)
+{
+	if (!node || !drop(node))
+		return;
+
+	unsigned position = 0;
+	for (unsigned index = 0; index <= LEVEL_MASK; index++) {
+		const uint32_t bit = 1u << index;
+		if (!(node->present & bit))
+			continue;
+		if (node->leaves & bit)
+			leaf_release(node->slots[position]);
+		else
+			node_release(node->slots[position]);
+		position++;
+	}
+	free(node);
+}
+
+/*
+ * Leaves
+ */
+
+static leaf_t *leaf_new(
+	uint32_t hash,
+	const char *name,
+	size_t name_length,
+	const char *value
+)
+{
+	const size_t value_length = strlen(value);
+	leaf_t *const leaf = malloc(sizeof(*leaf) + name_length + value_length + 2);
+	if (!leaf)
+		return NULL;
+
+	atomic_init(&leaf->counted.references, 1);
+	leaf->hash = hash;
+	leaf->name_length = name_length;
+	leaf->next = NULL;
+	memcpy(leaf->pair, name, name_length);
+	leaf->pair[name_length] = '=';
+	memcpy(leaf->pair + name_length + 1, value, value_length + 1);
+	return leaf;
+}
+
+static bool leaf_is(const leaf_t *leaf, const char *name, size_t name_length)
+{
+	return leaf->name_length == name_length
+		&& memcmp(leaf->pair, name, name_length) == 0;
+}
+
+static const leaf_t *chain_find(
+	const leaf_t *chain,
+	const char *name,
+	size_t name_length
+)
+{
+	for (; chain; chain = chain->next)
+		if (leaf_is(chain, name, name_length))
+			return chain;
+	return NULL;
+}
+
+/*
+ * Writes a chain without target, which must be in it, copying the
+ * leaves before it.
+ */
+static int chain_without(leaf_t *chain, const leaf_t *target, leaf_t **out)
+{
+	if (chain == target) {
+		*out = chain->next ? retain(chain->next) : NULL;
+		return 0;
+	}
+
+	const size_t size = sizeof(*chain) + strlen(chain->pair) + 1;
+	leaf_t *const copy = malloc(size);
+	if (!copy)
+		return -1;
+	memcpy(copy, chain, size);
+	atomic_init(&copy->counted.references, 1);
+
+	if (chain_without(chain->next, target, &copy->next)) {
+		free(copy);
+		return -1;
+	}
+	*out = copy;
+	return 0;
+}
+
+/*
+ * Nodes
+ */
+
+static unsigned slot_index(uint32_t hash, unsigned shift)
+{
+	return (hash >> shift) & LEVEL_MASK;
+}
+
+static unsigned slot_position(const node_t *node, uint32_t bit)
+{
+	return (unsigned)__builtin_popcount(node->present & (bit - 1));
+}
+
+static node_t *node_new(unsigned count)
+{
+	node_t *const node = malloc(sizeof(*node) + count * sizeof(*node->slots));
+	if (!node)
+		return NULL;
+	atomic_init(&node->counted.references, 1);
+	node->present = 0;
+	node->leaves = 0;
+	return node;
+}
+
+/*
+ * Copies a node with the slot at bit added, replaced or removed,
+ * retaining every other slot. A NULL slot removes it. The new
+ * slot's reference is taken over by the copy.
+ */
+static node_t *node_with(const node_t *node, uint32_t bit, void *slot, bool is_leaf)
+{
+	const bool had = node->present & bit;
+	const unsigned count = slot_count(node);
+	const unsigned position = slot_position(node, bit);
+	unsigned new_count = count;
+	if (slot && !had)
+		new_count++;
+	else if (!slot && had)
+		new_count--;
+
+	node_t *const copy = node_new(new_count);
+	if (!copy)
+		return NULL;
+	copy->present = slot ? node->present | bit : node->present & ~bit;
+	copy->leaves = slot && is_leaf ? node->leaves | bit : node->leaves & ~bit;
+
+	unsigned to = 0;
+	for (unsigned from = 0; from < count; from++) {
+		if (from == position) {
+			if (slot)
+				copy->slots[to++] = slot;
+			if (had)
+				continue;
+		}
+		copy->slots[to++] = retain(node->slots[from]);
+	}
+	if (slot && position == count)
+		copy->slots[to] = slot;
+	return copy;
+}
+
+/*
+ * Builds the node holding two leaves with different hashes which
+ * share every bit below shift.
+ */
+static node_t *node_of_pair(leaf_t *a, leaf_t *b, unsigned shift)
+{
+	const unsigned a_index = slot_index(a->hash, shift);
+	const unsigned b_index = slot_index(b->hash, shift);
+	if (a_index == b_index) {
+		node_t *const child = node_of_pair(a, b, shift + LEVEL_BITS);
+		if (!child)
+			return NULL;
+
+		node_t *const node = node_new(1);
+		if (!node) {
+			// The child holds the only references to a and b
+			retain(a);
+			retain(b);
+			node_release(child);
+			return NULL;
+		}
+		node->present = 1u << a_index;
+		node->slots[0] = child;
+		return node;
+	}
+
+	node_t *const node = node_new(2);
+	if (!node)
+		return NULL;
+	node->present = node->leaves = (1u << a_index) | (1u << b_index);
+	node->slots[a_index < b_index ? 0 : 1] = a;
+	node->slots[a_index < b_index ? 1 : 0] = b;
+	return node;
+}
+
+/*
+ * Returns a copy of the trie at node with leaf added, taking over
+ * the reference to leaf on success.
+ */
+static node_t *insert(const node_t *node, unsigned shift, leaf_t *leaf, bool *added)
+{
+	const uint32_t bit = 1u << slot_index(leaf->hash, shift);
+	if (!node) {
+		node_t *const result = node_new(1);
+		if (!result)
+			return NULL;
+		result->present = result->leaves = bit;
+		result->slots[0] = leaf;
+		*added = true;
+		return result;
+	}
+
+	if (!(node->present & bit)) {
+		*added = true;
+		return node_with(node, bit, leaf, true);
+	}
+
+	void *const slot = node->slots[slot_position(node, bit)];
+	if (!(node->leaves & bit)) {
+		node_t *const child = insert(slot, shift + LEVEL_BITS, leaf, added);
+		if (!child)
+			return NULL;
+
+		node_t *const result = node_with(node, bit, child, false);
+		if (!result) {
+			retain(leaf);
+			node_release(child);
+		}
+		return result;
+	}
+
+	leaf_t *const existing = slot;
+	if (existing->hash != leaf->hash) {
+		node_t *const child = node_of_pair(retain(existing), leaf, shift + LEVEL_BITS);
+		if (!child) {
+			leaf_release(existing);
+			return NULL;
+		}
+		*added = true;
+
+		node_t *const result = node_with(node, bit, child, false);
+		if (!result) {
+			retain(leaf);
+			node_release(child);
+		}
+		return result;
+	}
+
+	// The same hash: leaf replaces any leaf with its name, and
+	// goes in front of the others
+	const leaf_t *const replaced = chain_find(existing, leaf->pair, leaf->name_length);
+	*added = !replaced;
+	if (!replaced)
+		leaf->next = retain(existing);
+	else if (chain_without(existing, replaced, &leaf->next))
+		return NULL;
+
+	node_t *const result = node_with(node, bit, leaf, true);
+	if (!result) {
+		leaf_release(leaf->next);
+		leaf->next = NULL;
+	}
+	return result;
+}
+
+/*
+ * Writes a copy of the trie at node without target, which must be
+ * in it. The copy is NULL if it would be empty.
+ */
+static int erase(
+	const node_t *node,
+	unsigned shift,
+	const leaf_t *target,
+	node_t **out
+)
+{
+	const uint32_t bit = 1u << slot_index(target->hash, shift);
+	void *const slot = node->slots[slot_position(node, bit)];
+
+	void *replacement = NULL;
+	bool is_leaf = true;
+	if (node->leaves & bit) {
+		leaf_t *chain = NULL;
+		if (chain_without(slot, target, &chain))
+			return -1;
+		replacement = chain;
+	} else {
+		node_t *child = NULL;
+		if (erase(slot, shift + LEVEL_BITS, target, &child))
+			return -1;
+
+		// A child left with a single leaf is replaced by the leaf
+		const bool lift = child
+			&& slot_count(child) == 1
+			&& child->leaves == child->present;
+		if (lift) {
+			replacement = retain(child->slots[0]);
+			node_release(child);
+		} else {
+			replacement = child;
+			is_leaf = false;
+		}
+	}
+
+	if (!replacement && slot_count(node) == 1) {
+		*out = NULL;
+		return 0;
+	}
+
+	*out = node_with(node, bit, replacement, is_leaf);
+	if (!*out) {
+		if (is_leaf)
+			leaf_release(replacement);
+		else
+			node_release(replacement);
+		return -1;
+	}
+	return 0;
+}
+
+static const leaf_t *find(
+	const node_t *node,
+	uint32_t hash,
+	const char *name,
+	size_t name_length
+)
+{
+	for (unsigned shift = 0; node; shift += LEVEL_BITS) {
+		const uint32_t bit = 1u << slot_index(hash, shift);
+		if (!(node->present & bit))
+			return NULL;
+
+		void *const slot = node->slots[slot_position(node, bit)];
+		if (node->leaves & bit)
+			return chain_find(slot, name, name_length);
+		node = slot;
+	}
+	return NULL;
+}
+
+static void collect(const node_t *node, char **envp, size_t *length)
+{
+	unsigned position = 0;
+	for (unsigned index = 0; index <= LEVEL_MASK; index++) {
+		const uint32_t bit = 1u << index;
+		if (!(node->present & bit))
+			continue;
+
+		void *const slot = node->slots[position++];
+		if (!(node->leaves & bit)) {
+			collect(slot, envp, length);
+			continue;
+		}
+		for (leaf_t *leaf = slot; leaf; leaf = leaf->next)
+			envp[(*length)++] = leaf->pair;
+	}
+}
+
+/*
+ * Versions
+ */
+
+static version_t *version_new(node_t *root, size_t length)
+{
+	version_t *const version = malloc(sizeof(*version));
+	if (!version)
+		return NULL;
+	atomic_init(&version->counted.references, 1);
+	atomic_init(&version->envp, NULL);
+	version->root = root;
+	version->length = length;
+	return version;
+}
+
+static void version_release(version_t *version)
+{
+	if (!version || !drop(version))
+		return;
+	node_release(version->root);
+	free(atomic_load_explicit(&version->envp, memory_order_relaxed));
+	free(version);
+}
+
+/*
+ * Returns a copy of the trie at root with name set to value.
+ */
+static node_t *root_set(
+	const node_t *root,
+	const char *name,
+	size_t name_length,
+	const char *value,
+	bool *added
+)
+{
+	leaf_t *const leaf = leaf_new(_scallop_hash(name, name_length), name, name_length, value);
+	if (!leaf)
+		return NULL;
+
+	node_t *const result = insert(root, 0, leaf, added);
+	if (!result)
+		leaf_release(leaf);
+	return result;
+}
+
+/*
+ * Makes root the current version of env, replacing the last.
+ */
+static int replace_version(env_t *env, node_t *root, size_t length)
+{
+	version_t *const version = version_new(root, length);
+	if (!version) {
+		node_release(root);
+		return -1;
+	}
+	version_release(env->_version);
+	env->_version = version;
+	return 0;
+}
+
+int scallop_lang_env_init(env_t *env, char *const envp[])
+{
+	node_t *root = NULL;
+	size_t length = 0;
+	for (size_t i = 0; envp && envp[i]; i++) {
+		const char *const equals = strchr(envp[i], '=');
+		if (!equals || equals == envp[i])
+			continue;
+
+		bool added = false;
+		node_t *const next = root_set(
+			root,
+			envp[i],
+			(size_t)(equals - envp[i]),
+			equals + 1,
+			&added
+		);
+		if (!next) {
+			node_release(root);
+			return -1;
+		}
+		node_release(root);
+		root = next;
+		length += added;
+	}
+
+	env->_version = NULL;
+	return replace_version(env, root, length);
+}
+
+void scallop_lang_env_fork(const env_t *env, env_t *out)
+{
+	out->_version = retain(env->_version);
+}
+
+const char *scallop_lang_env_get(const env_t *env, const char *name)
+{
+	const size_t name_length = strlen(name);
+	const leaf_t *const leaf = find(
+		env->_version->root,
+		_scallop_hash(name, name_length),
+		name,
+		name_length
+	);
+	return leaf ? leaf->pair + leaf->name_length + 1 : NULL;
+}
+
+int scallop_lang_env_set(env_t *env, const char *name, const char *value)
+{
+	const size_t name_length = strlen(name);
+	if (!name_length || memchr(name, '=', name_length)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	bool added = false;
+	node_t *const root = root_set(env->_version->root, name, name_length, value, &added);
+	if (!root)
+		return -1;
+	return replace_version(env, root, env->_version->length + added);
+}
+
+int scallop_lang_env_unset(env_t *env, const char *name)
+{
+	const size_t name_length = strlen(name);
+	const leaf_t *const target = find(
+		env->_version->root,
+		_scallop_hash(name, name_length),
+		name,
+		name_length
+	);
+	if (!target)
+		return 0;
+
+	node_t *root = NULL;
+	if (erase(env->_version->root, 0, target, &root))
+		return -1;
+	return replace_version(env, root, env->_version->length - 1);
+}
+
+size_t scallop_lang_env_length(const env_t *env)
+{
+	return env->_version->length;
+}
+
+char *const *scallop_lang_env_envp(const env_t *env)
+{
+	version_t *const version = env->_version;
+	char **envp = atomic_load_explicit(&version->envp, memory_order_acquire);
+	if (envp)
+		return envp;
+
+	envp = malloc((version->length + 1) * sizeof(*envp));
+	if (!envp)
+		return NULL;
+
+	size_t length = 0;
+	if (version->root)
+		collect(version->root, envp, &length);
+	envp[length] = NULL;
+
+	// Another thread may have built it first
+	char **expected = NULL;
+	if (!atomic_compare_exchange_strong_explicit(
+		&version->envp,
+		&expected,
+		envp,
+		memory_order_acq_rel,
+		memory_order_acquire
+	)) {
+		free(envp);
+		return expected;
+	}
+	return envp;
+}
+
+void scallop_lang_env_free(env_t *env)
+{
+	version_release(env->_version);
+	env->_version = NULL;
+}
@@ -0,0 +1,459 @@
+#include "scallop-lang/events.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+typedef struct scallop_lang_events events_t;
+typedef struct scallop_lang_events_event event_t;
+typedef struct scallop_lang_events_watch watch_t;
+
+// The most epoll events taken in one system call
+#define EPOLL_BATCH 64
+
+typedef enum {
+	WATCH_CHILD,
+	WATCH_FD,
+	WATCH_TIMER,
+	WATCH_SIGNAL,
+} watch_kind;
+
+struct scallop_lang_events_watch {
+	watch_kind kind;
+	void *user;
+
+	// The pidfd, timerfd, signal pipe or user file descriptor,
+	// or -1 for a child without a pidfd
+	int fd;
+	pid_t pid;
+
+	watch_t *previous;
+	watch_t *next;
+};
+
+/*
+ * SIGCHLD fallback
+ */
+
+static int signal_pipe[2] = { -1, -1 };
+static int signal_error = 0;
+static pthread_once_t signal_once = PTHREAD_ONCE_INIT;
+
+static void on_child(int signal)
+{
+	(void)signal;
+	const int saved = errno;
+	const char byte = 0;
+	// A full pipe already has a wakeup pending
+	(void)!write(signal_pipe[1], &byte, 1);
+	errno = saved;
+}
+
+static void install_signal(void)
+{
+	if (pipe(signal_pipe)) {
+		signal_error = errno;
+		return;
+	}
+	for (int i = 0; i < 2; i++) {
+		fcntl(signal_pipe[i], F_SETFL, O_NONBLOCK);
+		fcntl(signal_pipe[i], F_SETFD, FD_CLOEXEC);
+	}
+
+	struct sigaction action = { 0 };
+	action.sa_handler = on_child;
+	action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigemptyset(&action.sa_mask);
+	if (sigaction(SIGCHLD, &action, NULL))
+		signal_error = errno;
+}
+
+static void drain(int fd)
+{
+	char buffer[256];
+	while (read(fd, buffer, sizeof(buffer)) > 0)
+		;
+}
+
+static int pidfd_open(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+	(void)pid;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/*
+ * Watches
+ */
+
+static watch_t *watch_add(
+	events_t *events,
+	watch_kind kind,
+	int fd,
+	uint32_t epoll_mask,
+	void *user
+)
+{
+	watch_t *const watch = calloc(1, sizeof(*watch));
+	if (!watch)
+		return NULL;
+
+	*watch = (watch_t) {
+		.kind = kind,
+		.user = user,
+		.fd = fd,
+		.next = events->_watches,
+	};
+
+	if (fd >= 0) {
+		struct epoll_event event = {
+			.events = epoll_mask,
+			.data.ptr = watch,
+		};
+		if (epoll_ctl(events->_epoll, EPOLL_CTL_ADD, fd, &event)) {
+			free(watch);
+			return NULL;
+		}
+	}
+
+	if (events->_watches)
+		events->_watches->previous = watch;
+	events->_watches = watch;
+	return watch;
+}
+
+static void watch_free(events_t *events, watch_t *watch)
+{
+	if (watch->previous)
+		watch->previous->next = watch->next;
+	else
+		events->_watches = watch->next;
+	if (watch->next)
+		watch->next->previous = watch->previous;
+
+	if (watch->fd >= 0) {
+		epoll_ctl(events->_epoll, EPOLL_CTL_DEL, watch->fd, NULL);
+		// The user's descriptor is left open
+		if (watch->kind != WATCH_FD && watch->kind != WATCH_SIGNAL)
+			close(watch->fd);
+	}
+	free(watch);
+}
+
+static void forget_child(events_t *events, watch_t *watch)
+{
+	for (size_t i = 0; i < events->_children_length; i++) {
+		if (events->_children[i] != watch)
+			continue;
+		events->_children[i] = events->_children[--events->_children_length];
+		return;
+	}
+}
+
+int scallop_lang_events_init(events_t *events, int flags)
+{
+	*events = (events_t) { 0 };
+	events->_epoll = epoll_create1(EPOLL_CLOEXEC);
+	if (events->_epoll < 0)
+		return -1;
+
+	events->_pidfd = !(flags & SCALLOP_LANG_EVENTS_NO_PIDFD);
+	if (events->_pidfd) {
+		// Probe with our own process, which always exists
+		const int fd = pidfd_open(getpid());
+		if (fd >= 0)
+			close(fd);
+		else
+			events->_pidfd = false;
+	}
+
+	if (!events->_pidfd) {
+		pthread_once(&signal_once, install_signal);
+		if (signal_error) {
+			errno = signal_error;
+			goto error;
+		}
+
+		events->_signal = watch_add(
+			events,
+			WATCH_SIGNAL,
+			signal_pipe[0],
+			EPOLLIN,
+			NULL
+		);
+		if (!events->_signal)
+			goto error;
+	}
+
+	return 0;
+
+error:
+	close(events->_epoll);
+	*events = (events_t) { 0 };
+	return -1;
+}
+
+watch_t *scallop_lang_events_add_child(events_t *events, pid_t pid, void *user)
+{
+	if (events->_pidfd) {
+		const int fd = pidfd_open(pid);
+		if (fd < 0)
+			return NULL;
+
+		watch_t *const watch = watch_add(events, WATCH_CHILD, fd, EPOLLIN, user);
+		if (!watch) {
+			close(fd);
+			return NULL;
+		}
+		watch->pid = pid;
+		return watch;
+	}
+
+	if (events->_children_length == events->_children_capacity) {
+		const size_t capacity = events->_children_capacity
+			? events->_children_capacity * 2
+			: 16;
+		watch_t **const children = realloc(
+			events->_children,
+			capacity * sizeof(*children)
+		);
+		if (!children)
+			return NULL;
+		events->_children = children;
+		events->_children_capacity = capacity;
+	}
+
+	watch_t *const watch = watch_add(events, WATCH_CHILD, -1, 0, user);
+	if (!watch)
+		return NULL;
+	watch->pid = pid;
+	events->_children[events->_children_length++] = watch;
+
+	// The child may have exited before it was added
+	events->_scan = true;
+	return watch;
+}
+
+watch_t *scallop_lang_events_add_fd(
+	events_t *events,
+	int fd,
+	uint32_t mask,
+	void *user
+)
+{
+	uint32_t epoll_mask = 0;
+	if (mask & SCALLOP_LANG_EVENTS_READ)
+		epoll_mask |= EPOLLIN;
+	if (mask & SCALLOP_LANG_EVENTS_WRITE)
+		epoll_mask |= EPOLLOUT;
+	return watch_add(events, WATCH_FD, fd, epoll_mask, user);
+}
+
+watch_t *scallop_lang_events_add_timer(
+	events_t *events,
+	uint64_t milliseconds,
+	void *user
+)
+{
+	const int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	// A zero it_value disarms the timer, so expire after 1ns instead
+	const struct itimerspec time = {
+		.it_value = {
+			.tv_sec = (time_t)(milliseconds / 1000),
+			.tv_nsec = milliseconds
+				? (long)(milliseconds % 1000) * 1000000
+				: 1,
+		},
+	};
+	if (timerfd_settime(fd, 0, &time, NULL)) {
+		close(fd);
+		return NULL;
+	}
+
+	watch_t *const watch = watch_add(events, WATCH_TIMER, fd, EPOLLIN, user);
+	if (!watch)
+		close(fd);
+	return watch;
+}
+
+void scallop_lang_events_remove(events_t *events, watch_t *watch)
+{
+	if (watch->kind == WATCH_CHILD && watch->fd < 0)
+		forget_child(events, watch);
+	watch_free(events, watch);
+}
+
+/*
+ * Waiting
+ */
+
+/*
+ * Checks every tracked child, without pidfds. Stops early if out
+ * is full, and scans again on the next wait.
+ */
+static size_t scan_children(events_t *events, event_t *out, size_t length)
+{
+	size_t count = 0;
+	events->_scan = false;
+	for (size_t i = 0; i < events->_children_length;) {
+		if (count == length) {
+			events->_scan = true;
+			break;
+		}
+
+		watch_t *const watch = events->_children[i];
+		int status = 0;
+		struct rusage usage = { 0 };
+		const pid_t result = wait4(watch->pid, &status, WNOHANG, &usage);
+		if (result == 0) {
+			i++;
+			continue;
+		}
+
+		out[count++] = (event_t) {
+			.type = SCALLOP_LANG_EVENTS_CHILD,
+			.user = watch->user,
+			.pid = watch->pid,
+			.status = result < 0 ? -1 : status,
+			.usage = usage,
+			.fd = -1,
+		};
+		// Replaces this entry, so i is checked again
+		scallop_lang_events_remove(events, watch);
+	}
+	return count;
+}
+
+static int64_t now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (int64_t)time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
+
+static bool convert(events_t *events, watch_t *watch, uint32_t ready, event_t *out)
+{
+	switch (watch->kind) {
+		case WATCH_FD:
+			*out = (event_t) {
+				.type = SCALLOP_LANG_EVENTS_FD,
+				.user = watch->user,
+				.fd = watch->fd,
+			};
+			if (ready & (EPOLLIN | EPOLLHUP | EPOLLERR))
+				out->ready |= SCALLOP_LANG_EVENTS_READ;
+			if (ready & EPOLLOUT)
+				out->ready |= SCALLOP_LANG_EVENTS_WRITE;
+			return true;
+		case WATCH_TIMER:
+			*out = (event_t) {
+				.type = SCALLOP_LANG_EVENTS_TIMER,
+				.user = watch->user,
+				.fd = -1,
+			};
+			watch_free(events, watch);
+			return true;
+		case WATCH_CHILD: {
+			int status = 0;
+			struct rusage usage = { 0 };
+			const pid_t result = wait4(watch->pid, &status, WNOHANG, &usage);
+			if (result == 0)
+				return false;
+			*out = (event_t) {
+				.type = SCALLOP_LANG_EVENTS_CHILD,
+				.user = watch->user,
+				.pid = watch->pid,
+				.status = result < 0 ? -1 : status,
+				.usage = usage,
+				.fd = -1,
+			};
+			watch_free(events, watch);
+			return true;
+		}
+		case WATCH_SIGNAL:
+			drain(watch->fd);
+			events->_scan = true;
+			return false;
+	}
+	return false;
+}
+
+ssize_t scallop_lang_events_wait(
+	events_t *events,
+	event_t *out,
+	size_t length,
+	int timeout
+)
+{
+	if (!length) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	size_t count = 0;
+	if (events->_scan)
+		count = scan_children(events, out, length);
+
+	const int64_t deadline = timeout > 0 ? now() + timeout : 0;
+	struct epoll_event ready[EPOLL_BATCH];
+	for (;;) {
+		const size_t space = length - count;
+		int remaining = timeout;
+		if (timeout > 0) {
+			const int64_t left = deadline - now();
+			remaining = left > 0 ? (int)left : 0;
+		}
+
+		const int amount = epoll_wait(
+			events->_epoll,
+			ready,
+			(int)(space < EPOLL_BATCH ? space : EPOLL_BATCH),
+			count ? 0 : remaining
+		);
+		if (amount < 0) {
+			if (errno == EINTR)
+				continue;
+			return count ? (ssize_t)count : -1;
+		}
+
+		for (int i = 0; i < amount; i++)
+			if (convert(events, ready[i].data.ptr, ready[i].events, &out[count]))
+				count++;
+
+		if (events->_scan && count < length)
+			count += scan_children(events, out + count, length - count);
+
+		// Wakeups that produced no events, such as a SIGCHLD for
+		// a child that isn't tracked, keep waiting
+		if (count || amount == 0 || remaining == 0)
+			return (ssize_t)count;
+	}
+}
+
+void scallop_lang_events_free(events_t *events)
+{
+	while (events->_watches)
+		watch_free(events, events->_watches);
+	free(events->_children);
+	if (events->_epoll >= 0)
+		close(events->_epoll);
+	*events = (events_t) { 0 };
+	events->_epoll = -1;
+}
@@ -0,0 +1,274 @@
+#include "scallop-lang/expand.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "scallop-lang/lex.h"
+#include "internal.h"
+
+typedef struct scallop_lang_expand_plan plan_t;
+typedef struct scallop_lang_expand_part part_t;
+
+typedef struct {
+	size_t text_capacity;
+	size_t parts_capacity;
+	size_t names_capacity;
+} capacities_t;
+
+/*
+ * Appends bytes to the last part, or starts a new part if
+ * the last one is of a different kind.
+ */
+static int push(
+	plan_t *plan,
+	capacities_t *capacities,
+	const char *bytes,
+	size_t length,
+	bool variable,
+	bool begin
+)
+{
+	const size_t text_length = plan->parts_length
+		? plan->parts[plan->parts_length - 1].offset
+			+ plan->parts[plan->parts_length - 1].length
+		: 0;
+
+	while (text_length + length > capacities->text_capacity) {
+		if (_scallop_grow(
+			(void **)&plan->text,
+			&capacities->text_capacity,
+			capacities->text_capacity,
+			1
+		))
+			return -1;
+	}
+	memcpy(plan->text + text_length, bytes, length);
+
+	part_t *const last = plan->parts_length
+		? &plan->parts[plan->parts_length - 1]
+		: NULL;
+	const bool extend = last
+		&& !begin
+		&& (last->slot >= 0) == variable;
+	if (extend) {
+		last->length += length;
+		return 0;
+	}
+
+	if (_scallop_grow(
+		(void **)&plan->parts,
+		&capacities->parts_capacity,
+		plan->parts_length,
+		sizeof(*plan->parts)
+	))
+		return -1;
+
+	plan->parts[plan->parts_length++] = (part_t) {
+		.offset = text_length,
+		.length = length,
+		// Resolved to a real slot once the names are known
+		.slot = variable ? 0 : -1,
+	};
+	return 0;
+}
+
+static int assign_slots(plan_t *plan, capacities_t *capacities)
+{
+	for (size_t i = 0; i < plan->parts_length; i++) {
+		part_t *const part = &plan->parts[i];
+		if (part->slot < 0) {
+			plan->literal_length += part->length;
+			continue;
+		}
+
+		const char *const name = plan->text + part->offset;
+		size_t slot = 0;
+		for (; slot < plan->names_length; slot++) {
+			const bool same = strlen(plan->names[slot]) == part->length
+				&& memcmp(plan->names[slot], name, part->length) == 0;
+			if (same)
+				break;
+		}
+
+		if (slot == plan->names_length) {
+			if (_scallop_grow(
+				(void **)&plan->names,
+				&capacities->names_capacity,
+				plan->names_length,
+				sizeof(*plan->names)
+			))
+				return -1;
+
+			char *const copy = malloc(part->length + 1);
+			if (!copy)
+				return -1;
+			memcpy(copy, name, part->length);
+			copy[part->length] = '\0';
+			plan->names[plan->names_length++] = copy;
+		}
+
+		part->slot = (ssize_t)slot;
+	}
+	return 0;
+}
+
+int scallop_lang_expand_compile(
+	struct libadt_const_lptr word,
+	plan_t *out
+)
+{
+	*out = (plan_t) { 0 };
+	capacities_t capacities = { 0 };
+
+	bool begin_variable = false;
+	const char *dollar = NULL;
+	scallop_lang_classifier_fn
+		*current = (scallop_lang_classifier_fn *)scallop_lang_classifier_begin;
+	for (
+		size_t read_amount = 0;
+		libadt_const_lptr_in_bounds(word);
+		word = libadt_const_lptr_index(word, (ssize_t)read_amount)
+	) {
+		wchar_t c = 0;
+		mbstate_t state = { 0 };
+		read_amount = _scallop_mbrtowc(&c, word, &state);
+
+		const bool read_error = read_amount == (size_t)-1
+			|| read_amount == (size_t)-2
+			|| read_amount == 0;
+		if (read_error)
+			goto error;
+
+		current = (scallop_lang_classifier_fn *)current((wint_t)c);
+		if (current == scallop_lang_classifier_unexpected)
+			goto error;
+
+		const bool variable = current == scallop_lang_classifier_variable_name
+			|| current == scallop_lang_classifier_double_quote_variable_name;
+
+		// A '$' in double quotes without a name is literal
+		if (begin_variable && !variable) {
+			if (push(out, &capacities, dollar, 1, false, false))
+				goto error_allocation;
+			begin_variable = false;
+		}
+
+		const bool skip_type = current == scallop_lang_classifier_single_quote
+			|| current == scallop_lang_classifier_single_quote_end
+			|| current == scallop_lang_classifier_double_quote
+			|| current == scallop_lang_classifier_double_quote_end
+			|| current == scallop_lang_classifier_escape;
+		if (skip_type)
+			continue;
+
+		const bool is_dollar = current == scallop_lang_classifier_variable
+			|| current == scallop_lang_classifier_double_quote_variable;
+		if (is_dollar) {
+			begin_variable = true;
+			dollar = word.buffer;
+			continue;
+		}
+
+		if (push(
+			out,
+			&capacities,
+			word.buffer,
+			read_amount,
+			variable,
+			begin_variable
+		))
+			goto error_allocation;
+		begin_variable = false;
+	}
+
+	const bool unterminated = current == scallop_lang_classifier_single_quote
+		|| current == scallop_lang_classifier_single_quote_word
+		|| current == scallop_lang_classifier_double_quote
+		|| current == scallop_lang_classifier_double_quote_word
+		|| current == scallop_lang_classifier_double_quote_variable_name
+		|| current == scallop_lang_classifier_escape
+		|| begin_variable;
+	if (unterminated)
+		goto error;
+
+	if (assign_slots(out, &capacities))
+		goto error_allocation;
+
+	return 0;
+
+error:
+	errno = EINVAL;
+error_allocation:
+	scallop_lang_expand_free(out);
+	return -1;
+}
+
+bool scallop_lang_expand_is_literal(const plan_t *plan)
+{
+	return plan->names_length == 0;
+}
+
+static size_t value_length(struct libadt_const_lptr value)
+{
+	if (!value.buffer || value.length < 0)
+		return 0;
+	return (size_t)value.length;
+}
+
+size_t scallop_lang_expand_length(
+	const plan_t *plan,
+	const struct libadt_const_lptr values[]
+)
+{
+	size_t length = plan->literal_length;
+	for (size_t i = 0; i < plan->parts_length; i++)
+		if (plan->parts[i].slot >= 0)
+			length += value_length(values[plan->parts[i].slot]);
+	return length;
+}
+
+char *scallop_lang_expand_apply(
+	const plan_t *plan,
+	const struct libadt_const_lptr values[],
+	size_t *length
+)
+{
+	const size_t total = scallop_lang_expand_length(plan, values);
+	char *const result = malloc(total + 1);
+	if (!result)
+		return NULL;
+
+	char *cursor = result;
+	for (size_t i = 0; i < plan->parts_length; i++) {
+		const part_t *const part = &plan->parts[i];
+		if (part->slot < 0) {
+			memcpy(cursor, plan->text + part->offset, part->length);
+			cursor += part->length;
+			continue;
+		}
+
+		const struct libadt_const_lptr value = values[part->slot];
+		const size_t amount = value_length(value);
+		if (amount)
+			memcpy(cursor, value.buffer, amount);
+		cursor += amount;
+	}
+	*cursor = '\0';
+
+	if (length)
+		*length = total;
+	return result;
+}
+
+void scallop_lang_expand_free(plan_t *plan)
+{
+	for (size_t i = 0; i < plan->names_length; i++)
+		free(plan->names[i]);
+	free(plan->names);
+	free(plan->parts);
+	free(plan->text);
+	*plan = (plan_t) { 0 };
+}
@@ -0,0 +1,625 @@
+#include "scallop-lang/glob.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "scallop-lang/lex.h"
+#include "internal.h"
+
+typedef struct scallop_lang_glob compiled_t;
+typedef struct scallop_lang_glob_component component_t;
+typedef struct scallop_lang_glob_matches matches_t;
+
+// Large enough to list most directories in one system call
+#define DIRENT_BUFFER_SIZE (64 * 1024)
+
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+// d_type values, from <dirent.h> without requiring _DEFAULT_SOURCE
+enum {
+	DIRENT_UNKNOWN = 0,
+	DIRENT_DIRECTORY = 4,
+	DIRENT_LINK = 10,
+};
+
+static char *join(const char *path, const char *name, size_t name_length)
+{
+	const size_t path_length = strlen(path);
+	const bool separator = path_length && path[path_length - 1] != '/';
+	char *const result = malloc(path_length + separator + name_length + 1);
+	if (!result)
+		return NULL;
+
+	memcpy(result, path, path_length);
+	if (separator)
+		result[path_length] = '/';
+	memcpy(result + path_length + separator, name, name_length);
+	result[path_length + separator + name_length] = '\0';
+	return result;
+}
+
+/*
+ * Compiling
+ */
+
+typedef struct {
+	char *text;
+	char *kinds;
+	size_t length;
+	size_t capacity;
+} pattern_t;
+
+static int pattern_push(pattern_t *pattern, const char *bytes, size_t length, char kind)
+{
+	for (size_t i = 0; i < length; i++) {
+		if (pattern->length == pattern->capacity) {
+			const size_t capacity = pattern->capacity
+				? pattern->capacity * 2
+				: 32;
+
+			char *const text = realloc(pattern->text, capacity);
+			if (!text)
+				return -1;
+			pattern->text = text;
+
+			char *const kinds = realloc(pattern->kinds, capacity);
+			if (!kinds)
+				return -1;
+			pattern->kinds = kinds;
+
+			pattern->capacity = capacity;
+		}
+
+		pattern->text[pattern->length] = bytes[i];
+		pattern->kinds[pattern->length] = kind;
+		pattern->length++;
+	}
+	return 0;
+}
+
+static int add_component(
+	compiled_t *glob,
+	size_t *capacity,
+	const pattern_t *pattern,
+	size_t begin,
+	size_t end
+)
+{
+	if (begin == end)
+		return 0;
+
+	bool literal = true;
+	for (size_t i = begin; i < end; i++)
+		literal = literal && !pattern->kinds[i];
+
+	if (_scallop_grow(
+		(void **)&glob->components,
+		capacity,
+		glob->components_length,
+		sizeof(*glob->components)
+	))
+		return -1;
+
+	component_t component = {
+		.text = malloc(end - begin + 1),
+		.kinds = malloc(end - begin + 1),
+		.length = end - begin,
+		.literal = literal,
+	};
+	if (!component.text || !component.kinds) {
+		free(component.text);
+		free(component.kinds);
+		return -1;
+	}
+
+	memcpy(component.text, pattern->text + begin, end - begin);
+	memcpy(component.kinds, pattern->kinds + begin, end - begin);
+	component.text[end - begin] = '\0';
+	component.kinds[end - begin] = 0;
+
+	glob->components[glob->components_length++] = component;
+	return 0;
+}
+
+/*
+ * Moves the leading literal components into the prefix.
+ */
+static int build_prefix(compiled_t *glob, bool absolute)
+{
+	size_t literal = 0;
+	while (
+		literal < glob->components_length
+		&& glob->components[literal].literal
+	)
+		literal++;
+
+	// Keep the last component, so there's always something to match
+	if (literal == glob->components_length && literal > 0)
+		literal--;
+
+	char *prefix = strdup(absolute ? "/" : "");
+	if (!prefix)
+		return -1;
+
+	for (size_t i = 0; i < literal; i++) {
+		component_t *const component = &glob->components[i];
+		char *const joined = join(prefix, component->text, component->length);
+		free(prefix);
+		if (!joined)
+			return -1;
+		prefix = joined;
+	}
+
+	for (size_t i = 0; i < literal; i++) {
+		free(glob->components[i].text);
+		free(glob->components[i].kinds);
+	}
+	memmove(
+		glob->components,
+		glob->components + literal,
+		(glob->components_length - literal) * sizeof(*glob->components)
+	);
+	glob->components_length -= literal;
+	glob->prefix = prefix;
+	return 0;
+}
+
+int scallop_lang_glob_compile(
+	struct libadt_const_lptr word,
+	compiled_t *out
+)
+{
+	*out = (compiled_t) { 0 };
+
+	pattern_t pattern = { 0 };
+	scallop_lang_classifier_fn
+		*current = (scallop_lang_classifier_fn *)scallop_lang_classifier_begin;
+	for (
+		size_t read_amount = 0;
+		libadt_const_lptr_in_bounds(word);
+		word = libadt_const_lptr_index(word, (ssize_t)read_amount)
+	) {
+		wchar_t c = 0;
+		mbstate_t state = { 0 };
+		read_amount = _scallop_mbrtowc(&c, word, &state);
+
+		const bool read_error = read_amount == (size_t)-1
+			|| read_amount == (size_t)-2
+			|| read_amount == 0;
+		if (read_error)
+			goto error;
+
+		current = (scallop_lang_classifier_fn *)current((wint_t)c);
+		if (current == scallop_lang_classifier_unexpected)
+			goto error;
+
+		const bool skip_type = current == scallop_lang_classifier_single_quote
+			|| current == scallop_lang_classifier_single_quote_end
+			|| current == scallop_lang_classifier_double_quote
+			|| current == scallop_lang_classifier_double_quote_end
+			|| current == scallop_lang_classifier_escape;
+		if (skip_type)
+			continue;
+
+		const char kind = current == scallop_lang_classifier_glob
+			? (char)c
+			: 0;
+		if (pattern_push(&pattern, word.buffer, read_amount, kind))
+			goto error_allocation;
+	}
+
+	const bool unterminated = current == scallop_lang_classifier_single_quote
+		|| current == scallop_lang_classifier_single_quote_word
+		|| current == scallop_lang_classifier_double_quote
+		|| current == scallop_lang_classifier_double_quote_word
+		|| current == scallop_lang_classifier_escape;
+	if (unterminated)
+		goto error;
+
+	const bool absolute = pattern.length && pattern.text[0] == '/' && !pattern.kinds[0];
+	size_t capacity = 0;
+	size_t begin = 0;
+	for (size_t i = 0; i <= pattern.length; i++) {
+		const bool boundary = i == pattern.length
+			|| (pattern.text[i] == '/' && !pattern.kinds[i]);
+		if (!boundary)
+			continue;
+
+		if (add_component(out, &capacity, &pattern, begin, i))
+			goto error_allocation;
+		begin = i + 1;
+	}
+
+	if (build_prefix(out, absolute))
+		goto error_allocation;
+
+	free(pattern.text);
+	free(pattern.kinds);
+	return 0;
+
+error:
+	errno = EINVAL;
+error_allocation:
+	free(pattern.text);
+	free(pattern.kinds);
+	scallop_lang_glob_free(out);
+	return -1;
+}
+
+bool scallop_lang_glob_is_literal(const compiled_t *glob)
+{
+	for (size_t i = 0; i < glob->components_length; i++)
+		if (!glob->components[i].literal)
+			return false;
+	return true;
+}
+
+/*
+ * Matching
+ */
+
+static size_t character_length(const char *name)
+{
+	mbstate_t state = { 0 };
+	const size_t length = mbrlen(name, MB_CUR_MAX, &state);
+	// Treat invalid sequences as single bytes
+	if (length == 0 || length > MB_CUR_MAX)
+		return 1;
+	return length;
+}
+
+bool scallop_lang_glob_match(const component_t *component, const char *name)
+{
+	const char *const text = component->text;
+	const char *const kinds = component->kinds;
+	const size_t length = component->length;
+
+	if (name[0] == '.' && length && kinds[0])
+		return false;
+
+	size_t pattern = 0;
+	size_t star_pattern = SIZE_MAX;
+	const char *star_name = NULL;
+	while (*name) {
+		if (pattern < length && kinds[pattern] == '*') {
+			star_pattern = ++pattern;
+			star_name = name;
+			continue;
+		}
+
+		if (pattern < length && kinds[pattern] == '?') {
+			name += character_length(name);
+			pattern++;
+			continue;
+		}
+
+		if (pattern < length && !kinds[pattern] && text[pattern] == *name) {
+			name++;
+			pattern++;
+			continue;
+		}
+
+		// Backtrack, letting the last star match one more character
+		if (star_pattern == SIZE_MAX)
+			return false;
+		pattern = star_pattern;
+		star_name += character_length(star_name);
+		name = star_name;
+	}
+
+	while (pattern < length && kinds[pattern] == '*')
+		pattern++;
+	return pattern == length;
+}
+
+/*
+ * Expanding
+ */
+
+typedef struct {
+	char *path;
+	size_t component;
+} work_t;
+
+typedef struct {
+	const compiled_t *glob;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t changed;
+	work_t *queue;
+	size_t queue_length;
+	size_t queue_capacity;
+	size_t active;
+	bool failed;
+} walk_t;
+
+typedef struct {
+	walk_t *walk;
+	char *dirents;
+	matches_t matches;
+	size_t matches_capacity;
+} walker_t;
+
+static int add_match(walker_t *walker, char *path)
+{
+	if (_scallop_grow(
+		(void **)&walker->matches.paths,
+		&walker->matches_capacity,
+		walker->matches.length,
+		sizeof(*walker->matches.paths)
+	)) {
+		free(path);
+		return -1;
+	}
+	walker->matches.paths[walker->matches.length++] = path;
+	return 0;
+}
+
+static int queue_push(walk_t *walk, char *path, size_t component)
+{
+	pthread_mutex_lock(&walk->mutex);
+	const int result = _scallop_grow(
+		(void **)&walk->queue,
+		&walk->queue_capacity,
+		walk->queue_length,
+		sizeof(*walk->queue)
+	);
+	if (result == 0) {
+		walk->queue[walk->queue_length++] = (work_t) { path, component };
+		pthread_cond_signal(&walk->changed);
+	}
+	pthread_mutex_unlock(&walk->mutex);
+
+	if (result)
+		free(path);
+	return result;
+}
+
+static bool is_directory(int dirfd, const char *name, unsigned char type)
+{
+	if (type == DIRENT_DIRECTORY)
+		return true;
+	if (type != DIRENT_UNKNOWN && type != DIRENT_LINK)
+		return false;
+
+	struct stat info = { 0 };
+	return fstatat(dirfd, name, &info, 0) == 0 && S_ISDIR(info.st_mode);
+}
+
+/*
+ * Follows literal components from path, then lists the directory
+ * for the next component with glob characters. Takes ownership
+ * of path.
+ */
+static int walk_path(walker_t *walker, char *path, size_t index)
+{
+	const compiled_t *const glob = walker->walk->glob;
+
+	for (; glob->components[index].literal; index++) {
+		const component_t *const component = &glob->components[index];
+		char *const next = join(path, component->text, component->length);
+		free(path);
+		if (!next)
+			return -1;
+		path = next;
+
+		struct stat info = { 0 };
+		const bool last = index + 1 == glob->components_length;
+		if (last) {
+			if (lstat(path, &info) == 0)
+				return add_match(walker, path);
+			free(path);
+			return 0;
+		}
+		if (stat(path, &info) || !S_ISDIR(info.st_mode)) {
+			free(path);
+			return 0;
+		}
+	}
+
+	const int dirfd = open(
+		path[0] ? path : ".",
+		O_RDONLY | O_DIRECTORY | O_CLOEXEC
+	);
+	if (dirfd < 0) {
+		free(path);
+		return 0;
+	}
+
+	const component_t *const component = &glob->components[index];
+	const bool last = index + 1 == glob->components_length;
+	int result = 0;
+
+	for (;;) {
+		const long amount = syscall(
+			SYS_getdents64,
+			dirfd,
+			walker->dirents,
+			DIRENT_BUFFER_SIZE
+		);
+		if (amount <= 0)
+			break;
+
+		for (long offset = 0; result == 0 && offset < amount;) {
+			const struct linux_dirent64 *const entry
+				= (const void *)(walker->dirents + offset);
+			offset += entry->d_reclen;
+
+			const bool dots = strcmp(entry->d_name, ".") == 0
+				|| strcmp(entry->d_name, "..") == 0;
+			if (dots)
+				continue;
+			if (!scallop_lang_glob_match(component, entry->d_name))
+				continue;
+			if (!last && !is_directory(dirfd, entry->d_name, entry->d_type))
+				continue;
+
+			char *const match = join(path, entry->d_name, strlen(entry->d_name));
+			if (!match)
+				result = -1;
+			else if (last)
+				result = add_match(walker, match);
+			else
+				result = queue_push(walker->walk, match, index + 1);
+		}
+		if (result)
+			break;
+	}
+
+	close(dirfd);
+	free(path);
+	return result;
+}
+
+static void *walker_run(void *data)
+{
+	walker_t *const walker = data;
+	walk_t *const walk = walker->walk;
+
+	pthread_mutex_lock(&walk->mutex);
+	for (;;) {
+		while (!walk->queue_length && walk->active && !walk->failed)
+			pthread_cond_wait(&walk->changed, &walk->mutex);
+		if (!walk->queue_length || walk->failed)
+			break;
+
+		const work_t work = walk->queue[--walk->queue_length];
+		walk->active++;
+		pthread_mutex_unlock(&walk->mutex);
+
+		const int result = walk_path(walker, work.path, work.component);
+
+		pthread_mutex_lock(&walk->mutex);
+		walk->active--;
+		if (result)
+			walk->failed = true;
+		if (!walk->active || walk->failed)
+			pthread_cond_broadcast(&walk->changed);
+	}
+	pthread_mutex_unlock(&walk->mutex);
+	return NULL;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int scallop_lang_glob_expand(
+	const compiled_t *glob,
+	size_t threads,
+	matches_t *out
+)
+{
+	*out = (matches_t) { 0 };
+	if (!threads)
+		threads = 1;
+
+	walk_t walk = {
+		.glob = glob,
+		.mutex = PTHREAD_MUTEX_INITIALIZER,
+		.changed = PTHREAD_COND_INITIALIZER,
+	};
+	walker_t *const walkers = calloc(threads, sizeof(*walkers));
+	pthread_t *const ids = calloc(threads, sizeof(*ids));
+	if (!walkers || !ids) {
+		free(walkers);
+		free(ids);
+		return -1;
+	}
+
+	char *const prefix = strdup(glob->prefix);
+	if (!prefix || queue_push(&walk, prefix, 0)) {
+		free(walkers);
+		free(ids);
+		return -1;
+	}
+
+	size_t started = 0;
+	for (size_t i = 0; i < threads; i++) {
+		walkers[i].walk = &walk;
+		walkers[i].dirents = malloc(DIRENT_BUFFER_SIZE);
+		if (!walkers[i].dirents) {
+			walk.failed = true;
+			break;
+		}
+	}
+
+	if (!walk.failed && glob->components_length) {
+		for (started = 1; started < threads; started++)
+			if (pthread_create(&ids[started], NULL, walker_run, &walkers[started]))
+				break;
+		walker_run(&walkers[0]);
+		for (size_t i = 1; i < started; i++)
+			pthread_join(ids[i], NULL);
+	}
+
+	for (size_t i = 0; i < walk.queue_length; i++)
+		free(walk.queue[i].path);
+	free(walk.queue);
+
+	size_t length = 0;
+	for (size_t i = 0; i < threads; i++)
+		length += walkers[i].matches.length;
+
+	out->paths = malloc((length ? length : 1) * sizeof(*out->paths));
+	if (!out->paths)
+		walk.failed = true;
+
+	for (size_t i = 0; i < threads; i++) {
+		for (size_t j = 0; j < walkers[i].matches.length; j++) {
+			if (walk.failed)
+				free(walkers[i].matches.paths[j]);
+			else
+				out->paths[out->length++] = walkers[i].matches.paths[j];
+		}
+		free(walkers[i].matches.paths);
+		free(walkers[i].dirents);
+	}
+	free(walkers);
+	free(ids);
+	pthread_mutex_destroy(&walk.mutex);
+	pthread_cond_destroy(&walk.changed);
+
+	if (walk.failed) {
+		scallop_lang_glob_matches_free(out);
+		return -1;
+	}
+
+	qsort(out->paths, out->length, sizeof(*out->paths), compare_paths);
+	return 0;
+}
+
+void scallop_lang_glob_free(compiled_t *glob)
+{
+	for (size_t i = 0; i < glob->components_length; i++) {
+		free(glob->components[i].text);
+		free(glob->components[i].kinds);
+	}
+	free(glob->components);
+	free(glob->prefix);
+	*glob = (compiled_t) { 0 };
+}
+
+void scallop_lang_glob_matches_free(matches_t *matches)
+{
+	for (size_t i = 0; i < matches->length; i++)
+		free(matches->paths[i]);
+	free(matches->paths);
+	*matches = (matches_t) { 0 };
+}
@@ -0,0 +1,258 @@
+#include "scallop-lang/history.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct scallop_lang_history history_t;
+typedef struct scallop_lang_history_record record_t;
+
+#define INITIAL_RECORDS 64
+
+static const char history_magic[8] = "SCLHIST1";
+
+typedef struct {
+	char magic[8];
+	uint64_t length;
+} header_t;
+
+// A record in the file is its key, its runs and 4 bytes of zeros,
+// then its wall and CPU time
+#define RECORD_SIZE 32
+#define RUNS_OFFSET 8
+#define WALL_OFFSET 16
+#define CPU_OFFSET 24
+
+static size_t hash_key(uint64_t key)
+{
+	// Keys are already hashes, but the low bits are folded with
+	// the high bits in case they're not well mixed
+	return (size_t)(key ^ key >> 32);
+}
+
+/*
+ * Returns the record for a key, or the unused record it would go
+ * in. The table must have room.
+ */
+static record_t *probe(const history_t *history, uint64_t key)
+{
+	const size_t mask = history->_capacity - 1;
+	size_t i = hash_key(key) & mask;
+	while (history->_records[i].runs && history->_records[i].key != key)
+		i = (i + 1) & mask;
+	return &history->_records[i];
+}
+
+static int grow(history_t *history)
+{
+	if ((history->_length + 1) * 4 <= history->_capacity * 3)
+		return 0;
+
+	const size_t capacity = history->_capacity * 2;
+	record_t *const records = calloc(capacity, sizeof(*records));
+	if (!records)
+		return -1;
+
+	record_t *const old = history->_records;
+	const size_t old_capacity = history->_capacity;
+	history->_records = records;
+	history->_capacity = capacity;
+	for (size_t i = 0; i < old_capacity; i++)
+		if (old[i].runs)
+			*probe(history, old[i].key) = old[i];
+	free(old);
+	return 0;
+}
+
+static int read_all(int fd, void *buffer, size_t length)
+{
+	char *bytes = buffer;
+	while (length) {
+		const ssize_t amount = read(fd, bytes, length);
+		if (amount < 0 && errno == EINTR)
+			continue;
+		if (amount <= 0)
+			return -1;
+		bytes += amount;
+		length -= (size_t)amount;
+	}
+	return 0;
+}
+
+static int write_all(int fd, const void *buffer, size_t length)
+{
+	const char *bytes = buffer;
+	while (length) {
+		const ssize_t amount = write(fd, bytes, length);
+		if (amount < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		bytes += amount;
+		length -= (size_t)amount;
+	}
+	return 0;
+}
+
+static void encode(const record_t *record, unsigned char out[RECORD_SIZE])
+{
+	memset(out, 0, RECORD_SIZE);
+	memcpy(out, &record->key, sizeof(record->key));
+	memcpy(out + RUNS_OFFSET, &record->runs, sizeof(record->runs));
+	memcpy(out + WALL_OFFSET, &record->wall, sizeof(record->wall));
+	memcpy(out + CPU_OFFSET, &record->cpu, sizeof(record->cpu));
+}
+
+static record_t decode(const unsigned char in[RECORD_SIZE])
+{
+	record_t record = { 0 };
+	memcpy(&record.key, in, sizeof(record.key));
+	memcpy(&record.runs, in + RUNS_OFFSET, sizeof(record.runs));
+	memcpy(&record.wall, in + WALL_OFFSET, sizeof(record.wall));
+	memcpy(&record.cpu, in + CPU_OFFSET, sizeof(record.cpu));
+	return record;
+}
+
+/*
+ * Reads the records in a file. Damaged files are skipped from the
+ * first bad record, and replaced by the next save.
+ */
+static int load(history_t *history, int fd)
+{
+	header_t header = { 0 };
+	const bool valid = read_all(fd, &header, sizeof(header)) == 0
+		&& memcmp(header.magic, history_magic, sizeof(history_magic)) == 0;
+	if (!valid)
+		return 0;
+
+	for (uint64_t i = 0; i < header.length; i++) {
+		unsigned char bytes[RECORD_SIZE];
+		if (read_all(fd, bytes, sizeof(bytes)))
+			return 0;
+		const record_t record = decode(bytes);
+		if (!record.runs)
+			return 0;
+
+		if (grow(history))
+			return -1;
+		record_t *const slot = probe(history, record.key);
+		if (!slot->runs)
+			history->_length++;
+		*slot = record;
+	}
+	return 0;
+}
+
+int scallop_lang_history_open(history_t *history, const char *path)
+{
+	*history = (history_t) { 0 };
+	history->_path = strdup(path);
+	history->_records = calloc(INITIAL_RECORDS, sizeof(*history->_records));
+	if (!history->_path || !history->_records) {
+		scallop_lang_history_close(history);
+		errno = ENOMEM;
+		return -1;
+	}
+	history->_capacity = INITIAL_RECORDS;
+
+	const int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		if (errno == ENOENT)
+			return 0;
+		scallop_lang_history_close(history);
+		return -1;
+	}
+
+	const int result = load(history, fd);
+	close(fd);
+	if (result) {
+		scallop_lang_history_close(history);
+		errno = ENOMEM;
+		return -1;
+	}
+	return 0;
+}
+
+const record_t *scallop_lang_history_find(const history_t *history, uint64_t key)
+{
+	const record_t *const record = probe(history, key);
+	return record->runs ? record : NULL;
+}
+
+double scallop_lang_history_estimate(const history_t *history, uint64_t key, double fallback)
+{
+	const record_t *const record = scallop_lang_history_find(history, key);
+	return record ? record->wall : fallback;
+}
+
+int scallop_lang_history_add(history_t *history, uint64_t key, double wall, double cpu)
+{
+	if (grow(history))
+		return -1;
+
+	record_t *const record = probe(history, key);
+	if (!record->runs) {
+		*record = (record_t) { .key = key };
+		history->_length++;
+	}
+
+	if (record->runs < SCALLOP_LANG_HISTORY_WINDOW)
+		record->runs++;
+	record->wall += (wall - record->wall) / record->runs;
+	record->cpu += (cpu - record->cpu) / record->runs;
+	return 0;
+}
+
+int scallop_lang_history_save(const history_t *history)
+{
+	char temporary[PATH_MAX];
+	const int length = snprintf(temporary, sizeof(temporary), "%s.XXXXXX", history->_path);
+	if (length < 0 || (size_t)length >= sizeof(temporary)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	const int fd = mkstemp(temporary);
+	if (fd < 0)
+		return -1;
+
+	// The file replacing the old one keeps its mode, rather than
+	// mkstemp()'s 0600
+	struct stat info = { 0 };
+	bool written = stat(history->_path, &info) != 0
+		|| fchmod(fd, info.st_mode & 07777) == 0;
+
+	header_t header = { .length = history->_length };
+	memcpy(header.magic, history_magic, sizeof(history_magic));
+	written = written && write_all(fd, &header, sizeof(header)) == 0;
+	for (size_t i = 0; written && i < history->_capacity; i++) {
+		if (!history->_records[i].runs)
+			continue;
+		unsigned char bytes[RECORD_SIZE];
+		encode(&history->_records[i], bytes);
+		written = write_all(fd, bytes, sizeof(bytes)) == 0;
+	}
+
+	if (close(fd) || !written || rename(temporary, history->_path)) {
+		const int error = errno;
+		unlink(temporary);
+		errno = error;
+		return -1;
+	}
+	return 0;
+}
+
+void scallop_lang_history_close(history_t *history)
+{
+	free(history->_path);
+	free(history->_records);
+	*history = (history_t) { 0 };
+}
@@ -0,0 +1,4 @@
+#include "internal.h"
+
+int _scallop_grow(void **array, size_t *capacity, size_t length, size_t size);
+uint32_t _scallop_hash(const void *data, size_t length);
@@ -0,0 +1,84 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_INTERNAL
+#define SCALLOP_LANG_INTERNAL
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * \file
+ *
+ * \brief Helpers shared by the modules of the library. This header
+ * 	isn't installed.
+ */
+
+/**
+ * \brief Makes room for one more element in a dynamic array,
+ * 	doubling its capacity when it's full.
+ *
+ * \param array A pointer to the array, which may be NULL.
+ * \param capacity A pointer to the array's capacity, in elements.
+ * \param length The number of elements in use.
+ * \param size The size of an element.
+ *
+ * \returns 0 on success, or -1 on failure, leaving the array as
+ * 	it was.
+ */
+inline int _scallop_grow(void **array, size_t *capacity, size_t length, size_t size)
+{
+	if (length < *capacity)
+		return 0;
+
+	const size_t new_capacity = *capacity ? *capacity * 2 : 8;
+	if (new_capacity > SIZE_MAX / size) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	void *const result = realloc(*array, new_capacity * size);
+	if (!result)
+		return -1;
+
+	*array = result;
+	*capacity = new_capacity;
+	return 0;
+}
+
+/**
+ * \brief Hashes bytes with 32-bit FNV-1a, for the hash tables of
+ * 	names and strings.
+ *
+ * \param data The bytes to hash.
+ * \param length The number of bytes.
+ *
+ * \returns The hash.
+ */
+inline uint32_t _scallop_hash(const void *data, size_t length)
+{
+	const unsigned char *const bytes = data;
+	uint32_t hash = 0x811c9dc5u;
+	for (size_t i = 0; i < length; i++)
+		hash = (hash ^ bytes[i]) * 0x01000193u;
+	return hash;
+}
+
+#endif // SCALLOP_LANG_INTERNAL
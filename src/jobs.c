@@ -0,0 +1,695 @@
+// For sched_setaffinity() and the CPU_* macros
+#define _GNU_SOURCE
+
+#include "scallop-lang/jobs.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "scallop-lang/events.h"
+
+typedef struct scallop_lang_jobs_job job_t;
+typedef struct scallop_lang_jobs_options options_t;
+
+extern char **environ;
+
+// The default time to wait between cancellation signals
+#define DEFAULT_GRACE 5000
+
+static const int default_signals[] = { SIGTERM, SIGKILL };
+
+typedef struct {
+	pid_t pid;
+
+	// The number of jobs in a block which aren't done
+	size_t remaining;
+
+	bool cancelled;
+	bool done;
+
+	// The next signal to send while cancelling
+	size_t step;
+	struct scallop_lang_events_watch *timer;
+
+	// When the command was started, in seconds
+	double started;
+
+	// The core the command is pinned to
+	size_t core;
+} slot_t;
+
+typedef struct {
+	double cost;
+	size_t index;
+} queued_t;
+
+typedef struct {
+	job_t *jobs;
+	slot_t *slots;
+	size_t length;
+	options_t options;
+	struct scallop_lang_events events;
+
+	// The commands in the order they start
+	queued_t *queue;
+	size_t queue_length;
+
+	// The commands running in each block, for their limits
+	size_t *block_running;
+
+	// The jobserver tokens held, one for each running command
+	// after the first
+	char *tokens;
+	size_t tokens_length;
+	struct scallop_lang_events_watch *jobserver_watch;
+
+	// The CPUs of each core of the topology, and the number of
+	// commands pinned to it
+	cpu_set_t **cores;
+	size_t *core_load;
+	size_t cores_size;
+
+	// Jobs in the outermost block which aren't done
+	size_t remaining;
+	size_t running;
+	bool failed;
+	bool error;
+} run_t;
+
+static void cancel(run_t *run, size_t i);
+
+static double now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static double seconds(struct timeval time)
+{
+	return (double)time.tv_sec + (double)time.tv_usec / 1e6;
+}
+
+static int compare_queued(const void *a, const void *b)
+{
+	const queued_t *const left = a;
+	const queued_t *const right = b;
+	if (left->cost != right->cost)
+		return left->cost > right->cost ? -1 : 1;
+	return (left->index > right->index) - (left->index < right->index);
+}
+
+/*
+ * Orders the commands longest first, keeping the order they're
+ * given in for equal costs. Returns NULL if memory couldn't be
+ * allocated.
+ */
+static queued_t *queue(const job_t *jobs, size_t length, size_t *count)
+{
+	queued_t *const result = calloc(length ? length : 1, sizeof(*result));
+	if (!result)
+		return NULL;
+
+	*count = 0;
+	for (size_t i = 0; i < length; i++)
+		if (jobs[i].argv)
+			result[(*count)++] = (queued_t) { .cost = jobs[i].cost, .index = i };
+	qsort(result, *count, sizeof(*result), compare_queued);
+	return result;
+}
+
+/*
+ * True if every block containing job i has room for another
+ * running command, given the commands running in each block.
+ */
+static bool fits(const job_t *jobs, const size_t *running, size_t i)
+{
+	for (ssize_t block = jobs[i].block; block >= 0; block = jobs[block].block) {
+		const size_t limit = jobs[block].max_running;
+		if (limit && running[block] >= limit)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Counts command i as running, or no longer running, in every
+ * block containing it.
+ */
+static void count_running(const job_t *jobs, size_t *running, size_t i, bool started)
+{
+	for (ssize_t block = jobs[i].block; block >= 0; block = jobs[block].block) {
+		if (started)
+			running[block]++;
+		else
+			running[block]--;
+	}
+}
+
+/*
+ * Takes a jobserver token for another command. If none is free,
+ * returns 0 and watches the jobserver for one to be given back.
+ */
+static int take_token(run_t *run)
+{
+	char token = 0;
+	const int taken = scallop_lang_jobserver_acquire(run->options.jobserver, &token);
+	if (taken < 0) {
+		run->error = true;
+		return -1;
+	}
+
+	if (!taken) {
+		if (!run->jobserver_watch) {
+			run->jobserver_watch = scallop_lang_events_add_fd(
+				&run->events,
+				scallop_lang_jobserver_fd(run->options.jobserver),
+				SCALLOP_LANG_EVENTS_READ,
+				run->options.jobserver
+			);
+			if (!run->jobserver_watch)
+				run->error = true;
+		}
+		return 0;
+	}
+
+	if (run->jobserver_watch) {
+		scallop_lang_events_remove(&run->events, run->jobserver_watch);
+		run->jobserver_watch = NULL;
+	}
+	run->tokens[run->tokens_length++] = token;
+	return 1;
+}
+
+/*
+ * Gives back the tokens the running commands no longer need.
+ */
+static void release_tokens(run_t *run, size_t keep)
+{
+	while (run->tokens_length > keep) {
+		const char token = run->tokens[--run->tokens_length];
+		if (scallop_lang_jobserver_release(run->options.jobserver, token))
+			run->error = true;
+	}
+}
+
+/*
+ * Finds the core with the fewest commands pinned to it.
+ */
+static size_t least_loaded(const run_t *run)
+{
+	size_t result = 0;
+	for (size_t i = 1; i < run->options.topology->cores_length; i++)
+		if (run->core_load[i] < run->core_load[result])
+			result = i;
+	return result;
+}
+
+/*
+ * Builds an affinity mask for each core of the topology, before
+ * any command is forked.
+ */
+static int init_cores(run_t *run)
+{
+	const struct scallop_lang_topology *const topology = run->options.topology;
+	if (!topology->cores_length)
+		return 0;
+
+	unsigned max = 0;
+	for (size_t i = 0; i < topology->cores_length; i++)
+		for (size_t j = 0; j < topology->cores[i].cpus_length; j++)
+			if (topology->cores[i].cpus[j] > max)
+				max = topology->cores[i].cpus[j];
+
+	run->cores = calloc(topology->cores_length, sizeof(*run->cores));
+	run->core_load = calloc(topology->cores_length, sizeof(*run->core_load));
+	if (!run->cores || !run->core_load)
+		return -1;
+
+	run->cores_size = CPU_ALLOC_SIZE(max + 1);
+	for (size_t i = 0; i < topology->cores_length; i++) {
+		run->cores[i] = CPU_ALLOC(max + 1);
+		if (!run->cores[i])
+			return -1;
+		CPU_ZERO_S(run->cores_size, run->cores[i]);
+		for (size_t j = 0; j < topology->cores[i].cpus_length; j++)
+			CPU_SET_S(topology->cores[i].cpus[j], run->cores_size, run->cores[i]);
+	}
+	return 0;
+}
+
+static void free_cores(run_t *run)
+{
+	if (run->cores)
+		for (size_t i = 0; i < run->options.topology->cores_length; i++)
+			if (run->cores[i])
+				CPU_FREE(run->cores[i]);
+	free(run->cores);
+	free(run->core_load);
+}
+
+/*
+ * Marks a job as done, and completes its block if it was the last.
+ */
+static void finish(run_t *run, size_t i)
+{
+	job_t *const job = &run->jobs[i];
+	run->slots[i].done = true;
+	if (job->state == SCALLOP_LANG_JOBS_RUNNING)
+		job->state = SCALLOP_LANG_JOBS_SUCCEEDED;
+
+	if (job->block < 0) {
+		run->remaining--;
+		return;
+	}
+
+	slot_t *const block = &run->slots[job->block];
+	if (--block->remaining == 0)
+		finish(run, (size_t)job->block);
+}
+
+static void cancel_block(run_t *run, ssize_t block)
+{
+	for (size_t i = (size_t)(block + 1); i < run->length; i++)
+		if (run->jobs[i].block == block)
+			cancel(run, i);
+}
+
+static void send_signal(run_t *run, size_t i)
+{
+	slot_t *const slot = &run->slots[i];
+	if (slot->step >= run->options.signals_length)
+		return;
+
+	kill(-slot->pid, run->options.signals[slot->step++]);
+	if (slot->step < run->options.signals_length) {
+		slot->timer = scallop_lang_events_add_timer(
+			&run->events,
+			run->options.grace,
+			&run->jobs[i]
+		);
+		if (!slot->timer)
+			run->error = true;
+	}
+}
+
+static void cancel(run_t *run, size_t i)
+{
+	job_t *const job = &run->jobs[i];
+	slot_t *const slot = &run->slots[i];
+	if (slot->done || slot->cancelled)
+		return;
+	slot->cancelled = true;
+
+	if (job->argv) {
+		if (job->state == SCALLOP_LANG_JOBS_PENDING) {
+			job->state = SCALLOP_LANG_JOBS_CANCELLED;
+			finish(run, i);
+		} else if (job->state == SCALLOP_LANG_JOBS_RUNNING) {
+			send_signal(run, i);
+		}
+		return;
+	}
+
+	if (job->state == SCALLOP_LANG_JOBS_RUNNING)
+		job->state = SCALLOP_LANG_JOBS_CANCELLED;
+	cancel_block(run, (ssize_t)i);
+}
+
+/*
+ * Fails the block containing a failed job, cancelling the rest
+ * of its jobs, and propagates the failure outwards.
+ */
+static void fail(run_t *run, size_t i)
+{
+	run->failed = true;
+	const ssize_t block = run->jobs[i].block;
+	if (block < 0) {
+		cancel_block(run, -1);
+		return;
+	}
+
+	job_t *const parent = &run->jobs[block];
+	if (parent->state != SCALLOP_LANG_JOBS_RUNNING)
+		return;
+
+	parent->state = SCALLOP_LANG_JOBS_FAILED;
+	cancel_block(run, block);
+	fail(run, (size_t)block);
+}
+
+static void start(run_t *run, size_t i)
+{
+	job_t *const job = &run->jobs[i];
+
+	const struct scallop_lang_commands_command *const command
+		= scallop_lang_commands_prepare(run->options.commands, job->argv);
+
+	const size_t core = run->cores ? least_loaded(run) : 0;
+
+	run->slots[i].started = now();
+	const pid_t pid = fork();
+	if (pid == 0) {
+		setpgid(0, 0);
+
+		// A command that can't be pinned still runs
+		if (run->cores)
+			sched_setaffinity(0, run->cores_size, run->cores[core]);
+
+		scallop_lang_commands_run(command, job->argv, environ);
+		_exit(127);
+	}
+	scallop_lang_commands_release(command);
+
+	if (pid < 0 || !scallop_lang_events_add_child(&run->events, pid, job)) {
+		if (pid > 0) {
+			kill(-pid, SIGKILL);
+			waitpid(pid, NULL, 0);
+		}
+		job->state = SCALLOP_LANG_JOBS_FAILED;
+		job->status = -1;
+		fail(run, i);
+		finish(run, i);
+		if (run->options.jobserver)
+			release_tokens(run, run->running ? run->running - 1 : 0);
+		return;
+	}
+
+	// Also set in the parent, so the group exists before any
+	// signal is sent to it
+	setpgid(pid, pid);
+	run->slots[i].pid = pid;
+	run->slots[i].core = core;
+	job->state = SCALLOP_LANG_JOBS_RUNNING;
+	run->running++;
+	count_running(run->jobs, run->block_running, i, true);
+	if (run->cores)
+		run->core_load[core]++;
+}
+
+static void exited(run_t *run, size_t i, int status, const struct rusage *usage)
+{
+	job_t *const job = &run->jobs[i];
+	slot_t *const slot = &run->slots[i];
+	run->running--;
+	count_running(run->jobs, run->block_running, i, false);
+	if (run->cores)
+		run->core_load[slot->core]--;
+	if (run->options.jobserver)
+		release_tokens(run, run->running ? run->running - 1 : 0);
+
+	job->status = status;
+	job->wall = now() - slot->started;
+	job->cpu = seconds(usage->ru_utime) + seconds(usage->ru_stime);
+
+	if (slot->timer) {
+		scallop_lang_events_remove(&run->events, slot->timer);
+		slot->timer = NULL;
+	}
+
+	const bool success = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	if (slot->cancelled) {
+		job->state = SCALLOP_LANG_JOBS_CANCELLED;
+	} else if (!success) {
+		job->state = SCALLOP_LANG_JOBS_FAILED;
+		fail(run, i);
+	}
+	finish(run, i);
+}
+
+static bool validate(const job_t *jobs, size_t length)
+{
+	for (size_t i = 0; i < length; i++) {
+		const ssize_t block = jobs[i].block;
+		if (block < -1 || block >= (ssize_t)i)
+			return false;
+		if (block >= 0 && jobs[block].argv)
+			return false;
+		if (jobs[i].argv && !jobs[i].argv[0])
+			return false;
+	}
+	return true;
+}
+
+static void free_run(run_t *run)
+{
+	if (run->cores)
+		free_cores(run);
+	free(run->slots);
+	free(run->queue);
+	free(run->block_running);
+	free(run->tokens);
+}
+
+int scallop_lang_jobs_run(job_t *jobs, size_t length, const options_t *options)
+{
+	if (!validate(jobs, length)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	run_t run = {
+		.jobs = jobs,
+		.length = length,
+		.options = options
+			? *options
+			: (options_t) { .grace = DEFAULT_GRACE },
+	};
+	if (!run.options.grace)
+		run.options.grace = DEFAULT_GRACE;
+	if (!run.options.signals) {
+		run.options.signals = default_signals;
+		run.options.signals_length = sizeof(default_signals) / sizeof(*default_signals);
+	}
+
+	run.slots = calloc(length ? length : 1, sizeof(*run.slots));
+	run.queue = queue(jobs, length, &run.queue_length);
+	run.block_running = calloc(length ? length : 1, sizeof(*run.block_running));
+	run.tokens = calloc(length ? length : 1, sizeof(*run.tokens));
+	const bool allocated = run.slots
+		&& run.queue
+		&& run.block_running
+		&& run.tokens
+		&& (!run.options.topology || !init_cores(&run));
+	if (!allocated || scallop_lang_events_init(&run.events, 0)) {
+		free_run(&run);
+		return -1;
+	}
+
+	const int commands_fd = run.options.commands
+		? scallop_lang_commands_fd(run.options.commands)
+		: -1;
+	if (commands_fd >= 0) {
+		const bool watched = scallop_lang_events_add_fd(
+			&run.events,
+			commands_fd,
+			SCALLOP_LANG_EVENTS_READ,
+			run.options.commands
+		);
+		if (!watched) {
+			scallop_lang_events_free(&run.events);
+			free_run(&run);
+			return -1;
+		}
+	}
+
+	for (size_t i = 0; i < length; i++) {
+		jobs[i].state = jobs[i].argv
+			? SCALLOP_LANG_JOBS_PENDING
+			: SCALLOP_LANG_JOBS_RUNNING;
+		jobs[i].status = 0;
+		jobs[i].wall = 0;
+		jobs[i].cpu = 0;
+		if (jobs[i].block < 0)
+			run.remaining++;
+		else
+			run.slots[jobs[i].block].remaining++;
+	}
+
+	// Empty blocks succeed immediately. Going backwards finishes
+	// nested empty blocks before the blocks containing them.
+	for (size_t i = length; i-- > 0;)
+		if (!jobs[i].argv && !run.slots[i].remaining && !run.slots[i].done)
+			finish(&run, i);
+
+	size_t next = 0;
+	while (run.remaining && !run.error) {
+		// Commands start in queue order, except that those whose
+		// blocks are full are passed over. Everything before next
+		// has already started or been cancelled.
+		while (
+			next < run.queue_length
+			&& jobs[run.queue[next].index].state != SCALLOP_LANG_JOBS_PENDING
+		)
+			next++;
+
+		for (size_t j = next; j < run.queue_length && !run.error; j++) {
+			const bool full = run.options.max_running
+				&& run.running >= run.options.max_running;
+			if (full)
+				break;
+
+			const size_t i = run.queue[j].index;
+			if (jobs[i].state != SCALLOP_LANG_JOBS_PENDING)
+				continue;
+			if (!fits(jobs, run.block_running, i))
+				continue;
+
+			// The first command runs on the token make started
+			// us with
+			const bool needs_token = run.options.jobserver
+				&& run.running > run.tokens_length;
+			if (needs_token && take_token(&run) <= 0)
+				break;
+
+			start(&run, i);
+		}
+
+		if (!run.running || run.error)
+			continue;
+
+		struct scallop_lang_events_event events[16];
+		const ssize_t count = scallop_lang_events_wait(
+			&run.events,
+			events,
+			sizeof(events) / sizeof(*events),
+			-1
+		);
+		if (count < 0) {
+			run.error = true;
+			break;
+		}
+
+		// A timer is freed once its event is returned, so it must
+		// be forgotten before a child exiting earlier in the same
+		// batch tries to remove it
+		for (ssize_t i = 0; i < count; i++) {
+			if (events[i].type == SCALLOP_LANG_EVENTS_TIMER) {
+				const size_t index = (size_t)((job_t *)events[i].user - jobs);
+				run.slots[index].timer = NULL;
+			}
+		}
+
+		for (ssize_t i = 0; i < count; i++) {
+			if (events[i].type == SCALLOP_LANG_EVENTS_FD) {
+				if (events[i].user == run.options.commands) {
+					if (scallop_lang_commands_update(run.options.commands))
+						run.error = true;
+				} else if (run.jobserver_watch) {
+					// A token may be free. It's taken on the
+					// next pass, if it's still needed.
+					scallop_lang_events_remove(&run.events, run.jobserver_watch);
+					run.jobserver_watch = NULL;
+				}
+				continue;
+			}
+
+			const size_t index = (size_t)((job_t *)events[i].user - jobs);
+			if (events[i].type == SCALLOP_LANG_EVENTS_CHILD) {
+				exited(&run, index, events[i].status, &events[i].usage);
+			} else if (events[i].type == SCALLOP_LANG_EVENTS_TIMER) {
+				if (!run.slots[index].done)
+					send_signal(&run, index);
+			}
+		}
+	}
+
+	if (run.error) {
+		// Don't leave anything running behind
+		for (size_t i = 0; i < length; i++) {
+			if (run.slots[i].pid && !run.slots[i].done) {
+				kill(-run.slots[i].pid, SIGKILL);
+				waitpid(run.slots[i].pid, &jobs[i].status, 0);
+				jobs[i].state = SCALLOP_LANG_JOBS_CANCELLED;
+			}
+		}
+	}
+
+	// Tokens are given back even on failure, or make would lose
+	// them for the rest of the build
+	if (run.options.jobserver)
+		release_tokens(&run, 0);
+
+	scallop_lang_events_free(&run.events);
+	free_run(&run);
+	if (run.error)
+		return -1;
+	return run.failed ? 1 : 0;
+}
+
+enum {
+	PREDICT_QUEUED,
+	PREDICT_RUNNING,
+	PREDICT_DONE,
+};
+
+double scallop_lang_jobs_predict(const job_t *jobs, size_t length, size_t max_running)
+{
+	size_t count = 0;
+	queued_t *const queued = queue(jobs, length, &count);
+	double *const finish_at = calloc(count ? count : 1, sizeof(*finish_at));
+	unsigned char *const states = calloc(count ? count : 1, sizeof(*states));
+	size_t *const block_running = calloc(length ? length : 1, sizeof(*block_running));
+	if (!queued || !finish_at || !states || !block_running) {
+		free(queued);
+		free(finish_at);
+		free(states);
+		free(block_running);
+		return -1;
+	}
+
+	// Whenever a command finishes, the queue is scanned again for
+	// the commands that now fit
+	double time = 0;
+	double makespan = 0;
+	size_t running = 0;
+	size_t started = 0;
+	for (;;) {
+		for (size_t i = 0; i < count; i++) {
+			if (max_running && running >= max_running)
+				break;
+
+			const size_t index = queued[i].index;
+			if (states[i] != PREDICT_QUEUED || !fits(jobs, block_running, index))
+				continue;
+
+			states[i] = PREDICT_RUNNING;
+			finish_at[i] = time + queued[i].cost;
+			if (finish_at[i] > makespan)
+				makespan = finish_at[i];
+			count_running(jobs, block_running, index, true);
+			running++;
+			started++;
+		}
+		if (started == count)
+			break;
+
+		double next = -1;
+		for (size_t i = 0; i < count; i++)
+			if (states[i] == PREDICT_RUNNING && (next < 0 || finish_at[i] < next))
+				next = finish_at[i];
+
+		time = next;
+		for (size_t i = 0; i < count; i++) {
+			if (states[i] == PREDICT_RUNNING && finish_at[i] == next) {
+				states[i] = PREDICT_DONE;
+				count_running(jobs, block_running, queued[i].index, false);
+				running--;
+			}
+		}
+	}
+
+	free(queued);
+	free(finish_at);
+	free(states);
+	free(block_running);
+	return makespan;
+}
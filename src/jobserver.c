@@ -0,0 +1,179 @@
+#include "scallop-lang/jobserver.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+typedef struct scallop_lang_jobserver jobserver_t;
+
+#define FIFO_PREFIX "fifo:"
+
+static const char *const option_prefixes[] = {
+	"--jobserver-auth=",
+	"--jobserver-fds=",
+};
+
+/*
+ * Finds the value of the last jobserver option in makeflags, and
+ * writes its length. Words after "--" are variable assignments,
+ * not options.
+ */
+static const char *find_auth(const char *makeflags, size_t *length)
+{
+	const char *result = NULL;
+	for (const char *word = makeflags; *word;) {
+		while (*word == ' ')
+			word++;
+		const char *end = word;
+		while (*end && *end != ' ')
+			end++;
+
+		const size_t word_length = (size_t)(end - word);
+		if (word_length == 2 && !strncmp(word, "--", 2))
+			break;
+
+		for (size_t i = 0; i < sizeof(option_prefixes) / sizeof(*option_prefixes); i++) {
+			const size_t prefix_length = strlen(option_prefixes[i]);
+			if (word_length >= prefix_length && !strncmp(word, option_prefixes[i], prefix_length)) {
+				result = word + prefix_length;
+				*length = word_length - prefix_length;
+			}
+		}
+		word = end;
+	}
+	return result;
+}
+
+static bool parse_fd(const char *text, const char *end, int *out)
+{
+	long result = 0;
+	if (text == end)
+		return false;
+	for (; text < end; text++) {
+		if (*text < '0' || *text > '9')
+			return false;
+		result = result * 10 + (*text - '0');
+		if (result > INT_MAX)
+			return false;
+	}
+	*out = (int)result;
+	return true;
+}
+
+/*
+ * Opens the pipe behind an inherited file descriptor again, as a
+ * new open file description, so its flags are our own.
+ */
+static int reopen(int fd, int flags)
+{
+	if (fcntl(fd, F_GETFD) < 0) {
+		errno = EBADF;
+		return -1;
+	}
+
+	char path[32];
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+	return open(path, flags | O_CLOEXEC);
+}
+
+int scallop_lang_jobserver_init(jobserver_t *jobserver, const char *makeflags)
+{
+	*jobserver = (jobserver_t) { ._read = -1, ._write = -1 };
+
+	size_t length = 0;
+	const char *const auth = makeflags ? find_auth(makeflags, &length) : NULL;
+	if (!auth || !length) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	const size_t fifo_length = strlen(FIFO_PREFIX);
+	if (length > fifo_length && !strncmp(auth, FIFO_PREFIX, fifo_length)) {
+		char *const path = strndup(auth + fifo_length, length - fifo_length);
+		if (!path)
+			return -1;
+
+		jobserver->_read = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+		if (jobserver->_read >= 0)
+			jobserver->_write = open(path, O_WRONLY | O_CLOEXEC);
+
+		const int error = errno;
+		free(path);
+		errno = error;
+	} else {
+		const char *const comma = memchr(auth, ',', length);
+		int read_fd = -1;
+		int write_fd = -1;
+		const bool valid = comma
+			&& parse_fd(auth, comma, &read_fd)
+			&& parse_fd(comma + 1, auth + length, &write_fd);
+		if (!valid) {
+			errno = EINVAL;
+			return -1;
+		}
+
+		// Only reads need their own file description, to make
+		// them non-blocking without affecting make
+		jobserver->_read = reopen(read_fd, O_RDONLY | O_NONBLOCK);
+		if (jobserver->_read >= 0) {
+			jobserver->_write = fcntl(write_fd, F_DUPFD_CLOEXEC, 0);
+			if (jobserver->_write < 0 && errno == EINVAL)
+				errno = EBADF;
+		}
+	}
+
+	if (jobserver->_read < 0 || jobserver->_write < 0) {
+		const int error = errno;
+		scallop_lang_jobserver_free(jobserver);
+		errno = error;
+		return -1;
+	}
+	return 0;
+}
+
+int scallop_lang_jobserver_fd(const jobserver_t *jobserver)
+{
+	return jobserver->_read;
+}
+
+int scallop_lang_jobserver_acquire(jobserver_t *jobserver, char *token)
+{
+	ssize_t amount = 0;
+	do
+		amount = read(jobserver->_read, token, 1);
+	while (amount < 0 && errno == EINTR);
+
+	if (amount == 1)
+		return 1;
+	if (amount < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return 0;
+
+	// We hold the write end open, so the pipe can't be at its end
+	if (amount == 0)
+		errno = EPIPE;
+	return -1;
+}
+
+int scallop_lang_jobserver_release(jobserver_t *jobserver, char token)
+{
+	ssize_t amount = 0;
+	do
+		amount = write(jobserver->_write, &token, 1);
+	while (amount < 0 && errno == EINTR);
+	return amount == 1 ? 0 : -1;
+}
+
+void scallop_lang_jobserver_free(jobserver_t *jobserver)
+{
+	if (jobserver->_read >= 0)
+		close(jobserver->_read);
+	if (jobserver->_write >= 0)
+		close(jobserver->_write);
+	*jobserver = (jobserver_t) { ._read = -1, ._write = -1 };
+}
@@ -1,27 +1,66 @@
 #include "scallop-lang/lex.h"
 
+#ifdef SCALLOP_LANG_LEX_STEPS
+size_t scallop_lang_lex_steps;
+#endif
+
 size_t _scallop_mbrtowc(
 	wchar_t *result,
 	struct libadt_const_lptr string,
 	mbstate_t *_mbstate
 );
 bool _scallop_read_error(_scallop_read_t read);
+bool _scallop_is_wide(struct libadt_const_lptr script);
+size_t _scallop_decode(
+	wchar_t *result,
+	struct libadt_const_lptr string
+);
 _scallop_read_t _scallop_read(
 	struct libadt_const_lptr script,
 	scallop_lang_classifier_fn *const previous
 );
+size_t _scallop_lex_skip(
+	scallop_lang_classifier_fn *type,
+	struct libadt_const_lptr script
+);
 scallop_lang_classifier_fn *_scallop_type(
 	scallop_lang_classifier_fn *type
 );
 struct scallop_lang_lex scallop_lang_lex_init(
 	struct libadt_const_lptr script
 );
+struct scallop_lang_lex scallop_lang_lex_init_wide(
+	const wchar_t *script,
+	size_t length
+);
 struct scallop_lang_lex scallop_lang_lex_next_raw(
 	struct scallop_lang_lex previous_lex
 );
+bool _scallop_lex_is_separator(scallop_lang_classifier_fn *type);
+int _scallop_lex_words_reserve(
+	struct scallop_lang_lex_words *words,
+	size_t amount
+);
+int _scallop_lex_words_append(
+	struct scallop_lang_lex_words *words,
+	struct scallop_lang_lex token
+);
+int _scallop_lex_words_terminate(
+	struct scallop_lang_lex_words *words,
+	size_t size
+);
+struct scallop_lang_lex _scallop_lex_next(
+	struct scallop_lang_lex previous,
+	struct scallop_lang_lex_words *words
+);
 struct scallop_lang_lex scallop_lang_lex_next(
 	struct scallop_lang_lex previous_lex
 );
+struct scallop_lang_lex scallop_lang_lex_next_normalized(
+	struct scallop_lang_lex previous,
+	struct scallop_lang_lex_words *words
+);
+void scallop_lang_lex_words_free(struct scallop_lang_lex_words *words);
 size_t _scallop_mbrtowc(
 	wchar_t *result,
 	struct libadt_const_lptr string,
@@ -31,3 +70,7 @@ ssize_t scallop_lang_lex_normalize_word(
 	struct libadt_const_lptr word,
 	struct libadt_lptr out
 );
+ssize_t scallop_lang_lex_normalize_wide_word(
+	struct libadt_const_lptr word,
+	struct libadt_lptr out
+);
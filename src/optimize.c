@@ -0,0 +1,634 @@
+#include "scallop-lang/optimize.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "scallop-lang/builtin.h"
+#include "scallop-lang/expand.h"
+#include "scallop-lang/lex.h"
+
+typedef struct scallop_lang_script script_t;
+typedef struct scallop_lang_script_block block_t;
+typedef struct scallop_lang_script_statement statement_t;
+typedef struct scallop_lang_script_word word_t;
+typedef struct scallop_lang_script_piece piece_t;
+typedef struct scallop_lang_optimize_stats stats_t;
+
+// Long enough for the longest command name that matters here
+#define NAME_MAX_LENGTH 8
+
+// The builtins whose output only depends on their arguments
+static const char *const pure_builtins[] = { "echo", "false", "true" };
+
+typedef struct {
+	script_t *script;
+	stats_t stats;
+} optimizer_t;
+
+static bool owns_block(const piece_t *piece)
+{
+	return piece->type == SCALLOP_LANG_SCRIPT_SUBSTITUTION
+		|| piece->type == SCALLOP_LANG_SCRIPT_BLOCK;
+}
+
+static struct libadt_const_lptr raw_of(const piece_t *piece)
+{
+	return (struct libadt_const_lptr) {
+		.buffer = piece->text,
+		.size = 1,
+		.length = (ssize_t)piece->length,
+	};
+}
+
+/*
+ * Interns literal text, counting text that was already interned.
+ */
+static const char *intern_literal(optimizer_t *optimizer, const char *text, size_t length)
+{
+	const size_t before = optimizer->script->_strings_length;
+	const char *const result = scallop_lang_script_intern(optimizer->script, text, length);
+	if (result && optimizer->script->_strings_length == before)
+		optimizer->stats.literals_shared++;
+	return result;
+}
+
+/*
+ * Writes the normalized text of a constant piece to out, which must
+ * be freed with free(). Returns 1 if the piece is constant, 0 if it
+ * isn't, or -1 on failure.
+ */
+static int constant_text(const piece_t *piece, char **out, size_t *length)
+{
+	if (piece->type == SCALLOP_LANG_SCRIPT_LITERAL) {
+		*out = malloc(piece->length + 1);
+		if (!*out)
+			return -1;
+		memcpy(*out, piece->text, piece->length + 1);
+		*length = piece->length;
+		return 1;
+	}
+	if (piece->type != SCALLOP_LANG_SCRIPT_RAW)
+		return 0;
+
+	struct scallop_lang_expand_plan plan = { 0 };
+	if (scallop_lang_expand_compile(raw_of(piece), &plan))
+		return errno == ENOMEM ? -1 : 0;
+
+	int result = 0;
+	if (scallop_lang_expand_is_literal(&plan)) {
+		*out = scallop_lang_expand_apply(&plan, NULL, length);
+		result = *out ? 1 : -1;
+	}
+	scallop_lang_expand_free(&plan);
+	return result;
+}
+
+/*
+ * Writes the name a word gives a command to name, or an empty
+ * string if the word isn't a short constant.
+ */
+static void word_name(const word_t *word, char name[NAME_MAX_LENGTH + 1])
+{
+	name[0] = '\0';
+	if (word->pieces_length != 1)
+		return;
+
+	const piece_t *const piece = &word->pieces[0];
+	if (piece->type == SCALLOP_LANG_SCRIPT_LITERAL) {
+		if (piece->length <= NAME_MAX_LENGTH)
+			memcpy(name, piece->text, piece->length + 1);
+		return;
+	}
+	if (piece->type != SCALLOP_LANG_SCRIPT_RAW || memchr(piece->text, '$', piece->length))
+		return;
+
+	const ssize_t length = scallop_lang_lex_normalize_word(
+		raw_of(piece),
+		(struct libadt_lptr) { .buffer = name, .size = 1, .length = NAME_MAX_LENGTH }
+	);
+	name[length >= 0 && length <= NAME_MAX_LENGTH ? length : 0] = '\0';
+}
+
+static bool is_pure_name(const char *name)
+{
+	for (size_t i = 0; i < sizeof(pure_builtins) / sizeof(*pure_builtins); i++)
+		if (strcmp(name, pure_builtins[i]) == 0)
+			return true;
+	return false;
+}
+
+/*
+ * Words
+ */
+
+static int normalize_word(optimizer_t *optimizer, word_t *word)
+{
+	for (size_t i = 0; i < word->pieces_length; i++) {
+		if (word->pieces[i].type != SCALLOP_LANG_SCRIPT_RAW)
+			continue;
+
+		struct scallop_lang_expand_plan plan = { 0 };
+		if (scallop_lang_expand_compile(raw_of(&word->pieces[i]), &plan)) {
+			// Invalid words fail when they're expanded, as before
+			if (errno == ENOMEM)
+				return -1;
+			continue;
+		}
+
+		// An empty word, like '', still needs one piece
+		const size_t parts_length = plan.parts_length ? plan.parts_length : 1;
+		piece_t *const pieces = calloc(
+			word->pieces_length - 1 + parts_length,
+			sizeof(*pieces)
+		);
+		if (!pieces) {
+			scallop_lang_expand_free(&plan);
+			return -1;
+		}
+
+		memcpy(pieces, word->pieces, i * sizeof(*pieces));
+		for (size_t j = 0; j < parts_length; j++) {
+			const struct scallop_lang_expand_part part = plan.parts_length
+				? plan.parts[j]
+				: (struct scallop_lang_expand_part) { .slot = -1 };
+			const bool literal = part.slot < 0;
+			const char *const text = literal
+				? intern_literal(optimizer, plan.text + part.offset, part.length)
+				: scallop_lang_script_intern(
+					optimizer->script,
+					plan.names[part.slot],
+					strlen(plan.names[part.slot])
+				);
+			if (!text) {
+				free(pieces);
+				scallop_lang_expand_free(&plan);
+				return -1;
+			}
+			pieces[i + j] = (piece_t) {
+				.type = literal
+					? SCALLOP_LANG_SCRIPT_LITERAL
+					: SCALLOP_LANG_SCRIPT_VARIABLE,
+				.text = text,
+				.length = literal ? part.length : strlen(text),
+			};
+		}
+		memcpy(
+			pieces + i + parts_length,
+			word->pieces + i + 1,
+			(word->pieces_length - i - 1) * sizeof(*pieces)
+		);
+		scallop_lang_expand_free(&plan);
+
+		free(word->pieces);
+		word->pieces = pieces;
+		word->pieces_length += parts_length - 1;
+		i += parts_length - 1;
+		optimizer->stats.words_normalized++;
+	}
+	return 0;
+}
+
+/*
+ * Runs a pass on every word of a block and the blocks inside it,
+ * inner blocks first.
+ */
+static int each_word(
+	optimizer_t *optimizer,
+	block_t *block,
+	int (*pass)(optimizer_t *optimizer, word_t *word)
+)
+{
+	for (size_t i = 0; i < block->statements_length; i++) {
+		statement_t *const statement = &block->statements[i];
+		for (size_t j = 0; j < statement->words_length; j++) {
+			word_t *const word = &statement->words[j];
+			for (size_t k = 0; k < word->pieces_length; k++)
+				if (owns_block(&word->pieces[k]))
+					if (each_word(optimizer, word->pieces[k].block, pass))
+						return -1;
+			if (pass(optimizer, word))
+				return -1;
+		}
+	}
+
+	for (size_t i = 0; i < block->hoisted_length; i++)
+		if (each_word(optimizer, block->hoisted[i], pass))
+			return -1;
+	return 0;
+}
+
+/*
+ * Folding
+ */
+
+static void free_arguments(char ***arguments, size_t length)
+{
+	for (size_t i = 0; i < length; i++) {
+		if (!arguments[i])
+			continue;
+		for (char **argument = arguments[i]; *argument; argument++)
+			free(*argument);
+		free(arguments[i]);
+	}
+	free(arguments);
+}
+
+/*
+ * Writes the text of a word whose pieces are all constant to out,
+ * which must be freed with free(). Returns 1 if the word is constant,
+ * 0 if it isn't, or -1 on failure.
+ */
+static int constant_word(const word_t *word, char **out, size_t *length)
+{
+	*out = NULL;
+	*length = 0;
+	for (size_t i = 0; i < word->pieces_length; i++) {
+		char *text = NULL;
+		size_t text_length = 0;
+		const int result = constant_text(&word->pieces[i], &text, &text_length);
+		if (result <= 0) {
+			free(*out);
+			*out = NULL;
+			return result;
+		}
+
+		char *const joined = realloc(*out, *length + text_length + 1);
+		if (!joined) {
+			free(text);
+			free(*out);
+			*out = NULL;
+			return -1;
+		}
+		memcpy(joined + *length, text, text_length + 1);
+		free(text);
+		*out = joined;
+		*length += text_length;
+	}
+
+	if (!*out) {
+		*out = calloc(1, 1);
+		return *out ? 1 : -1;
+	}
+	return 1;
+}
+
+/*
+ * Builds the arguments of a statement calling a pure builtin with
+ * constant arguments, adding their length to size. Returns 1 if the
+ * statement is one, 0 if it isn't, or -1 on failure.
+ */
+static int constant_arguments(const statement_t *statement, char ***out, size_t *size)
+{
+	char name[NAME_MAX_LENGTH + 1];
+	word_name(&statement->words[0], name);
+	if (!is_pure_name(name))
+		return 0;
+
+	*out = calloc(statement->words_length + 1, sizeof(**out));
+	if (!*out)
+		return -1;
+
+	for (size_t i = 0; i < statement->words_length; i++) {
+		size_t length = 0;
+		const int result = constant_word(&statement->words[i], &(*out)[i], &length);
+		if (result <= 0)
+			return result;
+		*size += length + 1;
+	}
+	return 1;
+}
+
+/*
+ * Runs the statements of a block, returning their output without
+ * trailing newlines, or NULL if one failed.
+ */
+static char *run_builtins(char ***arguments, size_t length, size_t size)
+{
+	int fds[2];
+	if (pipe(fds))
+		return NULL;
+
+	const struct scallop_lang_builtin_context context = {
+		.in = -1,
+		.out = fds[1],
+		.err = fds[1],
+	};
+	bool failed = false;
+	for (size_t i = 0; i < length && !failed; i++) {
+		size_t argc = 0;
+		while (arguments[i][argc])
+			argc++;
+		const struct scallop_lang_builtin *const builtin
+			= scallop_lang_builtin_find_name(arguments[i][0]);
+		failed = builtin->run(&context, argc, arguments[i]) != 0;
+	}
+	close(fds[1]);
+
+	char *const output = malloc(size + 1);
+	size_t used = 0;
+	while (output && !failed) {
+		const ssize_t amount = read(fds[0], output + used, size - used);
+		if (amount < 0 && errno == EINTR)
+			continue;
+		if (amount <= 0) {
+			failed = amount < 0;
+			break;
+		}
+		used += (size_t)amount;
+	}
+	close(fds[0]);
+
+	if (failed || !output) {
+		free(output);
+		return NULL;
+	}
+	while (used && output[used - 1] == '\n')
+		used--;
+	output[used] = '\0';
+	return output;
+}
+
+/*
+ * Replaces a substitution with its output, if it can be known now.
+ */
+static int fold_substitution(optimizer_t *optimizer, piece_t *piece)
+{
+	block_t *const block = piece->block;
+	char ***const arguments = calloc(
+		block->statements_length ? block->statements_length : 1,
+		sizeof(*arguments)
+	);
+	if (!arguments)
+		return -1;
+
+	// Each argument is written with at most one separator, and
+	// output that fits in PIPE_BUF never blocks the pipe
+	size_t size = 0;
+	int result = 1;
+	for (size_t i = 0; i < block->statements_length && result > 0; i++)
+		result = constant_arguments(&block->statements[i], &arguments[i], &size);
+	if (result <= 0 || size >= PIPE_BUF) {
+		free_arguments(arguments, block->statements_length);
+		return result < 0 ? -1 : 0;
+	}
+
+	char *const output = run_builtins(arguments, block->statements_length, size);
+	free_arguments(arguments, block->statements_length);
+	if (!output)
+		return 0;
+
+	const char *const text = intern_literal(optimizer, output, strlen(output));
+	if (!text) {
+		free(output);
+		return -1;
+	}
+	*piece = (piece_t) {
+		.type = SCALLOP_LANG_SCRIPT_LITERAL,
+		.text = text,
+		.length = strlen(output),
+	};
+	free(output);
+	scallop_lang_script_block_free(block);
+	optimizer->stats.substitutions_folded++;
+	return 0;
+}
+
+static int fold_word(optimizer_t *optimizer, word_t *word)
+{
+	for (size_t i = 0; i < word->pieces_length; i++)
+		if (word->pieces[i].type == SCALLOP_LANG_SCRIPT_SUBSTITUTION)
+			if (fold_substitution(optimizer, &word->pieces[i]))
+				return -1;
+	return 0;
+}
+
+/*
+ * Hoisting
+ */
+
+/*
+ * Tests if a block only calls pure builtins.
+ */
+static bool is_pure(const block_t *block)
+{
+	for (size_t i = 0; i < block->statements_length; i++) {
+		const statement_t *const statement = &block->statements[i];
+		char name[NAME_MAX_LENGTH + 1];
+		word_name(&statement->words[0], name);
+		if (!is_pure_name(name))
+			return false;
+
+		for (size_t j = 0; j < statement->words_length; j++) {
+			const word_t *const word = &statement->words[j];
+			for (size_t k = 0; k < word->pieces_length; k++) {
+				const piece_t *const piece = &word->pieces[k];
+				if (piece->type == SCALLOP_LANG_SCRIPT_BLOCK)
+					return false;
+				const bool nested = piece->type == SCALLOP_LANG_SCRIPT_SUBSTITUTION
+					|| piece->type == SCALLOP_LANG_SCRIPT_HOISTED;
+				if (nested && !is_pure(piece->block))
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+/*
+ * Tests if running a block might set a variable: if any statement
+ * in it, or in the blocks inside it, calls set or a command whose
+ * name isn't constant.
+ */
+static bool may_set(const block_t *block)
+{
+	for (size_t i = 0; i < block->statements_length; i++) {
+		const statement_t *const statement = &block->statements[i];
+		const bool is_block = statement->words_length == 1
+			&& statement->words[0].pieces_length == 1
+			&& statement->words[0].pieces[0].type == SCALLOP_LANG_SCRIPT_BLOCK;
+		if (!is_block) {
+			char name[NAME_MAX_LENGTH + 1];
+			word_name(&statement->words[0], name);
+			if (!name[0] || strcmp(name, "set") == 0)
+				return true;
+		}
+
+		for (size_t j = 0; j < statement->words_length; j++) {
+			const word_t *const word = &statement->words[j];
+			for (size_t k = 0; k < word->pieces_length; k++) {
+				const piece_t *const piece = &word->pieces[k];
+				if (piece->block && may_set(piece->block))
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+static int compare_sources(const void *a, const void *b)
+{
+	const struct libadt_const_lptr first = (*(piece_t *const *)a)->block->source;
+	const struct libadt_const_lptr second = (*(piece_t *const *)b)->block->source;
+	if (first.length != second.length)
+		return first.length < second.length ? -1 : 1;
+	return memcmp(first.buffer, second.buffer, (size_t)first.length);
+}
+
+static bool same_source(const piece_t *a, const piece_t *b)
+{
+	return compare_sources(&a, &b) == 0;
+}
+
+static int hoist_block(optimizer_t *optimizer, block_t *block)
+{
+	size_t candidates_length = 0;
+	for (size_t i = 0; i < block->statements_length; i++) {
+		statement_t *const statement = &block->statements[i];
+		for (size_t j = 0; j < statement->words_length; j++) {
+			word_t *const word = &statement->words[j];
+			for (size_t k = 0; k < word->pieces_length; k++) {
+				piece_t *const piece = &word->pieces[k];
+				if (owns_block(piece) && hoist_block(optimizer, piece->block))
+					return -1;
+				if (piece->type == SCALLOP_LANG_SCRIPT_SUBSTITUTION)
+					candidates_length++;
+			}
+		}
+	}
+	if (candidates_length < 2 || may_set(block))
+		return 0;
+
+	piece_t **const candidates = calloc(candidates_length, sizeof(*candidates));
+	if (!candidates)
+		return -1;
+	candidates_length = 0;
+	for (size_t i = 0; i < block->statements_length; i++) {
+		statement_t *const statement = &block->statements[i];
+		for (size_t j = 0; j < statement->words_length; j++) {
+			word_t *const word = &statement->words[j];
+			for (size_t k = 0; k < word->pieces_length; k++) {
+				piece_t *const piece = &word->pieces[k];
+				const bool candidate = piece->type == SCALLOP_LANG_SCRIPT_SUBSTITUTION
+					&& is_pure(piece->block);
+				if (candidate)
+					candidates[candidates_length++] = piece;
+			}
+		}
+	}
+
+	// Equal substitutions end up next to each other
+	qsort(candidates, candidates_length, sizeof(*candidates), compare_sources);
+
+	int result = 0;
+	for (size_t first = 0, end = 0; first < candidates_length; first = end) {
+		for (end = first + 1; end < candidates_length; end++)
+			if (!same_source(candidates[first], candidates[end]))
+				break;
+		if (end - first < 2)
+			continue;
+
+		block_t **const hoisted = realloc(
+			block->hoisted,
+			(block->hoisted_length + 1) * sizeof(*hoisted)
+		);
+		if (!hoisted) {
+			result = -1;
+			break;
+		}
+		block->hoisted = hoisted;
+
+		block_t *const kept = candidates[first]->block;
+		const size_t slot = block->hoisted_length;
+		block->hoisted[block->hoisted_length++] = kept;
+		for (size_t i = first; i < end; i++) {
+			if (candidates[i]->block != kept)
+				scallop_lang_script_block_free(candidates[i]->block);
+			*candidates[i] = (piece_t) {
+				.type = SCALLOP_LANG_SCRIPT_HOISTED,
+				.block = kept,
+				.slot = slot,
+			};
+		}
+		optimizer->stats.substitutions_hoisted += end - first;
+	}
+
+	free(candidates);
+	return result;
+}
+
+/*
+ * Merging
+ */
+
+static int merge_word(optimizer_t *optimizer, word_t *word)
+{
+	size_t kept = 0;
+	size_t i = 0;
+	for (; i < word->pieces_length; i++) {
+		piece_t *const piece = &word->pieces[i];
+		piece_t *const last = kept ? &word->pieces[kept - 1] : NULL;
+		const bool merge = last
+			&& last->type == SCALLOP_LANG_SCRIPT_LITERAL
+			&& piece->type == SCALLOP_LANG_SCRIPT_LITERAL;
+		if (!merge) {
+			word->pieces[kept++] = *piece;
+			continue;
+		}
+
+		const size_t length = last->length + piece->length;
+		char *const text = malloc(length + 1);
+		if (!text)
+			goto error;
+		memcpy(text, last->text, last->length);
+		memcpy(text + last->length, piece->text, piece->length);
+
+		const char *const merged = intern_literal(optimizer, text, length);
+		free(text);
+		if (!merged)
+			goto error;
+		last->text = merged;
+		last->length = length;
+		optimizer->stats.slices_merged++;
+	}
+	word->pieces_length = kept;
+	return 0;
+
+error:
+	// Keep the pieces that weren't merged yet
+	memmove(
+		&word->pieces[kept],
+		&word->pieces[i],
+		(word->pieces_length - i) * sizeof(*word->pieces)
+	);
+	word->pieces_length = kept + word->pieces_length - i;
+	return -1;
+}
+
+int scallop_lang_optimize(script_t *script, int passes, stats_t *stats)
+{
+	optimizer_t optimizer = { .script = script };
+
+	int result = 0;
+	if (!result && (passes & SCALLOP_LANG_OPTIMIZE_WORDS))
+		result = each_word(&optimizer, script->root, normalize_word);
+	if (!result && (passes & SCALLOP_LANG_OPTIMIZE_FOLD))
+		result = each_word(&optimizer, script->root, fold_word);
+	if (!result && (passes & SCALLOP_LANG_OPTIMIZE_HOIST))
+		result = hoist_block(&optimizer, script->root);
+	if (!result && (passes & SCALLOP_LANG_OPTIMIZE_MERGE))
+		result = each_word(&optimizer, script->root, merge_word);
+
+	if (stats) {
+		stats->words_normalized += optimizer.stats.words_normalized;
+		stats->literals_shared += optimizer.stats.literals_shared;
+		stats->substitutions_folded += optimizer.stats.substitutions_folded;
+		stats->substitutions_hoisted += optimizer.stats.substitutions_hoisted;
+		stats->slices_merged += optimizer.stats.slices_merged;
+	}
+	return result;
+}
@@ -0,0 +1,276 @@
+// For mkostemp()
+#define _GNU_SOURCE
+
+#include "scallop-lang/output.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+typedef struct scallop_lang_output output_t;
+typedef struct scallop_lang_output_stream stream_t;
+
+// The size of reads when copying a spilled buffer
+#define COPY_BUFFER_SIZE (64 * 1024)
+
+struct scallop_lang_output_stream {
+	char *buffer;
+	size_t length;
+	size_t capacity;
+
+	// An unlinked temporary file, once the buffer has spilled
+	int spill;
+	bool closed;
+};
+
+static int write_all(int fd, const char *buffer, size_t length)
+{
+	while (length) {
+		const ssize_t amount = write(fd, buffer, length);
+		if (amount < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buffer += amount;
+		length -= (size_t)amount;
+	}
+	return 0;
+}
+
+static void release(output_t *output, stream_t *stream)
+{
+	output->_memory -= stream->capacity;
+	free(stream->buffer);
+	stream->buffer = NULL;
+	stream->length = 0;
+	stream->capacity = 0;
+}
+
+static int open_spill(void)
+{
+	const char *directory = getenv("TMPDIR");
+	if (!directory || !*directory)
+		directory = "/tmp";
+
+	char path[PATH_MAX];
+	const int length = snprintf(path, sizeof(path), "%s/scallop-output-XXXXXX", directory);
+	if (length < 0 || (size_t)length >= sizeof(path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	// Commands are forked while streams are open, and mustn't
+	// inherit them
+	const int fd = mkostemp(path, O_CLOEXEC);
+	if (fd >= 0)
+		unlink(path);
+	return fd;
+}
+
+/*
+ * Moves a stream's buffer to a temporary file, so later writes
+ * to it don't use memory.
+ */
+static int spill(output_t *output, stream_t *stream)
+{
+	stream->spill = open_spill();
+	if (stream->spill < 0)
+		return -1;
+	if (write_all(stream->spill, stream->buffer, stream->length))
+		return -1;
+	release(output, stream);
+	return 0;
+}
+
+static int buffer(
+	output_t *output,
+	stream_t *stream,
+	const char *data,
+	size_t length,
+	bool may_spill
+)
+{
+	if (stream->spill >= 0)
+		return write_all(stream->spill, data, length);
+
+	if (stream->length + length > stream->capacity) {
+		size_t capacity = stream->capacity ? stream->capacity : 256;
+		while (capacity < stream->length + length) {
+			if (capacity > SIZE_MAX / 2) {
+				errno = ENOMEM;
+				return -1;
+			}
+			capacity *= 2;
+		}
+
+		const size_t growth = capacity - stream->capacity;
+		if (may_spill && output->_memory + growth > output->_memory_limit) {
+			if (spill(output, stream))
+				return -1;
+			return write_all(stream->spill, data, length);
+		}
+
+		char *const result = realloc(stream->buffer, capacity);
+		if (!result)
+			return -1;
+		stream->buffer = result;
+		stream->capacity = capacity;
+		output->_memory += growth;
+	}
+
+	memcpy(stream->buffer + stream->length, data, length);
+	stream->length += length;
+	return 0;
+}
+
+/*
+ * Writes out and frees everything buffered for a stream.
+ */
+static int flush(output_t *output, stream_t *stream)
+{
+	if (stream->spill < 0) {
+		const int result = write_all(output->_fd, stream->buffer, stream->length);
+		release(output, stream);
+		return result;
+	}
+
+	char *const copy = malloc(COPY_BUFFER_SIZE);
+	if (!copy || lseek(stream->spill, 0, SEEK_SET) < 0) {
+		free(copy);
+		return -1;
+	}
+
+	int result = 0;
+	for (;;) {
+		const ssize_t amount = read(stream->spill, copy, COPY_BUFFER_SIZE);
+		if (amount < 0 && errno == EINTR)
+			continue;
+		if (amount <= 0) {
+			result = amount < 0 ? -1 : 0;
+			break;
+		}
+		if (write_all(output->_fd, copy, (size_t)amount)) {
+			result = -1;
+			break;
+		}
+	}
+
+	free(copy);
+	close(stream->spill);
+	stream->spill = -1;
+	return result;
+}
+
+/*
+ * Writes the complete lines buffered for a stream.
+ */
+static int flush_lines(output_t *output, stream_t *stream)
+{
+	size_t end = stream->length;
+	while (end && stream->buffer[end - 1] != '\n')
+		end--;
+
+	// A single line too long to buffer is written in pieces
+	if (!end && output->_memory > output->_memory_limit)
+		end = stream->length;
+	if (!end)
+		return 0;
+
+	if (write_all(output->_fd, stream->buffer, end))
+		return -1;
+	memmove(stream->buffer, stream->buffer + end, stream->length - end);
+	stream->length -= end;
+	return 0;
+}
+
+int scallop_lang_output_init(
+	output_t *output,
+	int fd,
+	size_t streams,
+	enum scallop_lang_output_mode mode,
+	size_t memory_limit
+)
+{
+	*output = (output_t) {
+		._fd = fd,
+		._mode = mode,
+		._streams_length = streams,
+		._memory_limit = memory_limit,
+	};
+
+	output->_streams = calloc(streams ? streams : 1, sizeof(*output->_streams));
+	if (!output->_streams)
+		return -1;
+	for (size_t i = 0; i < streams; i++)
+		output->_streams[i].spill = -1;
+	return 0;
+}
+
+int scallop_lang_output_write(
+	output_t *output,
+	size_t index,
+	const void *data,
+	size_t length
+)
+{
+	if (index >= output->_streams_length || output->_streams[index].closed) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	stream_t *const stream = &output->_streams[index];
+	if (output->_mode == SCALLOP_LANG_OUTPUT_LINES) {
+		if (buffer(output, stream, data, length, false))
+			return -1;
+		return flush_lines(output, stream);
+	}
+
+	if (index == output->_head)
+		return write_all(output->_fd, data, length);
+	return buffer(output, stream, data, length, true);
+}
+
+int scallop_lang_output_close(output_t *output, size_t index)
+{
+	if (index >= output->_streams_length || output->_streams[index].closed) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	stream_t *const stream = &output->_streams[index];
+	stream->closed = true;
+	if (output->_mode == SCALLOP_LANG_OUTPUT_LINES)
+		return flush(output, stream);
+
+	if (index != output->_head)
+		return 0;
+
+	// Catch up on every stream up to the next unfinished one,
+	// which writes straight through from now on
+	while (++output->_head < output->_streams_length) {
+		stream_t *const next = &output->_streams[output->_head];
+		if (flush(output, next))
+			return -1;
+		if (!next->closed)
+			break;
+	}
+	return 0;
+}
+
+void scallop_lang_output_free(output_t *output)
+{
+	for (size_t i = 0; i < output->_streams_length; i++) {
+		free(output->_streams[i].buffer);
+		if (output->_streams[i].spill >= 0)
+			close(output->_streams[i].spill);
+	}
+	free(output->_streams);
+	*output = (output_t) { 0 };
+}
@@ -0,0 +1,213 @@
+#include "scallop-lang/parse.h"
+
+#include <errno.h>
+#include <stdbool.h>
+
+#include "scallop-lang/lex.h"
+
+typedef struct scallop_lang_parse_event event_t;
+typedef enum scallop_lang_parse_event_type event_type;
+
+typedef struct {
+	// The first and one past the last character of the statement
+	// open at this depth, or NULL if there isn't one
+	const char *begin;
+	const char *end;
+
+	// The type closing the bracket that opened this depth
+	scallop_lang_classifier_fn *close;
+} frame_t;
+
+typedef struct {
+	struct libadt_const_lptr script;
+	scallop_lang_parse_fn *handler;
+	void *user;
+
+	size_t depth;
+	frame_t frames[SCALLOP_LANG_PARSE_MAX_DEPTH + 1];
+} parser_t;
+
+static struct libadt_const_lptr span(
+	const parser_t *parser,
+	const char *begin,
+	const char *end
+)
+{
+	const ssize_t size = (ssize_t)parser->script.size;
+	return libadt_const_lptr_truncate(
+		libadt_const_lptr_index(
+			parser->script,
+			(begin - (const char *)parser->script.buffer) / size
+		),
+		(size_t)((end - begin) / size)
+	);
+}
+
+static const char *end_of(struct libadt_const_lptr value)
+{
+	return (const char *)value.buffer + value.length * (ssize_t)value.size;
+}
+
+static int emit(
+	parser_t *parser,
+	event_type type,
+	struct libadt_const_lptr value,
+	size_t depth
+)
+{
+	const event_t event = {
+		.type = type,
+		.value = value,
+		.depth = depth,
+	};
+	return parser->handler(parser->user, &event) ? 1 : 0;
+}
+
+/*
+ * Reports the beginning of a statement at the current depth, unless
+ * one is already open, and extends it over value.
+ */
+static int extend_statement(parser_t *parser, struct libadt_const_lptr value)
+{
+	frame_t *const frame = &parser->frames[parser->depth];
+	if (!frame->begin) {
+		frame->begin = value.buffer;
+		if (emit(
+			parser,
+			SCALLOP_LANG_PARSE_STATEMENT_BEGIN,
+			libadt_const_lptr_truncate(value, 0),
+			parser->depth
+		))
+			return 1;
+	}
+	frame->end = end_of(value);
+	return 0;
+}
+
+static int end_statement(parser_t *parser)
+{
+	frame_t *const frame = &parser->frames[parser->depth];
+	if (!frame->begin)
+		return 0;
+
+	const struct libadt_const_lptr statement = span(
+		parser,
+		frame->begin,
+		frame->end
+	);
+	frame->begin = frame->end = NULL;
+	return emit(parser, SCALLOP_LANG_PARSE_STATEMENT_END, statement, parser->depth);
+}
+
+static int open_bracket(
+	parser_t *parser,
+	struct libadt_const_lptr bracket,
+	bool substitution
+)
+{
+	if (parser->depth == SCALLOP_LANG_PARSE_MAX_DEPTH) {
+		errno = E2BIG;
+		return -1;
+	}
+	if (extend_statement(parser, bracket))
+		return 1;
+
+	const int result = emit(
+		parser,
+		substitution
+			? SCALLOP_LANG_PARSE_SUBSTITUTION_BEGIN
+			: SCALLOP_LANG_PARSE_BLOCK_BEGIN,
+		bracket,
+		parser->depth
+	);
+
+	parser->frames[++parser->depth] = (frame_t) {
+		.close = substitution
+			? (scallop_lang_classifier_fn *)scallop_lang_classifier_square_block_end
+			: (scallop_lang_classifier_fn *)scallop_lang_classifier_curly_block_end,
+	};
+	return result;
+}
+
+static int close_bracket(
+	parser_t *parser,
+	struct libadt_const_lptr bracket,
+	scallop_lang_classifier_fn *type
+)
+{
+	if (parser->depth == 0 || parser->frames[parser->depth].close != type) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (end_statement(parser))
+		return 1;
+
+	parser->depth--;
+	parser->frames[parser->depth].end = end_of(bracket);
+	return emit(
+		parser,
+		type == scallop_lang_classifier_square_block_end
+			? SCALLOP_LANG_PARSE_SUBSTITUTION_END
+			: SCALLOP_LANG_PARSE_BLOCK_END,
+		bracket,
+		parser->depth
+	);
+}
+
+int scallop_lang_parse(
+	struct libadt_const_lptr script,
+	scallop_lang_parse_fn *handler,
+	void *user
+)
+{
+	parser_t parser = {
+		.script = script,
+		.handler = handler,
+		.user = user,
+	};
+
+	struct scallop_lang_lex lex = scallop_lang_lex_init(script);
+	for (;;) {
+		lex = scallop_lang_lex_next(lex);
+
+		int result = 0;
+		if (scallop_lang_classifier_is_word(lex.type)) {
+			result = extend_statement(&parser, lex.value);
+			if (!result)
+				result = emit(&parser, SCALLOP_LANG_PARSE_WORD, lex.value, parser.depth);
+		} else if (lex.type == scallop_lang_classifier_statement_separator) {
+			result = end_statement(&parser);
+		} else if (
+			lex.type == scallop_lang_classifier_curly_block
+			|| lex.type == scallop_lang_classifier_square_block
+			|| lex.type == scallop_lang_classifier_curly_block_end
+			|| lex.type == scallop_lang_classifier_square_block_end
+		) {
+			// Consecutive brackets of one kind arrive as one token
+			for (ssize_t i = 0; !result && i < lex.value.length; i++) {
+				const struct libadt_const_lptr bracket = libadt_const_lptr_truncate(
+					libadt_const_lptr_index(lex.value, i),
+					1
+				);
+				if (lex.type == scallop_lang_classifier_curly_block)
+					result = open_bracket(&parser, bracket, false);
+				else if (lex.type == scallop_lang_classifier_square_block)
+					result = open_bracket(&parser, bracket, true);
+				else
+					result = close_bracket(&parser, bracket, lex.type);
+			}
+		} else if (lex.type == scallop_lang_classifier_end) {
+			if (parser.depth > 0) {
+				errno = EINVAL;
+				return -1;
+			}
+			return end_statement(&parser);
+		} else if (lex.type == scallop_lang_classifier_unexpected) {
+			errno = EINVAL;
+			return -1;
+		}
+
+		if (result)
+			return result;
+	}
+}
@@ -0,0 +1,1054 @@
+#include "scallop-lang/remote.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "scallop-lang/events.h"
+#include "scallop-lang/lex.h"
+
+typedef struct scallop_lang_remote remote_t;
+typedef struct scallop_lang_remote_file file_t;
+typedef struct scallop_lang_remote_job job_t;
+typedef struct scallop_lang_remote_options options_t;
+typedef struct scallop_lang_remote_worker worker_t;
+typedef struct scallop_lang_events_watch watch_t;
+
+#define MESSAGE_MAGIC 0x53434c57u
+
+// The largest message accepted, to bound allocations
+#define PAYLOAD_MAX (64 * 1024 * 1024)
+
+// The most output read from a command at once
+#define OUTPUT_CHUNK (64 * 1024)
+
+typedef enum {
+	MESSAGE_HELLO,
+	MESSAGE_JOB,
+	MESSAGE_STDOUT,
+	MESSAGE_STDERR,
+	MESSAGE_EXIT,
+} message_type;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t type;
+	uint64_t job;
+	uint64_t length;
+} header_t;
+
+typedef struct {
+	uint64_t capacity;
+} hello_t;
+
+typedef struct {
+	uint64_t statement_length;
+	uint32_t environment_length;
+	uint32_t files_length;
+} job_header_t;
+
+typedef struct {
+	uint64_t path_length;
+	uint64_t length;
+} file_header_t;
+
+typedef struct {
+	int32_t status;
+	int32_t error;
+} exit_t;
+
+typedef struct {
+	char *data;
+	size_t length;
+	size_t capacity;
+} buffer_t;
+
+static int append(buffer_t *buffer, const void *data, size_t length)
+{
+	if (buffer->length + length > buffer->capacity) {
+		size_t capacity = buffer->capacity ? buffer->capacity : 256;
+		while (capacity < buffer->length + length)
+			capacity *= 2;
+		char *const grown = realloc(buffer->data, capacity);
+		if (!grown)
+			return -1;
+		buffer->data = grown;
+		buffer->capacity = capacity;
+	}
+	memcpy(buffer->data + buffer->length, data, length);
+	buffer->length += length;
+	return 0;
+}
+
+static int read_all(int fd, char *buffer, size_t length)
+{
+	while (length) {
+		const ssize_t amount = read(fd, buffer, length);
+		if (amount < 0 && errno == EINTR)
+			continue;
+		if (amount < 0)
+			return -1;
+		if (amount == 0) {
+			errno = ECONNRESET;
+			return -1;
+		}
+		buffer += amount;
+		length -= (size_t)amount;
+	}
+	return 0;
+}
+
+static int send_all(int fd, const char *buffer, size_t length)
+{
+	while (length) {
+		const ssize_t amount = send(fd, buffer, length, MSG_NOSIGNAL);
+		if (amount < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buffer += amount;
+		length -= (size_t)amount;
+	}
+	return 0;
+}
+
+static int write_all(int fd, const char *buffer, size_t length)
+{
+	while (length) {
+		const ssize_t amount = write(fd, buffer, length);
+		if (amount < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buffer += amount;
+		length -= (size_t)amount;
+	}
+	return 0;
+}
+
+static int send_message(
+	int fd,
+	message_type type,
+	uint64_t job,
+	const void *payload,
+	size_t length
+)
+{
+	const header_t header = {
+		.magic = MESSAGE_MAGIC,
+		.type = type,
+		.job = job,
+		.length = length,
+	};
+	if (send_all(fd, (const char *)&header, sizeof(header)))
+		return -1;
+	return send_all(fd, payload, length);
+}
+
+/*
+ * Reads a whole message, with a terminator after the payload.
+ */
+static int receive_message(int fd, header_t *header, char **payload)
+{
+	*payload = NULL;
+	if (read_all(fd, (char *)header, sizeof(*header)))
+		return -1;
+	if (header->magic != MESSAGE_MAGIC || header->length > PAYLOAD_MAX) {
+		errno = EPROTO;
+		return -1;
+	}
+
+	*payload = malloc(header->length + 1);
+	if (!*payload)
+		return -1;
+	if (read_all(fd, *payload, header->length)) {
+		free(*payload);
+		*payload = NULL;
+		return -1;
+	}
+	(*payload)[header->length] = '\0';
+	return 0;
+}
+
+static int set_flags(int fd, int status_flags)
+{
+	if (fcntl(fd, F_SETFD, FD_CLOEXEC))
+		return -1;
+	if (!status_flags)
+		return 0;
+	const int flags = fcntl(fd, F_GETFL);
+	return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | status_flags);
+}
+
+/*
+ * Worker
+ */
+
+typedef struct {
+	bool used;
+	uint64_t job;
+	pid_t pid;
+	bool exited;
+	int status;
+
+	// Each stream's pipe, until it reaches the end
+	int fds[2];
+	watch_t *watches[2];
+} slot_t;
+
+typedef struct {
+	int socket;
+	int directory;
+	struct scallop_lang_events events;
+	slot_t *slots;
+	size_t capacity;
+} server_t;
+
+static void free_argv(char **argv)
+{
+	if (!argv)
+		return;
+	for (char **word = argv; *word; word++)
+		free(*word);
+	free(argv);
+}
+
+/*
+ * Splits a single statement into the words of a command.
+ */
+static char **split_statement(struct libadt_const_lptr statement)
+{
+	char **argv = calloc(1, sizeof(*argv));
+	size_t length = 0;
+	bool ended = false;
+	if (!argv)
+		return NULL;
+
+	struct scallop_lang_lex token = scallop_lang_lex_init(statement);
+	for (;;) {
+		token = scallop_lang_lex_next(token);
+		if (token.type == scallop_lang_classifier_end)
+			break;
+		if (token.type == scallop_lang_classifier_statement_separator) {
+			ended = length > 0;
+			continue;
+		}
+		const bool ignored = token.type == scallop_lang_classifier_word_separator
+			|| token.type == scallop_lang_classifier_line_comment;
+		if (ignored)
+			continue;
+		// Blocks, and anything after the first statement, aren't
+		// a single command
+		if (!scallop_lang_classifier_is_word(token.type) || ended)
+			goto invalid;
+
+		const ssize_t size = scallop_lang_lex_normalize_word(
+			token.value,
+			(struct libadt_lptr) { 0 }
+		);
+		if (size < 0)
+			goto invalid;
+
+		char **const grown = realloc(argv, (length + 2) * sizeof(*argv));
+		if (!grown)
+			goto error;
+		argv = grown;
+		argv[length + 1] = NULL;
+
+		char *const word = malloc((size_t)size + 1);
+		if (!word)
+			goto error;
+		scallop_lang_lex_normalize_word(
+			token.value,
+			(struct libadt_lptr) {
+				.buffer = word,
+				.size = 1,
+				.length = size,
+			}
+		);
+		word[size] = '\0';
+		argv[length++] = word;
+	}
+
+	if (length)
+		return argv;
+
+invalid:
+	errno = EINVAL;
+error:
+	free_argv(argv);
+	return NULL;
+}
+
+static bool valid_path(const char *path)
+{
+	if (!*path || *path == '/')
+		return false;
+	for (const char *part = path; *part;) {
+		const size_t length = strcspn(part, "/");
+		if (length == 2 && part[0] == '.' && part[1] == '.')
+			return false;
+		part += length;
+		part += *part == '/';
+	}
+	return true;
+}
+
+static int write_file(int directory, const char *path, const char *content, size_t length)
+{
+	if (!valid_path(path)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	// Create the parent directories first
+	char *const parents = strdup(path);
+	if (!parents)
+		return -1;
+	for (char *slash = strchr(parents, '/'); slash; slash = strchr(slash + 1, '/')) {
+		*slash = '\0';
+		if (mkdirat(directory, parents, 0755) && errno != EEXIST) {
+			free(parents);
+			return -1;
+		}
+		*slash = '/';
+	}
+	free(parents);
+
+	const int fd = openat(
+		directory,
+		path,
+		O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW,
+		0644
+	);
+	if (fd < 0)
+		return -1;
+	const int result = write_all(fd, content, length);
+	if (close(fd))
+		return -1;
+	return result;
+}
+
+/*
+ * Decodes a job, writing its files and returning its command and
+ * environment changes, which point into the payload.
+ */
+static char **prepare(
+	server_t *server,
+	char *payload,
+	size_t length,
+	char ***environment
+)
+{
+	job_header_t header = { 0 };
+	if (length < sizeof(header))
+		goto invalid;
+	memcpy(&header, payload, sizeof(header));
+
+	char *cursor = payload + sizeof(header);
+	const char *const end = payload + length;
+	if (header.statement_length > (uint64_t)(end - cursor))
+		goto invalid;
+	const struct libadt_const_lptr statement = {
+		.buffer = cursor,
+		.size = 1,
+		.length = (ssize_t)header.statement_length,
+	};
+	cursor += header.statement_length;
+
+	if (header.environment_length > (uint64_t)(end - cursor))
+		goto invalid;
+	*environment = calloc(header.environment_length + 1, sizeof(**environment));
+	if (!*environment)
+		return NULL;
+	for (uint32_t i = 0; i < header.environment_length; i++) {
+		char *const terminator = memchr(cursor, '\0', (size_t)(end - cursor));
+		if (!terminator)
+			goto invalid_environment;
+		(*environment)[i] = cursor;
+		cursor = terminator + 1;
+	}
+
+	for (uint32_t i = 0; i < header.files_length; i++) {
+		file_header_t file = { 0 };
+		if ((size_t)(end - cursor) < sizeof(file))
+			goto invalid_environment;
+		memcpy(&file, cursor, sizeof(file));
+		cursor += sizeof(file);
+
+		const bool fits = file.path_length > 0
+			&& file.path_length <= (uint64_t)(end - cursor)
+			&& file.length <= (uint64_t)(end - cursor) - file.path_length
+			&& cursor[file.path_length - 1] == '\0';
+		if (!fits)
+			goto invalid_environment;
+
+		const char *const path = cursor;
+		cursor += file.path_length;
+		if (write_file(server->directory, path, cursor, file.length))
+			goto error_environment;
+		cursor += file.length;
+	}
+
+	char **const argv = split_statement(statement);
+	if (!argv)
+		goto error_environment;
+	return argv;
+
+invalid_environment:
+	errno = EINVAL;
+error_environment:
+	free(*environment);
+	*environment = NULL;
+	return NULL;
+
+invalid:
+	errno = EINVAL;
+	return NULL;
+}
+
+static void child(server_t *server, int out, int err, char **argv, char **environment)
+{
+	const int null = open("/dev/null", O_RDONLY);
+	if (
+		null < 0
+		|| fchdir(server->directory)
+		|| dup2(null, STDIN_FILENO) < 0
+		|| dup2(out, STDOUT_FILENO) < 0
+		|| dup2(err, STDERR_FILENO) < 0
+	)
+		_exit(127);
+
+	// Commands that outlive the worker mustn't hold its connection
+	// open
+	close(server->socket);
+	close(server->directory);
+
+	for (char **change = environment; *change; change++) {
+		char *const equals = strchr(*change, '=');
+		if (!equals) {
+			unsetenv(*change);
+			continue;
+		}
+		*equals = '\0';
+		setenv(*change, equals + 1, 1);
+	}
+
+	execvp(argv[0], argv);
+	_exit(127);
+}
+
+static int send_exit(server_t *server, uint64_t job, int status, int error)
+{
+	const exit_t message = {
+		.status = status,
+		.error = error,
+	};
+	return send_message(server->socket, MESSAGE_EXIT, job, &message, sizeof(message));
+}
+
+static int start(server_t *server, uint64_t job, char *payload, size_t length)
+{
+	slot_t *slot = NULL;
+	for (size_t i = 0; i < server->capacity && !slot; i++)
+		if (!server->slots[i].used)
+			slot = &server->slots[i];
+	if (!slot)
+		return send_exit(server, job, -1, EBUSY);
+
+	char **environment = NULL;
+	char **const argv = prepare(server, payload, length, &environment);
+	if (!argv)
+		return send_exit(server, job, -1, errno);
+
+	int pipes[2][2] = { { -1, -1 }, { -1, -1 } };
+	int error = 0;
+	for (size_t i = 0; i < 2 && !error; i++) {
+		const bool opened = pipe(pipes[i]) == 0
+			&& set_flags(pipes[i][0], O_NONBLOCK) == 0
+			&& set_flags(pipes[i][1], 0) == 0;
+		if (!opened)
+			error = errno;
+	}
+
+	pid_t pid = -1;
+	if (!error) {
+		pid = fork();
+		if (pid == 0)
+			child(server, pipes[0][1], pipes[1][1], argv, environment);
+		if (pid < 0)
+			error = errno;
+	}
+
+	free_argv(argv);
+	free(environment);
+	for (size_t i = 0; i < 2; i++)
+		if (pipes[i][1] >= 0)
+			close(pipes[i][1]);
+
+	*slot = (slot_t) {
+		.used = true,
+		.job = job,
+		.pid = pid,
+		.fds = { pipes[0][0], pipes[1][0] },
+	};
+	if (!error && !scallop_lang_events_add_child(&server->events, pid, slot))
+		error = errno;
+	for (size_t i = 0; i < 2 && !error; i++) {
+		slot->watches[i] = scallop_lang_events_add_fd(
+			&server->events,
+			slot->fds[i],
+			SCALLOP_LANG_EVENTS_READ,
+			slot
+		);
+		if (!slot->watches[i])
+			error = errno;
+	}
+
+	if (!error)
+		return 0;
+
+	// Nothing is reported for a command that was started, so
+	// clean it up here
+	if (pid > 0) {
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+	}
+	for (size_t i = 0; i < 2; i++) {
+		if (slot->watches[i])
+			scallop_lang_events_remove(&server->events, slot->watches[i]);
+		if (slot->fds[i] >= 0)
+			close(slot->fds[i]);
+	}
+	*slot = (slot_t) { 0 };
+	return send_exit(server, job, -1, error);
+}
+
+/*
+ * Reports a job once its command has exited and both of its
+ * streams have ended.
+ */
+static int finish(server_t *server, slot_t *slot)
+{
+	if (!slot->exited || slot->fds[0] >= 0 || slot->fds[1] >= 0)
+		return 0;
+	slot->used = false;
+	return send_exit(server, slot->job, slot->status, 0);
+}
+
+static int forward(server_t *server, slot_t *slot, size_t stream, char *buffer)
+{
+	const ssize_t amount = read(slot->fds[stream], buffer, OUTPUT_CHUNK);
+	if (amount < 0 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+
+	if (amount > 0) {
+		return send_message(
+			server->socket,
+			stream ? MESSAGE_STDERR : MESSAGE_STDOUT,
+			slot->job,
+			buffer,
+			(size_t)amount
+		);
+	}
+
+	scallop_lang_events_remove(&server->events, slot->watches[stream]);
+	slot->watches[stream] = NULL;
+	close(slot->fds[stream]);
+	slot->fds[stream] = -1;
+	return finish(server, slot);
+}
+
+static void stop(server_t *server)
+{
+	for (size_t i = 0; i < server->capacity; i++) {
+		slot_t *const slot = &server->slots[i];
+		if (!slot->used)
+			continue;
+		if (!slot->exited) {
+			kill(slot->pid, SIGKILL);
+			waitpid(slot->pid, NULL, 0);
+		}
+		for (size_t j = 0; j < 2; j++)
+			if (slot->fds[j] >= 0)
+				close(slot->fds[j]);
+	}
+}
+
+int scallop_lang_remote_serve(int socket, int directory, size_t capacity)
+{
+	if (!capacity) {
+		const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+		capacity = processors > 0 ? (size_t)processors : 1;
+	}
+
+	server_t server = {
+		.socket = socket,
+		.directory = directory,
+		.capacity = capacity,
+	};
+	server.slots = calloc(capacity, sizeof(*server.slots));
+	char *const buffer = malloc(OUTPUT_CHUNK);
+	if (!server.slots || !buffer) {
+		free(server.slots);
+		free(buffer);
+		return -1;
+	}
+	if (scallop_lang_events_init(&server.events, 0)) {
+		free(server.slots);
+		free(buffer);
+		return -1;
+	}
+
+	const hello_t hello = { .capacity = capacity };
+	int result = send_message(socket, MESSAGE_HELLO, 0, &hello, sizeof(hello));
+	if (!result && !scallop_lang_events_add_fd(&server.events, socket, SCALLOP_LANG_EVENTS_READ, NULL))
+		result = -1;
+
+	bool open = true;
+	while (open && !result) {
+		struct scallop_lang_events_event events[16];
+		const ssize_t count = scallop_lang_events_wait(
+			&server.events,
+			events,
+			sizeof(events) / sizeof(*events),
+			-1
+		);
+		if (count < 0) {
+			result = -1;
+			break;
+		}
+
+		for (ssize_t i = 0; i < count && open && !result; i++) {
+			slot_t *const slot = events[i].user;
+			if (events[i].type == SCALLOP_LANG_EVENTS_CHILD) {
+				slot->exited = true;
+				slot->status = events[i].status;
+				result = finish(&server, slot);
+				continue;
+			}
+
+			if (slot) {
+				// The stream may have ended earlier in this batch
+				for (size_t stream = 0; stream < 2; stream++)
+					if (slot->used && slot->fds[stream] == events[i].fd)
+						result = forward(&server, slot, stream, buffer);
+				continue;
+			}
+
+			header_t header = { 0 };
+			char *payload = NULL;
+			if (receive_message(socket, &header, &payload)) {
+				// The coordinator closing the connection is the
+				// normal way to stop
+				open = false;
+				result = errno == ECONNRESET ? 0 : -1;
+				break;
+			}
+			if (header.type == MESSAGE_JOB)
+				result = start(&server, header.job, payload, (size_t)header.length);
+			free(payload);
+		}
+	}
+
+	stop(&server);
+	scallop_lang_events_free(&server.events);
+	free(server.slots);
+	free(buffer);
+	return result;
+}
+
+/*
+ * Coordinator
+ */
+
+struct scallop_lang_remote_worker {
+	int fd;
+	size_t capacity;
+	size_t running;
+	bool lost;
+	watch_t *watch;
+
+	// Jobs not yet sent, which are written as the socket allows,
+	// so a coordinator never blocks on a worker sending output
+	buffer_t queue;
+	size_t sent;
+};
+
+typedef struct {
+	worker_t *workers;
+	size_t workers_length;
+	job_t *jobs;
+	size_t length;
+	bool *done;
+	options_t options;
+	struct scallop_lang_events events;
+
+	size_t next;
+	size_t finished;
+	bool failed;
+	bool error;
+} run_t;
+
+static void complete(run_t *run, size_t i, int status, int error)
+{
+	job_t *const job = &run->jobs[i];
+	job->status = status;
+	job->error = error;
+	run->done[i] = true;
+	run->finished++;
+	if (status == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		run->failed = true;
+}
+
+static void lose(run_t *run, worker_t *worker)
+{
+	const size_t index = (size_t)(worker - run->workers);
+	worker->lost = true;
+	worker->running = 0;
+	if (worker->watch) {
+		scallop_lang_events_remove(&run->events, worker->watch);
+		worker->watch = NULL;
+	}
+	for (size_t i = 0; i < run->next; i++)
+		if (run->jobs[i].worker == index && !run->done[i])
+			complete(run, i, -1, ECONNRESET);
+}
+
+/*
+ * Watches a worker for replies, and for room to send when jobs
+ * are queued for it.
+ */
+static int watch(run_t *run, worker_t *worker)
+{
+	const uint32_t mask = SCALLOP_LANG_EVENTS_READ
+		| (worker->sent < worker->queue.length ? SCALLOP_LANG_EVENTS_WRITE : 0);
+	if (worker->watch)
+		scallop_lang_events_remove(&run->events, worker->watch);
+	worker->watch = scallop_lang_events_add_fd(&run->events, worker->fd, mask, worker);
+	return worker->watch ? 0 : -1;
+}
+
+static void flush_queue(run_t *run, worker_t *worker)
+{
+	const bool queued = worker->sent < worker->queue.length;
+	while (worker->sent < worker->queue.length) {
+		const ssize_t amount = send(
+			worker->fd,
+			worker->queue.data + worker->sent,
+			worker->queue.length - worker->sent,
+			MSG_NOSIGNAL | MSG_DONTWAIT
+		);
+		if (amount < 0 && errno == EINTR)
+			continue;
+		if (amount < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (amount < 0) {
+			lose(run, worker);
+			return;
+		}
+		worker->sent += (size_t)amount;
+	}
+
+	if (worker->sent == worker->queue.length) {
+		worker->queue.length = 0;
+		worker->sent = 0;
+	}
+
+	// Only change the watch when write readiness starts or stops
+	// mattering
+	if (queued != (worker->sent < worker->queue.length) && watch(run, worker))
+		run->error = true;
+}
+
+static int encode(buffer_t *buffer, uint64_t index, const job_t *job)
+{
+	size_t environment_length = 0;
+	if (job->environment)
+		while (job->environment[environment_length])
+			environment_length++;
+
+	const job_header_t job_header = {
+		.statement_length = (uint64_t)job->statement.length,
+		.environment_length = (uint32_t)environment_length,
+		.files_length = (uint32_t)job->files_length,
+	};
+	header_t header = {
+		.magic = MESSAGE_MAGIC,
+		.type = MESSAGE_JOB,
+		.job = index,
+	};
+
+	const size_t start = buffer->length;
+	bool success = append(buffer, &header, sizeof(header)) == 0
+		&& append(buffer, &job_header, sizeof(job_header)) == 0
+		&& append(buffer, job->statement.buffer, (size_t)job->statement.length) == 0;
+	for (size_t i = 0; i < environment_length && success; i++)
+		success = append(buffer, job->environment[i], strlen(job->environment[i]) + 1) == 0;
+	for (size_t i = 0; i < job->files_length && success; i++) {
+		const file_t *const file = &job->files[i];
+		const file_header_t file_header = {
+			.path_length = strlen(file->path) + 1,
+			.length = file->length,
+		};
+		success = append(buffer, &file_header, sizeof(file_header)) == 0
+			&& append(buffer, file->path, file_header.path_length) == 0
+			&& append(buffer, file->content, file->length) == 0;
+	}
+	if (!success) {
+		buffer->length = start;
+		return -1;
+	}
+
+	header.length = buffer->length - start - sizeof(header);
+	if (header.length > PAYLOAD_MAX) {
+		buffer->length = start;
+		errno = E2BIG;
+		return -1;
+	}
+	memcpy(buffer->data + start, &header, sizeof(header));
+	return 0;
+}
+
+/*
+ * Returns the worker with the smallest fraction of its slots in
+ * use, or NULL if every worker is full.
+ */
+static worker_t *least_loaded(run_t *run)
+{
+	worker_t *best = NULL;
+	for (size_t i = 0; i < run->workers_length; i++) {
+		worker_t *const worker = &run->workers[i];
+		if (worker->lost || worker->running >= worker->capacity)
+			continue;
+		const bool better = !best
+			|| worker->running * best->capacity < best->running * worker->capacity;
+		if (better)
+			best = worker;
+	}
+	return best;
+}
+
+static void dispatch(run_t *run)
+{
+	while (run->next < run->length && !run->error) {
+		worker_t *const worker = least_loaded(run);
+		if (!worker)
+			return;
+
+		const size_t i = run->next++;
+		run->jobs[i].worker = (size_t)(worker - run->workers);
+		if (encode(&worker->queue, i, &run->jobs[i])) {
+			complete(run, i, -1, errno);
+			continue;
+		}
+		worker->running++;
+		flush_queue(run, worker);
+	}
+}
+
+static void receive(run_t *run, worker_t *worker)
+{
+	header_t header = { 0 };
+	char *payload = NULL;
+	if (receive_message(worker->fd, &header, &payload)) {
+		lose(run, worker);
+		return;
+	}
+
+	const size_t index = (size_t)(worker - run->workers);
+	const bool valid = header.job < run->next
+		&& run->jobs[header.job].worker == index
+		&& !run->done[header.job];
+	if (!valid) {
+		free(payload);
+		lose(run, worker);
+		return;
+	}
+
+	switch (header.type) {
+		case MESSAGE_STDOUT:
+		case MESSAGE_STDERR: {
+			if (!run->options.output)
+				break;
+			const int result = run->options.output(
+				run->options.user,
+				(size_t)header.job,
+				header.type == MESSAGE_STDOUT
+					? SCALLOP_LANG_REMOTE_STDOUT
+					: SCALLOP_LANG_REMOTE_STDERR,
+				payload,
+				(size_t)header.length
+			);
+			if (result)
+				run->error = true;
+			break;
+		}
+		case MESSAGE_EXIT: {
+			exit_t message = { 0 };
+			if (header.length != sizeof(message)) {
+				lose(run, worker);
+				break;
+			}
+			memcpy(&message, payload, sizeof(message));
+			complete(run, (size_t)header.job, message.status, message.error);
+			worker->running--;
+			break;
+		}
+		default:
+			lose(run, worker);
+	}
+	free(payload);
+}
+
+static void hello(worker_t *worker)
+{
+	header_t header = { 0 };
+	char *payload = NULL;
+	hello_t message = { 0 };
+	const bool valid = receive_message(worker->fd, &header, &payload) == 0
+		&& header.type == MESSAGE_HELLO
+		&& header.length == sizeof(message);
+	if (valid)
+		memcpy(&message, payload, sizeof(message));
+	free(payload);
+
+	worker->lost = !valid || !message.capacity;
+	worker->capacity = (size_t)message.capacity;
+}
+
+int scallop_lang_remote_init(remote_t *remote, const int *workers, size_t length)
+{
+	*remote = (remote_t) { 0 };
+	remote->_workers = calloc(length ? length : 1, sizeof(*remote->_workers));
+	if (!remote->_workers)
+		return -1;
+	remote->_workers_length = length;
+
+	size_t reachable = 0;
+	for (size_t i = 0; i < length; i++) {
+		remote->_workers[i].fd = workers[i];
+		hello(&remote->_workers[i]);
+		reachable += !remote->_workers[i].lost;
+	}
+
+	if (!reachable) {
+		scallop_lang_remote_free(remote);
+		errno = ECONNREFUSED;
+		return -1;
+	}
+	return 0;
+}
+
+int scallop_lang_remote_run(
+	remote_t *remote,
+	job_t *jobs,
+	size_t length,
+	const options_t *options
+)
+{
+	run_t run = {
+		.workers = remote->_workers,
+		.workers_length = remote->_workers_length,
+		.jobs = jobs,
+		.length = length,
+		.options = options ? *options : (options_t) { 0 },
+	};
+
+	run.done = calloc(length ? length : 1, sizeof(*run.done));
+	if (!run.done || scallop_lang_events_init(&run.events, 0)) {
+		free(run.done);
+		return -1;
+	}
+
+	for (size_t i = 0; i < run.workers_length; i++) {
+		worker_t *const worker = &run.workers[i];
+		worker->running = 0;
+		if (!worker->lost && watch(&run, worker))
+			run.error = true;
+	}
+
+	for (size_t i = 0; i < length; i++)
+		jobs[i] = (job_t) {
+			.statement = jobs[i].statement,
+			.environment = jobs[i].environment,
+			.files = jobs[i].files,
+			.files_length = jobs[i].files_length,
+			.worker = run.workers_length,
+			.status = -1,
+		};
+
+	while (run.finished < length && !run.error) {
+		dispatch(&run);
+
+		bool alive = false;
+		for (size_t i = 0; i < run.workers_length; i++)
+			alive |= !run.workers[i].lost;
+		if (!alive) {
+			// Nothing is left to run the rest on
+			while (run.next < length)
+				complete(&run, run.next++, -1, ECONNRESET);
+			break;
+		}
+		if (run.finished == length || run.error)
+			break;
+
+		struct scallop_lang_events_event events[16];
+		const ssize_t count = scallop_lang_events_wait(
+			&run.events,
+			events,
+			sizeof(events) / sizeof(*events),
+			-1
+		);
+		if (count < 0) {
+			run.error = true;
+			break;
+		}
+
+		for (ssize_t i = 0; i < count && !run.error; i++) {
+			worker_t *const worker = events[i].user;
+			// Lost earlier in this batch
+			if (worker->lost)
+				continue;
+			if (events[i].ready & SCALLOP_LANG_EVENTS_WRITE)
+				flush_queue(&run, worker);
+			if (!worker->lost && (events[i].ready & SCALLOP_LANG_EVENTS_READ))
+				receive(&run, worker);
+		}
+	}
+
+	// A run that stopped early may leave jobs queued, which would
+	// desynchronize the next run
+	for (size_t i = 0; i < run.workers_length; i++) {
+		worker_t *const worker = &run.workers[i];
+		worker->watch = NULL;
+		if (worker->queue.length || worker->running)
+			worker->lost = true;
+		worker->queue.length = 0;
+		worker->sent = 0;
+	}
+	scallop_lang_events_free(&run.events);
+	free(run.done);
+
+	if (run.error)
+		return -1;
+	return run.failed ? 1 : 0;
+}
+
+void scallop_lang_remote_free(remote_t *remote)
+{
+	for (size_t i = 0; i < remote->_workers_length; i++)
+		free(remote->_workers[i].queue.data);
+	free(remote->_workers);
+	*remote = (remote_t) { 0 };
+}
@@ -0,0 +1,161 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_BATCH
+#define SCALLOP_LANG_BATCH
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include <libadt/lptr.h>
+
+#include "classifier.h"
+
+/**
+ * \file
+ *
+ * \brief This module lexes many independent scripts at once.
+ *
+ * Scripts are shared between a fixed number of worker threads,
+ * which are created once per batch. Each worker keeps its own
+ * scratch buffers and allocates results from its own arena, so
+ * lexing a script doesn't create threads or contend on a shared
+ * allocator.
+ *
+ * Scripts read from files are opened one script ahead, and the
+ * kernel is asked to read them in while the current script is
+ * being lexed.
+ */
+
+/**
+ * \brief Represents a script to lex.
+ */
+struct scallop_lang_batch_input {
+	/**
+	 * \brief The path of a file to read the script from,
+	 * 	or NULL to lex .script.
+	 */
+	const char *path;
+
+	/**
+	 * \brief The script, if .path is NULL. It must remain valid
+	 * 	until the batch is freed.
+	 */
+	struct libadt_const_lptr script;
+};
+
+/**
+ * \brief Represents a token, as returned by scallop_lang_lex_next().
+ */
+struct scallop_lang_batch_token {
+	scallop_lang_classifier_fn *type;
+
+	/**
+	 * \brief The offset of the token value in the script.
+	 */
+	size_t offset;
+	size_t length;
+};
+
+/**
+ * \brief Represents the result of lexing a single script.
+ */
+struct scallop_lang_batch_result {
+	/**
+	 * \brief The script that was lexed. For scripts read from
+	 * 	files, this is owned by the batch.
+	 */
+	struct libadt_const_lptr script;
+
+	/**
+	 * \brief The tokens of the script, not including the final
+	 * 	scallop_lang_classifier_end token.
+	 *
+	 * If an error occurred, these are the tokens before the error.
+	 */
+	struct scallop_lang_batch_token *tokens;
+	size_t tokens_length;
+
+	/**
+	 * \brief 0 on success, EINVAL if the script is invalid, or
+	 * 	the errno value of a failed read.
+	 */
+	int error;
+
+	/**
+	 * \brief The offset in the script where lexing failed,
+	 * 	if error is EINVAL.
+	 */
+	size_t error_offset;
+};
+
+struct scallop_lang_batch_arena;
+
+/**
+ * \brief Represents the results of a batch.
+ */
+struct scallop_lang_batch {
+	/**
+	 * \brief One result per input, in the same order.
+	 */
+	struct scallop_lang_batch_result *results;
+	size_t length;
+
+	struct scallop_lang_batch_arena **_arenas;
+	size_t _arenas_length;
+};
+
+/**
+ * \brief Lexes a list of scripts on a pool of threads.
+ *
+ * Errors in individual scripts are reported in their results
+ * and don't fail the batch.
+ *
+ * \param inputs The scripts to lex.
+ * \param length The number of inputs.
+ * \param threads The number of worker threads. If this is 0 or 1,
+ * 	the calling thread is used. If some of the threads can't be
+ * 	created, the batch is lexed by the ones that were, which
+ * 	always include the calling thread.
+ * \param out The object to write the results to. On success, it
+ * 	must be freed with scallop_lang_batch_free().
+ *
+ * \returns 0 on success, or -1 if memory could not be allocated.
+ */
+int scallop_lang_batch_lex(
+	const struct scallop_lang_batch_input *inputs,
+	size_t length,
+	size_t threads,
+	struct scallop_lang_batch *out
+);
+
+/**
+ * \brief Frees the results of a batch.
+ *
+ * \param batch The batch to free.
+ */
+void scallop_lang_batch_free(struct scallop_lang_batch *batch);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_BATCH
@@ -0,0 +1,169 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_BUILTIN
+#define SCALLOP_LANG_BUILTIN
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include <libadt/lptr.h>
+
+#include "commands.h"
+
+/**
+ * \file
+ *
+ * \brief This module provides the builtin commands, which are run
+ * 	inside the interpreter instead of spawning a process.
+ *
+ * A builtin is looked up by the first word of a statement, and
+ * run with the normalized words of the statement as its
+ * arguments. Builtins never use the standard streams directly:
+ * they read and write the file descriptors in their
+ * struct scallop_lang_builtin_context, so redirections are
+ * handled by setting those up before running the builtin.
+ *
+ * The builtins are:
+ *
+ * - true: succeeds.
+ * - false: fails.
+ * - echo [-n] [WORD]...: writes the words, separated by spaces,
+ *   followed by a newline unless -n is given.
+ * - test EXPRESSION: evaluates a test(1) expression, supporting
+ *   the unary file tests -e, -f, -d, -r, -w, -x and -s, the string
+ *   tests -n, -z, = and !=, the integer comparisons -eq, -ne, -lt,
+ *   -le, -gt and -ge, and negation with !.
+ * - cd [DIRECTORY]: changes the working directory of the process,
+ *   defaulting to $HOME.
+ * - pwd: writes the working directory.
+ * - set NAME VALUE: sets a variable through the context's
+ *   set_variable callback.
+ * - hash [-r] [NAME]...: looks up each command in the context's
+ *   command cache, or with -r, first forgets every command.
+ */
+
+/**
+ * \brief The environment a builtin runs in.
+ */
+struct scallop_lang_builtin_context {
+	/**
+	 * \brief The file descriptor used as standard input.
+	 */
+	int in;
+
+	/**
+	 * \brief The file descriptor used as standard output.
+	 */
+	int out;
+
+	/**
+	 * \brief The file descriptor used as standard error.
+	 */
+	int err;
+
+	/**
+	 * \brief Sets a variable, for the set builtin.
+	 *
+	 * If this is NULL, set fails.
+	 *
+	 * \param user The context's user pointer.
+	 * \param name The name of the variable.
+	 * \param value The new value of the variable.
+	 *
+	 * \returns 0 on success, or -1 on failure.
+	 */
+	int (*set_variable)(void *user, const char *name, const char *value);
+
+	/**
+	 * \brief The command cache, for the hash builtin.
+	 *
+	 * If this is NULL, hash fails.
+	 */
+	struct scallop_lang_commands *commands;
+
+	/**
+	 * \brief A pointer passed to callbacks.
+	 */
+	void *user;
+};
+
+/**
+ * \brief Type definition for a builtin implementation.
+ *
+ * \param context The environment to run in.
+ * \param argc The number of arguments, including the name
+ * 	of the builtin.
+ * \param argv The normalized words of the statement.
+ *
+ * \returns The exit status of the builtin.
+ */
+typedef int scallop_lang_builtin_fn(
+	const struct scallop_lang_builtin_context *context,
+	size_t argc,
+	char *const argv[]
+);
+
+/**
+ * \brief Describes a single builtin.
+ */
+struct scallop_lang_builtin {
+	/**
+	 * \brief The name the builtin is invoked with.
+	 */
+	const char *name;
+
+	/**
+	 * \brief The implementation of the builtin.
+	 */
+	scallop_lang_builtin_fn *run;
+};
+
+/**
+ * \brief Finds the builtin named by a word.
+ *
+ * \param word A word value from scallop_lang_lex_next(). It is
+ * 	normalized before looking it up, so quoted builtin names
+ * 	are found too.
+ *
+ * \returns The builtin, or NULL if the word does not name
+ * 	a builtin.
+ */
+const struct scallop_lang_builtin *scallop_lang_builtin_find(
+	struct libadt_const_lptr word
+);
+
+/**
+ * \brief Finds a builtin by its normalized name.
+ *
+ * \param name The normalized name, as a null-terminated string.
+ *
+ * \returns The builtin, or NULL if there is no such builtin.
+ */
+const struct scallop_lang_builtin *scallop_lang_builtin_find_name(
+	const char *name
+);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_BUILTIN
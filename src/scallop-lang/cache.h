@@ -0,0 +1,249 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_CACHE
+#define SCALLOP_LANG_CACHE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libadt/lptr.h>
+
+/**
+ * \file
+ *
+ * \brief This module provides an on-disk cache of statement
+ * 	results, for skipping statements whose inputs haven't changed.
+ *
+ * A statement's fingerprint is built from its normalized words,
+ * the files it declares as inputs and the variables it uses.
+ * Quoting and spacing that don't change the words don't change the
+ * fingerprint.
+ *
+ * The cache stores the status and output of successful runs, one
+ * file per fingerprint, so checking a statement costs one lookup
+ * and unchanged statements can be skipped by replaying their
+ * output.
+ *
+ * Entries are stored in the machine's byte order, and aren't meant
+ * to be shared between machines.
+ */
+
+/**
+ * \brief How an input file contributes to a fingerprint.
+ */
+enum scallop_lang_cache_file_mode {
+	/**
+	 * \brief Use the file's size and modification time, like make.
+	 */
+	SCALLOP_LANG_CACHE_STAT,
+
+	/**
+	 * \brief Hash the contents of the file.
+	 */
+	SCALLOP_LANG_CACHE_CONTENT,
+};
+
+/**
+ * \brief Represents a fingerprint being built.
+ */
+struct scallop_lang_cache_fingerprint {
+	/**
+	 * \brief Names the fingerprint's cache entry.
+	 */
+	uint64_t hash;
+
+	/**
+	 * \brief A second, independent hash of the same input, kept
+	 * 	in the entry so a collision of hash is a miss.
+	 */
+	uint64_t check;
+};
+
+/**
+ * \brief Represents a recorded run of a statement.
+ */
+struct scallop_lang_cache_entry {
+	int status;
+	char *out;
+	size_t out_length;
+	char *err;
+	size_t err_length;
+};
+
+/**
+ * \brief Represents a cache directory.
+ */
+struct scallop_lang_cache {
+	char *directory;
+};
+
+/**
+ * \brief Starts a new fingerprint.
+ *
+ * \returns An empty fingerprint.
+ */
+struct scallop_lang_cache_fingerprint scallop_lang_cache_fingerprint_init(void);
+
+/**
+ * \brief Adds the normalized words of a statement to a fingerprint.
+ *
+ * \param fingerprint The fingerprint to update.
+ * \param statement The statement's script.
+ *
+ * \returns 0 on success, or -1 if the statement is invalid.
+ */
+int scallop_lang_cache_add_statement(
+	struct scallop_lang_cache_fingerprint *fingerprint,
+	struct libadt_const_lptr statement
+);
+
+/**
+ * \brief Adds the words of an expanded statement to a fingerprint.
+ *
+ * A byte script statement without variables or substitutions gets
+ * the same fingerprint from scallop_lang_cache_add_statement() as
+ * its argument list does from this.
+ *
+ * \param fingerprint The fingerprint to update.
+ * \param argv A null-terminated argument list.
+ */
+void scallop_lang_cache_add_words(
+	struct scallop_lang_cache_fingerprint *fingerprint,
+	char *const argv[]
+);
+
+/**
+ * \brief Adds an input file to a fingerprint.
+ *
+ * A missing file is part of the fingerprint too, so creating it
+ * changes the fingerprint.
+ *
+ * \param fingerprint The fingerprint to update.
+ * \param path The path of the file.
+ * \param mode How the file is compared.
+ *
+ * \returns 0 on success, or -1 if the file exists but couldn't
+ * 	be read.
+ */
+int scallop_lang_cache_add_file(
+	struct scallop_lang_cache_fingerprint *fingerprint,
+	const char *path,
+	enum scallop_lang_cache_file_mode mode
+);
+
+/**
+ * \brief Adds a variable used by the statement to a fingerprint.
+ *
+ * \param fingerprint The fingerprint to update.
+ * \param name The name of the variable.
+ * \param value The value of the variable, or NULL if it's unset.
+ */
+void scallop_lang_cache_add_variable(
+	struct scallop_lang_cache_fingerprint *fingerprint,
+	const char *name,
+	const char *value
+);
+
+/**
+ * \brief Opens a cache directory, creating it if necessary.
+ *
+ * \param cache The object to initialize. It must be freed with
+ * 	scallop_lang_cache_close().
+ * \param directory The cache directory. Its parent must exist.
+ *
+ * \returns 0 on success, or -1 on failure.
+ */
+int scallop_lang_cache_open(struct scallop_lang_cache *cache, const char *directory);
+
+/**
+ * \brief Looks up the recorded run for a fingerprint.
+ *
+ * Damaged entries, and entries stored for a fingerprint with the
+ * same hash but a different check, are misses.
+ *
+ * \param cache The cache.
+ * \param fingerprint The complete fingerprint.
+ * \param out The object to write the entry to. On a hit, it must
+ * 	be freed with scallop_lang_cache_entry_free().
+ *
+ * \returns 1 on a hit, 0 on a miss, or -1 on failure.
+ */
+int scallop_lang_cache_lookup(
+	const struct scallop_lang_cache *cache,
+	struct scallop_lang_cache_fingerprint fingerprint,
+	struct scallop_lang_cache_entry *out
+);
+
+/**
+ * \brief Records a run for a fingerprint.
+ *
+ * Only successful runs, with a status of 0, are stored. The entry
+ * is written to a temporary file and renamed into place, so a
+ * concurrent lookup never sees a partial entry.
+ *
+ * \param cache The cache.
+ * \param fingerprint The complete fingerprint.
+ * \param entry The run to record.
+ *
+ * \returns 0 on success or if the run wasn't stored, or -1 on failure.
+ */
+int scallop_lang_cache_store(
+	const struct scallop_lang_cache *cache,
+	struct scallop_lang_cache_fingerprint fingerprint,
+	const struct scallop_lang_cache_entry *entry
+);
+
+/**
+ * \brief Writes the recorded output of a run.
+ *
+ * \param entry The recorded run.
+ * \param out The file descriptor to write standard output to.
+ * \param err The file descriptor to write standard error to.
+ *
+ * \returns 0 on success, or -1 on failure.
+ */
+int scallop_lang_cache_replay(
+	const struct scallop_lang_cache_entry *entry,
+	int out,
+	int err
+);
+
+/**
+ * \brief Frees an entry returned by scallop_lang_cache_lookup().
+ *
+ * \param entry The entry to free.
+ */
+void scallop_lang_cache_entry_free(struct scallop_lang_cache_entry *entry);
+
+/**
+ * \brief Frees a cache opened with scallop_lang_cache_open().
+ *
+ * \param cache The cache to free.
+ */
+void scallop_lang_cache_close(struct scallop_lang_cache *cache);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_CACHE
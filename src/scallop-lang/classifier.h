@@ -226,6 +226,57 @@ scallop_lang_void_fn *scallop_lang_classifier_statement_separator(wint_t input);
  */
 scallop_lang_void_fn *scallop_lang_classifier_line_comment(wint_t input);
 
+/**
+ * \brief Represents an unquoted glob character, '*' or '?'.
+ *
+ * Glob characters contribute to a word. Quoted or escaped glob
+ * characters are classified as plain word characters instead.
+ *
+ * \param input The next wide character input.
+ * \returns A pointer to the next state function.
+ */
+scallop_lang_void_fn *scallop_lang_classifier_glob(wint_t input);
+
+/**
+ * \brief Represents an unquoted '$', starting a variable reference.
+ *
+ * The '$' must be followed by a variable name made of letters,
+ * digits and underscores.
+ *
+ * \param input The next wide character input.
+ * \returns A pointer to the next state function.
+ */
+scallop_lang_void_fn *scallop_lang_classifier_variable(wint_t input);
+
+/**
+ * \brief Represents the name of an unquoted variable reference.
+ *
+ * \param input The next wide character input.
+ * \returns A pointer to the next state function.
+ */
+scallop_lang_void_fn *scallop_lang_classifier_variable_name(wint_t input);
+
+/**
+ * \brief Represents a '$' in a double-quoted string, starting
+ * 	a variable reference.
+ *
+ * A '$' not followed by a name character is literal text, as in
+ * "costs $".
+ *
+ * \param input The next wide character input.
+ * \returns A pointer to the next state function.
+ */
+scallop_lang_void_fn *scallop_lang_classifier_double_quote_variable(wint_t input);
+
+/**
+ * \brief Represents the name of a variable reference in
+ * 	a double-quoted string.
+ *
+ * \param input The next wide character input.
+ * \returns A pointer to the next state function.
+ */
+scallop_lang_void_fn *scallop_lang_classifier_double_quote_variable_name(wint_t input);
+
 /**
  * \brief Tests if a lex type contributes to a word.
  *
@@ -242,7 +293,12 @@ inline bool scallop_lang_classifier_is_word(scallop_lang_classifier_fn *type)
 		|| type == scallop_lang_classifier_double_quote
 		|| type == scallop_lang_classifier_double_quote_word
 		|| type == scallop_lang_classifier_double_quote_end
-		|| type == scallop_lang_classifier_escape;
+		|| type == scallop_lang_classifier_escape
+		|| type == scallop_lang_classifier_glob
+		|| type == scallop_lang_classifier_variable
+		|| type == scallop_lang_classifier_variable_name
+		|| type == scallop_lang_classifier_double_quote_variable
+		|| type == scallop_lang_classifier_double_quote_variable_name;
 }
 
 #ifdef __cplusplus
@@ -0,0 +1,249 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_COMMANDS
+#define SCALLOP_LANG_COMMANDS
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \file
+ *
+ * \brief This module caches where commands are found on $PATH,
+ * 	so they can be spawned without searching for them again.
+ *
+ * Each command is resolved the first time it's looked up, the way
+ * execvp(3) would resolve it, and the result is kept with an open
+ * file descriptor of the executable. Spawning it afterwards is a
+ * single fexecve(3), without probing each directory of $PATH.
+ * Commands that aren't found are cached too.
+ *
+ * The directories of $PATH are watched with inotify(7). When a
+ * file is created, removed, renamed or has its permissions changed
+ * in one of them, scallop_lang_commands_update() forgets the
+ * command with that name. Directories that don't exist when the
+ * cache is initialized, or that are removed later, are watched
+ * once they exist: each update, and each lookup of a command that
+ * isn't cached, tries again. Until then, commands that aren't found
+ * aren't cached, so they're found as soon as they're created there.
+ * A cached command can still be shadowed by a directory recreated
+ * earlier on the path until one of those happens, or until
+ * scallop_lang_commands_reset() is called, as with the "hash -r" of
+ * other shells.
+ *
+ * A cache is shared between threads. Lookups of cached commands
+ * only take a read lock.
+ */
+
+/**
+ * \brief Represents a resolved command.
+ *
+ * Commands are returned by scallop_lang_commands_find(), and stay
+ * valid until they're released with scallop_lang_commands_release(),
+ * even if the cache forgets them in the meantime.
+ */
+struct scallop_lang_commands_command {
+	/**
+	 * \brief The path the command was found at.
+	 */
+	const char *path;
+
+	/**
+	 * \brief An O_PATH file descriptor of the executable, closed
+	 * 	on exec.
+	 */
+	int fd;
+};
+
+/**
+ * \brief Represents a cache of commands.
+ */
+struct scallop_lang_commands {
+	pthread_rwlock_t _lock;
+	struct scallop_lang_commands_entry **_buckets;
+	size_t _buckets_length;
+	size_t _length;
+
+	// Changed whenever entries are forgotten, so lookups racing
+	// with an update don't cache what they found
+	uint64_t _generation;
+
+	char **_directories;
+	int *_watches;
+	size_t _directories_length;
+	int _inotify;
+};
+
+/**
+ * \brief Initializes a command cache.
+ *
+ * \param commands The cache to initialize. It must be freed with
+ * 	scallop_lang_commands_free().
+ * \param path A colon-separated list of directories, as in $PATH,
+ * 	or NULL for "/bin:/usr/bin". Empty entries are the working
+ * 	directory.
+ *
+ * \returns 0 on success, or -1 on failure, setting errno. Failing
+ * 	to watch the directories isn't an error: the cache then only
+ * 	forgets commands when it's reset.
+ */
+int scallop_lang_commands_init(
+	struct scallop_lang_commands *commands,
+	const char *path
+);
+
+/**
+ * \brief Looks up a command, resolving it if it isn't cached.
+ *
+ * \param commands The cache.
+ * \param name The name of the command. Names containing '/' aren't
+ * 	looked up in $PATH, so they're never found.
+ *
+ * \returns The command, which must be released with
+ * 	scallop_lang_commands_release(), or NULL on failure, setting
+ * 	errno to ENOENT if no executable was found, EACCES if only
+ * 	files without execute permission were found, EINVAL if the
+ * 	name is empty or contains '/', or ENOMEM.
+ */
+const struct scallop_lang_commands_command *scallop_lang_commands_find(
+	struct scallop_lang_commands *commands,
+	const char *name
+);
+
+/**
+ * \brief Releases a command returned by scallop_lang_commands_find()
+ * 	or scallop_lang_commands_prepare().
+ *
+ * \param command The command to release, or NULL.
+ */
+void scallop_lang_commands_release(
+	const struct scallop_lang_commands_command *command
+);
+
+/**
+ * \brief Replaces the process with a command, as execve(2).
+ *
+ * This is safe to call in a child after fork(2).
+ *
+ * \param command The command to run.
+ * \param argv The null-terminated argument list.
+ * \param envp The null-terminated environment.
+ *
+ * \returns -1, setting errno, if the command couldn't be run.
+ * 	It doesn't return otherwise.
+ */
+int scallop_lang_commands_exec(
+	const struct scallop_lang_commands_command *command,
+	char *const argv[],
+	char *const envp[]
+);
+
+/**
+ * \brief Looks up the command an argument list runs, before
+ * 	forking it.
+ *
+ * The child then finds the command resolved, and runs it with
+ * scallop_lang_commands_run() without taking any locks.
+ *
+ * \param commands The cache, or NULL to leave the search to the
+ * 	child.
+ * \param argv The null-terminated argument list.
+ *
+ * \returns The command, which must be released with
+ * 	scallop_lang_commands_release() in the parent, or NULL if the
+ * 	child should search $PATH itself. That's the case without a
+ * 	cache, for names containing '/', and for names that weren't
+ * 	found, so the child reports the error as execvp(3) does.
+ */
+const struct scallop_lang_commands_command *scallop_lang_commands_prepare(
+	struct scallop_lang_commands *commands,
+	char *const argv[]
+);
+
+/**
+ * \brief Replaces the process with a command prepared by
+ * 	scallop_lang_commands_prepare().
+ *
+ * This is safe to call in a child after fork(2).
+ *
+ * \param command The prepared command, or NULL to search $PATH
+ * 	with execvpe(3).
+ * \param argv The null-terminated argument list.
+ * \param envp The null-terminated environment.
+ *
+ * \returns -1, setting errno, if the command couldn't be run.
+ * 	It doesn't return otherwise.
+ */
+int scallop_lang_commands_run(
+	const struct scallop_lang_commands_command *command,
+	char *const argv[],
+	char *const envp[]
+);
+
+/**
+ * \brief Returns the inotify file descriptor of the cache.
+ *
+ * It's readable when scallop_lang_commands_update() has changes
+ * to apply, so it can be added to an event loop.
+ *
+ * \param commands The cache.
+ *
+ * \returns The file descriptor, or -1 if the directories
+ * 	aren't watched.
+ */
+int scallop_lang_commands_fd(const struct scallop_lang_commands *commands);
+
+/**
+ * \brief Forgets the commands whose files changed since the last
+ * 	update.
+ *
+ * This doesn't block.
+ *
+ * \param commands The cache.
+ *
+ * \returns 0 on success, or -1 on failure, setting errno.
+ */
+int scallop_lang_commands_update(struct scallop_lang_commands *commands);
+
+/**
+ * \brief Forgets every command.
+ *
+ * \param commands The cache.
+ */
+void scallop_lang_commands_reset(struct scallop_lang_commands *commands);
+
+/**
+ * \brief Frees a command cache.
+ *
+ * Commands that haven't been released stay valid until they are.
+ *
+ * \param commands The cache to free.
+ */
+void scallop_lang_commands_free(struct scallop_lang_commands *commands);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_COMMANDS
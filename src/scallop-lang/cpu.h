@@ -0,0 +1,112 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_CPU
+#define SCALLOP_LANG_CPU
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/**
+ * \file
+ *
+ * \brief This module binds the lexer's inner loops to the best
+ * 	variant for the processor it runs on.
+ *
+ * The kernels consume runs of ASCII characters which can't change
+ * the classifier's state, so the lexer only decodes and classifies
+ * characters one at a time where it matters. They stop at the first
+ * byte that isn't ASCII, leaving multibyte characters to mbrtowc(3).
+ *
+ * The best tier the processor supports is chosen when the library
+ * is loaded. Setting SCALLOP_LANG_CPU to "generic", "sse2",
+ * "sse4.2", "avx2" or "avx512" chooses a lower tier instead, for
+ * testing and comparison.
+ */
+
+enum scallop_lang_cpu_tier {
+	SCALLOP_LANG_CPU_GENERIC,
+	SCALLOP_LANG_CPU_SSE2,
+	SCALLOP_LANG_CPU_SSE42,
+	SCALLOP_LANG_CPU_AVX2,
+	SCALLOP_LANG_CPU_AVX512,
+};
+
+/**
+ * \brief Represents the kernels of one tier.
+ */
+struct scallop_lang_cpu_kernels {
+	enum scallop_lang_cpu_tier tier;
+
+	/**
+	 * \brief Returns the length of the leading characters that
+	 * 	continue a plain word: ASCII letters, digits and "-_.:/".
+	 */
+	size_t (*word_length)(const char *text, size_t length);
+
+	/**
+	 * \brief Returns the length of the leading characters that
+	 * 	continue a variable name: ASCII letters, digits and '_'.
+	 */
+	size_t (*name_length)(const char *text, size_t length);
+
+	/**
+	 * \brief Returns the length of the leading ASCII characters
+	 * 	other than NUL, first and second.
+	 *
+	 * first and second must be printable ASCII or control
+	 * characters other than NUL and SOH.
+	 */
+	size_t (*scan)(const char *text, size_t length, char first, char second);
+};
+
+/**
+ * \brief The kernels currently in use.
+ */
+extern struct scallop_lang_cpu_kernels scallop_lang_cpu;
+
+/**
+ * \brief Returns the best tier the processor supports.
+ */
+enum scallop_lang_cpu_tier scallop_lang_cpu_supported(void);
+
+/**
+ * \brief Switches every kernel to a tier.
+ *
+ * This isn't thread-safe, and is meant for tests and benchmarks.
+ *
+ * \param tier The tier to use.
+ *
+ * \returns 0 on success, or -1 if the processor doesn't support
+ * 	the tier.
+ */
+int scallop_lang_cpu_select(enum scallop_lang_cpu_tier tier);
+
+/**
+ * \brief Returns the name of a tier, as used by SCALLOP_LANG_CPU.
+ */
+const char *scallop_lang_cpu_tier_name(enum scallop_lang_cpu_tier tier);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_CPU
@@ -0,0 +1,281 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_DAEMON
+#define SCALLOP_LANG_DAEMON
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include <libadt/lptr.h>
+
+#include "batch.h"
+
+/**
+ * \file
+ *
+ * \brief This module provides the pieces of a long-running daemon
+ * 	that serves short invocations: a protocol for forwarding an
+ * 	invocation over a Unix socket, and a cache of lexed scripts.
+ *
+ * A thin client sends its arguments, environment, working directory
+ * and standard file descriptors with
+ * scallop_lang_daemon_send_request(). The working directory and
+ * file descriptors are passed with SCM_RIGHTS, so the daemon uses
+ * the client's own files. The daemon replies with an exit status.
+ */
+
+/**
+ * \brief The number of file descriptors forwarded with a request:
+ * 	standard input, output and error.
+ */
+#define SCALLOP_LANG_DAEMON_FDS 3
+
+/**
+ * \brief The default number of scripts a cache holds.
+ */
+#define SCALLOP_LANG_DAEMON_CACHE_SCRIPTS 256
+
+/**
+ * \brief The default number of bytes of text and tokens a cache
+ * 	holds.
+ */
+#define SCALLOP_LANG_DAEMON_CACHE_BYTES (64 * 1024 * 1024)
+
+/**
+ * \brief Represents a forwarded invocation.
+ */
+struct scallop_lang_daemon_request {
+	/**
+	 * \brief The null-terminated argument list.
+	 */
+	char **argv;
+	size_t argc;
+
+	/**
+	 * \brief The null-terminated environment.
+	 */
+	char **envp;
+
+	/**
+	 * \brief The path of the client's working directory, for
+	 * 	messages.
+	 */
+	char *cwd;
+
+	/**
+	 * \brief The client's working directory, for use with openat(2).
+	 */
+	int cwd_fd;
+
+	int fds[SCALLOP_LANG_DAEMON_FDS];
+
+	char *_payload;
+};
+
+/**
+ * \brief Represents a lexed script in the cache.
+ *
+ * Scripts are immutable, and stay valid until they're released,
+ * even if the cache replaces them.
+ */
+struct scallop_lang_daemon_script {
+	struct libadt_const_lptr script;
+
+	/**
+	 * \brief The tokens of the script, including the final
+	 * 	scallop_lang_classifier_end or
+	 * 	scallop_lang_classifier_unexpected token.
+	 */
+	struct scallop_lang_batch_token *tokens;
+	size_t tokens_length;
+
+	dev_t _device;
+	ino_t _inode;
+	off_t _size;
+	struct timespec _mtime;
+	bool _raw;
+	char *_codeset;
+	size_t _references;
+
+	// When the script was last returned, for eviction
+	uint64_t _used;
+};
+
+/**
+ * \brief Represents a cache of lexed scripts, shared between
+ * 	threads.
+ *
+ * Scripts are identified by device and inode, so different paths
+ * to the same file share an entry, and are lexed again when their
+ * size or modification time changes. Entries are separate for
+ * each character set, since that changes how scripts are lexed.
+ *
+ * When the cache holds more scripts or bytes than its limits, the
+ * scripts used least recently are dropped, skipping scripts that
+ * haven't been released yet. Those stay until they're released, so
+ * the cache only goes over its limits while they're in use.
+ */
+struct scallop_lang_daemon_cache {
+	/**
+	 * \brief The most scripts to hold, set to
+	 * 	SCALLOP_LANG_DAEMON_CACHE_SCRIPTS by
+	 * 	scallop_lang_daemon_cache_init().
+	 */
+	size_t max_scripts;
+
+	/**
+	 * \brief The most bytes of text and tokens to hold, set to
+	 * 	SCALLOP_LANG_DAEMON_CACHE_BYTES by
+	 * 	scallop_lang_daemon_cache_init(). Larger scripts are lexed
+	 * 	but never cached.
+	 */
+	size_t max_bytes;
+
+	pthread_mutex_t _mutex;
+	struct scallop_lang_daemon_script **_scripts;
+	size_t _scripts_length;
+	size_t _scripts_capacity;
+	size_t _bytes;
+	uint64_t _clock;
+};
+
+/**
+ * \brief Sends an invocation over a connected Unix socket.
+ *
+ * \param socket The socket.
+ * \param argv The null-terminated argument list.
+ * \param envp The null-terminated environment.
+ * \param cwd The path of the working directory.
+ * \param cwd_fd An open file descriptor of the working directory.
+ * \param fds The standard input, output and error to forward.
+ *
+ * \returns 0 on success, or -1 on failure.
+ */
+int scallop_lang_daemon_send_request(
+	int socket,
+	char *const argv[],
+	char *const envp[],
+	const char *cwd,
+	int cwd_fd,
+	const int fds[SCALLOP_LANG_DAEMON_FDS]
+);
+
+/**
+ * \brief Receives an invocation from a connected Unix socket.
+ *
+ * \param socket The socket.
+ * \param out The object to write the request to. On success, it
+ * 	must be freed with scallop_lang_daemon_request_free(), which
+ * 	also closes the received file descriptors.
+ *
+ * \returns 0 on success, or -1 on failure.
+ */
+int scallop_lang_daemon_receive_request(
+	int socket,
+	struct scallop_lang_daemon_request *out
+);
+
+/**
+ * \brief Frees a received request and closes its file descriptors.
+ *
+ * \param request The request to free.
+ */
+void scallop_lang_daemon_request_free(struct scallop_lang_daemon_request *request);
+
+/**
+ * \brief Sends the exit status of an invocation.
+ *
+ * \param socket The socket.
+ * \param status The exit status.
+ *
+ * \returns 0 on success, or -1 on failure.
+ */
+int scallop_lang_daemon_send_status(int socket, int status);
+
+/**
+ * \brief Receives the exit status of an invocation.
+ *
+ * \param socket The socket.
+ * \param status The location to write the exit status to.
+ *
+ * \returns 0 on success, or -1 on failure.
+ */
+int scallop_lang_daemon_receive_status(int socket, int *status);
+
+/**
+ * \brief Initializes a script cache.
+ *
+ * \param cache The cache to initialize. It must be freed with
+ * 	scallop_lang_daemon_cache_free().
+ *
+ * \returns 0 on success, or -1 on failure.
+ */
+int scallop_lang_daemon_cache_init(struct scallop_lang_daemon_cache *cache);
+
+/**
+ * \brief Returns the lexed script for an open file, lexing it
+ * 	if it isn't cached.
+ *
+ * The script is lexed with the calling thread's locale.
+ *
+ * \param cache The cache.
+ * \param fd An open regular file.
+ * \param raw True for tokens from scallop_lang_lex_next_raw(), or
+ * 	false for tokens from scallop_lang_lex_next().
+ *
+ * \returns The script, which must be released with
+ * 	scallop_lang_daemon_cache_release(), or NULL on failure.
+ */
+const struct scallop_lang_daemon_script *scallop_lang_daemon_cache_get(
+	struct scallop_lang_daemon_cache *cache,
+	int fd,
+	bool raw
+);
+
+/**
+ * \brief Releases a script returned by scallop_lang_daemon_cache_get().
+ *
+ * \param cache The cache.
+ * \param script The script to release.
+ */
+void scallop_lang_daemon_cache_release(
+	struct scallop_lang_daemon_cache *cache,
+	const struct scallop_lang_daemon_script *script
+);
+
+/**
+ * \brief Frees a script cache. Every script must have been released.
+ *
+ * \param cache The cache to free.
+ */
+void scallop_lang_daemon_cache_free(struct scallop_lang_daemon_cache *cache);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_DAEMON
@@ -0,0 +1,309 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_DEPS
+#define SCALLOP_LANG_DEPS
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <libadt/lptr.h>
+
+/**
+ * \file
+ *
+ * \brief This module provides a dependency analysis over the
+ * 	statements of a script, for running independent statements
+ * 	in parallel.
+ *
+ * Each top-level statement is described by the resources it
+ * reads and writes. What a command reads and writes is looked up
+ * by its first word in a table of struct scallop_lang_deps_command.
+ * Two statements depend on each other if one writes a resource
+ * the other reads or writes.
+ *
+ * Anything the analysis cannot see through is opaque:
+ * commands missing from the table, and statements containing
+ * blocks, substitutions, variable references or unquoted
+ * globs. An opaque statement depends on every
+ * statement before it, and every statement after it depends on
+ * it.
+ *
+ * The result is a dependency graph, along with a schedule
+ * of groups: every statement in a group depends only on
+ * statements in earlier groups, so a group can be run in
+ * parallel once the previous group has finished.
+ */
+
+/**
+ * \brief Describes the effects of a command.
+ *
+ * The arguments string describes the arguments in order,
+ * one character per argument:
+ *
+ * - 'r': the argument is a file which is read
+ * - 'w': the argument is a file which is written
+ * - 'm': the argument is a file which is read and written
+ * - 'v': the argument is a variable which is read
+ * - 'V': the argument is a variable which is written
+ * - '-': the argument is not a resource
+ *
+ * A role followed by '*' applies to as many arguments as
+ * necessary for the roles after it to match the last arguments.
+ * For example, "r*w" describes cp(1). Arguments with no
+ * matching role are treated as '-'.
+ */
+struct scallop_lang_deps_command {
+	/**
+	 * \brief The name of the command, as a normalized word.
+	 */
+	const char *name;
+
+	/**
+	 * \brief The roles of the command's arguments.
+	 */
+	const char *arguments;
+};
+
+/**
+ * \brief The kinds of resource a statement can access.
+ */
+enum scallop_lang_deps_resource {
+	SCALLOP_LANG_DEPS_FILE,
+	SCALLOP_LANG_DEPS_VARIABLE,
+};
+
+/**
+ * \brief Represents a single read or write of a resource.
+ */
+struct scallop_lang_deps_access {
+	enum scallop_lang_deps_resource resource;
+	bool write;
+
+	/**
+	 * \brief The name of the resource.
+	 *
+	 * File names are normalized: relative names are resolved
+	 * against the working directory, if one was given, and
+	 * redundant separators and "." components are removed.
+	 */
+	char *name;
+};
+
+/**
+ * \brief Represents a single top-level statement.
+ */
+struct scallop_lang_deps_statement {
+	/**
+	 * \brief The statement in the script, not including
+	 * 	the separator.
+	 */
+	struct libadt_const_lptr value;
+
+	/**
+	 * \brief True if the effects of the statement are unknown.
+	 */
+	bool opaque;
+
+	struct scallop_lang_deps_access *accesses;
+	size_t accesses_length;
+
+	/**
+	 * \brief The indices of the statements this statement
+	 * 	depends on directly, in ascending order.
+	 */
+	size_t *predecessors;
+	size_t predecessors_length;
+
+	/**
+	 * \brief The estimated cost of the statement, as passed to
+	 * 	scallop_lang_deps_schedule().
+	 */
+	double cost;
+
+	/**
+	 * \brief The earliest time the statement can finish,
+	 * 	given unlimited parallelism.
+	 */
+	double finish;
+
+	/**
+	 * \brief The cost of the longest chain of dependent statements
+	 * 	starting with this one.
+	 *
+	 * This is the least time from starting the statement to
+	 * finishing the script, given unlimited parallelism.
+	 */
+	double remaining;
+
+	/**
+	 * \brief The index of the group this statement is scheduled in.
+	 */
+	size_t group;
+
+	/**
+	 * \brief The time the statement starts, as placed by
+	 * 	scallop_lang_deps_place().
+	 */
+	double start;
+
+	/**
+	 * \brief The worker the statement was placed on by
+	 * 	scallop_lang_deps_place().
+	 */
+	size_t worker;
+};
+
+/**
+ * \brief Represents the dependency graph and schedule of a script.
+ */
+struct scallop_lang_deps {
+	struct scallop_lang_deps_statement *statements;
+	size_t statements_length;
+
+	/**
+	 * \brief The statement indices, ordered by group.
+	 */
+	size_t *order;
+
+	/**
+	 * \brief The group boundaries in .order.
+	 *
+	 * Group i consists of the statements order[groups[i]]
+	 * up to, but not including, order[groups[i + 1]].
+	 * This has groups_length + 1 elements.
+	 */
+	size_t *groups;
+	size_t groups_length;
+
+	/**
+	 * \brief The cost of the longest chain of dependent statements.
+	 *
+	 * This is a lower bound on the run time of the script,
+	 * however many statements are run in parallel.
+	 */
+	double critical_path;
+
+	/**
+	 * \brief The total cost of all statements.
+	 */
+	double total_cost;
+
+	/**
+	 * \brief The time the last statement finishes, as placed by
+	 * 	scallop_lang_deps_place().
+	 */
+	double makespan;
+};
+
+/**
+ * \brief Analyzes the dependencies between the statements
+ * 	of a script.
+ *
+ * The result is scheduled with a cost of 1 for every statement.
+ *
+ * \param script The script to analyze.
+ * \param commands A pointer to an array of struct
+ * 	scallop_lang_deps_command, describing the known commands.
+ * \param cwd The working directory the script runs in, used to
+ * 	compare relative and absolute file names. If NULL, relative
+ * 	and absolute file names are assumed to overlap.
+ * \param out The object to write the result to. On success,
+ * 	it must be freed with scallop_lang_deps_free().
+ *
+ * \returns 0 on success, or -1 if the script could not be
+ * 	lexed or memory could not be allocated.
+ */
+int scallop_lang_deps_analyze(
+	struct libadt_const_lptr script,
+	struct libadt_const_lptr commands,
+	const char *cwd,
+	struct scallop_lang_deps *out
+);
+
+/**
+ * \brief Recomputes the schedule of an analyzed script with
+ * 	new statement costs.
+ *
+ * \param deps The analyzed script.
+ * \param costs An array with one cost per statement, or NULL
+ * 	to give every statement a cost of 1.
+ */
+void scallop_lang_deps_schedule(
+	struct scallop_lang_deps *deps,
+	const double *costs
+);
+
+/**
+ * \brief Places the statements of a scheduled script on a
+ * 	limited number of workers.
+ *
+ * This simulates running the script with at most `workers`
+ * statements at a time, using the costs from the last call to
+ * scallop_lang_deps_schedule(). Whenever a worker becomes free,
+ * it is given the first statement in script order whose
+ * dependencies have finished.
+ *
+ * The resulting start times and workers can be used directly
+ * as a run order for an executor with a concurrency limit.
+ *
+ * \param deps The scheduled script.
+ * \param workers The maximum number of statements to run at
+ * 	the same time.
+ *
+ * \returns 0 on success, or -1 if workers is 0 or memory could
+ * 	not be allocated.
+ */
+int scallop_lang_deps_place(struct scallop_lang_deps *deps, size_t workers);
+
+/**
+ * \brief Places the statements of a scheduled script on a limited
+ * 	number of workers, critical path first.
+ *
+ * This is like scallop_lang_deps_place(), but whenever a worker
+ * becomes free, it is given the ready statement with the longest
+ * chain of statements left after it, as in .remaining, and then the
+ * highest cost. Statements that hold up the most work start first,
+ * and short statements fill the gaps around them, so one long
+ * statement isn't left to run alone at the end.
+ *
+ * \param deps The scheduled script.
+ * \param workers The maximum number of statements to run at
+ * 	the same time.
+ *
+ * \returns 0 on success, or -1 if workers is 0 or memory could
+ * 	not be allocated.
+ */
+int scallop_lang_deps_place_critical(struct scallop_lang_deps *deps, size_t workers);
+
+/**
+ * \brief Frees the memory held by an analyzed script.
+ *
+ * \param deps The analyzed script to free.
+ */
+void scallop_lang_deps_free(struct scallop_lang_deps *deps);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_DEPS
@@ -0,0 +1,166 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_ENV
+#define SCALLOP_LANG_ENV
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/**
+ * \file
+ *
+ * \brief This module provides a persistent store of variables,
+ * 	for giving each parallel branch its own scope.
+ *
+ * Variables are kept in a hash array mapped trie whose nodes are
+ * never changed once built. Forking a scope shares the whole trie,
+ * so it takes constant time, and setting a variable copies only
+ * the nodes on the path to it, leaving other scopes untouched.
+ *
+ * Each version of the store can build an envp array for spawning
+ * processes. It's built once per version and shared by every
+ * scope forked from it until one of them changes.
+ *
+ * Scopes may be used from different threads, including scopes
+ * forked from each other, but a single scope must not be used
+ * from two threads at once.
+ */
+
+/**
+ * \brief Represents a scope of variables.
+ *
+ * Initialize it with scallop_lang_env_init() or
+ * scallop_lang_env_fork(), and free it with
+ * scallop_lang_env_free().
+ */
+struct scallop_lang_env {
+	struct scallop_lang_env_version *_version;
+};
+
+/**
+ * \brief Initializes a scope from an environment.
+ *
+ * \param env The scope to initialize.
+ * \param envp A null-terminated array of "NAME=VALUE" strings,
+ * 	such as environ, or NULL for an empty scope. Strings
+ * 	without '=' are skipped, and later strings replace earlier
+ * 	ones with the same name.
+ *
+ * \returns 0 on success, or -1 on failure, setting errno.
+ */
+int scallop_lang_env_init(struct scallop_lang_env *env, char *const envp[]);
+
+/**
+ * \brief Initializes a scope sharing every variable of another.
+ *
+ * This takes constant time. Changes to either scope afterwards
+ * aren't seen by the other.
+ *
+ * \param env The scope to fork.
+ * \param out The scope to initialize.
+ */
+void scallop_lang_env_fork(
+	const struct scallop_lang_env *env,
+	struct scallop_lang_env *out
+);
+
+/**
+ * \brief Looks up a variable.
+ *
+ * \param env The scope to look in.
+ * \param name The name of the variable.
+ *
+ * \returns The value of the variable, valid until the scope is
+ * 	changed or freed, or NULL if it isn't set.
+ */
+const char *scallop_lang_env_get(
+	const struct scallop_lang_env *env,
+	const char *name
+);
+
+/**
+ * \brief Sets a variable.
+ *
+ * \param env The scope to change.
+ * \param name The name of the variable, which can't be empty or
+ * 	contain '='.
+ * \param value The new value of the variable.
+ *
+ * \returns 0 on success, or -1 on failure, setting errno to
+ * 	EINVAL for an invalid name.
+ */
+int scallop_lang_env_set(
+	struct scallop_lang_env *env,
+	const char *name,
+	const char *value
+);
+
+/**
+ * \brief Unsets a variable.
+ *
+ * \param env The scope to change.
+ * \param name The name of the variable.
+ *
+ * \returns 0 on success, including when the variable wasn't set,
+ * 	or -1 on failure, setting errno.
+ */
+int scallop_lang_env_unset(struct scallop_lang_env *env, const char *name);
+
+/**
+ * \brief Returns the number of variables set.
+ *
+ * \param env The scope to count.
+ *
+ * \returns The number of variables.
+ */
+size_t scallop_lang_env_length(const struct scallop_lang_env *env);
+
+/**
+ * \brief Returns the variables as an envp array, for execve(2)
+ * 	and similar.
+ *
+ * The array is built the first time it's asked for in each
+ * version of the store, and shared with every scope of that
+ * version.
+ *
+ * \param env The scope to convert.
+ *
+ * \returns A null-terminated array of "NAME=VALUE" strings, in no
+ * 	particular order, valid until the scope is changed or
+ * 	freed, or NULL on failure, setting errno.
+ */
+char *const *scallop_lang_env_envp(const struct scallop_lang_env *env);
+
+/**
+ * \brief Frees a scope.
+ *
+ * Variables still shared with other scopes are kept for them.
+ *
+ * \param env The scope to free.
+ */
+void scallop_lang_env_free(struct scallop_lang_env *env);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_ENV
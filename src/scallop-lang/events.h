@@ -0,0 +1,236 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_EVENTS
+#define SCALLOP_LANG_EVENTS
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+/**
+ * \file
+ *
+ * \brief This module provides a single-threaded event loop for
+ * 	running many commands at once.
+ *
+ * An event loop waits for child processes to exit, for file
+ * descriptors to become ready and for timers to expire, all in
+ * one call. Children are tracked with pidfd_open(2), so each
+ * wakeup only does work for the children that actually exited.
+ *
+ * On kernels without pidfd_open(2), a SIGCHLD handler writes to
+ * a pipe instead, and each wakeup checks every tracked child.
+ * The handler is installed the first time it's needed and is
+ * shared by every event loop in the process.
+ */
+
+/**
+ * \brief Don't use pidfd_open(2), even if the kernel supports it.
+ */
+#define SCALLOP_LANG_EVENTS_NO_PIDFD 1
+
+/**
+ * \brief The file descriptor is ready for reading, or was closed
+ * 	by the other end.
+ */
+#define SCALLOP_LANG_EVENTS_READ 1
+
+/**
+ * \brief The file descriptor is ready for writing.
+ */
+#define SCALLOP_LANG_EVENTS_WRITE 2
+
+enum scallop_lang_events_type {
+	SCALLOP_LANG_EVENTS_CHILD,
+	SCALLOP_LANG_EVENTS_FD,
+	SCALLOP_LANG_EVENTS_TIMER,
+};
+
+/**
+ * \brief Represents something being waited for.
+ */
+struct scallop_lang_events_watch;
+
+/**
+ * \brief Represents an event returned by scallop_lang_events_wait().
+ */
+struct scallop_lang_events_event {
+	enum scallop_lang_events_type type;
+
+	/**
+	 * \brief The user pointer given when the watch was added.
+	 */
+	void *user;
+
+	/**
+	 * \brief For SCALLOP_LANG_EVENTS_CHILD, the process that
+	 * 	exited, and its status as returned by waitpid(2).
+	 */
+	pid_t pid;
+	int status;
+
+	/**
+	 * \brief For SCALLOP_LANG_EVENTS_CHILD, the resources used by
+	 * 	the process and the children it waited for, as returned
+	 * 	by wait4(2).
+	 */
+	struct rusage usage;
+
+	/**
+	 * \brief For SCALLOP_LANG_EVENTS_FD, the file descriptor and
+	 * 	a mask of SCALLOP_LANG_EVENTS_READ and
+	 * 	SCALLOP_LANG_EVENTS_WRITE.
+	 */
+	int fd;
+	uint32_t ready;
+};
+
+/**
+ * \brief Represents an event loop.
+ */
+struct scallop_lang_events {
+	int _epoll;
+	bool _pidfd;
+	struct scallop_lang_events_watch *_watches;
+
+	// Only used without pidfd_open(2)
+	struct scallop_lang_events_watch *_signal;
+	struct scallop_lang_events_watch **_children;
+	size_t _children_length;
+	size_t _children_capacity;
+	bool _scan;
+};
+
+/**
+ * \brief Initializes an event loop.
+ *
+ * \param events The event loop to initialize. It must be freed with
+ * 	scallop_lang_events_free().
+ * \param flags 0, or SCALLOP_LANG_EVENTS_NO_PIDFD.
+ *
+ * \returns 0 on success, or -1 on failure.
+ */
+int scallop_lang_events_init(struct scallop_lang_events *events, int flags);
+
+/**
+ * \brief Waits for a child process to exit.
+ *
+ * The child is reaped by scallop_lang_events_wait(), and the watch
+ * is removed after its event is returned.
+ *
+ * \param events The event loop.
+ * \param pid A child of this process.
+ * \param user A pointer returned with the event.
+ *
+ * \returns The new watch, or NULL on failure.
+ */
+struct scallop_lang_events_watch *scallop_lang_events_add_child(
+	struct scallop_lang_events *events,
+	pid_t pid,
+	void *user
+);
+
+/**
+ * \brief Waits for a file descriptor to become ready.
+ *
+ * The watch stays active until it's removed with
+ * scallop_lang_events_remove().
+ *
+ * \param events The event loop.
+ * \param fd The file descriptor.
+ * \param mask SCALLOP_LANG_EVENTS_READ, SCALLOP_LANG_EVENTS_WRITE,
+ * 	or both.
+ * \param user A pointer returned with each event.
+ *
+ * \returns The new watch, or NULL on failure.
+ */
+struct scallop_lang_events_watch *scallop_lang_events_add_fd(
+	struct scallop_lang_events *events,
+	int fd,
+	uint32_t mask,
+	void *user
+);
+
+/**
+ * \brief Waits for an amount of time to pass.
+ *
+ * The watch is removed after its event is returned.
+ *
+ * \param events The event loop.
+ * \param milliseconds The time to wait.
+ * \param user A pointer returned with the event.
+ *
+ * \returns The new watch, or NULL on failure.
+ */
+struct scallop_lang_events_watch *scallop_lang_events_add_timer(
+	struct scallop_lang_events *events,
+	uint64_t milliseconds,
+	void *user
+);
+
+/**
+ * \brief Removes a watch before its event is returned.
+ *
+ * Removing a child watch doesn't reap the child.
+ *
+ * \param events The event loop.
+ * \param watch The watch to remove.
+ */
+void scallop_lang_events_remove(
+	struct scallop_lang_events *events,
+	struct scallop_lang_events_watch *watch
+);
+
+/**
+ * \brief Waits for events.
+ *
+ * \param events The event loop.
+ * \param out The array to write events to.
+ * \param length The length of out.
+ * \param timeout The longest time to wait in milliseconds,
+ * 	or -1 to wait indefinitely.
+ *
+ * \returns The number of events written to out, which is 0 if
+ * 	the timeout expired, or -1 on failure.
+ */
+ssize_t scallop_lang_events_wait(
+	struct scallop_lang_events *events,
+	struct scallop_lang_events_event *out,
+	size_t length,
+	int timeout
+);
+
+/**
+ * \brief Frees an event loop and all of its watches.
+ *
+ * \param events The event loop to free.
+ */
+void scallop_lang_events_free(struct scallop_lang_events *events);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_EVENTS
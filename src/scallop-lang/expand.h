@@ -0,0 +1,161 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_EXPAND
+#define SCALLOP_LANG_EXPAND
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <libadt/lptr.h>
+
+/**
+ * \file
+ *
+ * \brief This module provides variable expansion of words.
+ *
+ * A word is compiled once into a struct scallop_lang_expand_plan:
+ * a list of literal slices, with quotes and escapes already
+ * removed, and variable slots. Each distinct variable name in the
+ * word gets one slot.
+ *
+ * Expanding the plan doesn't decode the word again. The caller
+ * looks up a value for each slot, and scallop_lang_expand_apply()
+ * makes a single allocation of the exact size and copies the
+ * slices and values into it.
+ */
+
+/**
+ * \brief Represents a slice of a word: either literal text
+ * 	or a variable reference.
+ */
+struct scallop_lang_expand_part {
+	/**
+	 * \brief The offset of the slice in the plan's text.
+	 *
+	 * For a variable reference, this is the variable name.
+	 */
+	size_t offset;
+	size_t length;
+
+	/**
+	 * \brief The index of the variable in the plan's names,
+	 * 	or -1 for a literal slice.
+	 */
+	ssize_t slot;
+};
+
+/**
+ * \brief Represents a compiled word.
+ */
+struct scallop_lang_expand_plan {
+	/**
+	 * \brief The bytes referenced by the parts.
+	 */
+	char *text;
+
+	/**
+	 * \brief The total length of the literal parts.
+	 */
+	size_t literal_length;
+
+	struct scallop_lang_expand_part *parts;
+	size_t parts_length;
+
+	/**
+	 * \brief The distinct variable names in the word,
+	 * 	indexed by slot.
+	 */
+	char **names;
+	size_t names_length;
+};
+
+/**
+ * \brief Compiles a word into an expansion plan.
+ *
+ * \param word A word value from scallop_lang_lex_next().
+ * \param out The object to write the plan to. On success, it
+ * 	must be freed with scallop_lang_expand_free().
+ *
+ * \returns 0 on success, or -1 if the word is invalid or memory
+ * 	could not be allocated.
+ */
+int scallop_lang_expand_compile(
+	struct libadt_const_lptr word,
+	struct scallop_lang_expand_plan *out
+);
+
+/**
+ * \brief Tests if a plan contains no variable references.
+ *
+ * \param plan The compiled word.
+ *
+ * \returns True if the plan expands to its literal text.
+ */
+bool scallop_lang_expand_is_literal(const struct scallop_lang_expand_plan *plan);
+
+/**
+ * \brief Calculates the length of an expansion.
+ *
+ * \param plan The compiled word.
+ * \param values The value of each variable slot, as a byte string.
+ * 	A value with a NULL buffer is treated as empty.
+ *
+ * \returns The length of the expanded word, not including the
+ * 	terminating null byte.
+ */
+size_t scallop_lang_expand_length(
+	const struct scallop_lang_expand_plan *plan,
+	const struct libadt_const_lptr values[]
+);
+
+/**
+ * \brief Expands a compiled word.
+ *
+ * \param plan The compiled word.
+ * \param values The value of each variable slot, as a byte string.
+ * 	A value with a NULL buffer is treated as empty.
+ * \param length If not NULL, the length of the result is written
+ * 	here.
+ *
+ * \returns A null-terminated string which must be freed with
+ * 	free(), or NULL if memory could not be allocated.
+ */
+char *scallop_lang_expand_apply(
+	const struct scallop_lang_expand_plan *plan,
+	const struct libadt_const_lptr values[],
+	size_t *length
+);
+
+/**
+ * \brief Frees a compiled word.
+ *
+ * \param plan The plan to free.
+ */
+void scallop_lang_expand_free(struct scallop_lang_expand_plan *plan);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_EXPAND
@@ -0,0 +1,180 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_GLOB
+#define SCALLOP_LANG_GLOB
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <libadt/lptr.h>
+
+/**
+ * \file
+ *
+ * \brief This module provides glob expansion of words.
+ *
+ * A word is compiled once into a struct scallop_lang_glob, from
+ * the unquoted glob characters classified as
+ * scallop_lang_classifier_glob: '*' matches any sequence of
+ * characters and '?' matches a single character. Quoted and
+ * escaped glob characters match themselves. As in other shells,
+ * glob characters never match a leading '.' in a file name.
+ *
+ * The compiled pattern is split into path components. The leading
+ * components without glob characters form a literal prefix, which
+ * is where expansion starts; later components without glob
+ * characters are checked directly, without listing directories.
+ */
+
+/**
+ * \brief Represents a single path component of a pattern.
+ */
+struct scallop_lang_glob_component {
+	/**
+	 * \brief The bytes of the component.
+	 */
+	char *text;
+
+	/**
+	 * \brief One entry per byte in text: 0 for a literal byte,
+	 * 	or '*' or '?' for a glob character.
+	 */
+	char *kinds;
+
+	size_t length;
+
+	/**
+	 * \brief True if the component contains no glob characters.
+	 */
+	bool literal;
+};
+
+/**
+ * \brief Represents a compiled glob pattern.
+ */
+struct scallop_lang_glob {
+	/**
+	 * \brief The literal path prefix to start expanding from.
+	 *
+	 * This is empty for patterns starting in the working directory.
+	 */
+	char *prefix;
+
+	/**
+	 * \brief The components following the prefix.
+	 */
+	struct scallop_lang_glob_component *components;
+	size_t components_length;
+};
+
+/**
+ * \brief Represents the result of expanding a pattern.
+ */
+struct scallop_lang_glob_matches {
+	/**
+	 * \brief The matching paths, in ascending byte order.
+	 */
+	char **paths;
+	size_t length;
+};
+
+/**
+ * \brief Compiles a word into a glob pattern.
+ *
+ * \param word A word value from scallop_lang_lex_next().
+ * \param out The object to write the pattern to. On success, it
+ * 	must be freed with scallop_lang_glob_free().
+ *
+ * \returns 0 on success, or -1 if the word is invalid or memory
+ * 	could not be allocated.
+ */
+int scallop_lang_glob_compile(
+	struct libadt_const_lptr word,
+	struct scallop_lang_glob *out
+);
+
+/**
+ * \brief Tests if a pattern contains any glob characters.
+ *
+ * Words without glob characters don't need to be expanded.
+ *
+ * \param glob The compiled pattern.
+ *
+ * \returns True if the pattern is a literal path.
+ */
+bool scallop_lang_glob_is_literal(const struct scallop_lang_glob *glob);
+
+/**
+ * \brief Matches a single file name against a component
+ * 	of a pattern.
+ *
+ * \param component The component to match against.
+ * \param name The file name to match.
+ *
+ * \returns True if the name matches.
+ */
+bool scallop_lang_glob_match(
+	const struct scallop_lang_glob_component *component,
+	const char *name
+);
+
+/**
+ * \brief Expands a pattern into the paths it matches.
+ *
+ * Directories are listed in large batches with getdents64(2),
+ * on up to `threads` threads. Paths that can't be read are
+ * skipped.
+ *
+ * \param glob The compiled pattern.
+ * \param threads The number of threads to walk directories with.
+ * 	If this is 0 or 1, the calling thread is used.
+ * \param out The object to write the matches to. On success,
+ * 	it must be freed with scallop_lang_glob_matches_free().
+ *
+ * \returns 0 on success, or -1 on failure.
+ */
+int scallop_lang_glob_expand(
+	const struct scallop_lang_glob *glob,
+	size_t threads,
+	struct scallop_lang_glob_matches *out
+);
+
+/**
+ * \brief Frees a compiled pattern.
+ *
+ * \param glob The pattern to free.
+ */
+void scallop_lang_glob_free(struct scallop_lang_glob *glob);
+
+/**
+ * \brief Frees the result of an expansion.
+ *
+ * \param matches The matches to free.
+ */
+void scallop_lang_glob_matches_free(struct scallop_lang_glob_matches *matches);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_GLOB
@@ -0,0 +1,174 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_HISTORY
+#define SCALLOP_LANG_HISTORY
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \file
+ *
+ * \brief This module records how long statements take to run, in a
+ * 	small local file, to estimate their cost the next time.
+ *
+ * Statements are identified by a key, which is the hash of a
+ * fingerprint from cache.h built from the statement's normalized
+ * words alone: scallop_lang_cache_add_statement() for its script,
+ * or scallop_lang_cache_add_words() for its arguments. Quoting and
+ * spacing that don't change the words don't change the key.
+ *
+ * Each record keeps the wall and CPU time of the statement, in
+ * seconds, averaged over its last few runs so that a single slow
+ * run doesn't dominate: the first SCALLOP_LANG_HISTORY_WINDOW runs
+ * are averaged equally, and after that each run moves the average
+ * by 1 / SCALLOP_LANG_HISTORY_WINDOW of the difference.
+ *
+ * The file holds a 32-byte record per statement, in the machine's
+ * byte order, and isn't meant to be shared between machines.
+ */
+
+/**
+ * \brief The number of runs a record averages over.
+ */
+#define SCALLOP_LANG_HISTORY_WINDOW 8
+
+/**
+ * \brief Represents the recorded runs of a statement.
+ */
+struct scallop_lang_history_record {
+	uint64_t key;
+
+	/**
+	 * \brief The number of runs recorded, which is 0 for unused
+	 * 	records.
+	 */
+	uint32_t runs;
+
+	/**
+	 * \brief The average wall time, in seconds.
+	 */
+	double wall;
+
+	/**
+	 * \brief The average CPU time, user and system, in seconds.
+	 */
+	double cpu;
+};
+
+/**
+ * \brief Represents a history file.
+ */
+struct scallop_lang_history {
+	char *_path;
+	struct scallop_lang_history_record *_records;
+	size_t _length;
+	size_t _capacity;
+};
+
+/**
+ * \brief Opens a history file.
+ *
+ * A missing or damaged file is treated as empty. Nothing is written
+ * until scallop_lang_history_save() is called.
+ *
+ * \param history The object to initialize. On success, it must be
+ * 	freed with scallop_lang_history_close().
+ * \param path The path of the file.
+ *
+ * \returns 0 on success, or -1 if the file exists but couldn't be
+ * 	read, or memory couldn't be allocated.
+ */
+int scallop_lang_history_open(struct scallop_lang_history *history, const char *path);
+
+/**
+ * \brief Looks up the record of a statement.
+ *
+ * \param history The history.
+ * \param key The statement's key.
+ *
+ * \returns The record, valid until the history is changed, or NULL
+ * 	if the statement hasn't been recorded.
+ */
+const struct scallop_lang_history_record *scallop_lang_history_find(
+	const struct scallop_lang_history *history,
+	uint64_t key
+);
+
+/**
+ * \brief Estimates the wall time of a statement.
+ *
+ * \param history The history.
+ * \param key The statement's key.
+ * \param fallback The estimate for statements that haven't been
+ * 	recorded.
+ *
+ * \returns The average wall time of the statement, or fallback.
+ */
+double scallop_lang_history_estimate(
+	const struct scallop_lang_history *history,
+	uint64_t key,
+	double fallback
+);
+
+/**
+ * \brief Records a run of a statement.
+ *
+ * \param history The history.
+ * \param key The statement's key.
+ * \param wall The wall time of the run, in seconds.
+ * \param cpu The CPU time of the run, in seconds.
+ *
+ * \returns 0 on success, or -1 if memory couldn't be allocated.
+ */
+int scallop_lang_history_add(
+	struct scallop_lang_history *history,
+	uint64_t key,
+	double wall,
+	double cpu
+);
+
+/**
+ * \brief Writes a history back to its file.
+ *
+ * The file is replaced atomically, so a reader never sees part of
+ * it.
+ *
+ * \param history The history.
+ *
+ * \returns 0 on success, or -1 on failure, setting errno.
+ */
+int scallop_lang_history_save(const struct scallop_lang_history *history);
+
+/**
+ * \brief Frees a history without saving it.
+ *
+ * \param history The history to free.
+ */
+void scallop_lang_history_close(struct scallop_lang_history *history);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_HISTORY
@@ -0,0 +1,230 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_JOBS
+#define SCALLOP_LANG_JOBS
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "commands.h"
+#include "jobserver.h"
+#include "topology.h"
+
+/**
+ * \file
+ *
+ * \brief This module runs a tree of commands and parallel blocks,
+ * 	cancelling the rest of a block when one of its jobs fails.
+ *
+ * Jobs are given as a flat array. Each job is either a command or
+ * a block, and names the block it belongs to. The jobs in a block,
+ * like the statements of a '{}' block, all run in parallel; jobs
+ * without a block form the outermost block.
+ *
+ * When more commands are ready than may run at once, the ones
+ * expected to take longest start first, so a long command isn't
+ * left running alone at the end while the others wait for it.
+ * Since the jobs of a block have no order between them, the longest
+ * command is the critical path. The time each command took is
+ * written back, for history.h to estimate the next run from.
+ *
+ * How many commands run at once can be limited globally, for each
+ * block, and by a GNU make jobserver. A command waits in the queue
+ * until every limit allows it, while commands behind it that are
+ * allowed start first. Commands can also be pinned to the cores of
+ * a topology, each to the core running the fewest commands, so
+ * they aren't moved between cores, or crowded onto the SMT
+ * siblings of one, when there are more commands than CPUs.
+ *
+ * When a job fails, its block fails. Every other job in the block
+ * is cancelled: running commands receive a sequence of signals,
+ * queued commands are never started, and nested blocks cancel
+ * their own jobs. The failure then propagates to the enclosing
+ * block.
+ */
+
+enum scallop_lang_jobs_state {
+	SCALLOP_LANG_JOBS_PENDING,
+	SCALLOP_LANG_JOBS_RUNNING,
+	SCALLOP_LANG_JOBS_SUCCEEDED,
+	SCALLOP_LANG_JOBS_FAILED,
+	SCALLOP_LANG_JOBS_CANCELLED,
+};
+
+/**
+ * \brief Represents a command or a block.
+ */
+struct scallop_lang_jobs_job {
+	/**
+	 * \brief A null-terminated argument list for execvp(3),
+	 * 	or NULL for a block.
+	 */
+	char *const *argv;
+
+	/**
+	 * \brief The index of the block containing this job, or -1.
+	 *
+	 * Blocks must come before the jobs they contain.
+	 */
+	ssize_t block;
+
+	/**
+	 * \brief The expected run time of a command, in any unit,
+	 * 	or 0 if it's unknown.
+	 *
+	 * Queued commands start in order of decreasing cost, and
+	 * in the order they're given when the costs are equal.
+	 */
+	double cost;
+
+	/**
+	 * \brief For a block, the most commands in it, including
+	 * 	those in nested blocks, running at once, or 0 for no
+	 * 	limit.
+	 */
+	size_t max_running;
+
+	/**
+	 * \brief The final state of the job, written by
+	 * 	scallop_lang_jobs_run().
+	 *
+	 * Commands that were stopped by cancellation, and jobs that
+	 * were never started, are SCALLOP_LANG_JOBS_CANCELLED, even
+	 * if they exited unsuccessfully.
+	 */
+	enum scallop_lang_jobs_state state;
+
+	/**
+	 * \brief The status of a command as returned by waitpid(2),
+	 * 	or -1 if it couldn't be started.
+	 */
+	int status;
+
+	/**
+	 * \brief The wall time and CPU time, user and system, of a
+	 * 	command that exited, in seconds, written by
+	 * 	scallop_lang_jobs_run().
+	 */
+	double wall;
+	double cpu;
+};
+
+/**
+ * \brief Represents the options for running jobs.
+ */
+struct scallop_lang_jobs_options {
+	/**
+	 * \brief The most commands running at once, or 0
+	 * 	for no limit. Other commands are queued.
+	 */
+	size_t max_running;
+
+	/**
+	 * \brief The signals sent to a cancelled command, in order.
+	 *
+	 * If this is NULL, SIGTERM then SIGKILL are sent.
+	 */
+	const int *signals;
+	size_t signals_length;
+
+	/**
+	 * \brief The time in milliseconds to wait for a command to
+	 * 	exit before sending the next signal, or 0 for 5000.
+	 */
+	uint64_t grace;
+
+	/**
+	 * \brief A cache to find commands in, or NULL to search
+	 * 	$PATH for each command with execvp(3).
+	 *
+	 * Commands whose name contains '/' or isn't found in the
+	 * cache are still run with execvp(3). The cache is updated
+	 * while the jobs run, as its directories change.
+	 */
+	struct scallop_lang_commands *commands;
+
+	/**
+	 * \brief A jobserver to take a token from for each command
+	 * 	after the first running at once, or NULL.
+	 *
+	 * Tokens are given back as soon as commands exit, and when
+	 * scallop_lang_jobs_run() returns.
+	 */
+	struct scallop_lang_jobserver *jobserver;
+
+	/**
+	 * \brief The cores to pin commands to, or NULL to leave them
+	 * 	unpinned.
+	 *
+	 * Commands that can't be pinned, for example because none of
+	 * the CPUs of their core are allowed, run unpinned.
+	 */
+	const struct scallop_lang_topology *topology;
+};
+
+/**
+ * \brief Runs jobs until they have all finished or been cancelled.
+ *
+ * Each command runs in its own process group, and signals are sent
+ * to the whole group.
+ *
+ * \param jobs The jobs to run.
+ * \param length The number of jobs.
+ * \param options The options, or NULL for the defaults.
+ *
+ * \returns 0 if every job succeeded, 1 if any job failed, or -1
+ * 	if the jobs are invalid or the event loop failed.
+ */
+int scallop_lang_jobs_run(
+	struct scallop_lang_jobs_job *jobs,
+	size_t length,
+	const struct scallop_lang_jobs_options *options
+);
+
+/**
+ * \brief Predicts how long jobs will take to run, from their costs.
+ *
+ * This simulates scallop_lang_jobs_run() starting the commands in
+ * the same order, as if each took exactly its cost and none failed.
+ * The limits of blocks are followed as well as max_running.
+ *
+ * \param jobs The jobs.
+ * \param length The number of jobs.
+ * \param max_running The most commands running at once, or 0 for
+ * 	no limit.
+ *
+ * \returns The time the last command would finish, in the unit of
+ * 	the costs, or -1 if memory couldn't be allocated.
+ */
+double scallop_lang_jobs_predict(
+	const struct scallop_lang_jobs_job *jobs,
+	size_t length,
+	size_t max_running
+);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_JOBS
@@ -0,0 +1,125 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_JOBSERVER
+#define SCALLOP_LANG_JOBSERVER
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \file
+ *
+ * \brief This module is a client of GNU make's jobserver, so a
+ * 	script run from a recipe shares make's -j limit.
+ *
+ * make passes the jobserver in $MAKEFLAGS, as
+ * --jobserver-auth=fifo:PATH for a named pipe, or as
+ * --jobserver-auth=R,W (--jobserver-fds=R,W before make 4.2) for
+ * a pipe already open on file descriptors R and W. The pipe holds
+ * one byte, a token, for each job that may start beyond the
+ * first.
+ *
+ * Every client owns one implicit token, for the job make started
+ * it as, so it may always run one command. Each further command
+ * needs a token read from the pipe, which must be written back
+ * when the command exits, even if the client fails.
+ */
+
+/**
+ * \brief Represents a connection to a jobserver.
+ */
+struct scallop_lang_jobserver {
+	int _read;
+	int _write;
+};
+
+/**
+ * \brief Connects to the jobserver named in $MAKEFLAGS.
+ *
+ * The file descriptors make passed are reopened, so reading tokens
+ * never blocks and doesn't change how make reads them.
+ *
+ * \param jobserver The jobserver to initialize. It must be freed
+ * 	with scallop_lang_jobserver_free().
+ * \param makeflags The value of $MAKEFLAGS, or NULL.
+ *
+ * \returns 0 on success, or -1 on failure, setting errno to ENOENT
+ * 	if makeflags names no jobserver, or EBADF if it names file
+ * 	descriptors that aren't open, as when the recipe isn't
+ * 	marked with '+'.
+ */
+int scallop_lang_jobserver_init(
+	struct scallop_lang_jobserver *jobserver,
+	const char *makeflags
+);
+
+/**
+ * \brief Returns a file descriptor which is readable when a token
+ * 	may be free.
+ *
+ * \param jobserver The jobserver.
+ *
+ * \returns The file descriptor.
+ */
+int scallop_lang_jobserver_fd(const struct scallop_lang_jobserver *jobserver);
+
+/**
+ * \brief Takes a token, without blocking.
+ *
+ * \param jobserver The jobserver.
+ * \param token Where to write the token, to be given back to
+ * 	scallop_lang_jobserver_release().
+ *
+ * \returns 1 if a token was taken, 0 if none is free, or -1 on
+ * 	failure, setting errno.
+ */
+int scallop_lang_jobserver_acquire(
+	struct scallop_lang_jobserver *jobserver,
+	char *token
+);
+
+/**
+ * \brief Gives back a token.
+ *
+ * \param jobserver The jobserver.
+ * \param token The token, as returned by
+ * 	scallop_lang_jobserver_acquire().
+ *
+ * \returns 0 on success, or -1 on failure, setting errno.
+ */
+int scallop_lang_jobserver_release(
+	struct scallop_lang_jobserver *jobserver,
+	char token
+);
+
+/**
+ * \brief Disconnects from a jobserver.
+ *
+ * Tokens that were taken must be released first.
+ *
+ * \param jobserver The jobserver to free.
+ */
+void scallop_lang_jobserver_free(struct scallop_lang_jobserver *jobserver);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_JOBSERVER
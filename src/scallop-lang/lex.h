@@ -23,17 +23,29 @@
 extern "C" {
 #endif
 
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <wchar.h>
 
 #include <libadt/lptr.h>
 
 #include "classifier.h"
+#include "cpu.h"
 
 /**
  * \file
  *
  * \brief This module provides an API over the classifier finite state
  * 	machine, generating tokens from multibyte character scripts.
+ *
+ * Scripts may also be wide character strings, with a .size of
+ * sizeof(wchar_t), which are lexed without decoding. Token values
+ * are then pointers into the wide string, and their lengths count
+ * wide characters. Where wchar_t holds UTF-32 (__STDC_ISO_10646__
+ * is defined and wchar_t is 32 bits wide), char32_t strings can be
+ * passed in the same way.
  */
 
 /**
@@ -56,8 +68,63 @@ struct scallop_lang_lex {
 	 * This will always be a pointer into .script.
 	 */
 	struct libadt_const_lptr value;
+
+	/**
+	 * \brief The classifier state after the last character
+	 * 	of the token, or NULL if it's the same as .type.
+	 *
+	 * This differs from .type for merged tokens, for example
+	 * a$x has the type scallop_lang_classifier_word but ends in
+	 * scallop_lang_classifier_variable_name.
+	 */
+	scallop_lang_classifier_fn *state;
+};
+
+/**
+ * \brief A growable buffer of normalized words, written by
+ * 	scallop_lang_lex_next_normalized().
+ *
+ * Initialize it to zero, and free it with
+ * scallop_lang_lex_words_free(). Words are appended one after
+ * another, each followed by a null terminator; set .length to 0
+ * to reuse the buffer from the start.
+ *
+ * Words from wide character scripts are wide character strings,
+ * with .length and .capacity still counted in bytes.
+ */
+struct scallop_lang_lex_words {
+	char *buffer;
+
+	/**
+	 * \brief The number of bytes used, including terminators.
+	 */
+	size_t length;
+
+	size_t capacity;
+
+	/**
+	 * \brief The byte offset of the last word appended.
+	 */
+	size_t word;
+
+	/**
+	 * \brief The number of characters in the last word appended,
+	 * 	without its terminator.
+	 */
+	size_t word_length;
 };
 
+#ifdef SCALLOP_LANG_LEX_STEPS
+/*
+ * The number of characters classified so far, counted when built
+ * with SCALLOP_LANG_LEX_STEPS for the fuzzer in fuzz/.
+ */
+extern size_t scallop_lang_lex_steps;
+#define _SCALLOP_LEX_STEPS(amount) (scallop_lang_lex_steps += (amount))
+#else
+#define _SCALLOP_LEX_STEPS(amount) ((void)0)
+#endif
+
 inline size_t _scallop_mbrtowc(
 	wchar_t *result,
 	struct libadt_const_lptr string,
@@ -90,15 +157,48 @@ inline bool _scallop_read_error(_scallop_read_t read)
 		|| read.type == scallop_lang_classifier_unexpected;
 }
 
+inline bool _scallop_is_wide(struct libadt_const_lptr script)
+{
+	return script.size == sizeof(wchar_t) && sizeof(wchar_t) > 1;
+}
+
+/*
+ * Reads one character from the start of string, decoding it if
+ * string is multibyte. Returns the number of elements read, as
+ * _scallop_mbrtowc().
+ */
+inline size_t _scallop_decode(
+	wchar_t *result,
+	struct libadt_const_lptr string
+)
+{
+	_SCALLOP_LEX_STEPS(1);
+	if (_scallop_is_wide(string)) {
+		if (string.length <= 0) {
+			*result = (wchar_t)WEOF;
+			return 0;
+		}
+		*result = *(const wchar_t *)string.buffer;
+		return 1;
+	}
+
+	mbstate_t mbs = { 0 };
+	const size_t amount = _scallop_mbrtowc(result, string, &mbs);
+
+	// mbrtowc() returns 0 for the null character
+	if (amount == 0 && string.length > 0)
+		return 1;
+	return amount;
+}
+
 inline _scallop_read_t _scallop_read(
 	struct libadt_const_lptr script,
 	scallop_lang_classifier_fn *const previous
 )
 {
 	wchar_t c = 0;
-	mbstate_t mbs = { 0 };
 	_scallop_read_t result = { 0 };
-	result.amount = _scallop_mbrtowc(&c, script, &mbs);
+	result.amount = _scallop_decode(&c, script);
 	if (_scallop_read_error(result))
 		result.type = (scallop_lang_classifier_fn*)scallop_lang_classifier_unexpected;
 	else
@@ -108,10 +208,42 @@ inline _scallop_read_t _scallop_read(
 	return result;
 }
 
+/*
+ * Returns the length of the ASCII characters at the start of script
+ * that leave a token of the given type in the same state, which are
+ * consumed in bulk by the kernels in cpu.h.
+ */
+inline size_t _scallop_lex_skip(
+	scallop_lang_classifier_fn *type,
+	struct libadt_const_lptr script
+)
+{
+	if (script.length <= 0 || script.size != 1)
+		return 0;
+
+	const char *const text = script.buffer;
+	const size_t length = (size_t)script.length;
+	if (type == scallop_lang_classifier_word)
+		return scallop_lang_cpu.word_length(text, length);
+	if (
+		type == scallop_lang_classifier_variable_name
+		|| type == scallop_lang_classifier_double_quote_variable_name
+	)
+		return scallop_lang_cpu.name_length(text, length);
+	if (type == scallop_lang_classifier_single_quote_word)
+		return scallop_lang_cpu.scan(text, length, '\'', '\'');
+	if (type == scallop_lang_classifier_double_quote_word)
+		return scallop_lang_cpu.scan(text, length, '"', '$');
+	if (type == scallop_lang_classifier_line_comment)
+		return scallop_lang_cpu.scan(text, length, '\r', '\n');
+	return 0;
+}
+
 /**
  * \brief Initializes a token object for use in scallop_lang_lex_next().
  *
- * \param script The script to create a token from.
+ * \param script The script to create a token from, either a
+ * 	multibyte string or a wide character string.
  *
  * \returns A token, valid for passing to scallop_lang_lex_next().
  */
@@ -126,6 +258,27 @@ inline struct scallop_lang_lex scallop_lang_lex_init(
 	};
 }
 
+/**
+ * \brief Initializes a token object over a wide character script,
+ * 	for use in scallop_lang_lex_next().
+ *
+ * \param script The wide characters of the script.
+ * \param length The number of wide characters in script.
+ *
+ * \returns A token, valid for passing to scallop_lang_lex_next().
+ */
+inline struct scallop_lang_lex scallop_lang_lex_init_wide(
+	const wchar_t *script,
+	size_t length
+)
+{
+	return scallop_lang_lex_init((struct libadt_const_lptr) {
+		.buffer = script,
+		.size = sizeof(wchar_t),
+		.length = (ssize_t)length,
+	});
+}
+
 /**
  * \brief Returns the next, raw token in the script referred to by
  * 	previous.
@@ -147,15 +300,15 @@ inline struct scallop_lang_lex scallop_lang_lex_next_raw(
 	struct scallop_lang_lex previous
 )
 {
-	const ssize_t value_offset = (char *)previous.value.buffer
-		- (char *)previous.script.buffer;
+	const ssize_t value_offset = ((char *)previous.value.buffer
+		- (char *)previous.script.buffer) / (ssize_t)previous.script.size;
 	struct libadt_const_lptr next = libadt_const_lptr_index(
 		previous.script,
 		value_offset + previous.value.length
 	);
 
 	_scallop_read_t
-		read = _scallop_read(next, previous.type),
+		read = _scallop_read(next, previous.state ? previous.state : previous.type),
 		previous_read = read;
 
 	if (_scallop_read_error(read))
@@ -174,12 +327,15 @@ inline struct scallop_lang_lex scallop_lang_lex_next_raw(
 	}
 
 	size_t value_length = read.amount;
-	for (
-		read = _scallop_read(read.script, read.type);
-		!_scallop_read_error(read);
-		read = _scallop_read(read.script, read.type)
-	) {
-		if (read.type != previous_read.type)
+	for (;;) {
+		const size_t skipped = _scallop_lex_skip(read.type, read.script);
+		_SCALLOP_LEX_STEPS(skipped);
+		value_length += skipped;
+		read = _scallop_read(
+			libadt_const_lptr_index(read.script, (ssize_t)skipped),
+			read.type
+		);
+		if (_scallop_read_error(read) || read.type != previous_read.type)
 			break;
 
 		previous_read = read;
@@ -193,6 +349,141 @@ inline struct scallop_lang_lex scallop_lang_lex_next_raw(
 	};
 }
 
+inline bool _scallop_lex_is_separator(scallop_lang_classifier_fn *type)
+{
+	return type == scallop_lang_classifier_word_separator
+		|| type == scallop_lang_classifier_statement_separator;
+}
+
+inline int _scallop_lex_words_reserve(
+	struct scallop_lang_lex_words *words,
+	size_t amount
+)
+{
+	if (words->capacity - words->length >= amount)
+		return 0;
+
+	size_t capacity = words->capacity ? words->capacity : 64;
+	while (capacity - words->length < amount) {
+		if (capacity > SIZE_MAX / 2) {
+			errno = ENOMEM;
+			return -1;
+		}
+		capacity *= 2;
+	}
+
+	char *const result = (char *)realloc(words->buffer, capacity);
+	if (!result)
+		return -1;
+	words->buffer = result;
+	words->capacity = capacity;
+	return 0;
+}
+
+/*
+ * Appends a raw word token to the last word. A raw token is a run
+ * of one type, so it's either kept whole or skipped whole, the
+ * same as scallop_lang_lex_normalize_word() would for each of
+ * its characters.
+ */
+inline int _scallop_lex_words_append(
+	struct scallop_lang_lex_words *words,
+	struct scallop_lang_lex token
+)
+{
+	const bool skip_type = token.type == scallop_lang_classifier_single_quote
+		|| token.type == scallop_lang_classifier_single_quote_end
+		|| token.type == scallop_lang_classifier_double_quote
+		|| token.type == scallop_lang_classifier_double_quote_end
+		|| token.type == scallop_lang_classifier_escape;
+	if (skip_type)
+		return 0;
+
+	const size_t amount = (size_t)token.value.length * token.value.size;
+	if (_scallop_lex_words_reserve(words, amount))
+		return -1;
+	memcpy(words->buffer + words->length, token.value.buffer, amount);
+	words->length += amount;
+	words->word_length += (size_t)token.value.length;
+	return 0;
+}
+
+inline int _scallop_lex_words_terminate(
+	struct scallop_lang_lex_words *words,
+	size_t size
+)
+{
+	if (_scallop_lex_words_reserve(words, size))
+		return -1;
+	memset(words->buffer + words->length, 0, size);
+	words->length += size;
+	return 0;
+}
+
+/*
+ * Lexes the next token as scallop_lang_lex_next(), appending it to
+ * words if it's a word and words isn't NULL.
+ */
+inline struct scallop_lang_lex _scallop_lex_next(
+	struct scallop_lang_lex previous,
+	struct scallop_lang_lex_words *words
+)
+{
+	struct scallop_lang_lex result = scallop_lang_lex_next_raw(
+		previous
+	);
+
+	const bool is_word = scallop_lang_classifier_is_word(result.type);
+	const bool is_separator = _scallop_lex_is_separator(result.type);
+	if (!is_word && !is_separator)
+		return result;
+
+	const struct scallop_lang_lex failed = {
+		.script = previous.script,
+		.type = scallop_lang_classifier_unexpected,
+		.value = libadt_const_lptr_truncate(result.value, 0),
+	};
+	if (is_word && words) {
+		words->word = words->length;
+		words->word_length = 0;
+		if (_scallop_lex_words_append(words, result))
+			return failed;
+	}
+
+	// Merge raw tokens until one doesn't belong, which is
+	// lexed again by the next call
+	struct scallop_lang_lex last = result;
+	for (;;) {
+		const struct scallop_lang_lex next = scallop_lang_lex_next_raw(
+			last
+		);
+
+		const bool merge = is_word
+			? scallop_lang_classifier_is_word(next.type)
+			: _scallop_lex_is_separator(next.type);
+		if (!merge)
+			break;
+
+		if (is_word && words && _scallop_lex_words_append(words, next))
+			return failed;
+		if (next.type == scallop_lang_classifier_statement_separator)
+			result.type = next.type;
+		result.value.length += next.value.length;
+		last = next;
+	}
+
+	if (is_word && words && _scallop_lex_words_terminate(words, result.value.size))
+		return failed;
+
+	// Merged words continue lexing from the state of their last
+	// part, but are always reported as words
+	if (is_word) {
+		result.state = last.state ? last.state : last.type;
+		result.type = (scallop_lang_classifier_fn *)scallop_lang_classifier_word;
+	}
+	return result;
+}
+
 /**
  * \brief Returns the next token in the script referred to by previous.
  *
@@ -220,37 +511,45 @@ inline struct scallop_lang_lex scallop_lang_lex_next(
 	struct scallop_lang_lex previous
 )
 {
-	struct scallop_lang_lex result = scallop_lang_lex_next_raw(
-		previous
-	);
-
-	const bool end = result.type == scallop_lang_classifier_end
-		|| result.type == scallop_lang_classifier_unexpected;
-	if (end)
-		return result;
-
-	// This does a tonne more work than necessary but
-	// I'm lazy
-	struct scallop_lang_lex next = scallop_lang_lex_next(
-		result
-	);
+	return _scallop_lex_next(previous, NULL);
+}
 
-	const bool is_word = scallop_lang_classifier_is_word(result.type)
-		&& scallop_lang_classifier_is_word(next.type);
-	if (is_word)
-		result.value.length += next.value.length;
+/**
+ * \brief Returns the next token in the script referred to by
+ * 	previous, and appends it to words if it's a word.
+ *
+ * This behaves like scallop_lang_lex_next(), while also writing
+ * each word as scallop_lang_lex_normalize_word() would, so every
+ * character is lexed once instead of again to measure and again
+ * to copy it. The normalized word starts at .word in words, and
+ * is .word_length characters long.
+ *
+ * \param previous A token previously returned by
+ * 	scallop_lang_lex_next_normalized(), or initialized from
+ * 	scallop_lang_lex_init().
+ * \param words The buffer to append words to.
+ *
+ * \returns The next token, as scallop_lang_lex_next(). If words
+ * 	couldn't grow, it's a token of type
+ * 	scallop_lang_classifier_unexpected with errno set.
+ */
+inline struct scallop_lang_lex scallop_lang_lex_next_normalized(
+	struct scallop_lang_lex previous,
+	struct scallop_lang_lex_words *words
+)
+{
+	return _scallop_lex_next(previous, words);
+}
 
-	const bool has_word_separator
-		= result.type == scallop_lang_classifier_word_separator
-		|| next.type == scallop_lang_classifier_word_separator;
-	const bool has_statement_separator
-		= result.type == scallop_lang_classifier_statement_separator
-		|| next.type == scallop_lang_classifier_statement_separator;
-	if (has_word_separator && has_statement_separator) {
-		result.type = scallop_lang_classifier_statement_separator;
-		result.value.length += next.value.length;
-	}
-	return result;
+/**
+ * \brief Frees the memory used by a buffer of normalized words.
+ *
+ * \param words The buffer to free. It's zeroed, ready to reuse.
+ */
+inline void scallop_lang_lex_words_free(struct scallop_lang_lex_words *words)
+{
+	free(words->buffer);
+	*words = (struct scallop_lang_lex_words) { 0 };
 }
 
 /**
@@ -265,7 +564,9 @@ inline struct scallop_lang_lex scallop_lang_lex_next(
  *
  * \param word A value from scallop_lang_lex_next() that contains
  * 	a word.
- * \param out A pointer to the location to write to.
+ * \param out A pointer to the location to write to, with the same
+ * 	element size as word. It may be empty, to only measure
+ * 	the result.
  *
  * \returns If out is large enough for the result, the number of
  * 	characters actually written. If out is smaller than the
@@ -277,6 +578,9 @@ inline ssize_t scallop_lang_lex_normalize_word(
 	struct libadt_lptr out
 )
 {
+	if (libadt_lptr_in_bounds(out) && out.size != word.size)
+		return -1;
+
 	size_t read_amount = 0;
 	ssize_t total_read_amount = 0;
 
@@ -288,8 +592,7 @@ inline ssize_t scallop_lang_lex_normalize_word(
 		word = libadt_const_lptr_index(word, (ssize_t)read_amount)
 	) {
 		wchar_t c = 0;
-		mbstate_t state = { 0 };
-		read_amount = _scallop_mbrtowc(&c, word, &state);
+		read_amount = _scallop_decode(&c, word);
 
 		const bool read_error = read_amount == (size_t)-1
 			|| read_amount == (size_t)-2;
@@ -322,6 +625,35 @@ inline ssize_t scallop_lang_lex_normalize_word(
 	return total_read_amount;
 }
 
+/**
+ * \brief Takes a word value from a wide character script and
+ * 	normalizes it to the raw word value.
+ *
+ * This behaves like scallop_lang_lex_normalize_word(), but word
+ * and out are both wide character strings, so no decoding or
+ * encoding takes place.
+ *
+ * \param word A value from scallop_lang_lex_next() that contains
+ * 	a word, lexed from a wide character script.
+ * \param out A pointer to the wchar_t location to write to. It
+ * 	may be empty, to only measure the result.
+ *
+ * \returns If out is large enough for the result, the number of
+ * 	wide characters actually written. If out is smaller than the
+ * 	result, the number that would have been written. If an
+ * 	error occurred, or word or out are not wide character
+ * 	pointers, -1 is returned.
+ */
+inline ssize_t scallop_lang_lex_normalize_wide_word(
+	struct libadt_const_lptr word,
+	struct libadt_lptr out
+)
+{
+	if (!_scallop_is_wide(word))
+		return -1;
+	return scallop_lang_lex_normalize_word(word, out);
+}
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -0,0 +1,111 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_OPTIMIZE
+#define SCALLOP_LANG_OPTIMIZE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "script.h"
+
+/**
+ * \file
+ *
+ * \brief This module rewrites a script tree so that work that's the
+ * 	same on every run is done once, ahead of time.
+ *
+ * The passes run in this order, and each can be turned off:
+ *
+ * - SCALLOP_LANG_OPTIMIZE_WORDS normalizes raw pieces, replacing
+ *   them with interned literal text and variable references.
+ * - SCALLOP_LANG_OPTIMIZE_FOLD runs substitutions whose statements
+ *   only call the pure builtins echo, true and false with constant
+ *   arguments, and replaces them with their output.
+ * - SCALLOP_LANG_OPTIMIZE_HOIST finds substitutions of pure builtins
+ *   that appear more than once in a block, and evaluates them once
+ *   when the block is entered. Blocks which might set variables
+ *   aren't changed.
+ * - SCALLOP_LANG_OPTIMIZE_MERGE joins adjacent literal pieces of a
+ *   word, such as those left by folding, into one.
+ */
+
+#define SCALLOP_LANG_OPTIMIZE_WORDS 1
+#define SCALLOP_LANG_OPTIMIZE_FOLD 2
+#define SCALLOP_LANG_OPTIMIZE_HOIST 4
+#define SCALLOP_LANG_OPTIMIZE_MERGE 8
+#define SCALLOP_LANG_OPTIMIZE_ALL 15
+
+/**
+ * \brief Counts what each pass changed.
+ */
+struct scallop_lang_optimize_stats {
+	/**
+	 * \brief The raw pieces normalized.
+	 */
+	size_t words_normalized;
+
+	/**
+	 * \brief The literal pieces sharing interned text with an
+	 * 	earlier one.
+	 */
+	size_t literals_shared;
+
+	/**
+	 * \brief The substitutions replaced by their output.
+	 */
+	size_t substitutions_folded;
+
+	/**
+	 * \brief The substitutions replaced by hoisted ones.
+	 */
+	size_t substitutions_hoisted;
+
+	/**
+	 * \brief The pieces removed by merging them into the piece
+	 * 	before them.
+	 */
+	size_t slices_merged;
+};
+
+/**
+ * \brief Optimizes a script.
+ *
+ * Each pass leaves the script in a consistent state, so the script
+ * can still be used if a later pass fails.
+ *
+ * \param script The script, from scallop_lang_script_build().
+ * \param passes A mask of the passes to run.
+ * \param stats If not NULL, the counts of each pass are added here.
+ *
+ * \returns 0 on success, or -1 if memory couldn't be allocated.
+ */
+int scallop_lang_optimize(
+	struct scallop_lang_script *script,
+	int passes,
+	struct scallop_lang_optimize_stats *stats
+);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_OPTIMIZE
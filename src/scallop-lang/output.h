@@ -0,0 +1,138 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_OUTPUT
+#define SCALLOP_LANG_OUTPUT
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * \file
+ *
+ * \brief This module merges the output of parallel jobs into a
+ * 	single file descriptor.
+ *
+ * Each job writes to its own stream, numbered in statement order.
+ *
+ * In SCALLOP_LANG_OUTPUT_ORDERED mode, the output looks as if the
+ * jobs had run one after another. The earliest unfinished stream
+ * writes straight through; later streams are buffered, and each
+ * buffer is written out as soon as every earlier stream is closed.
+ * Buffers are kept in memory up to a total limit, past which a
+ * stream moves its buffer to an anonymous temporary file.
+ *
+ * In SCALLOP_LANG_OUTPUT_LINES mode, for long-running jobs, output
+ * is written as soon as a stream completes a line, so lines from
+ * different streams are interleaved but never split.
+ *
+ * Streams are not thread-safe, and are meant to be driven from a
+ * single event loop.
+ */
+
+enum scallop_lang_output_mode {
+	SCALLOP_LANG_OUTPUT_ORDERED,
+	SCALLOP_LANG_OUTPUT_LINES,
+};
+
+struct scallop_lang_output_stream;
+
+/**
+ * \brief Represents an output multiplexer.
+ */
+struct scallop_lang_output {
+	int _fd;
+	enum scallop_lang_output_mode _mode;
+
+	struct scallop_lang_output_stream *_streams;
+	size_t _streams_length;
+
+	// The earliest stream which isn't closed
+	size_t _head;
+
+	size_t _memory;
+	size_t _memory_limit;
+};
+
+/**
+ * \brief Initializes an output multiplexer.
+ *
+ * \param output The multiplexer to initialize. It must be freed
+ * 	with scallop_lang_output_free().
+ * \param fd The file descriptor to write to.
+ * \param streams The number of streams.
+ * \param mode How to merge the streams.
+ * \param memory_limit The most bytes buffered in memory across
+ * 	all streams.
+ *
+ * \returns 0 on success, or -1 on failure.
+ */
+int scallop_lang_output_init(
+	struct scallop_lang_output *output,
+	int fd,
+	size_t streams,
+	enum scallop_lang_output_mode mode,
+	size_t memory_limit
+);
+
+/**
+ * \brief Writes to a stream.
+ *
+ * \param output The multiplexer.
+ * \param stream The index of the stream.
+ * \param data The bytes to write.
+ * \param length The number of bytes to write.
+ *
+ * \returns 0 on success, or -1 on failure.
+ */
+int scallop_lang_output_write(
+	struct scallop_lang_output *output,
+	size_t stream,
+	const void *data,
+	size_t length
+);
+
+/**
+ * \brief Closes a stream once its job has finished, writing
+ * 	out anything that was waiting for it.
+ *
+ * \param output The multiplexer.
+ * \param stream The index of the stream.
+ *
+ * \returns 0 on success, or -1 on failure.
+ */
+int scallop_lang_output_close(struct scallop_lang_output *output, size_t stream);
+
+/**
+ * \brief Frees an output multiplexer.
+ *
+ * Output of streams which were never closed is discarded.
+ *
+ * \param output The multiplexer to free.
+ */
+void scallop_lang_output_free(struct scallop_lang_output *output);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_OUTPUT
@@ -0,0 +1,139 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_PARSE
+#define SCALLOP_LANG_PARSE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include <libadt/lptr.h>
+
+/**
+ * \file
+ *
+ * \brief This module provides a streaming parser over the lexer,
+ * 	which reports the structure of a script through a callback
+ * 	instead of building a tree.
+ *
+ * Events are reported in script order:
+ *
+ * - a statement begins before its first word or bracket, and ends
+ *   at a statement separator, at the bracket closing the block
+ *   it's in, or at the end of the script;
+ * - each word is reported as a single event, quotes and all;
+ * - a curly bracket block '{' ... '}' and a square bracket
+ *   substitution '[' ... ']' each report a begin and an end, with
+ *   the statements inside them reported in between.
+ *
+ * Empty statements and comments report nothing.
+ *
+ * The only state kept is a frame for each open bracket, in a fixed
+ * array of SCALLOP_LANG_PARSE_MAX_DEPTH frames, so memory use
+ * doesn't depend on the size of the script. Very large scripts can
+ * be parsed straight from a mapping of their file with mmap(2).
+ *
+ * Scripts may be multibyte or wide character strings, as with
+ * the lexer.
+ */
+
+/**
+ * \brief The deepest nesting of brackets the parser accepts.
+ */
+#define SCALLOP_LANG_PARSE_MAX_DEPTH 64
+
+enum scallop_lang_parse_event_type {
+	SCALLOP_LANG_PARSE_STATEMENT_BEGIN,
+	SCALLOP_LANG_PARSE_STATEMENT_END,
+	SCALLOP_LANG_PARSE_WORD,
+	SCALLOP_LANG_PARSE_BLOCK_BEGIN,
+	SCALLOP_LANG_PARSE_BLOCK_END,
+	SCALLOP_LANG_PARSE_SUBSTITUTION_BEGIN,
+	SCALLOP_LANG_PARSE_SUBSTITUTION_END,
+};
+
+/**
+ * \brief Represents a single parser event.
+ */
+struct scallop_lang_parse_event {
+	enum scallop_lang_parse_event_type type;
+
+	/**
+	 * \brief A pointer into the script for the event.
+	 *
+	 * For a word, this is the raw word, which can be normalized
+	 * with scallop_lang_lex_normalize_word(). For a bracket, it's
+	 * the bracket. A statement begins with an empty pointer to
+	 * its first character, and ends with a pointer to the whole
+	 * statement, without its separator.
+	 */
+	struct libadt_const_lptr value;
+
+	/**
+	 * \brief The number of brackets open around the event.
+	 *
+	 * The begin and end of a block or substitution are at the
+	 * depth of the statement containing them, and the statements
+	 * inside are one deeper.
+	 */
+	size_t depth;
+};
+
+/**
+ * \brief Receives a parser event.
+ *
+ * \param user The user pointer passed to scallop_lang_parse().
+ * \param event The event. It's only valid during the call.
+ *
+ * \returns 0 to continue parsing, or any other value to stop.
+ */
+typedef int scallop_lang_parse_fn(
+	void *user,
+	const struct scallop_lang_parse_event *event
+);
+
+/**
+ * \brief Parses a script, reporting its structure to handler.
+ *
+ * Events up to an error are still reported, so a handler may see
+ * a statement begin without it ending.
+ *
+ * \param script The script to parse.
+ * \param handler The function receiving events.
+ * \param user A pointer passed to handler.
+ *
+ * \returns 0 once the whole script was parsed, 1 if handler
+ * 	stopped parsing, or -1 on an error, setting errno to EINVAL
+ * 	for a script that can't be lexed or has unbalanced brackets,
+ * 	or E2BIG for brackets nested deeper than
+ * 	SCALLOP_LANG_PARSE_MAX_DEPTH.
+ */
+int scallop_lang_parse(
+	struct libadt_const_lptr script,
+	scallop_lang_parse_fn *handler,
+	void *user
+);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_PARSE
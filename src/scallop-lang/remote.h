@@ -0,0 +1,221 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_REMOTE
+#define SCALLOP_LANG_REMOTE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <libadt/lptr.h>
+
+/**
+ * \file
+ *
+ * \brief This module distributes statements over worker processes
+ * 	connected by stream sockets.
+ *
+ * A worker serves one coordinator over a connected socket with
+ * scallop_lang_remote_serve(). It starts by announcing how many jobs
+ * it runs at once, then runs each statement it's sent in its own
+ * directory, streaming standard output and standard error back as
+ * they're written, followed by the exit status.
+ *
+ * The coordinator connects to its workers with
+ * scallop_lang_remote_init(), then scallop_lang_remote_run() sends
+ * each job to the least loaded worker, by the fraction of its slots
+ * in use. Workers may be on other machines; on one machine, worker
+ * processes on Unix sockets stand in for them.
+ *
+ * Messages are sent in the byte order of the coordinator, so
+ * workers must share it.
+ */
+
+/**
+ * \brief Represents an input file sent with a job.
+ */
+struct scallop_lang_remote_file {
+	/**
+	 * \brief The path of the file, relative to the worker's
+	 * 	directory. It can't be absolute or contain "..".
+	 */
+	const char *path;
+
+	const void *content;
+	size_t length;
+};
+
+/**
+ * \brief Represents a statement to run on a worker.
+ */
+struct scallop_lang_remote_job {
+	/**
+	 * \brief A single statement, which is run as a command
+	 * 	from its words.
+	 */
+	struct libadt_const_lptr statement;
+
+	/**
+	 * \brief A null-terminated list of changes to the worker's
+	 * 	environment, or NULL.
+	 *
+	 * "NAME=VALUE" sets a variable, and "NAME" unsets it.
+	 */
+	char *const *environment;
+
+	const struct scallop_lang_remote_file *files;
+	size_t files_length;
+
+	/**
+	 * \brief The index of the worker the job ran on, written by
+	 * 	scallop_lang_remote_run().
+	 */
+	size_t worker;
+
+	/**
+	 * \brief The status of the command as returned by waitpid(2),
+	 * 	or -1 if it couldn't be run.
+	 */
+	int status;
+
+	/**
+	 * \brief An errno value for why the job couldn't be run:
+	 * 	EINVAL for an invalid statement or file path,
+	 * 	ECONNRESET if its worker was lost, or the error from the
+	 * 	worker.
+	 */
+	int error;
+};
+
+enum scallop_lang_remote_stream {
+	SCALLOP_LANG_REMOTE_STDOUT = 1,
+	SCALLOP_LANG_REMOTE_STDERR = 2,
+};
+
+/**
+ * \brief Receives output from a job, as it arrives.
+ *
+ * \param user The user pointer from the options.
+ * \param job The index of the job.
+ * \param stream The stream written to.
+ * \param data The data written.
+ * \param length The length of the data.
+ *
+ * \returns 0 on success, or -1 to stop with an error.
+ */
+typedef int scallop_lang_remote_output_fn(
+	void *user,
+	size_t job,
+	enum scallop_lang_remote_stream stream,
+	const void *data,
+	size_t length
+);
+
+/**
+ * \brief Represents the options for running jobs on workers.
+ */
+struct scallop_lang_remote_options {
+	/**
+	 * \brief Receives the output of jobs, or NULL to discard it.
+	 */
+	scallop_lang_remote_output_fn *output;
+	void *user;
+};
+
+/**
+ * \brief Represents a coordinator's connections to its workers.
+ */
+struct scallop_lang_remote {
+	struct scallop_lang_remote_worker *_workers;
+	size_t _workers_length;
+};
+
+/**
+ * \brief Serves a coordinator as a worker, until the coordinator
+ * 	closes the connection.
+ *
+ * Commands run with the worker's environment, updated by each
+ * job's changes, and with standard input from /dev/null. Jobs still
+ * running when the connection closes are killed.
+ *
+ * \param socket The connected socket.
+ * \param directory The directory commands run in, and that input
+ * 	files are written to.
+ * \param capacity The most jobs run at once, or 0 for the number
+ * 	of processors.
+ *
+ * \returns 0 when the connection closes, or -1 on failure.
+ */
+int scallop_lang_remote_serve(int socket, int directory, size_t capacity);
+
+/**
+ * \brief Connects a coordinator to its workers, waiting for each
+ * 	to announce itself.
+ *
+ * \param remote The coordinator to initialize. It must be freed
+ * 	with scallop_lang_remote_free().
+ * \param workers The connected sockets of the workers, which stay
+ * 	owned by the caller.
+ * \param length The number of workers.
+ *
+ * \returns 0 if any worker could be reached, or -1 on failure.
+ */
+int scallop_lang_remote_init(
+	struct scallop_lang_remote *remote,
+	const int *workers,
+	size_t length
+);
+
+/**
+ * \brief Runs jobs on workers until they have all finished.
+ *
+ * A worker that disconnects fails the jobs it was running, and
+ * isn't sent any more, in this run or later ones.
+ *
+ * \param remote The coordinator.
+ * \param jobs The jobs to run.
+ * \param length The number of jobs.
+ * \param options The options, or NULL for the defaults.
+ *
+ * \returns 0 if every job exited successfully, 1 if any job failed,
+ * 	or -1 if the event loop or an output callback failed.
+ */
+int scallop_lang_remote_run(
+	struct scallop_lang_remote *remote,
+	struct scallop_lang_remote_job *jobs,
+	size_t length,
+	const struct scallop_lang_remote_options *options
+);
+
+/**
+ * \brief Frees a coordinator, leaving its sockets open.
+ *
+ * \param remote The coordinator to free.
+ */
+void scallop_lang_remote_free(struct scallop_lang_remote *remote);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_REMOTE
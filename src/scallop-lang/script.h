@@ -0,0 +1,305 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_SCRIPT
+#define SCALLOP_LANG_SCRIPT
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include <libadt/lptr.h>
+
+/**
+ * \file
+ *
+ * \brief This module builds a tree of a parsed script, and expands
+ * 	its statements into argument lists.
+ *
+ * A script is a block of statements. Each statement is a list of
+ * words, and each word is a list of pieces which are concatenated
+ * to build one argument: words and brackets written next to each
+ * other, without a separator, make up a single argument.
+ *
+ * A freshly built script only has raw pieces, straight from the
+ * script text, and substitution and block pieces. Expanding a raw
+ * piece normalizes it and looks up its variables every time. The
+ * passes in optimize.h rewrite the tree so that work is done once:
+ * they replace raw pieces with literal and variable pieces, fold
+ * constant substitutions into literals, and hoist substitutions
+ * to the start of their block.
+ *
+ * Literal text and variable names are interned in a pool owned by
+ * the script, so equal strings share one copy.
+ */
+
+enum scallop_lang_script_piece_type {
+	/**
+	 * \brief Text from the script, with its quotes, escapes and
+	 * 	variable references.
+	 */
+	SCALLOP_LANG_SCRIPT_RAW,
+
+	/**
+	 * \brief Normalized text.
+	 */
+	SCALLOP_LANG_SCRIPT_LITERAL,
+
+	/**
+	 * \brief The value of a variable.
+	 */
+	SCALLOP_LANG_SCRIPT_VARIABLE,
+
+	/**
+	 * \brief The output of a '[' ... ']' block.
+	 */
+	SCALLOP_LANG_SCRIPT_SUBSTITUTION,
+
+	/**
+	 * \brief A '{' ... '}' block, which isn't expanded.
+	 */
+	SCALLOP_LANG_SCRIPT_BLOCK,
+
+	/**
+	 * \brief The output of a substitution evaluated when the
+	 * 	block containing the statement was entered.
+	 */
+	SCALLOP_LANG_SCRIPT_HOISTED,
+};
+
+/**
+ * \brief Represents part of a word.
+ */
+struct scallop_lang_script_piece {
+	enum scallop_lang_script_piece_type type;
+
+	/**
+	 * \brief The raw text, the literal text or the variable name.
+	 *
+	 * Raw text points into the script. Literal text and names are
+	 * interned and null-terminated.
+	 */
+	const char *text;
+	size_t length;
+
+	/**
+	 * \brief The block of a substitution, block or hoisted piece.
+	 *
+	 * Hoisted blocks are owned by the block they're hoisted to.
+	 */
+	struct scallop_lang_script_block *block;
+
+	/**
+	 * \brief The index of a hoisted piece in the hoisted
+	 * 	substitutions of its statement's block.
+	 */
+	size_t slot;
+};
+
+/**
+ * \brief Represents a word, which expands to one argument.
+ */
+struct scallop_lang_script_word {
+	struct scallop_lang_script_piece *pieces;
+	size_t pieces_length;
+};
+
+/**
+ * \brief Represents a statement.
+ *
+ * A statement made of a single block piece is a block of
+ * statements to run, rather than a command.
+ */
+struct scallop_lang_script_statement {
+	struct scallop_lang_script_word *words;
+	size_t words_length;
+};
+
+/**
+ * \brief Represents a block of statements.
+ */
+struct scallop_lang_script_block {
+	/**
+	 * \brief The text of the block, brackets included, or the
+	 * 	whole script for the outermost block.
+	 */
+	struct libadt_const_lptr source;
+
+	struct scallop_lang_script_statement *statements;
+	size_t statements_length;
+
+	/**
+	 * \brief The substitutions evaluated when the block is entered.
+	 */
+	struct scallop_lang_script_block **hoisted;
+	size_t hoisted_length;
+};
+
+/**
+ * \brief Represents a script.
+ */
+struct scallop_lang_script {
+	struct scallop_lang_script_block *root;
+
+	struct scallop_lang_script_string **_strings;
+	size_t _strings_length;
+	size_t _strings_capacity;
+};
+
+/**
+ * \brief The callbacks for expanding statements.
+ */
+struct scallop_lang_script_context {
+	/**
+	 * \brief Looks up a variable.
+	 *
+	 * \param user The context's user pointer.
+	 * \param name The name of the variable.
+	 *
+	 * \returns The value, or NULL if the variable is unset,
+	 * 	which expands to nothing.
+	 */
+	const char *(*get_variable)(void *user, const char *name);
+
+	/**
+	 * \brief Runs a substitution.
+	 *
+	 * \param user The context's user pointer.
+	 * \param block The block to run.
+	 *
+	 * \returns The standard output of the block, without trailing
+	 * 	newlines, which must be freed with free(), or NULL on
+	 * 	failure.
+	 */
+	char *(*substitute)(void *user, const struct scallop_lang_script_block *block);
+
+	void *user;
+};
+
+/**
+ * \brief Represents a block being run.
+ */
+struct scallop_lang_script_frame {
+	const struct scallop_lang_script_block *block;
+
+	/**
+	 * \brief The outputs of the hoisted substitutions.
+	 */
+	char **hoisted;
+};
+
+/**
+ * \brief Builds the tree of a script.
+ *
+ * \param text The script, as a multibyte string.
+ * \param out The object to write the script to. On success, it
+ * 	must be freed with scallop_lang_script_free().
+ *
+ * \returns 0 on success, or -1 on failure, setting errno as
+ * 	scallop_lang_parse(), or to ENOMEM.
+ */
+int scallop_lang_script_build(
+	struct libadt_const_lptr text,
+	struct scallop_lang_script *out
+);
+
+/**
+ * \brief Returns the interned copy of a string.
+ *
+ * \param script The script owning the pool.
+ * \param text The string, which may contain null bytes.
+ * \param length The length of the string.
+ *
+ * \returns A null-terminated copy which lives as long as the script,
+ * 	and is the same for equal strings, or NULL on failure.
+ */
+const char *scallop_lang_script_intern(
+	struct scallop_lang_script *script,
+	const char *text,
+	size_t length
+);
+
+/**
+ * \brief Enters a block, evaluating its hoisted substitutions.
+ *
+ * \param block The block.
+ * \param context The callbacks.
+ * \param out The frame to initialize. On success, it must be freed
+ * 	with scallop_lang_script_leave().
+ *
+ * \returns 0 on success, or -1 if a substitution failed.
+ */
+int scallop_lang_script_enter(
+	const struct scallop_lang_script_block *block,
+	const struct scallop_lang_script_context *context,
+	struct scallop_lang_script_frame *out
+);
+
+/**
+ * \brief Leaves a block entered with scallop_lang_script_enter().
+ *
+ * \param frame The frame to free.
+ */
+void scallop_lang_script_leave(struct scallop_lang_script_frame *frame);
+
+/**
+ * \brief Expands a statement into its arguments.
+ *
+ * \param frame The frame of the block containing the statement.
+ * \param statement The statement.
+ * \param context The callbacks.
+ *
+ * \returns A null-terminated argument list, which must be freed
+ * 	with scallop_lang_script_arguments_free(), or NULL on failure,
+ * 	setting errno to EINVAL if the statement contains a block.
+ */
+char **scallop_lang_script_arguments(
+	const struct scallop_lang_script_frame *frame,
+	const struct scallop_lang_script_statement *statement,
+	const struct scallop_lang_script_context *context
+);
+
+/**
+ * \brief Frees an argument list.
+ *
+ * \param arguments The argument list to free.
+ */
+void scallop_lang_script_arguments_free(char **arguments);
+
+/**
+ * \brief Frees a block and every block in it, for passes that
+ * 	take blocks out of a script.
+ *
+ * \param block The block to free, or NULL.
+ */
+void scallop_lang_script_block_free(struct scallop_lang_script_block *block);
+
+/**
+ * \brief Frees a script.
+ *
+ * \param script The script to free.
+ */
+void scallop_lang_script_free(struct scallop_lang_script *script);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_SCRIPT
@@ -0,0 +1,468 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_SEGMENT_LEX
+#define SCALLOP_LANG_SEGMENT_LEX
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <wchar.h>
+
+#include <libadt/lptr.h>
+
+#include "classifier.h"
+#include "lex.h"
+
+/**
+ * \file
+ *
+ * \brief This module provides a lexer over a script split into
+ * 	several non-contiguous segments.
+ *
+ * The segments are passed as a libadt_const_lptr of
+ * libadt_const_lptr, similar to an iovec array. Tokens are
+ * produced as if the segments were concatenated, without
+ * actually concatenating them: a token value is a range
+ * of positions into the segments, which usually lies within
+ * a single segment and can be used in place.
+ *
+ * Multibyte characters may be split over a segment boundary.
+ */
+
+/**
+ * \brief Represents a position in a segmented script.
+ */
+struct scallop_lang_segment_pos {
+	/**
+	 * \brief The index of the segment.
+	 */
+	ssize_t segment;
+
+	/**
+	 * \brief The byte offset into the segment.
+	 */
+	ssize_t offset;
+};
+
+/**
+ * \brief Represents a single token in a segmented script.
+ */
+struct scallop_lang_segment_lex {
+	/**
+	 * \brief Represents the type of token classified.
+	 */
+	scallop_lang_classifier_fn *type;
+
+	/**
+	 * \brief The classifier state after the last character
+	 * 	of the token.
+	 *
+	 * This differs from .type for merged tokens, for example
+	 * a quoted word has the type scallop_lang_classifier_word
+	 * but ends in scallop_lang_classifier_double_quote_end.
+	 */
+	scallop_lang_classifier_fn *state;
+
+	/**
+	 * \brief The list of segments, as a pointer to
+	 * 	struct libadt_const_lptr values.
+	 */
+	struct libadt_const_lptr segments;
+
+	/**
+	 * \brief The position of the first byte of the token.
+	 */
+	struct scallop_lang_segment_pos begin;
+
+	/**
+	 * \brief The position one past the last byte of the token.
+	 */
+	struct scallop_lang_segment_pos end;
+};
+
+inline struct libadt_const_lptr _scallop_segment(
+	struct libadt_const_lptr segments,
+	ssize_t index
+)
+{
+	return *(const struct libadt_const_lptr *)libadt_const_lptr_raw(
+		libadt_const_lptr_index(segments, index)
+	);
+}
+
+inline struct scallop_lang_segment_pos _scallop_segment_pos_normalize(
+	struct libadt_const_lptr segments,
+	struct scallop_lang_segment_pos pos
+)
+{
+	while (
+		pos.segment < segments.length
+		&& pos.offset >= _scallop_segment(segments, pos.segment).length
+	) {
+		pos.segment++;
+		pos.offset = 0;
+	}
+	return pos;
+}
+
+inline bool _scallop_segment_pos_equal(
+	struct scallop_lang_segment_pos a,
+	struct scallop_lang_segment_pos b
+)
+{
+	return a.segment == b.segment && a.offset == b.offset;
+}
+
+typedef struct {
+	scallop_lang_classifier_fn *type;
+	struct scallop_lang_segment_pos next;
+} _scallop_segment_read_t;
+
+/*
+ * Decodes the character at pos, continuing into the following
+ * segments if it is split over a boundary, and feeds it
+ * to previous. pos must already be normalized.
+ */
+inline _scallop_segment_read_t _scallop_segment_read(
+	struct libadt_const_lptr segments,
+	struct scallop_lang_segment_pos pos,
+	scallop_lang_classifier_fn *const previous
+)
+{
+	wchar_t c = (wchar_t)WEOF;
+	mbstate_t mbs = { 0 };
+	_scallop_segment_read_t result = {
+		.type = scallop_lang_classifier_unexpected,
+		.next = pos,
+	};
+
+	if (pos.segment >= segments.length) {
+		result.type = (scallop_lang_classifier_fn *)previous(WEOF);
+		return result;
+	}
+
+	for (;;) {
+		const struct libadt_const_lptr segment = libadt_const_lptr_index(
+			_scallop_segment(segments, pos.segment),
+			pos.offset
+		);
+		const size_t amount = _scallop_mbrtowc(&c, segment, &mbs);
+
+		if (amount == (size_t)-1)
+			return result;
+
+		if (amount == (size_t)-2) {
+			pos.offset += segment.length;
+			pos = _scallop_segment_pos_normalize(segments, pos);
+			if (pos.segment >= segments.length)
+				return result;
+			continue;
+		}
+
+		// mbrtowc() returns 0 for the null character
+		pos.offset += amount ? (ssize_t)amount : 1;
+		break;
+	}
+
+	result.type = (scallop_lang_classifier_fn *)previous((wint_t)c);
+	result.next = _scallop_segment_pos_normalize(segments, pos);
+	return result;
+}
+
+/**
+ * \brief Initializes a token object for use in
+ * 	scallop_lang_segment_lex_next().
+ *
+ * \param segments A pointer to an array of struct libadt_const_lptr,
+ * 	each referring to one segment of the script.
+ *
+ * \returns A token, valid for passing to scallop_lang_segment_lex_next().
+ */
+inline struct scallop_lang_segment_lex scallop_lang_segment_lex_init(
+	struct libadt_const_lptr segments
+)
+{
+	const struct scallop_lang_segment_pos begin
+		= _scallop_segment_pos_normalize(
+			segments,
+			(struct scallop_lang_segment_pos) { 0 }
+		);
+
+	return (struct scallop_lang_segment_lex) {
+		.type = (scallop_lang_classifier_fn *)scallop_lang_classifier_begin,
+		.state = (scallop_lang_classifier_fn *)scallop_lang_classifier_begin,
+		.segments = segments,
+		.begin = begin,
+		.end = begin,
+	};
+}
+
+/**
+ * \brief Returns the next, raw token in the segmented script.
+ *
+ * This behaves like scallop_lang_lex_next_raw(), treating the
+ * segments as a single script.
+ *
+ * \param previous A token returned by scallop_lang_segment_lex_init()
+ * 	or scallop_lang_segment_lex_next_raw().
+ *
+ * \returns A new token.
+ */
+inline struct scallop_lang_segment_lex scallop_lang_segment_lex_next_raw(
+	struct scallop_lang_segment_lex previous
+)
+{
+	struct scallop_lang_segment_lex result = {
+		.segments = previous.segments,
+		.begin = previous.end,
+		.end = previous.end,
+	};
+
+	_scallop_segment_read_t read = _scallop_segment_read(
+		previous.segments,
+		previous.end,
+		previous.state
+	);
+
+	result.type = result.state = read.type;
+	if (read.type == scallop_lang_classifier_unexpected)
+		return result;
+
+	result.end = read.next;
+	if (read.type == scallop_lang_classifier_end)
+		return result;
+
+	for (
+		read = _scallop_segment_read(previous.segments, result.end, read.type);
+		read.type == result.type;
+		read = _scallop_segment_read(previous.segments, result.end, read.type)
+	) {
+		result.end = read.next;
+	}
+
+	return result;
+}
+
+/**
+ * \brief Returns the next token in the segmented script.
+ *
+ * Consecutive word tokens, including quoted words and escapes,
+ * are merged into a single token of type
+ * scallop_lang_classifier_word. Consecutive separators are
+ * merged into a single token, of type
+ * scallop_lang_classifier_statement_separator if it contains
+ * a statement separator.
+ *
+ * \param previous A token previously returned by
+ * 	scallop_lang_segment_lex_next(), or initialized from
+ * 	scallop_lang_segment_lex_init().
+ *
+ * \returns The next token, scallop_lang_classifier_end at the
+ * 	end of the script, or scallop_lang_classifier_unexpected
+ * 	on an error.
+ */
+inline struct scallop_lang_segment_lex scallop_lang_segment_lex_next(
+	struct scallop_lang_segment_lex previous
+)
+{
+	struct scallop_lang_segment_lex result
+		= scallop_lang_segment_lex_next_raw(previous);
+
+	const bool is_word = scallop_lang_classifier_is_word(result.type);
+	const bool is_separator = _scallop_lex_is_separator(result.type);
+	if (!is_word && !is_separator)
+		return result;
+
+	for (;;) {
+		const struct scallop_lang_segment_lex next
+			= scallop_lang_segment_lex_next_raw(result);
+
+		const bool merge = is_word
+			? scallop_lang_classifier_is_word(next.type)
+			: _scallop_lex_is_separator(next.type);
+		if (!merge)
+			break;
+
+		if (next.type == scallop_lang_classifier_statement_separator)
+			result.type = next.type;
+		result.state = next.state;
+		result.end = next.end;
+	}
+
+	if (is_word)
+		result.type = (scallop_lang_classifier_fn *)scallop_lang_classifier_word;
+	return result;
+}
+
+/**
+ * \brief Returns the number of contiguous pieces a token's value
+ * 	is split into.
+ *
+ * \param token The token to test.
+ *
+ * \returns The number of pieces, which is 1 unless the token
+ * 	straddles a segment boundary, or 0 for an empty value.
+ */
+inline ssize_t scallop_lang_segment_lex_pieces(
+	struct scallop_lang_segment_lex token
+)
+{
+	if (_scallop_segment_pos_equal(token.begin, token.end))
+		return 0;
+	return token.end.segment - token.begin.segment
+		+ (token.end.offset > 0);
+}
+
+/**
+ * \brief Returns a contiguous piece of a token's value.
+ *
+ * \param token The token to read from.
+ * \param index The index of the piece, less than
+ * 	scallop_lang_segment_lex_pieces().
+ *
+ * \returns A pointer into the segment containing the piece.
+ */
+inline struct libadt_const_lptr scallop_lang_segment_lex_piece(
+	struct scallop_lang_segment_lex token,
+	ssize_t index
+)
+{
+	const ssize_t segment_index = token.begin.segment + index;
+	struct libadt_const_lptr segment = _scallop_segment(
+		token.segments,
+		segment_index
+	);
+
+	if (segment_index == token.end.segment)
+		segment = libadt_const_lptr_truncate(
+			segment,
+			(size_t)token.end.offset
+		);
+	if (index == 0)
+		segment = libadt_const_lptr_index(segment, token.begin.offset);
+	return segment;
+}
+
+/**
+ * \brief Copies a token's value into a contiguous buffer.
+ *
+ * Tokens with a single piece can be used in place through
+ * scallop_lang_segment_lex_piece(); this is only required for
+ * tokens straddling a segment boundary.
+ *
+ * \param token The token to copy.
+ * \param out A pointer to the location to write to.
+ *
+ * \returns The length of the value. If this is larger than
+ * 	out, only the first part of the value was written.
+ */
+inline ssize_t scallop_lang_segment_lex_copy(
+	struct scallop_lang_segment_lex token,
+	struct libadt_lptr out
+)
+{
+	ssize_t total = 0;
+	const ssize_t pieces = scallop_lang_segment_lex_pieces(token);
+	for (ssize_t i = 0; i < pieces; i++) {
+		const struct libadt_const_lptr piece
+			= scallop_lang_segment_lex_piece(token, i);
+		if (libadt_lptr_in_bounds(out)) {
+			libadt_lptr_memmove(out, piece);
+			out = libadt_lptr_index(
+				out,
+				piece.length < out.length ? piece.length : out.length
+			);
+		}
+		total += piece.length;
+	}
+	return total;
+}
+
+/**
+ * \brief Normalizes a word token to its raw word value.
+ *
+ * This behaves like scallop_lang_lex_normalize_word(), reading
+ * the word directly from the segments.
+ *
+ * \param token A word token from scallop_lang_segment_lex_next().
+ * \param out A pointer to the location to write to.
+ *
+ * \returns If out is large enough for the result, the number of
+ * 	characters actually written. If out is smaller than the
+ * 	result, the number of characters that would have been written.
+ * 	If an error occurred, -1 is returned.
+ */
+inline ssize_t scallop_lang_segment_lex_normalize_word(
+	struct scallop_lang_segment_lex token,
+	struct libadt_lptr out
+)
+{
+	if (scallop_lang_segment_lex_pieces(token) == 1)
+		return scallop_lang_lex_normalize_word(
+			scallop_lang_segment_lex_piece(token, 0),
+			out
+		);
+
+	ssize_t total = 0;
+	scallop_lang_classifier_fn
+		*current = (scallop_lang_classifier_fn *)scallop_lang_classifier_begin;
+	struct scallop_lang_segment_lex character = token;
+	for (
+		character.end = character.begin;
+		!_scallop_segment_pos_equal(character.end, token.end);
+		character.begin = character.end
+	) {
+		const _scallop_segment_read_t read = _scallop_segment_read(
+			token.segments,
+			character.begin,
+			current
+		);
+		current = read.type;
+		if (current == scallop_lang_classifier_unexpected)
+			return -1;
+		character.end = read.next;
+
+		const bool skip_type = current == scallop_lang_classifier_single_quote
+			|| current == scallop_lang_classifier_single_quote_end
+			|| current == scallop_lang_classifier_double_quote
+			|| current == scallop_lang_classifier_double_quote_end
+			|| current == scallop_lang_classifier_escape;
+
+		if (!skip_type) {
+			const ssize_t amount = scallop_lang_segment_lex_copy(
+				character,
+				out
+			);
+			out = libadt_lptr_index(
+				out,
+				amount < out.length ? amount : out.length
+			);
+			total += amount;
+		}
+	}
+
+	return total;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_SEGMENT_LEX
@@ -0,0 +1,106 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_TOPOLOGY
+#define SCALLOP_LANG_TOPOLOGY
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/**
+ * \file
+ *
+ * \brief This module reads which CPUs share a core, so commands
+ * 	can be pinned to whole cores.
+ *
+ * Linux describes the CPUs under /sys/devices/system/cpu. The
+ * online CPUs are listed in "online", and the CPUs sharing a core
+ * with cpuN, its SMT siblings, in cpuN/topology/core_cpus_list, or
+ * thread_siblings_list on older kernels. A CPU whose siblings can't
+ * be read is a core of its own.
+ *
+ * Lists are in the kernel's cpulist format, as in "0-3,8,10-11".
+ */
+
+/**
+ * \brief Represents a core.
+ */
+struct scallop_lang_topology_core {
+	/**
+	 * \brief The online CPUs of the core, in ascending order.
+	 */
+	const unsigned *cpus;
+	size_t cpus_length;
+};
+
+/**
+ * \brief Represents the cores of the system.
+ */
+struct scallop_lang_topology {
+	/**
+	 * \brief The cores, in order of their lowest CPU.
+	 */
+	struct scallop_lang_topology_core *cores;
+	size_t cores_length;
+
+	unsigned *_cpus;
+};
+
+/**
+ * \brief Reads the cores of the system.
+ *
+ * \param topology The topology to initialize. It must be freed
+ * 	with scallop_lang_topology_free().
+ * \param root The directory to read, or NULL for
+ * 	"/sys/devices/system/cpu".
+ *
+ * \returns 0 on success, or -1 on failure, setting errno. It's an
+ * 	error for root/online to be missing or malformed.
+ */
+int scallop_lang_topology_init(
+	struct scallop_lang_topology *topology,
+	const char *root
+);
+
+/**
+ * \brief Removes the CPUs this process may not run on, as set by
+ * 	sched_setaffinity(2), taskset(1) or a cgroup cpuset.
+ *
+ * Cores left without CPUs are removed too.
+ *
+ * \param topology The topology.
+ *
+ * \returns 0 on success, or -1 on failure, setting errno.
+ */
+int scallop_lang_topology_restrict(struct scallop_lang_topology *topology);
+
+/**
+ * \brief Frees a topology.
+ *
+ * \param topology The topology to free.
+ */
+void scallop_lang_topology_free(struct scallop_lang_topology *topology);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_TOPOLOGY
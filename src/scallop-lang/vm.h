@@ -0,0 +1,171 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCALLOP_LANG_VM
+#define SCALLOP_LANG_VM
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "builtin.h"
+#include "commands.h"
+#include "env.h"
+#include "script.h"
+
+/**
+ * \file
+ *
+ * \brief This module compiles a script tree to bytecode, and runs
+ * 	it on a stack machine.
+ *
+ * Compiling normalizes every word once, into a constant pool of
+ * literal text and variable names, and resolves commands named by a
+ * constant to their builtin. Running a program then only pushes
+ * constants and variable values, joins them into arguments, and runs
+ * each statement, without walking the tree or decoding the script
+ * again.
+ *
+ * Each instruction is a 32-bit word: the operation in the low byte,
+ * and its operand in the rest. Instructions are dispatched with
+ * computed gotos where the compiler supports them.
+ *
+ * Statements run one after the other, including the statements of
+ * '{' ... '}' blocks, with their output in the standard output given
+ * to scallop_lang_vm_run(), or captured for a substitution. Builtins
+ * run in the process, and other commands are spawned and waited for.
+ * Scripts that run blocks in parallel use jobs.h instead.
+ */
+
+/**
+ * \brief Represents a constant in the pool.
+ */
+struct scallop_lang_vm_constant {
+	/**
+	 * \brief Null-terminated text, owned by the script.
+	 */
+	const char *text;
+	size_t length;
+};
+
+/**
+ * \brief Represents a compiled script.
+ *
+ * A program refers to the strings of the script it was compiled
+ * from, so the script must outlive it.
+ */
+struct scallop_lang_vm_program {
+	uint32_t *code;
+	size_t code_length;
+
+	struct scallop_lang_vm_constant *constants;
+	size_t constants_length;
+
+	/**
+	 * \brief The number of hoisted substitution outputs kept
+	 * 	while running.
+	 */
+	size_t slots_length;
+
+	/**
+	 * \brief The deepest the stack gets, and the most arguments
+	 * 	of a statement.
+	 */
+	size_t max_stack;
+	size_t max_arguments;
+
+	const struct scallop_lang_builtin **_builtins;
+	size_t _builtins_length;
+	size_t _captures_length;
+};
+
+/**
+ * \brief The options for running a program.
+ */
+struct scallop_lang_vm_options {
+	/**
+	 * \brief The variables, which the set builtin changes, and
+	 * 	which are passed to spawned commands.
+	 */
+	struct scallop_lang_env *env;
+
+	/**
+	 * \brief A cache to find commands in, or NULL to search $PATH
+	 * 	for each spawn.
+	 */
+	struct scallop_lang_commands *commands;
+
+	/**
+	 * \brief The standard input, output and error of statements.
+	 */
+	int in;
+	int out;
+	int err;
+};
+
+/**
+ * \brief Compiles a script.
+ *
+ * \param script The script, optimized or not. Normalized words are
+ * 	interned in its pool.
+ * \param out The object to write the program to. On success, it
+ * 	must be freed with scallop_lang_vm_free().
+ *
+ * \returns 0 on success, or -1 on failure, setting errno to EINVAL
+ * 	if a word can't be normalized or a block is used as an
+ * 	argument, E2BIG if the script is too large to encode, or ENOMEM.
+ */
+int scallop_lang_vm_compile(
+	struct scallop_lang_script *script,
+	struct scallop_lang_vm_program *out
+);
+
+/**
+ * \brief Runs a program.
+ *
+ * \param program The program.
+ * \param options The options.
+ * \param status If not NULL, the exit status of the last statement
+ * 	is written here: the builtin's result, the command's exit
+ * 	status, 127 if it couldn't be run, or 128 plus the signal
+ * 	that stopped it.
+ *
+ * \returns 0 once every statement ran, or -1 if the program couldn't
+ * 	be run further, setting errno.
+ */
+int scallop_lang_vm_run(
+	const struct scallop_lang_vm_program *program,
+	const struct scallop_lang_vm_options *options,
+	int *status
+);
+
+/**
+ * \brief Frees a program.
+ *
+ * \param program The program to free.
+ */
+void scallop_lang_vm_free(struct scallop_lang_vm_program *program);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // SCALLOP_LANG_VM
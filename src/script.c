@@ -0,0 +1,492 @@
+#include "scallop-lang/script.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scallop-lang/expand.h"
+#include "scallop-lang/parse.h"
+#include "internal.h"
+
+typedef struct scallop_lang_script script_t;
+typedef struct scallop_lang_script_block block_t;
+typedef struct scallop_lang_script_statement statement_t;
+typedef struct scallop_lang_script_word word_t;
+typedef struct scallop_lang_script_piece piece_t;
+typedef struct scallop_lang_script_context context_t;
+typedef struct scallop_lang_script_frame frame_t;
+typedef struct scallop_lang_script_string string_t;
+
+#define INITIAL_STRINGS 64
+
+// The most pieces in a word expanded without allocating
+#define SMALL_WORD 8
+
+struct scallop_lang_script_string {
+	uint32_t hash;
+	size_t length;
+	char text[];
+};
+
+void scallop_lang_script_block_free(block_t *block)
+{
+	if (!block)
+		return;
+
+	for (size_t i = 0; i < block->statements_length; i++) {
+		statement_t *const statement = &block->statements[i];
+		for (size_t j = 0; j < statement->words_length; j++) {
+			word_t *const word = &statement->words[j];
+			for (size_t k = 0; k < word->pieces_length; k++) {
+				const bool owned = word->pieces[k].type == SCALLOP_LANG_SCRIPT_SUBSTITUTION
+					|| word->pieces[k].type == SCALLOP_LANG_SCRIPT_BLOCK;
+				if (owned)
+					scallop_lang_script_block_free(word->pieces[k].block);
+			}
+			free(word->pieces);
+		}
+		free(statement->words);
+	}
+	free(block->statements);
+
+	for (size_t i = 0; i < block->hoisted_length; i++)
+		scallop_lang_script_block_free(block->hoisted[i]);
+	free(block->hoisted);
+	free(block);
+}
+
+/*
+ * Building
+ */
+
+typedef struct {
+	block_t *block;
+	size_t statements_capacity;
+
+	// Of the statement being built, and its last word
+	size_t words_capacity;
+	size_t pieces_capacity;
+
+	// Where the last piece of the statement ended, so a piece
+	// starting there joins its word
+	const char *last_end;
+
+	// Where the block's opening bracket is
+	const char *begin;
+} building_t;
+
+typedef struct {
+	size_t depth;
+	building_t frames[SCALLOP_LANG_PARSE_MAX_DEPTH + 1];
+} builder_t;
+
+static const char *end_of(struct libadt_const_lptr value)
+{
+	return (const char *)value.buffer + value.length;
+}
+
+static int begin_statement(building_t *frame)
+{
+	block_t *const block = frame->block;
+	if (_scallop_grow(
+		(void **)&block->statements,
+		&frame->statements_capacity,
+		block->statements_length,
+		sizeof(*block->statements)
+	))
+		return -1;
+
+	block->statements[block->statements_length++] = (statement_t) { 0 };
+	frame->words_capacity = 0;
+	frame->pieces_capacity = 0;
+	frame->last_end = NULL;
+	return 0;
+}
+
+static int add_piece(building_t *frame, piece_t piece, const char *begin)
+{
+	statement_t *const statement = &frame->block->statements[
+		frame->block->statements_length - 1
+	];
+
+	const bool join = statement->words_length && frame->last_end == begin;
+	if (!join) {
+		if (_scallop_grow(
+			(void **)&statement->words,
+			&frame->words_capacity,
+			statement->words_length,
+			sizeof(*statement->words)
+		))
+			return -1;
+		statement->words[statement->words_length++] = (word_t) { 0 };
+		frame->pieces_capacity = 0;
+	}
+
+	word_t *const word = &statement->words[statement->words_length - 1];
+	if (_scallop_grow(
+		(void **)&word->pieces,
+		&frame->pieces_capacity,
+		word->pieces_length,
+		sizeof(*word->pieces)
+	))
+		return -1;
+	word->pieces[word->pieces_length++] = piece;
+	return 0;
+}
+
+static int build_event(void *user, const struct scallop_lang_parse_event *event)
+{
+	builder_t *const builder = user;
+	building_t *const frame = &builder->frames[builder->depth];
+	const char *const begin = event->value.buffer;
+
+	switch (event->type) {
+		case SCALLOP_LANG_PARSE_STATEMENT_BEGIN:
+			return begin_statement(frame);
+
+		case SCALLOP_LANG_PARSE_STATEMENT_END:
+			return 0;
+
+		case SCALLOP_LANG_PARSE_WORD: {
+			const piece_t piece = {
+				.type = SCALLOP_LANG_SCRIPT_RAW,
+				.text = begin,
+				.length = (size_t)event->value.length,
+			};
+			if (add_piece(frame, piece, begin))
+				return -1;
+			frame->last_end = end_of(event->value);
+			return 0;
+		}
+
+		case SCALLOP_LANG_PARSE_BLOCK_BEGIN:
+		case SCALLOP_LANG_PARSE_SUBSTITUTION_BEGIN: {
+			block_t *const block = calloc(1, sizeof(*block));
+			if (!block)
+				return -1;
+
+			const piece_t piece = {
+				.type = event->type == SCALLOP_LANG_PARSE_BLOCK_BEGIN
+					? SCALLOP_LANG_SCRIPT_BLOCK
+					: SCALLOP_LANG_SCRIPT_SUBSTITUTION,
+				.block = block,
+			};
+			if (add_piece(frame, piece, begin)) {
+				free(block);
+				return -1;
+			}
+
+			builder->frames[++builder->depth] = (building_t) {
+				.block = block,
+				.begin = begin,
+			};
+			return 0;
+		}
+
+		case SCALLOP_LANG_PARSE_BLOCK_END:
+		case SCALLOP_LANG_PARSE_SUBSTITUTION_END: {
+			const char *const end = end_of(event->value);
+			frame->block->source = (struct libadt_const_lptr) {
+				.buffer = frame->begin,
+				.size = 1,
+				.length = end - frame->begin,
+			};
+			builder->depth--;
+			builder->frames[builder->depth].last_end = end;
+			return 0;
+		}
+	}
+	return 0;
+}
+
+int scallop_lang_script_build(struct libadt_const_lptr text, script_t *out)
+{
+	*out = (script_t) { 0 };
+	if (text.size != 1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	out->root = calloc(1, sizeof(*out->root));
+	if (!out->root)
+		return -1;
+	out->root->source = text;
+
+	builder_t builder = { 0 };
+	builder.frames[0] = (building_t) {
+		.block = out->root,
+		.begin = text.buffer,
+	};
+
+	errno = 0;
+	const int result = scallop_lang_parse(text, build_event, &builder);
+	if (result) {
+		// The handler only stops parsing when it runs out of memory
+		if (result > 0 && !errno)
+			errno = ENOMEM;
+		scallop_lang_script_free(out);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Interning
+ */
+
+static int grow_strings(script_t *script)
+{
+	const size_t capacity = script->_strings_capacity
+		? script->_strings_capacity * 2
+		: INITIAL_STRINGS;
+	string_t **const strings = calloc(capacity, sizeof(*strings));
+	if (!strings)
+		return -1;
+
+	for (size_t i = 0; i < script->_strings_capacity; i++) {
+		string_t *const string = script->_strings[i];
+		if (!string)
+			continue;
+		size_t slot = string->hash & (capacity - 1);
+		while (strings[slot])
+			slot = (slot + 1) & (capacity - 1);
+		strings[slot] = string;
+	}
+
+	free(script->_strings);
+	script->_strings = strings;
+	script->_strings_capacity = capacity;
+	return 0;
+}
+
+const char *scallop_lang_script_intern(script_t *script, const char *text, size_t length)
+{
+	// Empty slices of an expansion plan may have no text
+	if (!length)
+		text = "";
+
+	const bool full = script->_strings_length + 1 > script->_strings_capacity / 2;
+	if (full && grow_strings(script))
+		return NULL;
+
+	const uint32_t hash = _scallop_hash(text, length);
+	const size_t mask = script->_strings_capacity - 1;
+	size_t slot = hash & mask;
+	for (; script->_strings[slot]; slot = (slot + 1) & mask) {
+		const string_t *const string = script->_strings[slot];
+		const bool same = string->hash == hash
+			&& string->length == length
+			&& memcmp(string->text, text, length) == 0;
+		if (same)
+			return string->text;
+	}
+
+	string_t *const string = malloc(sizeof(*string) + length + 1);
+	if (!string)
+		return NULL;
+	string->hash = hash;
+	string->length = length;
+	memcpy(string->text, text, length);
+	string->text[length] = '\0';
+
+	script->_strings[slot] = string;
+	script->_strings_length++;
+	return string->text;
+}
+
+/*
+ * Expanding
+ */
+
+typedef struct {
+	const char *text;
+	size_t length;
+
+	// Set if text was allocated for this expansion
+	char *owned;
+} value_t;
+
+static int expand_raw(const piece_t *piece, const context_t *context, value_t *out)
+{
+	struct scallop_lang_expand_plan plan = { 0 };
+	const struct libadt_const_lptr raw = {
+		.buffer = piece->text,
+		.size = 1,
+		.length = (ssize_t)piece->length,
+	};
+	if (scallop_lang_expand_compile(raw, &plan))
+		return -1;
+
+	struct libadt_const_lptr *const values = calloc(
+		plan.names_length ? plan.names_length : 1,
+		sizeof(*values)
+	);
+	if (!values) {
+		scallop_lang_expand_free(&plan);
+		return -1;
+	}
+	for (size_t i = 0; i < plan.names_length; i++) {
+		const char *const value = context->get_variable(context->user, plan.names[i]);
+		if (value)
+			values[i] = (struct libadt_const_lptr) {
+				.buffer = value,
+				.size = 1,
+				.length = (ssize_t)strlen(value),
+			};
+	}
+
+	out->owned = scallop_lang_expand_apply(&plan, values, &out->length);
+	out->text = out->owned;
+	free(values);
+	scallop_lang_expand_free(&plan);
+	return out->owned ? 0 : -1;
+}
+
+static int expand_piece(
+	const frame_t *frame,
+	const piece_t *piece,
+	const context_t *context,
+	value_t *out
+)
+{
+	*out = (value_t) { 0 };
+	switch (piece->type) {
+		case SCALLOP_LANG_SCRIPT_RAW:
+			return expand_raw(piece, context, out);
+
+		case SCALLOP_LANG_SCRIPT_LITERAL:
+			out->text = piece->text;
+			out->length = piece->length;
+			return 0;
+
+		case SCALLOP_LANG_SCRIPT_VARIABLE:
+			out->text = context->get_variable(context->user, piece->text);
+			out->length = out->text ? strlen(out->text) : 0;
+			return 0;
+
+		case SCALLOP_LANG_SCRIPT_SUBSTITUTION:
+			out->owned = context->substitute(context->user, piece->block);
+			out->text = out->owned;
+			out->length = out->text ? strlen(out->text) : 0;
+			return out->owned ? 0 : -1;
+
+		case SCALLOP_LANG_SCRIPT_HOISTED:
+			out->text = frame->hoisted[piece->slot];
+			out->length = strlen(out->text);
+			return 0;
+
+		case SCALLOP_LANG_SCRIPT_BLOCK:
+			break;
+	}
+	errno = EINVAL;
+	return -1;
+}
+
+static char *expand_word(const frame_t *frame, const word_t *word, const context_t *context)
+{
+	value_t small[SMALL_WORD];
+	value_t *const values = word->pieces_length <= SMALL_WORD
+		? small
+		: calloc(word->pieces_length, sizeof(*values));
+	if (!values)
+		return NULL;
+
+	char *result = NULL;
+	size_t expanded = 0;
+	size_t length = 0;
+	for (; expanded < word->pieces_length; expanded++) {
+		if (expand_piece(frame, &word->pieces[expanded], context, &values[expanded]))
+			goto done;
+		length += values[expanded].length;
+	}
+
+	result = malloc(length + 1);
+	if (!result)
+		goto done;
+	char *cursor = result;
+	for (size_t i = 0; i < word->pieces_length; i++) {
+		if (values[i].length)
+			memcpy(cursor, values[i].text, values[i].length);
+		cursor += values[i].length;
+	}
+	*cursor = '\0';
+
+done:
+	for (size_t i = 0; i < expanded; i++)
+		free(values[i].owned);
+	if (values != small)
+		free(values);
+	return result;
+}
+
+int scallop_lang_script_enter(
+	const block_t *block,
+	const context_t *context,
+	frame_t *out
+)
+{
+	*out = (frame_t) { .block = block };
+	if (!block->hoisted_length)
+		return 0;
+
+	out->hoisted = calloc(block->hoisted_length, sizeof(*out->hoisted));
+	if (!out->hoisted)
+		return -1;
+	for (size_t i = 0; i < block->hoisted_length; i++) {
+		out->hoisted[i] = context->substitute(context->user, block->hoisted[i]);
+		if (!out->hoisted[i]) {
+			scallop_lang_script_leave(out);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void scallop_lang_script_leave(frame_t *frame)
+{
+	if (frame->hoisted)
+		for (size_t i = 0; i < frame->block->hoisted_length; i++)
+			free(frame->hoisted[i]);
+	free(frame->hoisted);
+	*frame = (frame_t) { 0 };
+}
+
+char **scallop_lang_script_arguments(
+	const frame_t *frame,
+	const statement_t *statement,
+	const context_t *context
+)
+{
+	char **const arguments = calloc(statement->words_length + 1, sizeof(*arguments));
+	if (!arguments)
+		return NULL;
+
+	for (size_t i = 0; i < statement->words_length; i++) {
+		arguments[i] = expand_word(frame, &statement->words[i], context);
+		if (!arguments[i]) {
+			scallop_lang_script_arguments_free(arguments);
+			return NULL;
+		}
+	}
+	return arguments;
+}
+
+void scallop_lang_script_arguments_free(char **arguments)
+{
+	if (!arguments)
+		return;
+	for (char **argument = arguments; *argument; argument++)
+		free(*argument);
+	free(arguments);
+}
+
+void scallop_lang_script_free(script_t *script)
+{
+	scallop_lang_script_block_free(script->root);
+	for (size_t i = 0; i < script->_strings_capacity; i++)
+		free(script->_strings[i]);
+	free(script->_strings);
+	*script = (script_t) { 0 };
+}
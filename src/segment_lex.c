@@ -0,0 +1,43 @@
+#include "scallop-lang/segment_lex.h"
+
+struct libadt_const_lptr _scallop_segment(
+	struct libadt_const_lptr segments,
+	ssize_t index
+);
+struct scallop_lang_segment_pos _scallop_segment_pos_normalize(
+	struct libadt_const_lptr segments,
+	struct scallop_lang_segment_pos pos
+);
+bool _scallop_segment_pos_equal(
+	struct scallop_lang_segment_pos a,
+	struct scallop_lang_segment_pos b
+);
+_scallop_segment_read_t _scallop_segment_read(
+	struct libadt_const_lptr segments,
+	struct scallop_lang_segment_pos pos,
+	scallop_lang_classifier_fn *const previous
+);
+struct scallop_lang_segment_lex scallop_lang_segment_lex_init(
+	struct libadt_const_lptr segments
+);
+struct scallop_lang_segment_lex scallop_lang_segment_lex_next_raw(
+	struct scallop_lang_segment_lex previous
+);
+struct scallop_lang_segment_lex scallop_lang_segment_lex_next(
+	struct scallop_lang_segment_lex previous
+);
+ssize_t scallop_lang_segment_lex_pieces(
+	struct scallop_lang_segment_lex token
+);
+struct libadt_const_lptr scallop_lang_segment_lex_piece(
+	struct scallop_lang_segment_lex token,
+	ssize_t index
+);
+ssize_t scallop_lang_segment_lex_copy(
+	struct scallop_lang_segment_lex token,
+	struct libadt_lptr out
+);
+ssize_t scallop_lang_segment_lex_normalize_word(
+	struct scallop_lang_segment_lex token,
+	struct libadt_lptr out
+);
@@ -0,0 +1,289 @@
+// For sched_getaffinity() and the CPU_* macros
+#define _GNU_SOURCE
+
+#include "scallop-lang/topology.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <unistd.h>
+
+typedef struct scallop_lang_topology topology_t;
+typedef struct scallop_lang_topology_core core_t;
+
+#define DEFAULT_ROOT "/sys/devices/system/cpu"
+
+// The highest CPU number accepted in a list, so a malformed list
+// can't make us allocate a huge table
+#define MAX_CPU 65535
+
+// The largest affinity mask tried, in CPUs
+#define MAX_AFFINITY (MAX_CPU + 1)
+
+typedef struct {
+	unsigned *buffer;
+	size_t length;
+	size_t capacity;
+} list_t;
+
+static int push(list_t *list, unsigned cpu)
+{
+	if (list->length == list->capacity) {
+		const size_t capacity = list->capacity ? list->capacity * 2 : 16;
+		unsigned *const buffer = realloc(list->buffer, capacity * sizeof(*buffer));
+		if (!buffer)
+			return -1;
+		list->buffer = buffer;
+		list->capacity = capacity;
+	}
+	list->buffer[list->length++] = cpu;
+	return 0;
+}
+
+static bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+/*
+ * Parses a cpulist, such as "0-3,8", replacing the contents of
+ * list. A trailing newline is allowed.
+ */
+static int parse_list(const char *text, list_t *list)
+{
+	list->length = 0;
+	const char *read = text;
+	while (*read && *read != '\n') {
+		if (!is_digit(*read))
+			goto invalid;
+
+		char *end = NULL;
+		const unsigned long first = strtoul(read, &end, 10);
+		unsigned long last = first;
+		if (*end == '-') {
+			if (!is_digit(end[1]))
+				goto invalid;
+			last = strtoul(end + 1, &end, 10);
+		}
+		if (last < first || last > MAX_CPU)
+			goto invalid;
+
+		for (unsigned long cpu = first; cpu <= last; cpu++)
+			if (push(list, (unsigned)cpu))
+				return -1;
+
+		read = end;
+		if (*read == ',')
+			read++;
+		else if (*read && *read != '\n')
+			goto invalid;
+	}
+	return 0;
+
+invalid:
+	errno = EINVAL;
+	return -1;
+}
+
+static int read_list(const char *path, list_t *list)
+{
+	const int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	char buffer[4096];
+	ssize_t amount = 0;
+	do
+		amount = read(fd, buffer, sizeof(buffer) - 1);
+	while (amount < 0 && errno == EINTR);
+
+	const int error = errno;
+	close(fd);
+	if (amount < 0) {
+		errno = error;
+		return -1;
+	}
+	buffer[amount] = '\0';
+	return parse_list(buffer, list);
+}
+
+static int compare_cpus(const void *a, const void *b)
+{
+	const unsigned left = *(const unsigned *)a;
+	const unsigned right = *(const unsigned *)b;
+	return (left > right) - (left < right);
+}
+
+/*
+ * Reads the siblings of a CPU, from the first file that exists.
+ * Leaves list empty if neither does.
+ */
+static int read_siblings(const char *root, unsigned cpu, list_t *list)
+{
+	static const char *const names[] = {
+		"core_cpus_list",
+		"thread_siblings_list",
+	};
+
+	list->length = 0;
+	for (size_t i = 0; i < sizeof(names) / sizeof(*names); i++) {
+		char path[PATH_MAX];
+		const int length = snprintf(
+			path,
+			sizeof(path),
+			"%s/cpu%u/topology/%s",
+			root,
+			cpu,
+			names[i]
+		);
+		if (length < 0 || (size_t)length >= sizeof(path)) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+
+		if (!read_list(path, list))
+			return 0;
+		if (errno == ENOMEM)
+			return -1;
+	}
+	list->length = 0;
+	return 0;
+}
+
+int scallop_lang_topology_init(topology_t *topology, const char *root)
+{
+	*topology = (topology_t) { 0 };
+	if (!root)
+		root = DEFAULT_ROOT;
+
+	list_t online = { 0 };
+	list_t siblings = { 0 };
+	bool *is_online = NULL;
+	bool *assigned = NULL;
+
+	char path[PATH_MAX];
+	const int path_length = snprintf(path, sizeof(path), "%s/online", root);
+	if (path_length < 0 || (size_t)path_length >= sizeof(path)) {
+		errno = ENAMETOOLONG;
+		goto error;
+	}
+	if (read_list(path, &online))
+		goto error;
+	if (!online.length) {
+		errno = EINVAL;
+		goto error;
+	}
+	qsort(online.buffer, online.length, sizeof(*online.buffer), compare_cpus);
+
+	const unsigned max = online.buffer[online.length - 1];
+	is_online = calloc((size_t)max + 1, sizeof(*is_online));
+	assigned = calloc((size_t)max + 1, sizeof(*assigned));
+	topology->_cpus = calloc(online.length, sizeof(*topology->_cpus));
+	topology->cores = calloc(online.length, sizeof(*topology->cores));
+	if (!is_online || !assigned || !topology->_cpus || !topology->cores)
+		goto error;
+	for (size_t i = 0; i < online.length; i++)
+		is_online[online.buffer[i]] = true;
+
+	size_t cpus_length = 0;
+	for (size_t i = 0; i < online.length; i++) {
+		const unsigned cpu = online.buffer[i];
+		if (assigned[cpu])
+			continue;
+		if (read_siblings(root, cpu, &siblings))
+			goto error;
+
+		// The CPU is always part of its own core, and offline
+		// siblings are left out
+		unsigned *const core = topology->_cpus + cpus_length;
+		assigned[cpu] = true;
+		topology->_cpus[cpus_length++] = cpu;
+		for (size_t j = 0; j < siblings.length; j++) {
+			const unsigned sibling = siblings.buffer[j];
+			if (sibling > max || !is_online[sibling] || assigned[sibling])
+				continue;
+			assigned[sibling] = true;
+			topology->_cpus[cpus_length++] = sibling;
+		}
+
+		const size_t length = (size_t)(topology->_cpus + cpus_length - core);
+		qsort(core, length, sizeof(*core), compare_cpus);
+		topology->cores[topology->cores_length++] = (core_t) {
+			.cpus = core,
+			.cpus_length = length,
+		};
+	}
+
+	free(online.buffer);
+	free(siblings.buffer);
+	free(is_online);
+	free(assigned);
+	return 0;
+
+error:;
+	const int error = errno;
+	free(online.buffer);
+	free(siblings.buffer);
+	free(is_online);
+	free(assigned);
+	scallop_lang_topology_free(topology);
+	errno = error;
+	return -1;
+}
+
+int scallop_lang_topology_restrict(topology_t *topology)
+{
+	// The mask must be at least as large as the kernel's, which
+	// isn't known up front
+	cpu_set_t *allowed = NULL;
+	size_t count = CPU_SETSIZE;
+	size_t size = 0;
+	for (;;) {
+		allowed = CPU_ALLOC(count);
+		if (!allowed)
+			return -1;
+		size = CPU_ALLOC_SIZE(count);
+		if (!sched_getaffinity(0, size, allowed))
+			break;
+
+		const int error = errno;
+		CPU_FREE(allowed);
+		if (error != EINVAL || count >= MAX_AFFINITY) {
+			errno = error;
+			return -1;
+		}
+		count *= 2;
+	}
+
+	size_t cores_length = 0;
+	for (size_t i = 0; i < topology->cores_length; i++) {
+		const core_t core = topology->cores[i];
+		unsigned *const cpus = topology->_cpus + (core.cpus - topology->_cpus);
+		size_t length = 0;
+		for (size_t j = 0; j < core.cpus_length; j++)
+			if (CPU_ISSET_S(cpus[j], size, allowed))
+				cpus[length++] = cpus[j];
+
+		if (length)
+			topology->cores[cores_length++] = (core_t) {
+				.cpus = cpus,
+				.cpus_length = length,
+			};
+	}
+	topology->cores_length = cores_length;
+
+	CPU_FREE(allowed);
+	return 0;
+}
+
+void scallop_lang_topology_free(topology_t *topology)
+{
+	free(topology->cores);
+	free(topology->_cpus);
+	*topology = (topology_t) { 0 };
+}
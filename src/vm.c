@@ -0,0 +1,803 @@
+#include "scallop-lang/vm.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "scallop-lang/builtin.h"
+#include "scallop-lang/expand.h"
+#include "internal.h"
+
+typedef struct scallop_lang_vm_program program_t;
+typedef struct scallop_lang_vm_options options_t;
+typedef struct scallop_lang_vm_constant constant_t;
+typedef struct scallop_lang_script script_t;
+typedef struct scallop_lang_script_block block_t;
+typedef struct scallop_lang_script_statement statement_t;
+typedef struct scallop_lang_script_word word_t;
+typedef struct scallop_lang_script_piece piece_t;
+
+// Labels as values are a GNU extension, also supported by Clang
+#if defined(__GNUC__) && !defined(SCALLOP_LANG_VM_SWITCH)
+#define COMPUTED_GOTO
+#endif
+
+#define OP_BITS 8
+#define OP_MASK ((UINT32_C(1) << OP_BITS) - 1)
+#define MAX_OPERAND (UINT32_MAX >> OP_BITS)
+
+#define INSTRUCTION(op, operand) ((uint32_t)(op) | (uint32_t)(operand) << OP_BITS)
+
+enum op {
+	// Pushes constant OPERAND
+	OP_LITERAL,
+
+	// Pushes the value of the variable named by constant OPERAND
+	OP_VARIABLE,
+
+	// Pushes a copy of the value, for statements with
+	// substitutions, which could set the variable before the
+	// statement runs
+	OP_VARIABLE_COPY,
+
+	// Pushes hoisted substitution OPERAND
+	OP_SLOT,
+
+	// Pops OPERAND values and pushes them joined
+	OP_CONCAT,
+
+	// Sends the output of statements to a new capture
+	OP_CAPTURE,
+
+	// Ends the innermost capture, and pushes its output
+	OP_SUBSTITUTE,
+
+	// Pops a value into hoisted substitution OPERAND
+	OP_STORE,
+
+	// Pops OPERAND arguments, and runs the command they name
+	OP_RUN,
+
+	// Pops OPERAND arguments, and runs the builtin indexed by
+	// the next word
+	OP_BUILTIN,
+
+	OP_HALT,
+};
+
+typedef struct {
+	script_t *script;
+	program_t *program;
+	size_t code_capacity;
+	size_t constants_capacity;
+	size_t builtins_capacity;
+
+	// Constant indexes plus one, by the address of their interned
+	// text, with open addressing
+	size_t *index;
+	size_t index_capacity;
+
+	// The values on the stack and the open captures at this point
+	// of the program
+	size_t depth;
+	size_t captures;
+} compiler_t;
+
+typedef struct {
+	const char *text;
+	size_t length;
+
+	// Set if text was allocated for this value
+	char *owned;
+} value_t;
+
+typedef struct {
+	const program_t *program;
+	const options_t *options;
+
+	value_t *stack;
+	size_t stack_length;
+
+	value_t *slots;
+
+	// Reused for each substitution at the same depth
+	FILE **captures;
+	size_t captures_length;
+
+	char **argv;
+	int status;
+} machine_t;
+
+static int append(compiler_t *compiler, uint32_t word)
+{
+	program_t *const program = compiler->program;
+	if (_scallop_grow(
+		(void **)&program->code,
+		&compiler->code_capacity,
+		program->code_length,
+		sizeof(*program->code)
+	))
+		return -1;
+
+	program->code[program->code_length++] = word;
+	return 0;
+}
+
+/*
+ * Emits an instruction, and updates the depth of the stack by the
+ * number of values it pushes, less the number it pops.
+ */
+static int emit(compiler_t *compiler, enum op op, size_t operand, ssize_t pushed)
+{
+	program_t *const program = compiler->program;
+	if (operand > MAX_OPERAND) {
+		errno = E2BIG;
+		return -1;
+	}
+	if (append(compiler, INSTRUCTION(op, operand)))
+		return -1;
+
+	compiler->depth += (size_t)pushed;
+	if (compiler->depth > program->max_stack)
+		program->max_stack = compiler->depth;
+	return 0;
+}
+
+static size_t hash_address(const char *text)
+{
+	const uintptr_t address = (uintptr_t)text;
+	return (size_t)(address ^ address >> 17) * 0x9e3779b1u;
+}
+
+static int grow_index(compiler_t *compiler)
+{
+	const program_t *const program = compiler->program;
+	if ((program->constants_length + 1) * 4 <= compiler->index_capacity * 3)
+		return 0;
+
+	const size_t capacity = compiler->index_capacity ? compiler->index_capacity * 2 : 64;
+	size_t *const index = calloc(capacity, sizeof(*index));
+	if (!index)
+		return -1;
+
+	for (size_t i = 0; i < program->constants_length; i++) {
+		size_t j = hash_address(program->constants[i].text) & (capacity - 1);
+		while (index[j])
+			j = (j + 1) & (capacity - 1);
+		index[j] = i + 1;
+	}
+	free(compiler->index);
+	compiler->index = index;
+	compiler->index_capacity = capacity;
+	return 0;
+}
+
+/*
+ * Returns the index of the constant for an interned string, adding
+ * it to the pool the first time, or -1 on failure.
+ */
+static ssize_t constant(compiler_t *compiler, const char *text, size_t length)
+{
+	program_t *const program = compiler->program;
+	if (!text || grow_index(compiler))
+		return -1;
+
+	const size_t mask = compiler->index_capacity - 1;
+	size_t i = hash_address(text) & mask;
+	for (; compiler->index[i]; i = (i + 1) & mask)
+		if (program->constants[compiler->index[i] - 1].text == text)
+			return (ssize_t)(compiler->index[i] - 1);
+
+	if (_scallop_grow(
+		(void **)&program->constants,
+		&compiler->constants_capacity,
+		program->constants_length,
+		sizeof(*program->constants)
+	))
+		return -1;
+
+	program->constants[program->constants_length] = (constant_t) {
+		.text = text,
+		.length = length,
+	};
+	compiler->index[i] = ++program->constants_length;
+	return (ssize_t)(program->constants_length - 1);
+}
+
+static int emit_literal(compiler_t *compiler, const char *text, size_t length)
+{
+	const ssize_t index = constant(
+		compiler,
+		scallop_lang_script_intern(compiler->script, text, length),
+		length
+	);
+	return index < 0 ? -1 : emit(compiler, OP_LITERAL, (size_t)index, 1);
+}
+
+static int emit_variable(compiler_t *compiler, const char *name, bool copy)
+{
+	const size_t length = strlen(name);
+	const ssize_t index = constant(
+		compiler,
+		scallop_lang_script_intern(compiler->script, name, length),
+		length
+	);
+	if (index < 0)
+		return -1;
+	return emit(compiler, copy ? OP_VARIABLE_COPY : OP_VARIABLE, (size_t)index, 1);
+}
+
+/*
+ * Normalizes a raw piece, pushing its literal slices and variables.
+ * Returns the number of values pushed, or -1 on failure.
+ */
+static ssize_t compile_raw(compiler_t *compiler, const piece_t *piece, bool copy)
+{
+	struct scallop_lang_expand_plan plan = { 0 };
+	const struct libadt_const_lptr raw = {
+		.buffer = piece->text,
+		.size = 1,
+		.length = (ssize_t)piece->length,
+	};
+	if (scallop_lang_expand_compile(raw, &plan)) {
+		if (errno != ENOMEM)
+			errno = EINVAL;
+		return -1;
+	}
+
+	// An empty word, like '', still pushes one value
+	int result = plan.parts_length ? 0 : emit_literal(compiler, "", 0);
+	for (size_t i = 0; !result && i < plan.parts_length; i++) {
+		const struct scallop_lang_expand_part part = plan.parts[i];
+		result = part.slot < 0
+			? emit_literal(
+				compiler,
+				part.length ? plan.text + part.offset : "",
+				part.length
+			)
+			: emit_variable(compiler, plan.names[part.slot], copy);
+	}
+
+	const size_t pushed = plan.parts_length ? plan.parts_length : 1;
+	scallop_lang_expand_free(&plan);
+	return result ? -1 : (ssize_t)pushed;
+}
+
+static int compile_block(compiler_t *compiler, const block_t *block);
+
+static int compile_substitution(compiler_t *compiler, const block_t *block)
+{
+	if (emit(compiler, OP_CAPTURE, 0, 0))
+		return -1;
+	if (++compiler->captures > compiler->program->_captures_length)
+		compiler->program->_captures_length = compiler->captures;
+
+	if (compile_block(compiler, block))
+		return -1;
+
+	compiler->captures--;
+	return emit(compiler, OP_SUBSTITUTE, 0, 1);
+}
+
+/*
+ * Pushes the values of a piece. Returns the number of values
+ * pushed, or -1 on failure.
+ */
+static ssize_t compile_piece(
+	compiler_t *compiler,
+	const piece_t *piece,
+	size_t slots,
+	bool copy
+)
+{
+	int result = -1;
+	switch (piece->type) {
+		case SCALLOP_LANG_SCRIPT_RAW:
+			return compile_raw(compiler, piece, copy);
+
+		case SCALLOP_LANG_SCRIPT_LITERAL:
+			result = emit_literal(compiler, piece->text, piece->length);
+			break;
+
+		case SCALLOP_LANG_SCRIPT_VARIABLE:
+			result = emit_variable(compiler, piece->text, copy);
+			break;
+
+		case SCALLOP_LANG_SCRIPT_SUBSTITUTION:
+			result = compile_substitution(compiler, piece->block);
+			break;
+
+		case SCALLOP_LANG_SCRIPT_HOISTED:
+			result = emit(compiler, OP_SLOT, slots + piece->slot, 1);
+			break;
+
+		case SCALLOP_LANG_SCRIPT_BLOCK:
+			errno = EINVAL;
+			break;
+	}
+	return result ? -1 : 1;
+}
+
+static int compile_word(compiler_t *compiler, const word_t *word, size_t slots, bool copy)
+{
+	size_t pushed = 0;
+	for (size_t i = 0; i < word->pieces_length; i++) {
+		const ssize_t result = compile_piece(compiler, &word->pieces[i], slots, copy);
+		if (result < 0)
+			return -1;
+		pushed += (size_t)result;
+	}
+
+	if (pushed == 0)
+		return emit_literal(compiler, "", 0);
+	if (pushed == 1)
+		return 0;
+	return emit(compiler, OP_CONCAT, pushed, 1 - (ssize_t)pushed);
+}
+
+static bool has_substitution(const statement_t *statement)
+{
+	for (size_t i = 0; i < statement->words_length; i++) {
+		const word_t *const word = &statement->words[i];
+		for (size_t j = 0; j < word->pieces_length; j++)
+			if (word->pieces[j].type == SCALLOP_LANG_SCRIPT_SUBSTITUTION)
+				return true;
+	}
+	return false;
+}
+
+/*
+ * Returns the builtin a command name compiled to a single constant
+ * names, or NULL.
+ */
+static const struct scallop_lang_builtin *constant_builtin(
+	const compiler_t *compiler,
+	size_t begin
+)
+{
+	const program_t *const program = compiler->program;
+	if (program->code_length != begin + 1)
+		return NULL;
+
+	const uint32_t instruction = program->code[begin];
+	if ((instruction & OP_MASK) != OP_LITERAL)
+		return NULL;
+	return scallop_lang_builtin_find_name(program->constants[instruction >> OP_BITS].text);
+}
+
+static int compile_statement(compiler_t *compiler, const statement_t *statement, size_t slots)
+{
+	const word_t *const first = &statement->words[0];
+	if (
+		statement->words_length == 1
+		&& first->pieces_length == 1
+		&& first->pieces[0].type == SCALLOP_LANG_SCRIPT_BLOCK
+	)
+		return compile_block(compiler, first->pieces[0].block);
+
+	program_t *const program = compiler->program;
+	const bool copy = has_substitution(statement);
+	const struct scallop_lang_builtin *builtin = NULL;
+	for (size_t i = 0; i < statement->words_length; i++) {
+		const size_t begin = program->code_length;
+		if (compile_word(compiler, &statement->words[i], slots, copy))
+			return -1;
+		if (i == 0)
+			builtin = constant_builtin(compiler, begin);
+	}
+
+	const size_t argc = statement->words_length;
+	if (argc > program->max_arguments)
+		program->max_arguments = argc;
+	if (!builtin)
+		return emit(compiler, OP_RUN, argc, -(ssize_t)argc);
+
+	if (_scallop_grow(
+		(void **)&program->_builtins,
+		&compiler->builtins_capacity,
+		program->_builtins_length,
+		sizeof(*program->_builtins)
+	))
+		return -1;
+	program->_builtins[program->_builtins_length] = builtin;
+	if (emit(compiler, OP_BUILTIN, argc, -(ssize_t)argc))
+		return -1;
+	return append(compiler, (uint32_t)program->_builtins_length++);
+}
+
+static int compile_block(compiler_t *compiler, const block_t *block)
+{
+	// Each block's hoisted substitutions get their own slots
+	const size_t slots = compiler->program->slots_length;
+	compiler->program->slots_length += block->hoisted_length;
+	for (size_t i = 0; i < block->hoisted_length; i++) {
+		if (compile_substitution(compiler, block->hoisted[i]))
+			return -1;
+		if (emit(compiler, OP_STORE, slots + i, -1))
+			return -1;
+	}
+
+	for (size_t i = 0; i < block->statements_length; i++)
+		if (compile_statement(compiler, &block->statements[i], slots))
+			return -1;
+	return 0;
+}
+
+int scallop_lang_vm_compile(script_t *script, program_t *out)
+{
+	*out = (program_t) { 0 };
+	compiler_t compiler = {
+		.script = script,
+		.program = out,
+	};
+
+	const int result = compile_block(&compiler, script->root)
+		|| emit(&compiler, OP_HALT, 0, 0);
+	free(compiler.index);
+	if (result) {
+		scallop_lang_vm_free(out);
+		return -1;
+	}
+	return 0;
+}
+
+static void release(value_t *value)
+{
+	free(value->owned);
+	*value = (value_t) { 0 };
+}
+
+static void pop(machine_t *machine, size_t count)
+{
+	for (; count; count--)
+		release(&machine->stack[--machine->stack_length]);
+}
+
+static int current_output(const machine_t *machine)
+{
+	return machine->captures_length
+		? fileno(machine->captures[machine->captures_length - 1])
+		: machine->options->out;
+}
+
+static int begin_capture(machine_t *machine)
+{
+	FILE **const capture = &machine->captures[machine->captures_length];
+	if (!*capture && !(*capture = tmpfile()))
+		return -1;
+	machine->captures_length++;
+	return 0;
+}
+
+/*
+ * Reads the output of the innermost capture without its trailing
+ * newlines, and empties the capture for the next substitution.
+ */
+static int end_capture(machine_t *machine, value_t *out)
+{
+	const int fd = fileno(machine->captures[--machine->captures_length]);
+	struct stat info = { 0 };
+	if (fstat(fd, &info))
+		return -1;
+
+	char *const output = malloc((size_t)info.st_size + 1);
+	if (!output)
+		return -1;
+
+	size_t length = 0;
+	while (length < (size_t)info.st_size) {
+		const ssize_t amount = pread(
+			fd,
+			output + length,
+			(size_t)info.st_size - length,
+			(off_t)length
+		);
+		if (amount < 0 && errno == EINTR)
+			continue;
+		if (amount <= 0)
+			break;
+		length += (size_t)amount;
+	}
+
+	if (ftruncate(fd, 0) || lseek(fd, 0, SEEK_SET) < 0) {
+		free(output);
+		return -1;
+	}
+
+	while (length && output[length - 1] == '\n')
+		length--;
+	output[length] = '\0';
+	*out = (value_t) { .text = output, .length = length, .owned = output };
+	return 0;
+}
+
+static int concat(machine_t *machine, size_t count)
+{
+	value_t *const values = &machine->stack[machine->stack_length - count];
+	size_t length = 0;
+	for (size_t i = 0; i < count; i++)
+		length += values[i].length;
+
+	char *const text = malloc(length + 1);
+	if (!text)
+		return -1;
+
+	char *end = text;
+	for (size_t i = 0; i < count; i++) {
+		memcpy(end, values[i].text, values[i].length);
+		end += values[i].length;
+	}
+	*end = '\0';
+
+	pop(machine, count);
+	machine->stack[machine->stack_length++] = (value_t) {
+		.text = text,
+		.length = length,
+		.owned = text,
+	};
+	return 0;
+}
+
+static int set_variable(void *user, const char *name, const char *value)
+{
+	return scallop_lang_env_set(user, name, value);
+}
+
+static int run_builtin(
+	machine_t *machine,
+	const struct scallop_lang_builtin *builtin,
+	size_t argc
+)
+{
+	const options_t *const options = machine->options;
+	const struct scallop_lang_builtin_context context = {
+		.in = options->in,
+		.out = current_output(machine),
+		.err = options->err,
+		.set_variable = set_variable,
+		.commands = options->commands,
+		.user = options->env,
+	};
+	machine->status = builtin->run(&context, argc, machine->argv);
+	return 0;
+}
+
+static int spawn(machine_t *machine)
+{
+	const options_t *const options = machine->options;
+	char **const argv = machine->argv;
+	char *const *const envp = scallop_lang_env_envp(options->env);
+	if (!envp)
+		return -1;
+
+	const struct scallop_lang_commands_command *const command
+		= scallop_lang_commands_prepare(options->commands, argv);
+
+	const int out = current_output(machine);
+	const pid_t pid = fork();
+	if (pid == 0) {
+		if (
+			dup2(options->in, STDIN_FILENO) < 0
+			|| dup2(out, STDOUT_FILENO) < 0
+			|| dup2(options->err, STDERR_FILENO) < 0
+		)
+			_exit(127);
+		scallop_lang_commands_run(command, argv, envp);
+		_exit(127);
+	}
+	scallop_lang_commands_release(command);
+	if (pid < 0)
+		return -1;
+
+	int status = 0;
+	while (waitpid(pid, &status, 0) < 0)
+		if (errno != EINTR)
+			return -1;
+	machine->status = WIFEXITED(status)
+		? WEXITSTATUS(status)
+		: 128 + WTERMSIG(status);
+	return 0;
+}
+
+/*
+ * Runs a statement with the arguments on top of the stack, and pops
+ * them. builtin is NULL to look the command up by its name.
+ */
+static int run_statement(
+	machine_t *machine,
+	const struct scallop_lang_builtin *builtin,
+	size_t argc
+)
+{
+	const value_t *const values = &machine->stack[machine->stack_length - argc];
+	for (size_t i = 0; i < argc; i++)
+		machine->argv[i] = (char *)values[i].text;
+	machine->argv[argc] = NULL;
+
+	if (!builtin)
+		builtin = scallop_lang_builtin_find_name(machine->argv[0]);
+	const int result = builtin
+		? run_builtin(machine, builtin, argc)
+		: spawn(machine);
+	pop(machine, argc);
+	return result;
+}
+
+#ifdef COMPUTED_GOTO
+#define TARGET(op) target_##op:
+#define DISPATCH() goto *targets[(instruction = *pc++) & OP_MASK]
+#else
+#define TARGET(op) case op:
+#define DISPATCH() continue
+#endif
+
+#define OPERAND() ((size_t)(instruction >> OP_BITS))
+
+static int execute(machine_t *machine)
+{
+	const program_t *const program = machine->program;
+	const constant_t *const constants = program->constants;
+	const struct scallop_lang_env *const env = machine->options->env;
+	const uint32_t *pc = program->code;
+	value_t *const stack = machine->stack;
+	uint32_t instruction;
+
+#ifdef COMPUTED_GOTO
+	// In the order of enum op
+	static const void *const targets[] = {
+		&&target_OP_LITERAL,
+		&&target_OP_VARIABLE,
+		&&target_OP_VARIABLE_COPY,
+		&&target_OP_SLOT,
+		&&target_OP_CONCAT,
+		&&target_OP_CAPTURE,
+		&&target_OP_SUBSTITUTE,
+		&&target_OP_STORE,
+		&&target_OP_RUN,
+		&&target_OP_BUILTIN,
+		&&target_OP_HALT,
+	};
+	DISPATCH();
+#else
+	for (;;) switch ((instruction = *pc++) & OP_MASK) {
+#endif
+
+	TARGET(OP_LITERAL) {
+		const constant_t *const literal = &constants[OPERAND()];
+		stack[machine->stack_length++] = (value_t) {
+			.text = literal->text,
+			.length = literal->length,
+		};
+		DISPATCH();
+	}
+
+	TARGET(OP_VARIABLE) {
+		const char *const value = scallop_lang_env_get(env, constants[OPERAND()].text);
+		stack[machine->stack_length++] = (value_t) {
+			.text = value ? value : "",
+			.length = value ? strlen(value) : 0,
+		};
+		DISPATCH();
+	}
+
+	TARGET(OP_VARIABLE_COPY) {
+		const char *const value = scallop_lang_env_get(env, constants[OPERAND()].text);
+		char *const copy = strdup(value ? value : "");
+		if (!copy)
+			return -1;
+		stack[machine->stack_length++] = (value_t) {
+			.text = copy,
+			.length = strlen(copy),
+			.owned = copy,
+		};
+		DISPATCH();
+	}
+
+	TARGET(OP_SLOT) {
+		const value_t *const slot = &machine->slots[OPERAND()];
+		stack[machine->stack_length++] = (value_t) {
+			.text = slot->text,
+			.length = slot->length,
+		};
+		DISPATCH();
+	}
+
+	TARGET(OP_CONCAT) {
+		if (concat(machine, OPERAND()))
+			return -1;
+		DISPATCH();
+	}
+
+	TARGET(OP_CAPTURE) {
+		if (begin_capture(machine))
+			return -1;
+		DISPATCH();
+	}
+
+	TARGET(OP_SUBSTITUTE) {
+		if (end_capture(machine, &stack[machine->stack_length]))
+			return -1;
+		machine->stack_length++;
+		DISPATCH();
+	}
+
+	TARGET(OP_STORE) {
+		value_t *const slot = &machine->slots[OPERAND()];
+		release(slot);
+		*slot = stack[--machine->stack_length];
+		stack[machine->stack_length] = (value_t) { 0 };
+		DISPATCH();
+	}
+
+	TARGET(OP_RUN) {
+		if (run_statement(machine, NULL, OPERAND()))
+			return -1;
+		DISPATCH();
+	}
+
+	TARGET(OP_BUILTIN) {
+		const struct scallop_lang_builtin *const builtin = program->_builtins[*pc++];
+		if (run_statement(machine, builtin, OPERAND()))
+			return -1;
+		DISPATCH();
+	}
+
+	TARGET(OP_HALT) {
+		return 0;
+	}
+
+#ifndef COMPUTED_GOTO
+	}
+#endif
+}
+
+int scallop_lang_vm_run(const program_t *program, const options_t *options, int *status)
+{
+	machine_t machine = {
+		.program = program,
+		.options = options,
+		.stack = calloc(program->max_stack + 1, sizeof(*machine.stack)),
+		.slots = calloc(program->slots_length + 1, sizeof(*machine.slots)),
+		.captures = calloc(program->_captures_length + 1, sizeof(*machine.captures)),
+		.argv = calloc(program->max_arguments + 1, sizeof(*machine.argv)),
+	};
+
+	int result = -1;
+	if (machine.stack && machine.slots && machine.captures && machine.argv)
+		result = execute(&machine);
+
+	// Keep errno from the failure while cleaning up
+	const int error = errno;
+	if (machine.stack)
+		pop(&machine, machine.stack_length);
+	if (machine.slots)
+		for (size_t i = 0; i < program->slots_length; i++)
+			release(&machine.slots[i]);
+	if (machine.captures)
+		for (size_t i = 0; i < program->_captures_length; i++)
+			if (machine.captures[i])
+				fclose(machine.captures[i]);
+	free(machine.stack);
+	free(machine.slots);
+	free(machine.captures);
+	free(machine.argv);
+	errno = error;
+
+	if (!result && status)
+		*status = machine.status;
+	return result;
+}
+
+void scallop_lang_vm_free(program_t *program)
+{
+	free(program->code);
+	free(program->constants);
+	free(program->_builtins);
+	*program = (program_t) { 0 };
+}
@@ -0,0 +1,143 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "scallop-lang/batch.h"
+#include "scallop-lang/lex.h"
+
+#include <libadt/str.h>
+
+#define lit libadt_str_literal
+typedef struct scallop_lang_batch batch_t;
+typedef struct scallop_lang_batch_input input_t;
+typedef struct scallop_lang_batch_result result_t;
+
+static char path[] = "/tmp/scallop-batch-XXXXXX";
+
+static void assert_same_tokens(const result_t *result)
+{
+	size_t i = 0;
+	struct scallop_lang_lex token = scallop_lang_lex_init(result->script);
+	for (;;) {
+		token = scallop_lang_lex_next(token);
+		if (
+			token.type == scallop_lang_classifier_end
+			|| token.type == scallop_lang_classifier_unexpected
+		)
+			break;
+
+		assert(i < result->tokens_length);
+		assert(result->tokens[i].type == token.type);
+		assert(result->tokens[i].length == (size_t)token.value.length);
+		assert(
+			(const char *)result->script.buffer + result->tokens[i].offset
+			== token.value.buffer
+		);
+		i++;
+	}
+	assert(i == result->tokens_length);
+}
+
+static void check_batch(size_t threads)
+{
+	const input_t inputs[] = {
+		{ .script = lit("echo hello world") },
+		{ .path = path },
+		{ .script = lit("cat 'unterminated") },
+		{ .path = "/nonexistent/scallop-batch" },
+		{ .script = lit("") },
+		{ .script = lit("a; b\nc 'd e'") },
+	};
+	const size_t length = sizeof(inputs) / sizeof(*inputs);
+
+	batch_t batch = { 0 };
+	assert(scallop_lang_batch_lex(inputs, length, threads, &batch) == 0);
+	assert(batch.length == length);
+
+	assert(batch.results[0].error == 0);
+	assert(batch.results[0].tokens_length == 5);
+	assert_same_tokens(&batch.results[0]);
+
+	assert(batch.results[1].error == 0);
+	assert(batch.results[1].script.length == 9);
+	assert(memcmp(batch.results[1].script.buffer, "ls -l /;\n", 9) == 0);
+	assert(batch.results[1].tokens_length == 6);
+	assert_same_tokens(&batch.results[1]);
+
+	assert(batch.results[2].error == EINVAL);
+	assert(batch.results[2].error_offset == 17);
+	assert(batch.results[2].tokens_length == 3);
+
+	assert(batch.results[3].error == ENOENT);
+	assert(batch.results[3].tokens_length == 0);
+
+	assert(batch.results[4].error == 0);
+	assert(batch.results[4].tokens_length == 0);
+
+	assert(batch.results[5].error == 0);
+	assert_same_tokens(&batch.results[5]);
+
+	scallop_lang_batch_free(&batch);
+}
+
+void test_batch_lex(void)
+{
+	check_batch(1);
+	check_batch(4);
+	check_batch(16);
+}
+
+void test_batch_many(void)
+{
+	enum { COUNT = 1000 };
+	static input_t inputs[COUNT];
+	for (size_t i = 0; i < COUNT; i++)
+		inputs[i] = (input_t) {
+			.script = i % 2 ? lit("x y z") : lit("x"),
+		};
+
+	batch_t batch = { 0 };
+	assert(scallop_lang_batch_lex(inputs, COUNT, 8, &batch) == 0);
+	for (size_t i = 0; i < COUNT; i++) {
+		assert(batch.results[i].error == 0);
+		assert(batch.results[i].tokens_length == (i % 2 ? 5 : 1));
+	}
+	scallop_lang_batch_free(&batch);
+
+	assert(scallop_lang_batch_lex(inputs, 0, 8, &batch) == 0);
+	assert(batch.length == 0);
+	scallop_lang_batch_free(&batch);
+}
+
+int main()
+{
+	const int fd = mkstemp(path);
+	assert(fd >= 0);
+	assert(write(fd, "ls -l /;\n", 9) == 9);
+	close(fd);
+
+	test_batch_lex();
+	test_batch_many();
+
+	unlink(path);
+}
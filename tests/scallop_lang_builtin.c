@@ -0,0 +1,199 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include "scallop-lang/builtin.h"
+
+#include <libadt/str.h>
+
+#define lit libadt_str_literal
+#define find scallop_lang_builtin_find
+typedef struct scallop_lang_builtin_context context_t;
+
+static int run(const context_t *context, char *const argv[])
+{
+	size_t argc = 0;
+	while (argv[argc])
+		argc++;
+
+	const struct scallop_lang_builtin *const builtin
+		= scallop_lang_builtin_find_name(argv[0]);
+	assert(builtin);
+	return builtin->run(context, argc, argv);
+}
+
+static context_t pipe_context(int fds[2])
+{
+	assert(pipe(fds) == 0);
+	return (context_t) {
+		.in = -1,
+		.out = fds[1],
+		.err = fds[1],
+	};
+}
+
+static void assert_output(int fd, const char *expected)
+{
+	char buffer[256] = { 0 };
+	const ssize_t amount = read(fd, buffer, sizeof(buffer) - 1);
+	assert(amount == (ssize_t)strlen(expected));
+	assert(strcmp(buffer, expected) == 0);
+}
+
+void test_builtin_find(void)
+{
+	assert(find(lit("echo")) == scallop_lang_builtin_find_name("echo"));
+	assert(find(lit("'ec'ho")) == scallop_lang_builtin_find_name("echo"));
+	assert(find(lit("\"true\"")));
+	assert(!find(lit("echoes")));
+	assert(!find(lit("a_word_longer_than_any_builtin")));
+	assert(!find(lit("ls")));
+}
+
+void test_builtin_true_false(void)
+{
+	const context_t context = { .in = -1, .out = -1, .err = -1 };
+	assert(run(&context, (char *[]) { "true", NULL }) == 0);
+	assert(run(&context, (char *[]) { "false", NULL }) == 1);
+}
+
+void test_builtin_echo(void)
+{
+	int fds[2];
+	const context_t context = pipe_context(fds);
+
+	assert(run(&context, (char *[]) { "echo", "Hello,", "world!", NULL }) == 0);
+	assert_output(fds[0], "Hello, world!\n");
+
+	assert(run(&context, (char *[]) { "echo", "-n", "no", "newline", NULL }) == 0);
+	assert_output(fds[0], "no newline");
+
+	assert(run(&context, (char *[]) { "echo", NULL }) == 0);
+	assert_output(fds[0], "\n");
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+void test_builtin_test(void)
+{
+	int fds[2];
+	const context_t context = pipe_context(fds);
+
+	assert(run(&context, (char *[]) { "test", NULL }) == 1);
+	assert(run(&context, (char *[]) { "test", "word", NULL }) == 0);
+	assert(run(&context, (char *[]) { "test", "", NULL }) == 1);
+	assert(run(&context, (char *[]) { "test", "-n", "word", NULL }) == 0);
+	assert(run(&context, (char *[]) { "test", "-z", "word", NULL }) == 1);
+	assert(run(&context, (char *[]) { "test", "a", "=", "a", NULL }) == 0);
+	assert(run(&context, (char *[]) { "test", "a", "!=", "a", NULL }) == 1);
+	assert(run(&context, (char *[]) { "test", "!", "a", "=", "b", NULL }) == 0);
+	assert(run(&context, (char *[]) { "test", "2", "-lt", "10", NULL }) == 0);
+	assert(run(&context, (char *[]) { "test", "2", "-ge", "10", NULL }) == 1);
+	assert(run(&context, (char *[]) { "test", "-d", "/", NULL }) == 0);
+	assert(run(&context, (char *[]) { "test", "-f", "/", NULL }) == 1);
+	assert(run(&context, (char *[]) { "test", "-e", "/nonexistent/path", NULL }) == 1);
+
+	assert(run(&context, (char *[]) { "test", "a", "-lt", "1", NULL }) == 2);
+	assert_output(fds[0], "test: integer expression expected\n");
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+void test_builtin_cd_pwd(void)
+{
+	int fds[2];
+	const context_t context = pipe_context(fds);
+
+	assert(run(&context, (char *[]) { "cd", "/", NULL }) == 0);
+	assert(run(&context, (char *[]) { "pwd", NULL }) == 0);
+	assert_output(fds[0], "/\n");
+
+	assert(run(&context, (char *[]) { "cd", "/nonexistent/path", NULL }) == 1);
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+static char set_name[16];
+static char set_value[16];
+
+static int set_variable(void *user, const char *name, const char *value)
+{
+	*(int *)user += 1;
+	strcpy(set_name, name);
+	strcpy(set_value, value);
+	return 0;
+}
+
+void test_builtin_set(void)
+{
+	int calls = 0;
+	context_t context = {
+		.in = -1,
+		.out = -1,
+		.err = -1,
+		.set_variable = set_variable,
+		.user = &calls,
+	};
+
+	assert(run(&context, (char *[]) { "set", "name", "value", NULL }) == 0);
+	assert(calls == 1);
+	assert(strcmp(set_name, "name") == 0);
+	assert(strcmp(set_value, "value") == 0);
+
+	context.set_variable = NULL;
+	assert(run(&context, (char *[]) { "set", "name", "value", NULL }) == 1);
+}
+
+void test_builtin_hash(void)
+{
+	int fds[2];
+	context_t context = pipe_context(fds);
+
+	assert(run(&context, (char *[]) { "hash", "-r", NULL }) == 1);
+	assert_output(fds[0], "hash: commands are not cached\n");
+
+	struct scallop_lang_commands commands = { 0 };
+	assert(scallop_lang_commands_init(&commands, NULL) == 0);
+	context.commands = &commands;
+
+	assert(run(&context, (char *[]) { "hash", "sh", NULL }) == 0);
+	assert(run(&context, (char *[]) { "hash", "-r", "sh", NULL }) == 0);
+	assert(run(&context, (char *[]) { "hash", "scallop-missing", NULL }) == 1);
+	assert_output(fds[0], "hash: scallop-missing: not found\n");
+
+	scallop_lang_commands_free(&commands);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+int main()
+{
+	test_builtin_find();
+	test_builtin_true_false();
+	test_builtin_echo();
+	test_builtin_test();
+	test_builtin_cd_pwd();
+	test_builtin_set();
+	test_builtin_hash();
+}
@@ -0,0 +1,186 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "scallop-lang/cache.h"
+
+#include <libadt/str.h>
+
+#define lit libadt_str_literal
+typedef struct scallop_lang_cache cache_t;
+typedef struct scallop_lang_cache_entry entry_t;
+typedef struct scallop_lang_cache_fingerprint fingerprint_t;
+
+static char root[] = "/tmp/scallop-cache-XXXXXX";
+
+static uint64_t statement_hash(struct libadt_const_lptr statement)
+{
+	fingerprint_t fingerprint = scallop_lang_cache_fingerprint_init();
+	assert(scallop_lang_cache_add_statement(&fingerprint, statement) == 0);
+	return fingerprint.hash;
+}
+
+static uint64_t file_hash(const char *path, enum scallop_lang_cache_file_mode mode)
+{
+	fingerprint_t fingerprint = scallop_lang_cache_fingerprint_init();
+	assert(scallop_lang_cache_add_file(&fingerprint, path, mode) == 0);
+	return fingerprint.hash;
+}
+
+static void write_file(const char *path, const char *content)
+{
+	const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	assert(fd >= 0);
+	assert(write(fd, content, strlen(content)) == (ssize_t)strlen(content));
+	close(fd);
+}
+
+void test_cache_statement(void)
+{
+	const uint64_t plain = statement_hash(lit("cc -c main.c"));
+	assert(statement_hash(lit("cc  -c 'main.c' # compile")) == plain);
+	assert(statement_hash(lit("cc -c \"main\".c")) == plain);
+	assert(statement_hash(lit("cc -c main.c2")) != plain);
+	assert(statement_hash(lit("cc -cmain.c")) != plain);
+
+	fingerprint_t fingerprint = scallop_lang_cache_fingerprint_init();
+	assert(scallop_lang_cache_add_statement(&fingerprint, lit("cc 'main")) == -1);
+	assert(errno == EINVAL);
+}
+
+void test_cache_words(void)
+{
+	char *const argv[] = { "cc", "-c", "main.c", NULL };
+	fingerprint_t fingerprint = scallop_lang_cache_fingerprint_init();
+	scallop_lang_cache_add_words(&fingerprint, argv);
+	assert(fingerprint.hash == statement_hash(lit("cc -c 'main.c'")));
+
+	char *const joined[] = { "cc -c", "main.c", NULL };
+	fingerprint = scallop_lang_cache_fingerprint_init();
+	scallop_lang_cache_add_words(&fingerprint, joined);
+	assert(fingerprint.hash != statement_hash(lit("cc -c main.c")));
+}
+
+void test_cache_inputs(void)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "%s/input", root);
+
+	const uint64_t missing = file_hash(path, SCALLOP_LANG_CACHE_STAT);
+	write_file(path, "one");
+	const uint64_t stat_one = file_hash(path, SCALLOP_LANG_CACHE_STAT);
+	const uint64_t content_one = file_hash(path, SCALLOP_LANG_CACHE_CONTENT);
+	assert(stat_one != missing);
+	assert(file_hash(path, SCALLOP_LANG_CACHE_STAT) == stat_one);
+
+	write_file(path, "two");
+	assert(file_hash(path, SCALLOP_LANG_CACHE_CONTENT) != content_one);
+	write_file(path, "one");
+	assert(file_hash(path, SCALLOP_LANG_CACHE_CONTENT) == content_one);
+	unlink(path);
+
+	fingerprint_t a = scallop_lang_cache_fingerprint_init();
+	fingerprint_t b = scallop_lang_cache_fingerprint_init();
+	fingerprint_t c = scallop_lang_cache_fingerprint_init();
+	scallop_lang_cache_add_variable(&a, "CC", "gcc");
+	scallop_lang_cache_add_variable(&b, "CC", "clang");
+	scallop_lang_cache_add_variable(&c, "CC", NULL);
+	assert(a.hash != b.hash);
+	assert(a.hash != c.hash);
+}
+
+void test_cache_store(void)
+{
+	char directory[64];
+	snprintf(directory, sizeof(directory), "%s/cache", root);
+
+	cache_t cache = { 0 };
+	assert(scallop_lang_cache_open(&cache, directory) == 0);
+
+	fingerprint_t fingerprint = scallop_lang_cache_fingerprint_init();
+	assert(scallop_lang_cache_add_statement(&fingerprint, lit("make all")) == 0);
+	entry_t entry = { 0 };
+	assert(scallop_lang_cache_lookup(&cache, fingerprint, &entry) == 0);
+
+	// Failed runs aren't stored
+	entry_t failed = { .status = 1, .out = "x", .out_length = 1 };
+	assert(scallop_lang_cache_store(&cache, fingerprint, &failed) == 0);
+	assert(scallop_lang_cache_lookup(&cache, fingerprint, &entry) == 0);
+
+	entry_t run = {
+		.out = "built\n",
+		.out_length = 6,
+		.err = "warning\n",
+		.err_length = 8,
+	};
+	assert(scallop_lang_cache_store(&cache, fingerprint, &run) == 0);
+	assert(scallop_lang_cache_lookup(&cache, fingerprint, &entry) == 1);
+	assert(entry.status == 0);
+	assert(strcmp(entry.out, "built\n") == 0);
+	assert(strcmp(entry.err, "warning\n") == 0);
+
+	int fds[2];
+	assert(pipe(fds) == 0);
+	assert(scallop_lang_cache_replay(&entry, fds[1], fds[1]) == 0);
+	char replayed[32] = { 0 };
+	assert(read(fds[0], replayed, sizeof(replayed)) == 14);
+	assert(strcmp(replayed, "built\nwarning\n") == 0);
+	close(fds[0]);
+	close(fds[1]);
+	scallop_lang_cache_entry_free(&entry);
+
+	// Another fingerprint with the same hash doesn't get its output
+	fingerprint_t collision = fingerprint;
+	collision.check ^= 1;
+	assert(scallop_lang_cache_lookup(&cache, collision, &entry) == 0);
+
+	// Nor does a damaged entry, whatever lengths it claims
+	char path[128];
+	snprintf(path, sizeof(path), "%s/%016llx", directory, (unsigned long long)fingerprint.hash);
+	const int fd = open(path, O_RDWR);
+	assert(fd >= 0);
+	// out_length follows the magic, status and check
+	const uint64_t huge = UINT64_MAX / 2;
+	assert(pwrite(fd, &huge, sizeof(huge), 24) == sizeof(huge));
+	close(fd);
+	assert(scallop_lang_cache_lookup(&cache, fingerprint, &entry) == 0);
+
+	assert(truncate(path, 10) == 0);
+	assert(scallop_lang_cache_lookup(&cache, fingerprint, &entry) == 0);
+
+	unlink(path);
+	rmdir(directory);
+	scallop_lang_cache_close(&cache);
+}
+
+int main()
+{
+	assert(mkdtemp(root));
+	test_cache_statement();
+	test_cache_words();
+	test_cache_inputs();
+	test_cache_store();
+	rmdir(root);
+}
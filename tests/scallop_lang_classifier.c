@@ -42,6 +42,11 @@
 #define statement_separator scallop_lang_classifier_statement_separator
 #define escape scallop_lang_classifier_escape
 #define line_comment scallop_lang_classifier_line_comment
+#define glob scallop_lang_classifier_glob
+#define variable scallop_lang_classifier_variable
+#define variable_name scallop_lang_classifier_variable_name
+#define double_quote_variable scallop_lang_classifier_double_quote_variable
+#define double_quote_variable_name scallop_lang_classifier_double_quote_variable_name
 
 void default_context_asserts(fn *state)
 {
@@ -52,6 +57,9 @@ void default_context_asserts(fn *state)
 	assert((fn*)state('\'') == single_quote);
 	assert((fn*)state(';') == statement_separator);
 	assert((fn*)state('#') == line_comment);
+	assert((fn*)state('*') == glob);
+	assert((fn*)state('?') == glob);
+	assert((fn*)state('$') == variable);
 	assert((fn*)state(1) == unexpected);
 }
 
@@ -61,6 +69,8 @@ void single_quote_context_asserts(fn *state)
 	assert((fn*)state('\'') == single_quote_end);
 	assert((fn*)state('a') == single_quote_word);
 	assert((fn*)state('"') == single_quote_word);
+	assert((fn*)state('*') == single_quote_word);
+	assert((fn*)state('$') == single_quote_word);
 }
 
 void double_quote_context_asserts(fn *state)
@@ -69,6 +79,8 @@ void double_quote_context_asserts(fn *state)
 	assert((fn*)state('"') == double_quote_end);
 	assert((fn*)state('\'') == double_quote_word);
 	assert((fn*)state('a') == double_quote_word);
+	assert((fn*)state('*') == double_quote_word);
+	assert((fn*)state('$') == double_quote_variable);
 }
 
 void test_word(void)
@@ -145,6 +157,45 @@ void test_escape(void)
 	assert((fn*)escape(WEOF) == unexpected);
 }
 
+void test_glob(void)
+{
+	default_context_asserts(glob);
+	assert((fn*)escape('*') == word);
+}
+
+void test_variable(void)
+{
+	assert((fn*)variable('a') == variable_name);
+	assert((fn*)variable('_') == variable_name);
+	assert((fn*)variable('1') == variable_name);
+	assert((fn*)variable(' ') == unexpected);
+	assert((fn*)variable(WEOF) == unexpected);
+	assert((fn*)escape('$') == word);
+
+	assert((fn*)variable_name('a') == variable_name);
+	assert((fn*)variable_name('_') == variable_name);
+	assert((fn*)variable_name('.') == word);
+	assert((fn*)variable_name(' ') == word_separator);
+	assert((fn*)variable_name('$') == variable);
+	assert((fn*)variable_name(WEOF) == end);
+}
+
+void test_double_quote_variable(void)
+{
+	assert((fn*)double_quote_variable('a') == double_quote_variable_name);
+	// A '$' without a name is literal
+	assert((fn*)double_quote_variable('"') == double_quote_end);
+	assert((fn*)double_quote_variable(' ') == double_quote_word);
+	assert((fn*)double_quote_variable('$') == double_quote_variable);
+	assert((fn*)double_quote_variable(WEOF) == unexpected);
+
+	assert((fn*)double_quote_variable_name('a') == double_quote_variable_name);
+	assert((fn*)double_quote_variable_name(' ') == double_quote_word);
+	assert((fn*)double_quote_variable_name('"') == double_quote_end);
+	assert((fn*)double_quote_variable_name('$') == double_quote_variable);
+	assert((fn*)double_quote_variable_name(WEOF) == unexpected);
+}
+
 void test_line_comment(void)
 {
 	assert((fn*)line_comment('a') == line_comment);
@@ -169,4 +220,7 @@ int main()
 	test_single_quote();
 	test_escape();
 	test_line_comment();
+	test_glob();
+	test_variable();
+	test_double_quote_variable();
 }
@@ -0,0 +1,343 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "scallop-lang/commands.h"
+
+typedef struct scallop_lang_commands commands_t;
+typedef struct scallop_lang_commands_command command_t;
+
+#define find scallop_lang_commands_find
+#define release scallop_lang_commands_release
+
+static char first[] = "/tmp/scallop-commands-XXXXXX";
+static char second[] = "/tmp/scallop-commands-XXXXXX";
+static char path[sizeof(first) + sizeof(second)];
+
+static const char *join(const char *directory, const char *name)
+{
+	static char buffer[256];
+	snprintf(buffer, sizeof(buffer), "%s/%s", directory, name);
+	return buffer;
+}
+
+static void create(const char *directory, const char *name, const char *text, mode_t mode)
+{
+	const int fd = open(join(directory, name), O_WRONLY | O_CREAT | O_TRUNC, mode);
+	assert(fd >= 0);
+	assert(write(fd, text, strlen(text)) == (ssize_t)strlen(text));
+	assert(fchmod(fd, mode) == 0);
+	close(fd);
+}
+
+static void assert_found(commands_t *commands, const char *name, const char *directory)
+{
+	const command_t *const command = find(commands, name);
+	assert(command);
+	assert(command->fd >= 0);
+	assert(strcmp(command->path, join(directory, name)) == 0);
+	release(command);
+}
+
+static void assert_missing(commands_t *commands, const char *name, int error)
+{
+	errno = 0;
+	assert(!find(commands, name));
+	assert(errno == error);
+}
+
+static int run(const command_t *command, char *const argv[])
+{
+	const pid_t pid = fork();
+	assert(pid >= 0);
+	if (pid == 0) {
+		scallop_lang_commands_exec(command, argv, (char *[]) { NULL });
+		_exit(127);
+	}
+
+	int status = 0;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status));
+	return WEXITSTATUS(status);
+}
+
+void test_commands_find(void)
+{
+	create(second, "tool", "#!/bin/sh\nexit 0\n", 0755);
+	create(first, "plain", "not executable\n", 0644);
+
+	commands_t commands = { 0 };
+	assert(scallop_lang_commands_init(&commands, path) == 0);
+
+	assert_found(&commands, "tool", second);
+	assert_missing(&commands, "plain", EACCES);
+	assert_missing(&commands, "missing", ENOENT);
+	assert_missing(&commands, "", EINVAL);
+	assert_missing(&commands, "sub/tool", EINVAL);
+
+	// Cached commands are shared
+	const command_t *const command = find(&commands, "tool");
+	const command_t *const again = find(&commands, "tool");
+	assert(command == again);
+	release(command);
+	release(again);
+
+	scallop_lang_commands_free(&commands);
+	unlink(join(second, "tool"));
+	unlink(join(first, "plain"));
+}
+
+void test_commands_update(void)
+{
+	create(second, "tool", "#!/bin/sh\nexit 0\n", 0755);
+
+	commands_t commands = { 0 };
+	assert(scallop_lang_commands_init(&commands, path) == 0);
+	if (scallop_lang_commands_fd(&commands) < 0) {
+		// inotify isn't available here
+		scallop_lang_commands_free(&commands);
+		unlink(join(second, "tool"));
+		return;
+	}
+
+	assert_found(&commands, "tool", second);
+	assert_missing(&commands, "later", ENOENT);
+
+	// A command created earlier on the path shadows the cached one
+	create(first, "tool", "#!/bin/sh\nexit 0\n", 0755);
+	assert_found(&commands, "tool", second);
+	assert(scallop_lang_commands_update(&commands) == 0);
+	assert_found(&commands, "tool", first);
+
+	// Removing it uncovers the other again
+	unlink(join(first, "tool"));
+	assert(scallop_lang_commands_update(&commands) == 0);
+	assert_found(&commands, "tool", second);
+
+	// Commands that weren't found are forgotten when they appear
+	create(second, "later", "#!/bin/sh\nexit 0\n", 0755);
+	assert(scallop_lang_commands_update(&commands) == 0);
+	assert_found(&commands, "later", second);
+
+	// And when they lose their permissions
+	chmod(join(second, "later"), 0644);
+	assert(scallop_lang_commands_update(&commands) == 0);
+	assert_missing(&commands, "later", EACCES);
+
+	// Updating with nothing to read doesn't block
+	assert(scallop_lang_commands_update(&commands) == 0);
+
+	scallop_lang_commands_free(&commands);
+	unlink(join(second, "tool"));
+	unlink(join(second, "later"));
+}
+
+void test_commands_recreate(void)
+{
+	commands_t commands = { 0 };
+	assert(scallop_lang_commands_init(&commands, path) == 0);
+	if (scallop_lang_commands_fd(&commands) < 0) {
+		scallop_lang_commands_free(&commands);
+		return;
+	}
+
+	// While the first directory is gone, missing commands are
+	// looked up again each time
+	assert(rmdir(first) == 0);
+	assert(scallop_lang_commands_update(&commands) == 0);
+	assert_missing(&commands, "tool", ENOENT);
+
+	assert(mkdir(first, 0700) == 0);
+	create(first, "tool", "#!/bin/sh\nexit 0\n", 0755);
+	assert_found(&commands, "tool", first);
+
+	// It's watched again, so misses are cached and forgotten as
+	// usual
+	assert_missing(&commands, "later", ENOENT);
+	create(first, "later", "#!/bin/sh\nexit 0\n", 0755);
+	assert(scallop_lang_commands_update(&commands) == 0);
+	assert_found(&commands, "later", first);
+
+	// Replacing the directory is noticed by the update
+	unlink(join(first, "tool"));
+	unlink(join(first, "later"));
+	char moved[sizeof(first) + 8];
+	snprintf(moved, sizeof(moved), "%s.moved", first);
+	assert(rename(first, moved) == 0);
+	assert(mkdir(first, 0700) == 0);
+	assert(scallop_lang_commands_update(&commands) == 0);
+	assert_missing(&commands, "other", ENOENT);
+	create(first, "other", "#!/bin/sh\nexit 0\n", 0755);
+	assert(scallop_lang_commands_update(&commands) == 0);
+	assert_found(&commands, "other", first);
+
+	scallop_lang_commands_free(&commands);
+	unlink(join(first, "other"));
+	rmdir(moved);
+}
+
+void test_commands_reset(void)
+{
+	create(second, "tool", "#!/bin/sh\nexit 0\n", 0755);
+
+	commands_t commands = { 0 };
+	assert(scallop_lang_commands_init(&commands, path) == 0);
+	assert_found(&commands, "tool", second);
+
+	create(first, "tool", "#!/bin/sh\nexit 0\n", 0755);
+	scallop_lang_commands_reset(&commands);
+	assert_found(&commands, "tool", first);
+
+	scallop_lang_commands_free(&commands);
+	unlink(join(first, "tool"));
+	unlink(join(second, "tool"));
+}
+
+void test_commands_exec(void)
+{
+	create(first, "script", "#!/bin/sh\nexit 3\n", 0755);
+	create(first, "shell", "exit 4\n", 0755);
+
+	commands_t commands = { 0 };
+	assert(scallop_lang_commands_init(&commands, path) == 0);
+
+	const command_t *command = find(&commands, "script");
+	assert(command);
+	assert(run(command, (char *[]) { "script", NULL }) == 3);
+	release(command);
+
+	// Files without an interpreter line are run by the shell
+	command = find(&commands, "shell");
+	assert(command);
+	assert(run(command, (char *[]) { "shell", NULL }) == 4);
+	release(command);
+
+	scallop_lang_commands_free(&commands);
+
+	// Binaries are run through their descriptor, and commands stay
+	// usable after the cache is freed
+	assert(scallop_lang_commands_init(&commands, NULL) == 0);
+	command = find(&commands, "true");
+	assert(command);
+	scallop_lang_commands_free(&commands);
+	assert(run(command, (char *[]) { "true", NULL }) == 0);
+	release(command);
+
+	unlink(join(first, "script"));
+	unlink(join(first, "shell"));
+}
+
+static int run_prepared(const command_t *command, char *const argv[])
+{
+	const pid_t pid = fork();
+	assert(pid >= 0);
+	if (pid == 0) {
+		scallop_lang_commands_run(command, argv, (char *[]) { NULL });
+		_exit(127);
+	}
+
+	int status = 0;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status));
+	return WEXITSTATUS(status);
+}
+
+void test_commands_prepare(void)
+{
+	create(first, "script", "#!/bin/sh\nexit 3\n", 0755);
+
+	commands_t commands = { 0 };
+	assert(scallop_lang_commands_init(&commands, path) == 0);
+
+	char *const script[] = { "script", NULL };
+	const command_t *command = scallop_lang_commands_prepare(&commands, script);
+	assert(command);
+	assert(run_prepared(command, script) == 3);
+	release(command);
+
+	// Without a command, the child searches $PATH itself
+	assert(!scallop_lang_commands_prepare(NULL, script));
+	char *const absolute[] = { "/bin/sh", "-c", "exit 5", NULL };
+	assert(!scallop_lang_commands_prepare(&commands, absolute));
+	assert(run_prepared(NULL, absolute) == 5);
+
+	char *const missing[] = { "missing", NULL };
+	assert(!scallop_lang_commands_prepare(&commands, missing));
+	assert(run_prepared(NULL, missing) == 127);
+	release(NULL);
+
+	scallop_lang_commands_free(&commands);
+	unlink(join(first, "script"));
+}
+
+static void *find_repeatedly(void *commands)
+{
+	for (int i = 0; i < 2000; i++) {
+		const command_t *const command = find(commands, "tool");
+		assert(command);
+		assert(command->fd >= 0);
+		release(command);
+	}
+	return NULL;
+}
+
+void test_commands_threads(void)
+{
+	create(second, "tool", "#!/bin/sh\nexit 0\n", 0755);
+
+	commands_t commands = { 0 };
+	assert(scallop_lang_commands_init(&commands, path) == 0);
+
+	pthread_t threads[4];
+	for (size_t i = 0; i < sizeof(threads) / sizeof(*threads); i++)
+		assert(pthread_create(&threads[i], NULL, find_repeatedly, &commands) == 0);
+	for (int i = 0; i < 200; i++)
+		scallop_lang_commands_reset(&commands);
+	for (size_t i = 0; i < sizeof(threads) / sizeof(*threads); i++)
+		pthread_join(threads[i], NULL);
+
+	scallop_lang_commands_free(&commands);
+	unlink(join(second, "tool"));
+}
+
+int main()
+{
+	assert(mkdtemp(first));
+	assert(mkdtemp(second));
+	snprintf(path, sizeof(path), "%s:%s", first, second);
+
+	test_commands_find();
+	test_commands_update();
+	test_commands_recreate();
+	test_commands_reset();
+	test_commands_exec();
+	test_commands_prepare();
+	test_commands_threads();
+
+	rmdir(first);
+	rmdir(second);
+}
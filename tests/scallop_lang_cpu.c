@@ -0,0 +1,153 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scallop-lang/cpu.h"
+#include "scallop-lang/lex.h"
+
+#include <libadt/str.h>
+
+#define lit libadt_str_literal
+typedef enum scallop_lang_cpu_tier tier_t;
+
+#define BUFFER_SIZE 300
+
+static const char alphabet[] = "aZ09-_.:/'\"$ \t\r\n\\#*{}\x01\x7f\x80\xc3\xa9";
+
+static void fill(char *buffer, size_t length, unsigned seed, size_t stop)
+{
+	srand(seed);
+	for (size_t i = 0; i < length; i++) {
+		// Mostly word characters, so runs cross block boundaries
+		buffer[i] = rand() % 8 ? "abcXYZ019-_./:"[rand() % 14] : alphabet[rand() % (sizeof(alphabet) - 1)];
+	}
+	if (stop < length)
+		buffer[stop] = '\0';
+}
+
+/*
+ * Checks every kernel of the current tier against the generic
+ * tier, at every offset and length.
+ */
+static void check_kernels(const char *buffer)
+{
+	const struct scallop_lang_cpu_kernels tier = scallop_lang_cpu;
+	assert(scallop_lang_cpu_select(SCALLOP_LANG_CPU_GENERIC) == 0);
+	const struct scallop_lang_cpu_kernels generic = scallop_lang_cpu;
+	scallop_lang_cpu = tier;
+
+	static const char stops[][2] = { { '\'', '\'' }, { '"', '$' }, { '\r', '\n' } };
+	for (size_t offset = 0; offset < 70; offset++) {
+		for (size_t length = 0; offset + length <= BUFFER_SIZE; length += 1 + length / 8) {
+			const char *const text = buffer + offset;
+			assert(tier.word_length(text, length) == generic.word_length(text, length));
+			assert(tier.name_length(text, length) == generic.name_length(text, length));
+			for (size_t i = 0; i < sizeof(stops) / sizeof(*stops); i++)
+				assert(
+					tier.scan(text, length, stops[i][0], stops[i][1])
+					== generic.scan(text, length, stops[i][0], stops[i][1])
+				);
+		}
+	}
+}
+
+void test_cpu_kernels(void)
+{
+	static char buffer[BUFFER_SIZE];
+	for (tier_t tier = SCALLOP_LANG_CPU_GENERIC; tier <= scallop_lang_cpu_supported(); tier++) {
+		assert(scallop_lang_cpu_select(tier) == 0);
+		assert(scallop_lang_cpu.tier == tier);
+		for (unsigned seed = 0; seed < 20; seed++) {
+			fill(buffer, sizeof(buffer), seed, seed % 2 ? (size_t)rand() % BUFFER_SIZE : BUFFER_SIZE);
+			check_kernels(buffer);
+		}
+
+		// Long runs, which only stop at the end or at a stop
+		memset(buffer, 'w', sizeof(buffer));
+		assert(scallop_lang_cpu.word_length(buffer, sizeof(buffer)) == sizeof(buffer));
+		assert(scallop_lang_cpu.scan(buffer, sizeof(buffer), '"', '$') == sizeof(buffer));
+		buffer[200] = '$';
+		assert(scallop_lang_cpu.scan(buffer, sizeof(buffer), '"', '$') == 200);
+		buffer[100] = (char)0xc3;
+		assert(scallop_lang_cpu.word_length(buffer, sizeof(buffer)) == 100);
+		assert(scallop_lang_cpu.scan(buffer, sizeof(buffer), '"', '$') == 100);
+		buffer[60] = '\0';
+		assert(scallop_lang_cpu.name_length(buffer, sizeof(buffer)) == 60);
+	}
+}
+
+void test_cpu_select(void)
+{
+	const tier_t supported = scallop_lang_cpu_supported();
+	assert(scallop_lang_cpu_select(SCALLOP_LANG_CPU_GENERIC) == 0);
+	if (supported < SCALLOP_LANG_CPU_AVX512)
+		assert(scallop_lang_cpu_select(SCALLOP_LANG_CPU_AVX512) == -1);
+	assert(scallop_lang_cpu_select((tier_t)99) == -1);
+
+	assert(strcmp(scallop_lang_cpu_tier_name(SCALLOP_LANG_CPU_SSE42), "sse4.2") == 0);
+	assert(strcmp(scallop_lang_cpu_tier_name((tier_t)99), "unknown") == 0);
+}
+
+static size_t token_count(struct libadt_const_lptr script, size_t *bytes)
+{
+	size_t count = 0;
+	*bytes = 0;
+	struct scallop_lang_lex token = scallop_lang_lex_init(script);
+	for (;;) {
+		token = scallop_lang_lex_next(token);
+		count++;
+		*bytes += (size_t)token.value.length;
+		if (
+			token.type == scallop_lang_classifier_end
+			|| token.type == scallop_lang_classifier_unexpected
+		)
+			return count;
+	}
+}
+
+void test_cpu_lex(void)
+{
+	// Long enough for every kernel to take whole blocks
+	const struct libadt_const_lptr script = lit(
+		"/usr/local/bin/some-really-long-command-name_with.dots:and/slashes "
+		"'a single quoted string long enough to cross a sixty-four byte block' "
+		"\"a double quoted string with a $variable_name_that_is_quite_long in it\" "
+		"# and a comment that runs for quite a while before reaching the newline\n"
+		"echo $another_long_variable_name_for_the_name_kernel_to_consume\n"
+	);
+
+	assert(scallop_lang_cpu_select(SCALLOP_LANG_CPU_GENERIC) == 0);
+	size_t bytes = 0;
+	const size_t expected = token_count(script, &bytes);
+	assert(bytes == (size_t)script.length);
+
+	for (tier_t tier = SCALLOP_LANG_CPU_SSE2; tier <= scallop_lang_cpu_supported(); tier++) {
+		assert(scallop_lang_cpu_select(tier) == 0);
+		assert(token_count(script, &bytes) == expected);
+		assert(bytes == (size_t)script.length);
+	}
+}
+
+int main()
+{
+	test_cpu_kernels();
+	test_cpu_select();
+	test_cpu_lex();
+}
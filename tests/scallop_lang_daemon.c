@@ -0,0 +1,282 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "scallop-lang/daemon.h"
+#include "scallop-lang/lex.h"
+
+typedef struct scallop_lang_daemon_cache cache_t;
+typedef struct scallop_lang_daemon_request request_t;
+typedef struct scallop_lang_daemon_script script_t;
+
+static char root[] = "/tmp/scallop-daemon-XXXXXX";
+
+static void write_file(const char *path, const char *content)
+{
+	const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	assert(fd >= 0);
+	assert(write(fd, content, strlen(content)) == (ssize_t)strlen(content));
+	close(fd);
+}
+
+void test_daemon_request(void)
+{
+	int sockets[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+
+	int pipes[2];
+	assert(pipe(pipes) == 0);
+	const int cwd = open(root, O_RDONLY);
+	assert(cwd >= 0);
+
+	char *argv[] = { "scallop-lex", "-f", "ndjson", "script", NULL };
+	char *envp[] = { "LANG=C.UTF-8", "EMPTY=", NULL };
+	const int fds[SCALLOP_LANG_DAEMON_FDS] = { pipes[0], pipes[1], pipes[1] };
+	assert(scallop_lang_daemon_send_request(sockets[0], argv, envp, root, cwd, fds) == 0);
+
+	request_t request = { 0 };
+	assert(scallop_lang_daemon_receive_request(sockets[1], &request) == 0);
+	assert(request.argc == 4);
+	for (size_t i = 0; i < 4; i++)
+		assert(strcmp(request.argv[i], argv[i]) == 0);
+	assert(!request.argv[4]);
+	assert(strcmp(request.envp[0], "LANG=C.UTF-8") == 0);
+	assert(strcmp(request.envp[1], "EMPTY=") == 0);
+	assert(!request.envp[2]);
+	assert(strcmp(request.cwd, root) == 0);
+
+	// The received descriptors refer to the same files
+	struct stat sent = { 0 };
+	struct stat received = { 0 };
+	assert(fstat(cwd, &sent) == 0 && fstat(request.cwd_fd, &received) == 0);
+	assert(sent.st_ino == received.st_ino);
+	assert(write(request.fds[1], "x", 1) == 1);
+	char byte = 0;
+	assert(read(pipes[0], &byte, 1) == 1 && byte == 'x');
+
+	scallop_lang_daemon_request_free(&request);
+
+	int status = 0;
+	assert(scallop_lang_daemon_send_status(sockets[1], 3) == 0);
+	assert(scallop_lang_daemon_receive_status(sockets[0], &status) == 0);
+	assert(status == 3);
+
+	// A closed connection is an error, not an empty request
+	close(sockets[0]);
+	assert(scallop_lang_daemon_receive_request(sockets[1], &request) == -1);
+
+	close(sockets[1]);
+	close(pipes[0]);
+	close(pipes[1]);
+	close(cwd);
+}
+
+void test_daemon_request_fds(void)
+{
+	int sockets[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+	int pipes[2];
+	assert(pipe(pipes) == 0);
+	assert(fcntl(pipes[0], F_SETFL, O_NONBLOCK) == 0);
+
+	// A request passing the wrong number of descriptors...
+	char byte = 0;
+	union {
+		struct cmsghdr header;
+		char buffer[CMSG_SPACE(sizeof(int))];
+	} control = { 0 };
+	struct iovec vector = { .iov_base = &byte, .iov_len = 1 };
+	struct msghdr message = {
+		.msg_iov = &vector,
+		.msg_iovlen = 1,
+		.msg_control = control.buffer,
+		.msg_controllen = sizeof(control.buffer),
+	};
+	struct cmsghdr *const cmsg = CMSG_FIRSTHDR(&message);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &pipes[1], sizeof(int));
+	assert(sendmsg(sockets[0], &message, 0) == 1);
+	close(pipes[1]);
+	close(sockets[0]);
+
+	request_t request = { 0 };
+	assert(scallop_lang_daemon_receive_request(sockets[1], &request) == -1);
+
+	// ...is rejected without keeping them open
+	assert(read(pipes[0], &byte, 1) == 0);
+
+	close(sockets[1]);
+	close(pipes[0]);
+}
+
+void test_daemon_cache(void)
+{
+	char path[64];
+	char link[64];
+	snprintf(path, sizeof(path), "%s/script", root);
+	snprintf(link, sizeof(link), "%s/link", root);
+	write_file(path, "echo 'hi'; ls\n");
+	assert(symlink(path, link) == 0);
+
+	cache_t cache = { 0 };
+	assert(scallop_lang_daemon_cache_init(&cache) == 0);
+
+	int fd = open(path, O_RDONLY);
+	const script_t *const first = scallop_lang_daemon_cache_get(&cache, fd, false);
+	close(fd);
+	assert(first);
+	assert(first->script.length == 14);
+	assert(first->tokens_length == 7);
+	assert(first->tokens[0].type == scallop_lang_classifier_word);
+	assert(first->tokens[0].offset == 0 && first->tokens[0].length == 4);
+	assert(first->tokens[6].type == scallop_lang_classifier_end);
+
+	// Another path to the same file is a hit
+	fd = open(link, O_RDONLY);
+	const script_t *const second = scallop_lang_daemon_cache_get(&cache, fd, false);
+	close(fd);
+	assert(second == first);
+
+	// Raw tokens are kept separately
+	fd = open(path, O_RDONLY);
+	const script_t *const raw = scallop_lang_daemon_cache_get(&cache, fd, true);
+	close(fd);
+	assert(raw && raw != first);
+	assert(raw->tokens_length > first->tokens_length);
+
+	// A changed file is lexed again, while the old script stays
+	// valid until it's released
+	write_file(path, "echo 'unterminated\n");
+	const struct timeval times[2] = { { .tv_sec = 1 }, { .tv_sec = 1 } };
+	assert(utimes(path, times) == 0);
+	fd = open(path, O_RDONLY);
+	const script_t *const changed = scallop_lang_daemon_cache_get(&cache, fd, false);
+	close(fd);
+	assert(changed && changed != first);
+	assert(changed->tokens[changed->tokens_length - 1].type == scallop_lang_classifier_unexpected);
+	assert(first->tokens[6].type == scallop_lang_classifier_end);
+
+	// Only regular files are cached
+	fd = open(root, O_RDONLY);
+	assert(!scallop_lang_daemon_cache_get(&cache, fd, false));
+	close(fd);
+
+	scallop_lang_daemon_cache_release(&cache, first);
+	scallop_lang_daemon_cache_release(&cache, second);
+	scallop_lang_daemon_cache_release(&cache, raw);
+	scallop_lang_daemon_cache_release(&cache, changed);
+	scallop_lang_daemon_cache_free(&cache);
+
+	unlink(link);
+	unlink(path);
+}
+
+static const script_t *get(cache_t *cache, const char *path)
+{
+	const int fd = open(path, O_RDONLY);
+	assert(fd >= 0);
+	const script_t *const script = scallop_lang_daemon_cache_get(cache, fd, false);
+	close(fd);
+	assert(script);
+	return script;
+}
+
+static bool cached(const cache_t *cache, const char *path)
+{
+	struct stat info = { 0 };
+	assert(stat(path, &info) == 0);
+	for (size_t i = 0; i < cache->_scripts_length; i++)
+		if (cache->_scripts[i]->_inode == info.st_ino)
+			return true;
+	return false;
+}
+
+void test_daemon_cache_bounded(void)
+{
+	char paths[6][64];
+	for (size_t i = 0; i < 6; i++) {
+		snprintf(paths[i], sizeof(paths[i]), "%s/bounded%zu", root, i);
+		write_file(paths[i], "echo 'hi'; ls\n");
+	}
+
+	cache_t cache = { 0 };
+	assert(scallop_lang_daemon_cache_init(&cache) == 0);
+	assert(cache.max_scripts == SCALLOP_LANG_DAEMON_CACHE_SCRIPTS);
+	cache.max_scripts = 2;
+
+	// The least recently used script is dropped
+	scallop_lang_daemon_cache_release(&cache, get(&cache, paths[0]));
+	scallop_lang_daemon_cache_release(&cache, get(&cache, paths[1]));
+	scallop_lang_daemon_cache_release(&cache, get(&cache, paths[0]));
+	scallop_lang_daemon_cache_release(&cache, get(&cache, paths[2]));
+	assert(cache._scripts_length == 2);
+	assert(cached(&cache, paths[0]));
+	assert(!cached(&cache, paths[1]));
+	assert(cached(&cache, paths[2]));
+
+	// Scripts in use are kept until they're released
+	const script_t *held[6];
+	for (size_t i = 0; i < 6; i++)
+		held[i] = get(&cache, paths[i]);
+	assert(cache._scripts_length == 6);
+	for (size_t i = 0; i < 6; i++) {
+		assert(held[i]->tokens_length == 7);
+		scallop_lang_daemon_cache_release(&cache, held[i]);
+		assert(cache._scripts_length == (i < 3 ? 5 - i : 2));
+	}
+	assert(cache._scripts_length == 2);
+	assert(cached(&cache, paths[4]) && cached(&cache, paths[5]));
+
+	// The bytes are limited too, and a script over the limit
+	// isn't cached at all
+	const size_t bytes = cache._bytes / 2;
+	cache.max_scripts = SCALLOP_LANG_DAEMON_CACHE_SCRIPTS;
+	cache.max_bytes = bytes;
+	scallop_lang_daemon_cache_release(&cache, get(&cache, paths[0]));
+	assert(cache._scripts_length == 1 && cache._bytes == bytes);
+	assert(cached(&cache, paths[0]));
+
+	cache.max_bytes = bytes - 1;
+	const script_t *const large = get(&cache, paths[1]);
+	assert(!cached(&cache, paths[1]));
+	scallop_lang_daemon_cache_release(&cache, large);
+	assert(cache._scripts_length == 0 && cache._bytes == 0);
+
+	scallop_lang_daemon_cache_free(&cache);
+	for (size_t i = 0; i < 6; i++)
+		unlink(paths[i]);
+}
+
+int main()
+{
+	assert(mkdtemp(root));
+	test_daemon_request();
+	test_daemon_request_fds();
+	test_daemon_cache();
+	test_daemon_cache_bounded();
+	rmdir(root);
+}
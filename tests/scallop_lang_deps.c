@@ -0,0 +1,347 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+#include "scallop-lang/deps.h"
+
+#include <libadt/str.h>
+
+#define lit libadt_str_literal
+typedef struct scallop_lang_deps deps_t;
+typedef struct scallop_lang_deps_command command_t;
+
+static const command_t command_array[] = {
+	{ "cat", "r*" },
+	{ "cp", "r*w" },
+	{ "touch", "w*" },
+	{ "rm", "w*" },
+	{ "sort", "rw" },
+	{ "echo", "" },
+	{ "set", "V-" },
+	{ "print", "v*" },
+};
+
+static const struct libadt_const_lptr commands = {
+	.buffer = command_array,
+	.size = sizeof(command_array[0]),
+	.length = sizeof(command_array) / sizeof(command_array[0]),
+};
+
+static bool depends_on(const deps_t *deps, size_t statement, size_t on)
+{
+	const struct scallop_lang_deps_statement *const s
+		= &deps->statements[statement];
+	for (size_t i = 0; i < s->predecessors_length; i++)
+		if (s->predecessors[i] == on)
+			return true;
+	return false;
+}
+
+void test_deps_independent(void)
+{
+	deps_t deps = { 0 };
+	assert(scallop_lang_deps_analyze(
+		lit("cp a b; cp c d\necho hi"),
+		commands,
+		NULL,
+		&deps
+	) == 0);
+
+	assert(deps.statements_length == 3);
+	assert(deps.groups_length == 1);
+	assert(deps.critical_path == 1);
+	assert(deps.total_cost == 3);
+	assert(deps.statements[1].value.length == sizeof("cp c d") - 1);
+
+	scallop_lang_deps_free(&deps);
+}
+
+void test_deps_files(void)
+{
+	deps_t deps = { 0 };
+	assert(scallop_lang_deps_analyze(
+		lit(
+			"cp a b\n"
+			"cat ./b\n"
+			"cat a\n"
+			"touch dir\n"
+			"cat 'dir/file'\n"
+			"sort dir/x /abs/y\n"
+		),
+		commands,
+		NULL,
+		&deps
+	) == 0);
+
+	assert(deps.statements_length == 6);
+	assert(depends_on(&deps, 1, 0));
+	assert(!depends_on(&deps, 2, 0));
+	assert(!depends_on(&deps, 2, 1));
+	assert(depends_on(&deps, 4, 3));
+	assert(!depends_on(&deps, 4, 0));
+	// relative and absolute names may overlap without a cwd
+	assert(depends_on(&deps, 5, 0));
+	assert(depends_on(&deps, 5, 3));
+
+	assert(deps.groups_length == 3);
+	assert(deps.critical_path == 3);
+
+	scallop_lang_deps_free(&deps);
+}
+
+void test_deps_cwd(void)
+{
+	deps_t deps = { 0 };
+	assert(scallop_lang_deps_analyze(
+		lit("touch /work/a; cat a; cat /elsewhere/a"),
+		commands,
+		"/work",
+		&deps
+	) == 0);
+
+	assert(strcmp(deps.statements[1].accesses[0].name, "/work/a") == 0);
+	assert(depends_on(&deps, 1, 0));
+	assert(!depends_on(&deps, 2, 0));
+
+	scallop_lang_deps_free(&deps);
+}
+
+void test_deps_variables(void)
+{
+	deps_t deps = { 0 };
+	assert(scallop_lang_deps_analyze(
+		lit("set x 1; print y; print x; set y 2"),
+		commands,
+		NULL,
+		&deps
+	) == 0);
+
+	assert(!depends_on(&deps, 1, 0));
+	assert(depends_on(&deps, 2, 0));
+	assert(depends_on(&deps, 3, 1));
+	assert(!depends_on(&deps, 3, 2));
+
+	scallop_lang_deps_free(&deps);
+}
+
+void test_deps_opaque(void)
+{
+	deps_t deps = { 0 };
+	assert(scallop_lang_deps_analyze(
+		lit(
+			"cat a\n"
+			"unknown a\n"
+			"cat b\n"
+			"cat [echo c]\n"
+			"{\n\tcat d; cat e\n}\n"
+		),
+		commands,
+		NULL,
+		&deps
+	) == 0);
+
+	assert(deps.statements_length == 5);
+	assert(deps.statements[1].opaque);
+	assert(depends_on(&deps, 1, 0));
+	assert(depends_on(&deps, 2, 1));
+	assert(deps.statements[3].opaque);
+	assert(deps.statements[4].opaque);
+	assert(deps.groups_length == 5);
+
+	scallop_lang_deps_free(&deps);
+}
+
+void test_deps_variable_words(void)
+{
+	deps_t deps = { 0 };
+	assert(scallop_lang_deps_analyze(
+		lit("cat a; rm $F; cat b; rm \"dir/$F\"; rm '$F'"),
+		commands,
+		NULL,
+		&deps
+	) == 0);
+
+	// $F could name a, so rm can't move past cat
+	assert(deps.statements[1].opaque);
+	assert(depends_on(&deps, 1, 0));
+	assert(depends_on(&deps, 2, 1));
+	assert(deps.statements[3].opaque);
+	assert(!deps.statements[4].opaque);
+	assert(strcmp(deps.statements[4].accesses[0].name, "$F") == 0);
+
+	scallop_lang_deps_free(&deps);
+}
+
+void test_deps_glob_words(void)
+{
+	deps_t deps = { 0 };
+	assert(scallop_lang_deps_analyze(
+		lit("cp main.o bin; touch *.o; cat a*; cat 'b*' \\*"),
+		commands,
+		NULL,
+		&deps
+	) == 0);
+
+	// *.o could match main.o, so touch has to wait for cp
+	assert(deps.statements[1].opaque);
+	assert(depends_on(&deps, 1, 0));
+	assert(deps.statements[2].opaque);
+	assert(depends_on(&deps, 2, 1));
+	assert(!deps.statements[3].opaque);
+	assert(strcmp(deps.statements[3].accesses[0].name, "b*") == 0);
+	assert(strcmp(deps.statements[3].accesses[1].name, "*") == 0);
+
+	scallop_lang_deps_free(&deps);
+}
+
+void test_deps_schedule_costs(void)
+{
+	deps_t deps = { 0 };
+	assert(scallop_lang_deps_analyze(
+		lit("cp a b; cat b; touch c"),
+		commands,
+		NULL,
+		&deps
+	) == 0);
+
+	assert(deps.groups_length == 2);
+	assert(deps.groups[0] == 0);
+	assert(deps.groups[1] == 2);
+	assert(deps.groups[2] == 3);
+	assert(deps.order[0] == 0);
+	assert(deps.order[1] == 2);
+	assert(deps.order[2] == 1);
+
+	const double costs[] = { 2, 3, 10 };
+	scallop_lang_deps_schedule(&deps, costs);
+	assert(deps.critical_path == 10);
+	assert(deps.statements[1].finish == 5);
+	assert(deps.total_cost == 15);
+	assert(deps.statements[0].remaining == 5);
+	assert(deps.statements[1].remaining == 3);
+	assert(deps.statements[2].remaining == 10);
+
+	scallop_lang_deps_free(&deps);
+}
+
+void test_deps_place(void)
+{
+	deps_t deps = { 0 };
+	assert(scallop_lang_deps_analyze(
+		lit("touch a; touch b; touch c; cat a b c; touch d"),
+		commands,
+		NULL,
+		&deps
+	) == 0);
+
+	assert(scallop_lang_deps_place(&deps, 0) == -1);
+
+	assert(scallop_lang_deps_place(&deps, 1) == 0);
+	assert(deps.makespan == deps.total_cost);
+
+	assert(scallop_lang_deps_place(&deps, 8) == 0);
+	assert(deps.makespan == deps.critical_path);
+
+	assert(scallop_lang_deps_place(&deps, 2) == 0);
+	assert(deps.makespan == 3);
+	assert(deps.statements[0].start == 0);
+	assert(deps.statements[1].start == 0);
+	assert(deps.statements[0].worker != deps.statements[1].worker);
+	assert(deps.statements[2].start == 1);
+	// touch d is runnable before cat, which waits for touch c
+	assert(deps.statements[4].start == 1);
+	assert(deps.statements[3].start == 2);
+
+	scallop_lang_deps_free(&deps);
+}
+
+void test_deps_place_critical(void)
+{
+	deps_t deps = { 0 };
+	assert(scallop_lang_deps_analyze(
+		lit("touch a; touch b; touch c; touch d; touch e"),
+		commands,
+		NULL,
+		&deps
+	) == 0);
+	const double costs[] = { 1, 1, 1, 1, 4 };
+	scallop_lang_deps_schedule(&deps, costs);
+
+	assert(scallop_lang_deps_place_critical(&deps, 0) == -1);
+
+	// In order, the long statement starts last and runs alone
+	assert(scallop_lang_deps_place(&deps, 2) == 0);
+	assert(deps.makespan == 6);
+
+	assert(scallop_lang_deps_place_critical(&deps, 2) == 0);
+	assert(deps.makespan == 4);
+	assert(deps.statements[4].start == 0);
+	for (size_t i = 0; i < 4; i++)
+		assert(deps.statements[i].worker != deps.statements[4].worker);
+
+	scallop_lang_deps_free(&deps);
+
+	// A short statement holding up a long one goes first
+	assert(scallop_lang_deps_analyze(
+		lit("touch a; touch b; cat a; touch c"),
+		commands,
+		NULL,
+		&deps
+	) == 0);
+	const double chain_costs[] = { 1, 3, 5, 2 };
+	scallop_lang_deps_schedule(&deps, chain_costs);
+	assert(deps.statements[0].remaining == 6);
+
+	assert(scallop_lang_deps_place_critical(&deps, 1) == 0);
+	assert(deps.statements[0].start == 0);
+	assert(deps.makespan == deps.total_cost);
+
+	assert(scallop_lang_deps_place_critical(&deps, 2) == 0);
+	assert(deps.makespan == 6);
+
+	scallop_lang_deps_free(&deps);
+}
+
+void test_deps_errors(void)
+{
+	deps_t deps = { 0 };
+	assert(scallop_lang_deps_analyze(lit("cat 'a"), commands, NULL, &deps) == -1);
+	assert(scallop_lang_deps_analyze(lit("{ cat a"), commands, NULL, &deps) == -1);
+	assert(scallop_lang_deps_analyze(lit("cat a }"), commands, NULL, &deps) == -1);
+	assert(scallop_lang_deps_analyze(lit(""), commands, NULL, &deps) == 0);
+	assert(deps.statements_length == 0);
+	assert(deps.groups_length == 0);
+	scallop_lang_deps_free(&deps);
+}
+
+int main()
+{
+	test_deps_independent();
+	test_deps_files();
+	test_deps_cwd();
+	test_deps_variables();
+	test_deps_opaque();
+	test_deps_variable_words();
+	test_deps_glob_words();
+	test_deps_schedule_costs();
+	test_deps_place();
+	test_deps_place_critical();
+	test_deps_errors();
+}
@@ -0,0 +1,218 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "scallop-lang/env.h"
+
+typedef struct scallop_lang_env env_t;
+
+#define MANY 5000
+
+// Two names with the same hash, so they share a leaf chain
+#define COLLIDING_A "VU948"
+#define COLLIDING_B "V18PA"
+
+static bool envp_has(char *const *envp, const char *pair)
+{
+	for (; *envp; envp++)
+		if (strcmp(*envp, pair) == 0)
+			return true;
+	return false;
+}
+
+static size_t envp_length(char *const *envp)
+{
+	size_t length = 0;
+	while (envp[length])
+		length++;
+	return length;
+}
+
+void test_env_init(void)
+{
+	char *const envp[] = { "HOME=/home/user", "invalid", "=empty", "A=1", "A=2", NULL };
+	env_t env = { 0 };
+	assert(scallop_lang_env_init(&env, envp) == 0);
+
+	assert(scallop_lang_env_length(&env) == 2);
+	assert(strcmp(scallop_lang_env_get(&env, "HOME"), "/home/user") == 0);
+	assert(strcmp(scallop_lang_env_get(&env, "A"), "2") == 0);
+	assert(scallop_lang_env_get(&env, "invalid") == NULL);
+	scallop_lang_env_free(&env);
+
+	assert(scallop_lang_env_init(&env, NULL) == 0);
+	assert(scallop_lang_env_length(&env) == 0);
+	assert(envp_length(scallop_lang_env_envp(&env)) == 0);
+	scallop_lang_env_free(&env);
+}
+
+void test_env_set_unset(void)
+{
+	env_t env = { 0 };
+	assert(scallop_lang_env_init(&env, NULL) == 0);
+
+	assert(scallop_lang_env_set(&env, "NAME", "value") == 0);
+	assert(scallop_lang_env_set(&env, "NAME", "other") == 0);
+	assert(scallop_lang_env_length(&env) == 1);
+	assert(strcmp(scallop_lang_env_get(&env, "NAME"), "other") == 0);
+
+	errno = 0;
+	assert(scallop_lang_env_set(&env, "A=B", "value") == -1);
+	assert(errno == EINVAL);
+	assert(scallop_lang_env_set(&env, "", "value") == -1);
+
+	assert(scallop_lang_env_unset(&env, "MISSING") == 0);
+	assert(scallop_lang_env_unset(&env, "NAME") == 0);
+	assert(scallop_lang_env_get(&env, "NAME") == NULL);
+	assert(scallop_lang_env_length(&env) == 0);
+	scallop_lang_env_free(&env);
+}
+
+void test_env_fork(void)
+{
+	env_t parent = { 0 };
+	assert(scallop_lang_env_init(&parent, NULL) == 0);
+	assert(scallop_lang_env_set(&parent, "SHARED", "1") == 0);
+
+	env_t child = { 0 };
+	scallop_lang_env_fork(&parent, &child);
+	assert(scallop_lang_env_set(&child, "SHARED", "2") == 0);
+	assert(scallop_lang_env_set(&child, "CHILD", "yes") == 0);
+	assert(scallop_lang_env_unset(&parent, "SHARED") == 0);
+
+	assert(scallop_lang_env_get(&parent, "SHARED") == NULL);
+	assert(scallop_lang_env_get(&parent, "CHILD") == NULL);
+	assert(strcmp(scallop_lang_env_get(&child, "SHARED"), "2") == 0);
+	assert(strcmp(scallop_lang_env_get(&child, "CHILD"), "yes") == 0);
+
+	// The child outlives the scope it was forked from
+	scallop_lang_env_free(&parent);
+	assert(strcmp(scallop_lang_env_get(&child, "SHARED"), "2") == 0);
+	scallop_lang_env_free(&child);
+}
+
+void test_env_many(void)
+{
+	env_t env = { 0 };
+	assert(scallop_lang_env_init(&env, NULL) == 0);
+
+	char name[32], value[32];
+	for (int i = 0; i < MANY; i++) {
+		snprintf(name, sizeof(name), "VARIABLE_%d", i);
+		snprintf(value, sizeof(value), "%d", i * 7);
+		assert(scallop_lang_env_set(&env, name, value) == 0);
+	}
+	assert(scallop_lang_env_length(&env) == MANY);
+
+	env_t fork = { 0 };
+	scallop_lang_env_fork(&env, &fork);
+	for (int i = 0; i < MANY; i += 2) {
+		snprintf(name, sizeof(name), "VARIABLE_%d", i);
+		assert(scallop_lang_env_unset(&fork, name) == 0);
+	}
+	assert(scallop_lang_env_length(&fork) == MANY / 2);
+
+	for (int i = 0; i < MANY; i++) {
+		snprintf(name, sizeof(name), "VARIABLE_%d", i);
+		snprintf(value, sizeof(value), "%d", i * 7);
+		assert(strcmp(scallop_lang_env_get(&env, name), value) == 0);
+		if (i % 2)
+			assert(strcmp(scallop_lang_env_get(&fork, name), value) == 0);
+		else
+			assert(scallop_lang_env_get(&fork, name) == NULL);
+	}
+
+	assert(envp_length(scallop_lang_env_envp(&env)) == MANY);
+	assert(envp_length(scallop_lang_env_envp(&fork)) == MANY / 2);
+	assert(envp_has(scallop_lang_env_envp(&fork), "VARIABLE_1=7"));
+
+	for (int i = 1; i < MANY; i += 2) {
+		snprintf(name, sizeof(name), "VARIABLE_%d", i);
+		assert(scallop_lang_env_unset(&fork, name) == 0);
+	}
+	assert(scallop_lang_env_length(&fork) == 0);
+	assert(envp_length(scallop_lang_env_envp(&fork)) == 0);
+
+	scallop_lang_env_free(&fork);
+	scallop_lang_env_free(&env);
+}
+
+void test_env_collisions(void)
+{
+	env_t env = { 0 };
+	assert(scallop_lang_env_init(&env, NULL) == 0);
+	assert(scallop_lang_env_set(&env, COLLIDING_A, "a") == 0);
+	assert(scallop_lang_env_set(&env, COLLIDING_B, "b") == 0);
+	assert(scallop_lang_env_set(&env, COLLIDING_A, "A") == 0);
+	assert(scallop_lang_env_length(&env) == 2);
+	assert(strcmp(scallop_lang_env_get(&env, COLLIDING_A), "A") == 0);
+	assert(strcmp(scallop_lang_env_get(&env, COLLIDING_B), "b") == 0);
+
+	env_t fork = { 0 };
+	scallop_lang_env_fork(&env, &fork);
+	assert(scallop_lang_env_unset(&fork, COLLIDING_B) == 0);
+	assert(scallop_lang_env_get(&fork, COLLIDING_B) == NULL);
+	assert(strcmp(scallop_lang_env_get(&fork, COLLIDING_A), "A") == 0);
+	assert(strcmp(scallop_lang_env_get(&env, COLLIDING_B), "b") == 0);
+
+	char *const *const envp = scallop_lang_env_envp(&env);
+	assert(envp_length(envp) == 2);
+	assert(envp_has(envp, COLLIDING_A "=A"));
+	assert(envp_has(envp, COLLIDING_B "=b"));
+
+	scallop_lang_env_free(&fork);
+	scallop_lang_env_free(&env);
+}
+
+void test_env_envp_cache(void)
+{
+	char *const initial[] = { "A=1", "B=2", NULL };
+	env_t env = { 0 };
+	assert(scallop_lang_env_init(&env, initial) == 0);
+
+	env_t fork = { 0 };
+	scallop_lang_env_fork(&env, &fork);
+
+	// Built once per version, and shared by its scopes
+	char *const *const envp = scallop_lang_env_envp(&env);
+	assert(scallop_lang_env_envp(&env) == envp);
+	assert(scallop_lang_env_envp(&fork) == envp);
+	assert(envp_has(envp, "A=1") && envp_has(envp, "B=2"));
+
+	assert(scallop_lang_env_set(&fork, "C", "3") == 0);
+	char *const *const changed = scallop_lang_env_envp(&fork);
+	assert(envp_length(changed) == 3);
+	assert(envp_has(changed, "C=3"));
+	assert(envp_length(scallop_lang_env_envp(&env)) == 2);
+
+	scallop_lang_env_free(&fork);
+	scallop_lang_env_free(&env);
+}
+
+int main()
+{
+	test_env_init();
+	test_env_set_unset();
+	test_env_fork();
+	test_env_many();
+	test_env_collisions();
+	test_env_envp_cache();
+}
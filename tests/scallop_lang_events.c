@@ -0,0 +1,145 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "scallop-lang/events.h"
+
+typedef struct scallop_lang_events events_t;
+typedef struct scallop_lang_events_event event_t;
+
+#define CHILDREN 20
+
+static pid_t spawn(int status, unsigned delay)
+{
+	const pid_t pid = fork();
+	assert(pid >= 0);
+	if (pid == 0) {
+		usleep(delay);
+		_exit(status);
+	}
+	return pid;
+}
+
+static void check_children(int flags)
+{
+	events_t events = { 0 };
+	assert(scallop_lang_events_init(&events, flags) == 0);
+
+	int seen[CHILDREN] = { 0 };
+	for (int i = 0; i < CHILDREN; i++) {
+		const pid_t pid = spawn(i, (unsigned)(i % 4) * 1000);
+		assert(scallop_lang_events_add_child(&events, pid, &seen[i]));
+	}
+
+	// Use a small output array, so events are spread over calls
+	size_t remaining = CHILDREN;
+	while (remaining) {
+		event_t out[3] = { 0 };
+		const ssize_t count = scallop_lang_events_wait(&events, out, 3, 5000);
+		assert(count > 0);
+		for (ssize_t i = 0; i < count; i++) {
+			assert(out[i].type == SCALLOP_LANG_EVENTS_CHILD);
+			assert(WIFEXITED(out[i].status));
+			int *const slot = out[i].user;
+			assert(WEXITSTATUS(out[i].status) == slot - seen);
+			assert(!*slot);
+			*slot = 1;
+			remaining--;
+		}
+	}
+
+	event_t out[1] = { 0 };
+	assert(scallop_lang_events_wait(&events, out, 1, 0) == 0);
+	scallop_lang_events_free(&events);
+}
+
+void test_events_children(void)
+{
+	check_children(0);
+	check_children(SCALLOP_LANG_EVENTS_NO_PIDFD);
+}
+
+void test_events_fd(void)
+{
+	events_t events = { 0 };
+	assert(scallop_lang_events_init(&events, 0) == 0);
+
+	int fds[2];
+	assert(pipe(fds) == 0);
+	struct scallop_lang_events_watch *const watch = scallop_lang_events_add_fd(
+		&events,
+		fds[0],
+		SCALLOP_LANG_EVENTS_READ,
+		&fds
+	);
+	assert(watch);
+
+	event_t out[4] = { 0 };
+	assert(scallop_lang_events_wait(&events, out, 4, 0) == 0);
+
+	assert(write(fds[1], "x", 1) == 1);
+	assert(scallop_lang_events_wait(&events, out, 4, 1000) == 1);
+	assert(out[0].type == SCALLOP_LANG_EVENTS_FD);
+	assert(out[0].fd == fds[0]);
+	assert(out[0].ready == SCALLOP_LANG_EVENTS_READ);
+	assert(out[0].user == &fds);
+
+	// Watches stay active until removed
+	assert(scallop_lang_events_wait(&events, out, 4, 0) == 1);
+	scallop_lang_events_remove(&events, watch);
+	assert(scallop_lang_events_wait(&events, out, 4, 0) == 0);
+
+	close(fds[0]);
+	close(fds[1]);
+	scallop_lang_events_free(&events);
+}
+
+void test_events_timer(void)
+{
+	events_t events = { 0 };
+	assert(scallop_lang_events_init(&events, 0) == 0);
+
+	int first = 0, second = 0, cancelled = 0;
+	assert(scallop_lang_events_add_timer(&events, 30, &second));
+	assert(scallop_lang_events_add_timer(&events, 0, &first));
+	struct scallop_lang_events_watch *const watch
+		= scallop_lang_events_add_timer(&events, 10, &cancelled);
+	assert(watch);
+	scallop_lang_events_remove(&events, watch);
+
+	event_t out[4] = { 0 };
+	assert(scallop_lang_events_wait(&events, out, 4, 1000) == 1);
+	assert(out[0].type == SCALLOP_LANG_EVENTS_TIMER);
+	assert(out[0].user == &first);
+	assert(scallop_lang_events_wait(&events, out, 4, 1000) == 1);
+	assert(out[0].user == &second);
+
+	// Times out with nothing left to wait for
+	assert(scallop_lang_events_wait(&events, out, 4, 20) == 0);
+	scallop_lang_events_free(&events);
+}
+
+int main()
+{
+	test_events_children();
+	test_events_fd();
+	test_events_timer();
+}
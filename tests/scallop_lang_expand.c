@@ -0,0 +1,133 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scallop-lang/expand.h"
+
+#include <libadt/str.h>
+
+#define lit libadt_str_literal
+typedef struct scallop_lang_expand_plan plan_t;
+
+static struct libadt_const_lptr string(const char *s)
+{
+	return (struct libadt_const_lptr) {
+		.buffer = s,
+		.size = 1,
+		.length = (ssize_t)strlen(s),
+	};
+}
+
+static void assert_expands(
+	const char *word,
+	const struct libadt_const_lptr values[],
+	const char *expected
+)
+{
+	plan_t plan = { 0 };
+	assert(scallop_lang_expand_compile(string(word), &plan) == 0);
+
+	size_t length = 0;
+	char *const result = scallop_lang_expand_apply(&plan, values, &length);
+	assert(result);
+	assert(length == strlen(expected));
+	assert(length == scallop_lang_expand_length(&plan, values));
+	assert(strcmp(result, expected) == 0);
+
+	free(result);
+	scallop_lang_expand_free(&plan);
+}
+
+void test_expand_literal(void)
+{
+	plan_t plan = { 0 };
+	assert(scallop_lang_expand_compile(lit("'a b'\\ \"c\""), &plan) == 0);
+	assert(scallop_lang_expand_is_literal(&plan));
+	assert(plan.parts_length == 1);
+	assert(plan.literal_length == 5);
+	scallop_lang_expand_free(&plan);
+
+	assert_expands("'$a'", NULL, "$a");
+	assert_expands("\\$a", NULL, "$a");
+}
+
+void test_expand_compile(void)
+{
+	plan_t plan = { 0 };
+	assert(scallop_lang_expand_compile(lit("x$a.c\"$b $a\""), &plan) == 0);
+	assert(!scallop_lang_expand_is_literal(&plan));
+	assert(plan.names_length == 2);
+	assert(strcmp(plan.names[0], "a") == 0);
+	assert(strcmp(plan.names[1], "b") == 0);
+
+	// x, a, .c, b, ' ', a
+	assert(plan.parts_length == 6);
+	assert(plan.parts[0].slot == -1);
+	assert(plan.parts[1].slot == 0);
+	assert(plan.parts[2].slot == -1);
+	assert(plan.parts[3].slot == 1);
+	assert(plan.parts[4].slot == -1);
+	assert(plan.parts[5].slot == 0);
+	assert(plan.literal_length == 4);
+	scallop_lang_expand_free(&plan);
+}
+
+void test_expand_apply(void)
+{
+	const struct libadt_const_lptr values[] = {
+		string("one"),
+		string("two words"),
+	};
+	assert_expands("$a", values, "one");
+	assert_expands("x$a.c\"$b $a\"", values, "xone.ctwo words one");
+	assert_expands("$a$b", values, "onetwo words");
+	assert_expands("\"$a\"'$b'", values, "one$b");
+
+	const struct libadt_const_lptr unset[] = {
+		{ 0 },
+	};
+	assert_expands("pre$x.post", unset, "pre.post");
+
+	// A '$' in double quotes without a name is literal
+	assert_expands("\"costs $\"", values, "costs $");
+	assert_expands("\"a $ b\"", values, "a $ b");
+	assert_expands("\"$$a\"", values, "$one");
+	assert_expands("\"$\"$a", values, "$one");
+}
+
+void test_expand_invalid(void)
+{
+	plan_t plan = { 0 };
+	assert(scallop_lang_expand_compile(lit("$"), &plan) == -1);
+	assert(errno == EINVAL);
+	assert(scallop_lang_expand_compile(lit("a$ b"), &plan) == -1);
+	assert(scallop_lang_expand_compile(lit("\"$a"), &plan) == -1);
+	assert(scallop_lang_expand_compile(lit("\"$"), &plan) == -1);
+	assert(scallop_lang_expand_compile(lit("${a}"), &plan) == -1);
+}
+
+int main()
+{
+	test_expand_literal();
+	test_expand_compile();
+	test_expand_apply();
+	test_expand_invalid();
+}
@@ -0,0 +1,184 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "scallop-lang/glob.h"
+
+#include <libadt/str.h>
+
+#define lit libadt_str_literal
+typedef struct scallop_lang_glob compiled_t;
+typedef struct scallop_lang_glob_matches matches_t;
+
+static const char *const files[] = {
+	"a.c",
+	"b.c",
+	".hidden.c",
+	"f",
+	"d1/x.c",
+	"d1/y.h",
+	"d2/x.c",
+	"d2/.z.h",
+};
+
+static char root[] = "/tmp/scallop-glob-XXXXXX";
+
+static struct libadt_const_lptr string(const char *s)
+{
+	return (struct libadt_const_lptr) {
+		.buffer = s,
+		.size = 1,
+		.length = (ssize_t)strlen(s),
+	};
+}
+
+static void make_tree(void)
+{
+	assert(mkdtemp(root));
+	char path[256];
+	snprintf(path, sizeof(path), "%s/d1", root);
+	assert(mkdir(path, 0700) == 0);
+	snprintf(path, sizeof(path), "%s/d2", root);
+	assert(mkdir(path, 0700) == 0);
+
+	for (size_t i = 0; i < sizeof(files) / sizeof(*files); i++) {
+		snprintf(path, sizeof(path), "%s/%s", root, files[i]);
+		const int fd = open(path, O_WRONLY | O_CREAT, 0600);
+		assert(fd >= 0);
+		close(fd);
+	}
+}
+
+static void remove_tree(void)
+{
+	char path[256];
+	for (size_t i = 0; i < sizeof(files) / sizeof(*files); i++) {
+		snprintf(path, sizeof(path), "%s/%s", root, files[i]);
+		unlink(path);
+	}
+	snprintf(path, sizeof(path), "%s/d1", root);
+	rmdir(path);
+	snprintf(path, sizeof(path), "%s/d2", root);
+	rmdir(path);
+	rmdir(root);
+}
+
+/*
+ * Expands root/pattern, and compares against the expected
+ * names relative to root.
+ */
+static void assert_expands(const char *pattern, size_t threads, const char *const expected[])
+{
+	char word[256];
+	snprintf(word, sizeof(word), "%s/%s", root, pattern);
+
+	compiled_t glob = { 0 };
+	matches_t matches = { 0 };
+	assert(scallop_lang_glob_compile(string(word), &glob) == 0);
+	assert(scallop_lang_glob_expand(&glob, threads, &matches) == 0);
+
+	size_t i = 0;
+	for (; expected[i]; i++) {
+		char path[256];
+		snprintf(path, sizeof(path), "%s/%s", root, expected[i]);
+		assert(i < matches.length);
+		assert(strcmp(matches.paths[i], path) == 0);
+	}
+	assert(i == matches.length);
+
+	scallop_lang_glob_matches_free(&matches);
+	scallop_lang_glob_free(&glob);
+}
+
+void test_glob_compile(void)
+{
+	compiled_t glob = { 0 };
+
+	assert(scallop_lang_glob_compile(lit("src//lib/*/x?.c"), &glob) == 0);
+	assert(strcmp(glob.prefix, "src/lib") == 0);
+	assert(glob.components_length == 2);
+	assert(!glob.components[0].literal);
+	assert(glob.components[1].literal == false);
+	assert(!scallop_lang_glob_is_literal(&glob));
+	scallop_lang_glob_free(&glob);
+
+	assert(scallop_lang_glob_compile(lit("/abs/'*'/\\?"), &glob) == 0);
+	assert(strcmp(glob.prefix, "/abs/*") == 0);
+	assert(glob.components_length == 1);
+	assert(strcmp(glob.components[0].text, "?") == 0);
+	assert(scallop_lang_glob_is_literal(&glob));
+	scallop_lang_glob_free(&glob);
+
+	assert(scallop_lang_glob_compile(lit("'unterminated"), &glob) == -1);
+}
+
+void test_glob_match(void)
+{
+	compiled_t glob = { 0 };
+	assert(scallop_lang_glob_compile(lit("a*b?c*"), &glob) == 0);
+	const struct scallop_lang_glob_component *const component
+		= &glob.components[0];
+
+	assert(scallop_lang_glob_match(component, "abxc"));
+	assert(scallop_lang_glob_match(component, "a123b4c567"));
+	assert(scallop_lang_glob_match(component, "abbbxc"));
+	assert(!scallop_lang_glob_match(component, "abc"));
+	assert(!scallop_lang_glob_match(component, "xabxc"));
+	scallop_lang_glob_free(&glob);
+
+	assert(scallop_lang_glob_compile(lit("*.c"), &glob) == 0);
+	assert(scallop_lang_glob_match(&glob.components[0], "x.c"));
+	assert(!scallop_lang_glob_match(&glob.components[0], ".x.c"));
+	assert(!scallop_lang_glob_match(&glob.components[0], "x.h"));
+	scallop_lang_glob_free(&glob);
+
+	assert(scallop_lang_glob_compile(lit("'*'.c"), &glob) == 0);
+	assert(scallop_lang_glob_match(&glob.components[0], "*.c"));
+	assert(!scallop_lang_glob_match(&glob.components[0], "x.c"));
+	scallop_lang_glob_free(&glob);
+}
+
+void test_glob_expand(void)
+{
+	for (size_t threads = 1; threads <= 4; threads += 3) {
+		assert_expands("*.c", threads, (const char *[]) { "a.c", "b.c", NULL });
+		assert_expands("d*/x.c", threads, (const char *[]) { "d1/x.c", "d2/x.c", NULL });
+		assert_expands("*/*.h", threads, (const char *[]) { "d1/y.h", NULL });
+		assert_expands("d?/.*", threads, (const char *[]) { "d2/.z.h", NULL });
+		assert_expands("?", threads, (const char *[]) { "f", NULL });
+		assert_expands("*/missing", threads, (const char *[]) { NULL });
+		assert_expands("f", threads, (const char *[]) { "f", NULL });
+		assert_expands("missing", threads, (const char *[]) { NULL });
+	}
+}
+
+int main()
+{
+	make_tree();
+	test_glob_compile();
+	test_glob_match();
+	test_glob_expand();
+	remove_tree();
+}
@@ -0,0 +1,192 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "scallop-lang/cache.h"
+#include "scallop-lang/history.h"
+
+#include <libadt/str.h>
+
+#define lit libadt_str_literal
+
+typedef struct scallop_lang_history history_t;
+typedef struct scallop_lang_history_record record_t;
+
+static char root[] = "/tmp/scallop-history-XXXXXX";
+static char path[64];
+
+static uint64_t key_of(struct libadt_const_lptr statement)
+{
+	struct scallop_lang_cache_fingerprint fingerprint
+		= scallop_lang_cache_fingerprint_init();
+	assert(scallop_lang_cache_add_statement(&fingerprint, statement) == 0);
+	return fingerprint.hash;
+}
+
+void test_history_missing(void)
+{
+	history_t history = { 0 };
+	assert(scallop_lang_history_open(&history, path) == 0);
+	assert(scallop_lang_history_find(&history, key_of(lit("make all"))) == NULL);
+	assert(scallop_lang_history_estimate(&history, key_of(lit("make all")), 7) == 7);
+	scallop_lang_history_close(&history);
+
+	// Opening doesn't create the file
+	assert(access(path, F_OK) == -1);
+}
+
+void test_history_average(void)
+{
+	history_t history = { 0 };
+	assert(scallop_lang_history_open(&history, path) == 0);
+
+	const uint64_t key = key_of(lit("make all"));
+	assert(scallop_lang_history_add(&history, key, 2, 1) == 0);
+	assert(scallop_lang_history_add(&history, key, 4, 3) == 0);
+
+	const record_t *record = scallop_lang_history_find(&history, key);
+	assert(record);
+	assert(record->runs == 2);
+	assert(record->wall == 3);
+	assert(record->cpu == 2);
+
+	// Older runs count for less once the window is full
+	for (int i = 0; i < 100; i++)
+		assert(scallop_lang_history_add(&history, key, 10, 10) == 0);
+	record = scallop_lang_history_find(&history, key);
+	assert(record->runs == SCALLOP_LANG_HISTORY_WINDOW);
+	assert(record->wall > 9.99 && record->wall <= 10);
+	assert(scallop_lang_history_add(&history, key, 18, 10) == 0);
+	record = scallop_lang_history_find(&history, key);
+	assert(record->wall > 10.99 && record->wall < 11.01);
+
+	// Quoting doesn't change the key, but the words do
+	assert(scallop_lang_history_find(&history, key_of(lit("'make' \"all\""))) == record);
+	assert(scallop_lang_history_find(&history, key_of(lit("make clean"))) == NULL);
+
+	scallop_lang_history_close(&history);
+}
+
+void test_history_save(void)
+{
+	history_t history = { 0 };
+	assert(scallop_lang_history_open(&history, path) == 0);
+
+	// Enough statements to grow the table
+	for (uint64_t i = 0; i < 1000; i++)
+		assert(scallop_lang_history_add(&history, i * 0x9e3779b97f4a7c15u, (double)i, 1) == 0);
+
+	char *const argv[] = { "cc", "-c", "main.c", NULL };
+	struct scallop_lang_cache_fingerprint fingerprint
+		= scallop_lang_cache_fingerprint_init();
+	scallop_lang_cache_add_words(&fingerprint, argv);
+	assert(scallop_lang_history_add(&history, fingerprint.hash, 1.5, 0.5) == 0);
+
+	assert(scallop_lang_history_save(&history) == 0);
+	scallop_lang_history_close(&history);
+
+	assert(scallop_lang_history_open(&history, path) == 0);
+	for (uint64_t i = 0; i < 1000; i++) {
+		const record_t *const record = scallop_lang_history_find(
+			&history,
+			i * 0x9e3779b97f4a7c15u
+		);
+		assert(record);
+		assert(record->wall == (double)i);
+	}
+	assert(scallop_lang_history_estimate(&history, key_of(lit("cc -c main.c")), 0) == 1.5);
+	scallop_lang_history_close(&history);
+}
+
+void test_history_damaged(void)
+{
+	const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	assert(fd >= 0);
+	assert(write(fd, "SCLHIST1\xff", 9) == 9);
+	close(fd);
+
+	history_t history = { 0 };
+	assert(scallop_lang_history_open(&history, path) == 0);
+	assert(scallop_lang_history_find(&history, key_of(lit("make all"))) == NULL);
+	assert(scallop_lang_history_add(&history, key_of(lit("make all")), 1, 1) == 0);
+	assert(scallop_lang_history_save(&history) == 0);
+	scallop_lang_history_close(&history);
+
+	assert(scallop_lang_history_open(&history, path) == 0);
+	assert(scallop_lang_history_find(&history, key_of(lit("make all"))));
+	scallop_lang_history_close(&history);
+}
+
+void test_history_file(void)
+{
+	history_t history = { 0 };
+	assert(scallop_lang_history_open(&history, path) == 0);
+	assert(scallop_lang_history_add(&history, 1, 2, 3) == 0);
+	assert(chmod(path, 0644) == 0);
+	assert(scallop_lang_history_save(&history) == 0);
+	scallop_lang_history_close(&history);
+
+	// The saved file keeps the old one's mode...
+	struct stat info = { 0 };
+	assert(stat(path, &info) == 0);
+	assert((info.st_mode & 07777) == 0644);
+
+	// ...and each record is 32 bytes, with zeros after the runs
+	unsigned char bytes[16 + 2 * 32];
+	const int fd = open(path, O_RDONLY);
+	assert(fd >= 0);
+	const ssize_t length = read(fd, bytes, sizeof(bytes));
+	close(fd);
+	assert(length >= 16 + 32);
+	assert((length - 16) % 32 == 0);
+	for (ssize_t record = 16; record < length; record += 32)
+		for (size_t i = 12; i < 16; i++)
+			assert(bytes[record + i] == 0);
+}
+
+void test_history_errors(void)
+{
+	history_t history = { 0 };
+	assert(scallop_lang_history_open(&history, "/nonexistent/history") == 0);
+	assert(scallop_lang_history_add(&history, 1, 1, 1) == 0);
+	assert(scallop_lang_history_save(&history) == -1);
+	assert(errno == ENOENT);
+	scallop_lang_history_close(&history);
+}
+
+int main()
+{
+	assert(mkdtemp(root));
+	snprintf(path, sizeof(path), "%s/history", root);
+
+	test_history_missing();
+	test_history_average();
+	test_history_save();
+	test_history_damaged();
+	test_history_file();
+	test_history_errors();
+
+	unlink(path);
+	rmdir(root);
+}
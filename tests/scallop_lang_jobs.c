@@ -0,0 +1,417 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// For sched_getaffinity() and the CPU_* macros
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "scallop-lang/jobs.h"
+
+typedef struct scallop_lang_jobs_job job_t;
+typedef struct scallop_lang_jobs_options options_t;
+
+#define BLOCK NULL
+
+static char *const sh_true[] = { "true", NULL };
+static char *const sh_false[] = { "false", NULL };
+static char *const sh_sleep[] = { "sleep", "10", NULL };
+static char *const sh_stubborn[] = {
+	"sh", "-c", "trap '' TERM; sleep 10", NULL,
+};
+
+static double now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+void test_jobs_success(void)
+{
+	job_t jobs[] = {
+		{ .argv = sh_true, .block = -1 },
+		{ .argv = BLOCK, .block = -1 },
+		{ .argv = sh_true, .block = 1 },
+		{ .argv = BLOCK, .block = 1 },
+		{ .argv = sh_true, .block = 3 },
+		{ .argv = BLOCK, .block = 1 },
+	};
+	assert(scallop_lang_jobs_run(jobs, sizeof(jobs) / sizeof(*jobs), NULL) == 0);
+	for (size_t i = 0; i < sizeof(jobs) / sizeof(*jobs); i++)
+		assert(jobs[i].state == SCALLOP_LANG_JOBS_SUCCEEDED);
+	assert(WIFEXITED(jobs[0].status) && WEXITSTATUS(jobs[0].status) == 0);
+}
+
+void test_jobs_fail_fast(void)
+{
+	job_t jobs[] = {
+		// 0: { sleep; false; { sleep } }
+		{ .argv = BLOCK, .block = -1 },
+		{ .argv = sh_sleep, .block = 0 },
+		{ .argv = sh_false, .block = 0 },
+		{ .argv = BLOCK, .block = 0 },
+		{ .argv = sh_sleep, .block = 3 },
+		// 5: a sibling of the failed block
+		{ .argv = sh_sleep, .block = -1 },
+	};
+
+	const double start = now();
+	assert(scallop_lang_jobs_run(jobs, sizeof(jobs) / sizeof(*jobs), NULL) == 1);
+	assert(now() - start < 5);
+
+	assert(jobs[0].state == SCALLOP_LANG_JOBS_FAILED);
+	assert(jobs[1].state == SCALLOP_LANG_JOBS_CANCELLED);
+	assert(WIFSIGNALED(jobs[1].status) && WTERMSIG(jobs[1].status) == SIGTERM);
+	assert(jobs[2].state == SCALLOP_LANG_JOBS_FAILED);
+	assert(jobs[3].state == SCALLOP_LANG_JOBS_CANCELLED);
+	assert(jobs[4].state == SCALLOP_LANG_JOBS_CANCELLED);
+	assert(jobs[5].state == SCALLOP_LANG_JOBS_CANCELLED);
+}
+
+void test_jobs_queue(void)
+{
+	job_t jobs[] = {
+		{ .argv = sh_false, .block = -1 },
+		{ .argv = sh_true, .block = -1 },
+		{ .argv = sh_true, .block = -1 },
+	};
+	const options_t options = { .max_running = 1 };
+	assert(scallop_lang_jobs_run(jobs, 3, &options) == 1);
+	assert(jobs[0].state == SCALLOP_LANG_JOBS_FAILED);
+
+	// Queued jobs are dropped without running
+	assert(jobs[1].state == SCALLOP_LANG_JOBS_CANCELLED);
+	assert(jobs[1].status == 0);
+	assert(jobs[2].state == SCALLOP_LANG_JOBS_CANCELLED);
+}
+
+void test_jobs_costs(void)
+{
+	job_t jobs[] = {
+		{ .argv = sh_true, .block = -1, .cost = 1 },
+		{ .argv = sh_false, .block = -1, .cost = 3 },
+		{ .argv = sh_true, .block = -1, .cost = 2 },
+	};
+	const options_t options = { .max_running = 1 };
+
+	// The most expensive command runs first, and fails the rest
+	// before they start
+	assert(scallop_lang_jobs_run(jobs, 3, &options) == 1);
+	assert(jobs[1].state == SCALLOP_LANG_JOBS_FAILED);
+	assert(jobs[0].state == SCALLOP_LANG_JOBS_CANCELLED);
+	assert(jobs[2].state == SCALLOP_LANG_JOBS_CANCELLED);
+}
+
+void test_jobs_times(void)
+{
+	static char *const sh_nap[] = { "sleep", "0.2", NULL };
+	static char *const sh_busy[] = {
+		"sh", "-c", "i=0; while [ $i -lt 100000 ]; do i=$((i + 1)); done", NULL,
+	};
+	job_t jobs[] = {
+		{ .argv = sh_nap, .block = -1 },
+		{ .argv = sh_busy, .block = -1 },
+	};
+	assert(scallop_lang_jobs_run(jobs, 2, NULL) == 0);
+	assert(jobs[0].wall >= 0.2 && jobs[0].wall < 5);
+	assert(jobs[0].cpu < jobs[0].wall);
+	assert(jobs[1].cpu > 0);
+	assert(jobs[1].wall > 0);
+}
+
+void test_jobs_predict(void)
+{
+	job_t jobs[] = {
+		{ .argv = BLOCK, .block = -1 },
+		{ .argv = sh_true, .block = 0, .cost = 1 },
+		{ .argv = sh_true, .block = 0, .cost = 1 },
+		{ .argv = sh_true, .block = 0, .cost = 1 },
+		{ .argv = sh_true, .block = 0, .cost = 1 },
+		{ .argv = sh_true, .block = -1, .cost = 4 },
+	};
+	const size_t length = sizeof(jobs) / sizeof(*jobs);
+
+	// The long command starts first, and the rest fit beside it
+	assert(scallop_lang_jobs_predict(jobs, length, 2) == 4);
+	assert(scallop_lang_jobs_predict(jobs, length, 1) == 8);
+	assert(scallop_lang_jobs_predict(jobs, length, 0) == 4);
+	assert(scallop_lang_jobs_predict(jobs, 1, 2) == 0);
+}
+
+void test_jobs_block_limits(void)
+{
+	static char *const sh_nap[] = { "sleep", "0.2", NULL };
+	job_t jobs[] = {
+		{ .argv = BLOCK, .block = -1, .max_running = 1 },
+		{ .argv = sh_nap, .block = 0, .cost = 2 },
+		{ .argv = BLOCK, .block = 0 },
+		{ .argv = sh_nap, .block = 2, .cost = 2 },
+		{ .argv = sh_nap, .block = 2, .cost = 2 },
+		{ .argv = (char *const[]) { "sleep", "0.6", NULL }, .block = -1, .cost = 1 },
+	};
+	const size_t length = sizeof(jobs) / sizeof(*jobs);
+
+	// The block's commands run one at a time, including the
+	// nested ones, while the cheaper command outside it starts
+	// beside them instead of waiting behind them
+	const options_t options = { .max_running = 2 };
+	const double start = now();
+	assert(scallop_lang_jobs_run(jobs, length, &options) == 0);
+	const double elapsed = now() - start;
+	assert(elapsed >= 0.6 && elapsed < 1.0);
+
+	assert(scallop_lang_jobs_predict(jobs, length, 2) == 6);
+	assert(scallop_lang_jobs_predict(jobs, length, 1) == 7);
+	jobs[0].max_running = 2;
+	assert(scallop_lang_jobs_predict(jobs, length, 0) == 4);
+	jobs[2].max_running = 1;
+	assert(scallop_lang_jobs_predict(jobs, length, 0) == 4);
+	jobs[0].max_running = 0;
+	assert(scallop_lang_jobs_predict(jobs, length, 0) == 4);
+	jobs[2].max_running = 0;
+	assert(scallop_lang_jobs_predict(jobs, length, 0) == 2);
+}
+
+void test_jobs_jobserver(void)
+{
+	static char *const sh_nap[] = { "sleep", "0.2", NULL };
+	int fds[2];
+	assert(pipe(fds) == 0);
+	assert(write(fds[1], "+", 1) == 1);
+	char makeflags[64];
+	snprintf(makeflags, sizeof(makeflags), "-j2 --jobserver-auth=%d,%d", fds[0], fds[1]);
+
+	struct scallop_lang_jobserver jobserver = { 0 };
+	assert(scallop_lang_jobserver_init(&jobserver, makeflags) == 0);
+	const options_t options = { .jobserver = &jobserver };
+
+	// One token and the implicit one run two at a time
+	job_t jobs[] = {
+		{ .argv = sh_nap, .block = -1 },
+		{ .argv = sh_nap, .block = -1 },
+		{ .argv = sh_nap, .block = -1 },
+	};
+	double start = now();
+	assert(scallop_lang_jobs_run(jobs, 3, &options) == 0);
+	double elapsed = now() - start;
+	assert(elapsed >= 0.4 && elapsed < 0.6 + 0.4);
+
+	// The token is back in the pipe, even after a failure
+	char token = 0;
+	assert(fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+	assert(read(fds[0], &token, 1) == 1 && token == '+');
+	assert(write(fds[1], "+", 1) == 1);
+
+	job_t failing[] = {
+		{ .argv = sh_sleep, .block = -1, .cost = 1 },
+		{ .argv = sh_false, .block = -1 },
+	};
+	start = now();
+	assert(scallop_lang_jobs_run(failing, 2, &options) == 1);
+	assert(now() - start < 5);
+	assert(read(fds[0], &token, 1) == 1 && token == '+');
+	assert(read(fds[0], &token, 1) == -1 && errno == EAGAIN);
+
+	// Without tokens, commands run one at a time
+	start = now();
+	assert(scallop_lang_jobs_run(jobs, 2, &options) == 0);
+	elapsed = now() - start;
+	assert(elapsed >= 0.4);
+
+	scallop_lang_jobserver_free(&jobserver);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+void test_jobs_pinning(void)
+{
+	cpu_set_t allowed;
+	assert(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+	unsigned cpu = 0;
+	while (!CPU_ISSET(cpu, &allowed))
+		cpu++;
+
+	// One core with a CPU we may use, and one with a CPU that
+	// doesn't exist
+	const unsigned missing = CPU_SETSIZE + 7;
+	struct scallop_lang_topology_core cores[] = {
+		{ .cpus = &cpu, .cpus_length = 1 },
+		{ .cpus = &missing, .cpus_length = 1 },
+	};
+	const struct scallop_lang_topology topology = {
+		.cores = cores,
+		.cores_length = 2,
+	};
+
+	char script[128];
+	snprintf(
+		script,
+		sizeof(script),
+		"test \"$(grep Cpus_allowed_list /proc/self/status | cut -f2)\" = %u",
+		cpu
+	);
+	char *const pinned[] = { "sh", "-c", script, NULL };
+
+	// The first command goes on the first core. The second goes
+	// on the other, which can't be used, so it isn't pinned.
+	job_t jobs[] = {
+		{ .argv = pinned, .block = -1, .cost = 2 },
+		{ .argv = sh_true, .block = -1, .cost = 1 },
+	};
+	const options_t options = { .topology = &topology };
+	assert(scallop_lang_jobs_run(jobs, 2, &options) == 0);
+}
+
+void test_jobs_escalate(void)
+{
+	job_t jobs[] = {
+		{ .argv = sh_stubborn, .block = -1 },
+		{ .argv = sh_sleep, .block = -1 },
+		{ .argv = (char *const[]) { "sh", "-c", "sleep 0.2; exit 3", NULL }, .block = -1 },
+	};
+	const int signals[] = { SIGTERM, SIGKILL };
+	const options_t options = {
+		.signals = signals,
+		.signals_length = 2,
+		.grace = 100,
+	};
+
+	const double start = now();
+	assert(scallop_lang_jobs_run(jobs, 3, &options) == 1);
+	assert(now() - start < 5);
+
+	assert(jobs[0].state == SCALLOP_LANG_JOBS_CANCELLED);
+	assert(WIFSIGNALED(jobs[0].status) && WTERMSIG(jobs[0].status) == SIGKILL);
+	assert(jobs[1].state == SCALLOP_LANG_JOBS_CANCELLED);
+	assert(WIFSIGNALED(jobs[1].status) && WTERMSIG(jobs[1].status) == SIGTERM);
+	assert(jobs[2].state == SCALLOP_LANG_JOBS_FAILED);
+	assert(WEXITSTATUS(jobs[2].status) == 3);
+}
+
+void test_jobs_default_grace(void)
+{
+	static char *const sh_graceful[] = {
+		"sh", "-c", "trap 'sleep 0.5; exit 0' TERM; sleep 10 & wait", NULL,
+	};
+	job_t jobs[] = {
+		{ .argv = sh_graceful, .block = -1 },
+		{ .argv = (char *const[]) { "sh", "-c", "sleep 0.2; exit 1", NULL }, .block = -1 },
+	};
+
+	// Options that only set a limit still give a TERM trap time
+	// to finish, instead of sending KILL straight away
+	const options_t options = { .max_running = 2 };
+	const double start = now();
+	assert(scallop_lang_jobs_run(jobs, 2, &options) == 1);
+	const double elapsed = now() - start;
+	assert(elapsed >= 0.7 && elapsed < 5);
+
+	assert(jobs[0].state == SCALLOP_LANG_JOBS_CANCELLED);
+	assert(WIFEXITED(jobs[0].status) && WEXITSTATUS(jobs[0].status) == 0);
+}
+
+void test_jobs_exit_with_timer(void)
+{
+	// On TERM, the command stops this process once it's waiting
+	// for events, exits, and has it continued after the grace
+	// period has run out, so the exit and the timer are reported
+	// together, exit first
+	static char *const sh_stopper[] = {
+		"sh", "-c",
+		"trap 'sleep 0.05; kill -STOP $PPID; (sleep 0.5; kill -CONT $PPID) & "
+		"sleep 0.1; exit 0' TERM; "
+		"sleep 10 & wait",
+		NULL,
+	};
+	job_t jobs[] = {
+		{ .argv = sh_stopper, .block = -1 },
+		{ .argv = (char *const[]) { "sh", "-c", "sleep 0.2; exit 1", NULL }, .block = -1 },
+	};
+	const options_t options = { .grace = 300 };
+	assert(scallop_lang_jobs_run(jobs, 2, &options) == 1);
+	assert(jobs[0].state == SCALLOP_LANG_JOBS_CANCELLED);
+	assert(WIFEXITED(jobs[0].status) && WEXITSTATUS(jobs[0].status) == 0);
+}
+
+void test_jobs_invalid(void)
+{
+	job_t jobs[] = {
+		{ .argv = sh_true, .block = -1 },
+		{ .argv = sh_true, .block = 0 },
+	};
+	assert(scallop_lang_jobs_run(jobs, 2, NULL) == -1);
+	assert(errno == EINVAL);
+
+	job_t missing[] = {
+		{ .argv = (char *const[]) { "/nonexistent/scallop", NULL }, .block = -1 },
+	};
+	assert(scallop_lang_jobs_run(missing, 1, NULL) == 1);
+	assert(missing[0].state == SCALLOP_LANG_JOBS_FAILED);
+	assert(WEXITSTATUS(missing[0].status) == 127);
+}
+
+void test_jobs_commands(void)
+{
+	struct scallop_lang_commands commands = { 0 };
+	assert(scallop_lang_commands_init(&commands, getenv("PATH")) == 0);
+
+	job_t jobs[] = {
+		{ .argv = sh_true, .block = -1 },
+		{ .argv = (char *const[]) { "sh", "-c", "exit 3", NULL }, .block = -1 },
+		{ .argv = (char *const[]) { "scallop-missing", NULL }, .block = -1 },
+	};
+	const options_t options = { .commands = &commands };
+	assert(scallop_lang_jobs_run(jobs, 1, &options) == 0);
+	assert(jobs[0].state == SCALLOP_LANG_JOBS_SUCCEEDED);
+
+	assert(scallop_lang_jobs_run(&jobs[1], 1, &options) == 1);
+	assert(WEXITSTATUS(jobs[1].status) == 3);
+
+	// Commands that aren't found still fail as with execvp(3)
+	assert(scallop_lang_jobs_run(&jobs[2], 1, &options) == 1);
+	assert(WEXITSTATUS(jobs[2].status) == 127);
+
+	scallop_lang_commands_free(&commands);
+}
+
+int main()
+{
+	test_jobs_success();
+	test_jobs_fail_fast();
+	test_jobs_queue();
+	test_jobs_costs();
+	test_jobs_times();
+	test_jobs_predict();
+	test_jobs_block_limits();
+	test_jobs_jobserver();
+	test_jobs_pinning();
+	test_jobs_escalate();
+	test_jobs_default_grace();
+	test_jobs_exit_with_timer();
+	test_jobs_invalid();
+	test_jobs_commands();
+}
@@ -0,0 +1,138 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "scallop-lang/jobserver.h"
+
+typedef struct scallop_lang_jobserver jobserver_t;
+
+static void check_tokens(jobserver_t *jobserver, int pipe_read)
+{
+	// Two tokens are free
+	char first = 0;
+	char second = 0;
+	char third = 0;
+	assert(scallop_lang_jobserver_acquire(jobserver, &first) == 1);
+	assert(scallop_lang_jobserver_acquire(jobserver, &second) == 1);
+	assert(first == '+' && second == '-');
+	assert(scallop_lang_jobserver_acquire(jobserver, &third) == 0);
+
+	assert(scallop_lang_jobserver_release(jobserver, second) == 0);
+	assert(scallop_lang_jobserver_acquire(jobserver, &third) == 1);
+	assert(third == '-');
+
+	// Tokens go back to the pipe, for make to read
+	assert(scallop_lang_jobserver_release(jobserver, first) == 0);
+	assert(scallop_lang_jobserver_release(jobserver, third) == 0);
+	char buffer[2] = { 0 };
+	assert(read(pipe_read, buffer, 2) == 2);
+	assert(buffer[0] == '+' && buffer[1] == '-');
+}
+
+void test_jobserver_fds(void)
+{
+	int fds[2];
+	assert(pipe(fds) == 0);
+	assert(write(fds[1], "+-", 2) == 2);
+
+	char makeflags[64];
+	snprintf(makeflags, sizeof(makeflags), "-j3 --jobserver-auth=%d,%d", fds[0], fds[1]);
+
+	jobserver_t jobserver = { 0 };
+	assert(scallop_lang_jobserver_init(&jobserver, makeflags) == 0);
+
+	// make's own file descriptors stay blocking
+	assert(!(fcntl(fds[0], F_GETFL) & O_NONBLOCK));
+	assert(scallop_lang_jobserver_fd(&jobserver) != fds[0]);
+
+	check_tokens(&jobserver, fds[0]);
+	scallop_lang_jobserver_free(&jobserver);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+void test_jobserver_fifo(void)
+{
+	char directory[] = "/tmp/scallop-jobserver-XXXXXX";
+	char path[64];
+	assert(mkdtemp(directory));
+	snprintf(path, sizeof(path), "%s/fifo", directory);
+	assert(mkfifo(path, 0600) == 0);
+
+	// make holds the fifo open for the whole build
+	const int pipe_read = open(path, O_RDONLY | O_NONBLOCK);
+	const int pipe_write = open(path, O_WRONLY);
+	assert(pipe_read >= 0 && pipe_write >= 0);
+	assert(write(pipe_write, "+-", 2) == 2);
+
+	char makeflags[128];
+	snprintf(makeflags, sizeof(makeflags), " --jobserver-auth=fifo:%s -- X=1", path);
+
+	jobserver_t jobserver = { 0 };
+	assert(scallop_lang_jobserver_init(&jobserver, makeflags) == 0);
+	check_tokens(&jobserver, pipe_read);
+	scallop_lang_jobserver_free(&jobserver);
+
+	close(pipe_read);
+	close(pipe_write);
+	unlink(path);
+	rmdir(directory);
+}
+
+void test_jobserver_errors(void)
+{
+	jobserver_t jobserver = { 0 };
+	static const char *const missing[] = {
+		NULL,
+		"",
+		"-j4",
+		"-- X=--jobserver-auth=3,4",
+	};
+	for (size_t i = 0; i < sizeof(missing) / sizeof(*missing); i++) {
+		assert(scallop_lang_jobserver_init(&jobserver, missing[i]) == -1);
+		assert(errno == ENOENT);
+	}
+
+	assert(scallop_lang_jobserver_init(&jobserver, "--jobserver-auth=3") == -1);
+	assert(errno == EINVAL);
+	assert(scallop_lang_jobserver_init(&jobserver, "--jobserver-auth=a,4") == -1);
+	assert(errno == EINVAL);
+
+	// The recipe wasn't marked with '+', so make closed them
+	assert(scallop_lang_jobserver_init(&jobserver, "--jobserver-fds=1000,1001") == -1);
+	assert(errno == EBADF);
+
+	assert(scallop_lang_jobserver_init(
+		&jobserver,
+		"--jobserver-auth=fifo:/nonexistent/scallop"
+	) == -1);
+	assert(errno == ENOENT);
+}
+
+int main()
+{
+	test_jobserver_fds();
+	test_jobserver_fifo();
+	test_jobserver_errors();
+}
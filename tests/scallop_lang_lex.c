@@ -17,7 +17,9 @@
  */
 
 #include <assert.h>
+#include <locale.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include "scallop-lang/lex.h"
 
 #include <libadt/str.h>
@@ -70,6 +72,82 @@ void test_lex_next_statement_separator_promotion(void)
 	assert(lex.value.length == sizeof(WORD_STATEMENT_SEPARATOR) - 1);
 }
 
+#define QUOTED_SCRIPT "\"quoted word\" 'next' end"
+
+void test_lex_next_quoted(void)
+{
+	lex_t lex = lex_init(lit(QUOTED_SCRIPT));
+	lex = lex_next(lex);
+
+	assert(lex.type == scallop_lang_classifier_word);
+	assert(lex.value.length == sizeof("\"quoted word\"") - 1);
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word_separator);
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word);
+	assert(lex.value.length == sizeof("'next'") - 1);
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word_separator);
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word);
+	assert(lex.value.length == sizeof("end") - 1);
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_end);
+}
+
+#define MERGED_SCRIPT "$x a$x *.o \"$y\"; $ "
+
+void test_lex_next_merged_words(void)
+{
+	lex_t lex = lex_init(lit(MERGED_SCRIPT));
+
+	// Every complete word is reported as a word, whatever part it
+	// ends in
+	const ssize_t lengths[] = { 2, 3, 3, 4 };
+	for (size_t i = 0; i < sizeof(lengths) / sizeof(*lengths); i++) {
+		lex = lex_next(lex);
+		assert(lex.type == scallop_lang_classifier_word);
+		assert(lex.value.length == lengths[i]);
+		lex = lex_next(lex);
+		assert(lex.type == scallop_lang_classifier_word_separator
+			|| lex.type == scallop_lang_classifier_statement_separator);
+	}
+
+	// ...but lexing still continues from the last part, so the
+	// space after a lone $ is still an error
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word);
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_unexpected);
+}
+
+#define LONE_DOLLAR_SCRIPT "\"costs $\" \"a $ b\""
+
+void test_lex_next_lone_dollar(void)
+{
+	lex_t lex = lex_init(lit(LONE_DOLLAR_SCRIPT));
+
+	// A '$' in double quotes without a name is part of the string
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word);
+	assert(lex.value.length == sizeof("\"costs $\"") - 1);
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word_separator);
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word);
+	assert(lex.value.length == sizeof("\"a $ b\"") - 1);
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_end);
+}
+
 void test_lex_normalize_word(void)
 {
 	const char word_buffer[] = "\"Hello, \"'world'\\!";
@@ -84,10 +162,171 @@ void test_lex_normalize_word(void)
 	assert(0 == strcmp(out_buffer, "Hello, world!"));
 }
 
+void test_lex_null_character(void)
+{
+	// mbrtowc() reads the null character as zero bytes long
+	lex_t lex = lex_init(lit("'a\0b'"));
+	lex = lex_next(lex);
+
+	assert(lex.type == scallop_lang_classifier_word);
+	assert(lex.value.length == sizeof("'a\0b'") - 1);
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_end);
+}
+
+#define WIDE_SCRIPT L"echo 'hello world' \"$name\"; ls # done\n"
+
+void test_lex_wide(void)
+{
+	const wchar_t script[] = WIDE_SCRIPT;
+	lex_t lex = scallop_lang_lex_init_wide(script, sizeof(script) / sizeof(*script) - 1);
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word);
+	assert(lex.value.buffer == script);
+	assert(lex.value.length == sizeof("echo") - 1);
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word_separator);
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word);
+	assert(lex.value.buffer == script + sizeof("echo ") - 1);
+	assert(lex.value.length == sizeof("'hello world'") - 1);
+
+	lex = lex_next(lex);
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word);
+	assert(lex.value.length == sizeof("\"$name\"") - 1);
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_statement_separator);
+}
+
+/*
+ * Lexing a wide script gives the same tokens as lexing its
+ * multibyte encoding.
+ */
+void test_lex_wide_matches_multibyte(void)
+{
+	if (!setlocale(LC_ALL, "C.UTF-8"))
+		return;
+
+	const char bytes[] = "caf\xc3\xa9 'na\xc3\xafve' \"$x \xc3\xa9t\xc3\xa9\" # \xc3\xa7" "a\nls";
+	wchar_t wide[sizeof(bytes)] = { 0 };
+	const size_t wide_length = mbstowcs(wide, bytes, sizeof(bytes));
+	assert(wide_length != (size_t)-1);
+
+	lex_t lex = lex_init(lit(bytes));
+	lex_t wide_lex = scallop_lang_lex_init_wide(wide, wide_length);
+	do {
+		lex = lex_next(lex);
+		wide_lex = lex_next(wide_lex);
+		assert(lex.type == wide_lex.type);
+
+		char value[sizeof(bytes)] = { 0 };
+		memcpy(value, lex.value.buffer, (size_t)lex.value.length);
+		assert(mbstowcs(NULL, value, 0) == (size_t)wide_lex.value.length);
+	} while (lex.type != scallop_lang_classifier_end);
+
+	setlocale(LC_ALL, "C");
+}
+
+void test_lex_normalize_wide_word(void)
+{
+	const wchar_t word_buffer[] = L"\"Hello, \"'world'\\!";
+	wchar_t out_buffer[255] = { 0 };
+
+	const const_lptr_t word = {
+		.buffer = word_buffer,
+		.size = sizeof(wchar_t),
+		.length = sizeof(word_buffer) / sizeof(*word_buffer) - 1,
+	};
+	lptr_t out = libadt_lptr_init_array(out_buffer);
+
+	assert(scallop_lang_lex_normalize_wide_word(word, (lptr_t) { 0 }) == sizeof("Hello, world!") - 1);
+	assert(scallop_lang_lex_normalize_wide_word(word, out) == sizeof("Hello, world!") - 1);
+	assert(wcscmp(out_buffer, L"Hello, world!") == 0);
+
+	// Byte words, or a byte output buffer, are rejected
+	char bytes[255] = { 0 };
+	assert(scallop_lang_lex_normalize_wide_word(lit("word"), out) == -1);
+	assert(scallop_lang_lex_normalize_word(word, libadt_lptr_init_array(bytes)) == -1);
+}
+
+/*
+ * Checks scallop_lang_lex_next_normalized() gives the same tokens
+ * as scallop_lang_lex_next(), and the same words as
+ * scallop_lang_lex_normalize_word().
+ */
+static void check_normalized(const_lptr_t script)
+{
+	struct scallop_lang_lex_words words = { 0 };
+	lex_t lex = lex_init(script);
+	lex_t fused = lex_init(script);
+	size_t count = 0;
+	do {
+		lex = lex_next(lex);
+		fused = scallop_lang_lex_next_normalized(fused, &words);
+		assert(fused.type == lex.type);
+		assert(fused.value.buffer == lex.value.buffer);
+		assert(fused.value.length == lex.value.length);
+		if (!scallop_lang_classifier_is_word(lex.type))
+			continue;
+
+		char expected[256] = { 0 };
+		const ssize_t length = scallop_lang_lex_normalize_word(
+			lex.value,
+			(lptr_t) {
+				.buffer = expected,
+				.size = script.size,
+				.length = (ssize_t)(sizeof(expected) / script.size - 1),
+			}
+		);
+		assert(length >= 0 && (size_t)length == words.word_length);
+		assert(memcmp(
+			words.buffer + words.word,
+			expected,
+			((size_t)length + 1) * script.size
+		) == 0);
+		count++;
+	} while (lex.type != scallop_lang_classifier_end && lex.type != scallop_lang_classifier_unexpected);
+
+	// Words are kept one after another, each terminated
+	size_t total = 0;
+	for (size_t offset = 0; offset < words.length; offset += script.size)
+		total += memcmp(words.buffer + offset, "\0\0\0\0", script.size) == 0;
+	assert(total == count);
+	scallop_lang_lex_words_free(&words);
+}
+
+void test_lex_next_normalized(void)
+{
+	check_normalized(lit("echo \"Hello, \"'world'\\! $name \"$x y\" 'a''b' *.c"));
+	check_normalized(lit("  ;\n\"\" '' \\\\ {a [b c]} # comment\nlast"));
+	check_normalized(lit("'unterminated"));
+
+	const wchar_t wide[] = L"wide \"quoted word\" 'x'\\y";
+	check_normalized((const_lptr_t) {
+		.buffer = wide,
+		.size = sizeof(wchar_t),
+		.length = sizeof(wide) / sizeof(*wide) - 1,
+	});
+}
+
 int main()
 {
 	test_lex_init();
 	test_lex_next_simple();
 	test_lex_next_statement_separator_promotion();
+	test_lex_next_quoted();
 	test_lex_normalize_word();
+	test_lex_next_merged_words();
+	test_lex_next_lone_dollar();
+	test_lex_null_character();
+	test_lex_wide();
+	test_lex_wide_matches_multibyte();
+	test_lex_normalize_wide_word();
+	test_lex_next_normalized();
 }
@@ -0,0 +1,338 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "scallop-lang/builtin.h"
+#include "scallop-lang/optimize.h"
+
+#include <libadt/str.h>
+
+#define lit libadt_str_literal
+typedef struct scallop_lang_script script_t;
+typedef struct scallop_lang_script_block block_t;
+typedef struct scallop_lang_script_statement statement_t;
+typedef struct scallop_lang_script_word word_t;
+typedef struct scallop_lang_script_piece piece_t;
+typedef struct scallop_lang_script_context context_t;
+typedef struct scallop_lang_script_frame frame_t;
+typedef struct scallop_lang_optimize_stats stats_t;
+
+static int substitutions = 0;
+
+static const char *get_variable(void *user, const char *name)
+{
+	(void)user;
+	if (strcmp(name, "X") == 0)
+		return "ex";
+	if (strcmp(name, "Y") == 0)
+		return "why";
+	return NULL;
+}
+
+static char *substitute(void *user, const block_t *block);
+
+static const context_t context = {
+	.get_variable = get_variable,
+	.substitute = substitute,
+};
+
+/*
+ * Runs a substitution of builtins, as an interpreter would.
+ */
+static char *substitute(void *user, const block_t *block)
+{
+	(void)user;
+	substitutions++;
+
+	frame_t frame = { 0 };
+	if (scallop_lang_script_enter(block, &context, &frame))
+		return NULL;
+
+	int fds[2];
+	assert(pipe(fds) == 0);
+	const struct scallop_lang_builtin_context builtin_context = {
+		.in = -1,
+		.out = fds[1],
+		.err = fds[1],
+	};
+	for (size_t i = 0; i < block->statements_length; i++) {
+		char **const arguments = scallop_lang_script_arguments(
+			&frame,
+			&block->statements[i],
+			&context
+		);
+		assert(arguments);
+		size_t argc = 0;
+		while (arguments[argc])
+			argc++;
+		const struct scallop_lang_builtin *const builtin
+			= scallop_lang_builtin_find_name(arguments[0]);
+		if (builtin)
+			builtin->run(&builtin_context, argc, arguments);
+		scallop_lang_script_arguments_free(arguments);
+	}
+	close(fds[1]);
+	scallop_lang_script_leave(&frame);
+
+	char *const output = calloc(1024, 1);
+	ssize_t length = read(fds[0], output, 1023);
+	close(fds[0]);
+	assert(length >= 0);
+	while (length && output[length - 1] == '\n')
+		output[--length] = '\0';
+	return output;
+}
+
+static const piece_t *piece(const script_t *script, size_t statement, size_t word, size_t index)
+{
+	const word_t *const w = &script->root->statements[statement].words[word];
+	assert(index < w->pieces_length);
+	return &w->pieces[index];
+}
+
+static size_t pieces_length(const script_t *script, size_t statement, size_t word)
+{
+	return script->root->statements[statement].words[word].pieces_length;
+}
+
+/*
+ * Expands every statement of the outermost block into one string.
+ */
+static char *expand_all(const script_t *script)
+{
+	frame_t frame = { 0 };
+	assert(scallop_lang_script_enter(script->root, &context, &frame) == 0);
+
+	char *const result = calloc(4096, 1);
+	for (size_t i = 0; i < script->root->statements_length; i++) {
+		char **const arguments = scallop_lang_script_arguments(
+			&frame,
+			&script->root->statements[i],
+			&context
+		);
+		assert(arguments);
+		for (char **argument = arguments; *argument; argument++) {
+			strcat(result, *argument);
+			strcat(result, "|");
+		}
+		strcat(result, "\n");
+		scallop_lang_script_arguments_free(arguments);
+	}
+	scallop_lang_script_leave(&frame);
+	return result;
+}
+
+void test_optimize_words(void)
+{
+	script_t script = { 0 };
+	assert(scallop_lang_script_build(lit("echo hello 'a b' pre$X\"-$Y\"; echo hello"), &script) == 0);
+
+	stats_t stats = { 0 };
+	assert(scallop_lang_optimize(&script, SCALLOP_LANG_OPTIMIZE_WORDS, &stats) == 0);
+	assert(stats.words_normalized == 6);
+	assert(stats.literals_shared == 2);
+
+	assert(piece(&script, 0, 1, 0)->type == SCALLOP_LANG_SCRIPT_LITERAL);
+	assert(strcmp(piece(&script, 0, 2, 0)->text, "a b") == 0);
+
+	// Literal text is interned
+	assert(piece(&script, 0, 1, 0)->text == piece(&script, 1, 1, 0)->text);
+
+	assert(pieces_length(&script, 0, 3) == 4);
+	assert(strcmp(piece(&script, 0, 3, 0)->text, "pre") == 0);
+	assert(piece(&script, 0, 3, 1)->type == SCALLOP_LANG_SCRIPT_VARIABLE);
+	assert(strcmp(piece(&script, 0, 3, 1)->text, "X") == 0);
+	assert(strcmp(piece(&script, 0, 3, 2)->text, "-") == 0);
+	assert(piece(&script, 0, 3, 3)->type == SCALLOP_LANG_SCRIPT_VARIABLE);
+
+	scallop_lang_script_free(&script);
+}
+
+void test_optimize_empty_word(void)
+{
+	script_t script = { 0 };
+	assert(scallop_lang_script_build(lit("echo '' x\"\""), &script) == 0);
+
+	// An empty quoted word is one empty literal, without any text
+	// in its expansion plan
+	assert(scallop_lang_optimize(&script, SCALLOP_LANG_OPTIMIZE_WORDS, NULL) == 0);
+	assert(piece(&script, 0, 1, 0)->type == SCALLOP_LANG_SCRIPT_LITERAL);
+	assert(strcmp(piece(&script, 0, 1, 0)->text, "") == 0);
+	assert(strcmp(piece(&script, 0, 2, 0)->text, "x") == 0);
+
+	char *const result = expand_all(&script);
+	assert(strcmp(result, "echo||x|\n") == 0);
+	free(result);
+
+	scallop_lang_script_free(&script);
+}
+
+void test_optimize_fold(void)
+{
+	script_t script = { 0 };
+	assert(scallop_lang_script_build(
+		lit("echo [echo a  b] [true]x [false] [cat f] [echo [echo deep]] [echo $X]"),
+		&script
+	) == 0);
+
+	stats_t stats = { 0 };
+	assert(scallop_lang_optimize(
+		&script,
+		SCALLOP_LANG_OPTIMIZE_FOLD | SCALLOP_LANG_OPTIMIZE_MERGE,
+		&stats
+	) == 0);
+
+	assert(stats.substitutions_folded == 4);
+	assert(piece(&script, 0, 1, 0)->type == SCALLOP_LANG_SCRIPT_LITERAL);
+	assert(strcmp(piece(&script, 0, 1, 0)->text, "a b") == 0);
+
+	// The output of true is empty, and the raw x is still raw
+	assert(pieces_length(&script, 0, 2) == 2);
+	assert(piece(&script, 0, 2, 0)->length == 0);
+	assert(piece(&script, 0, 2, 1)->type == SCALLOP_LANG_SCRIPT_RAW);
+
+	// Failing, impure and variable substitutions stay
+	assert(piece(&script, 0, 3, 0)->type == SCALLOP_LANG_SCRIPT_SUBSTITUTION);
+	assert(piece(&script, 0, 4, 0)->type == SCALLOP_LANG_SCRIPT_SUBSTITUTION);
+	assert(strcmp(piece(&script, 0, 5, 0)->text, "deep") == 0);
+	assert(piece(&script, 0, 6, 0)->type == SCALLOP_LANG_SCRIPT_SUBSTITUTION);
+
+	scallop_lang_script_free(&script);
+}
+
+void test_optimize_merge(void)
+{
+	script_t script = { 0 };
+	assert(scallop_lang_script_build(lit("echo a[echo b]c[echo d]$X"), &script) == 0);
+
+	stats_t stats = { 0 };
+	assert(scallop_lang_optimize(&script, SCALLOP_LANG_OPTIMIZE_ALL, &stats) == 0);
+	assert(stats.substitutions_folded == 2);
+	assert(stats.slices_merged == 3);
+
+	assert(pieces_length(&script, 0, 1) == 2);
+	assert(strcmp(piece(&script, 0, 1, 0)->text, "abcd") == 0);
+	assert(piece(&script, 0, 1, 1)->type == SCALLOP_LANG_SCRIPT_VARIABLE);
+
+	scallop_lang_script_free(&script);
+}
+
+void test_optimize_hoist(void)
+{
+	script_t script = { 0 };
+	assert(scallop_lang_script_build(
+		lit("echo [echo $X] one; echo two [echo $X]; echo [echo $Y]"),
+		&script
+	) == 0);
+
+	stats_t stats = { 0 };
+	assert(scallop_lang_optimize(&script, SCALLOP_LANG_OPTIMIZE_ALL, &stats) == 0);
+	assert(stats.substitutions_hoisted == 2);
+	assert(script.root->hoisted_length == 1);
+	assert(piece(&script, 0, 1, 0)->type == SCALLOP_LANG_SCRIPT_HOISTED);
+	assert(piece(&script, 1, 2, 0)->block == piece(&script, 0, 1, 0)->block);
+	assert(piece(&script, 2, 1, 0)->type == SCALLOP_LANG_SCRIPT_SUBSTITUTION);
+
+	// Entering the block runs it once, for both statements
+	substitutions = 0;
+	char *const expanded = expand_all(&script);
+	assert(strcmp(expanded, "echo|ex|one|\necho|two|ex|\necho|why|\n") == 0);
+	assert(substitutions == 2);
+	free(expanded);
+
+	scallop_lang_script_free(&script);
+
+	// Nothing is hoisted from blocks which might change variables
+	assert(scallop_lang_script_build(
+		lit("{ echo [echo $X]; set X 1; echo [echo $X] }; $cmd [echo $Y] [echo $Y]"),
+		&script
+	) == 0);
+	stats = (stats_t) { 0 };
+	assert(scallop_lang_optimize(&script, SCALLOP_LANG_OPTIMIZE_ALL, &stats) == 0);
+	assert(stats.substitutions_hoisted == 0);
+	scallop_lang_script_free(&script);
+}
+
+void test_optimize_passes_off(void)
+{
+	script_t script = { 0 };
+	assert(scallop_lang_script_build(lit("echo [echo a] b"), &script) == 0);
+
+	stats_t stats = { 0 };
+	assert(scallop_lang_optimize(&script, 0, &stats) == 0);
+	assert(piece(&script, 0, 0, 0)->type == SCALLOP_LANG_SCRIPT_RAW);
+	assert(piece(&script, 0, 1, 0)->type == SCALLOP_LANG_SCRIPT_SUBSTITUTION);
+
+	assert(scallop_lang_optimize(
+		&script,
+		SCALLOP_LANG_OPTIMIZE_ALL & ~SCALLOP_LANG_OPTIMIZE_FOLD,
+		&stats
+	) == 0);
+	assert(piece(&script, 0, 0, 0)->type == SCALLOP_LANG_SCRIPT_LITERAL);
+	assert(piece(&script, 0, 1, 0)->type == SCALLOP_LANG_SCRIPT_SUBSTITUTION);
+	assert(stats.substitutions_folded == 0);
+
+	scallop_lang_script_free(&script);
+}
+
+void test_optimize_equivalent(void)
+{
+	static const char *const scripts[] = {
+		"echo plain 'single quoted' \"double $X quoted\" \\escaped",
+		"echo [echo a b] [echo $X]-[echo $X] x[echo $Y]y [true]",
+		"echo [echo [echo nested $X] [echo nested $X]] $UNSET''",
+		"echo a[echo b]c$X[echo d]''e; echo [echo $X] [echo $X]",
+	};
+
+	for (size_t i = 0; i < sizeof(scripts) / sizeof(*scripts); i++) {
+		const struct libadt_const_lptr text = {
+			.buffer = scripts[i],
+			.size = 1,
+			.length = (ssize_t)strlen(scripts[i]),
+		};
+
+		script_t plain = { 0 };
+		script_t optimized = { 0 };
+		assert(scallop_lang_script_build(text, &plain) == 0);
+		assert(scallop_lang_script_build(text, &optimized) == 0);
+		assert(scallop_lang_optimize(&optimized, SCALLOP_LANG_OPTIMIZE_ALL, NULL) == 0);
+
+		char *const expected = expand_all(&plain);
+		char *const actual = expand_all(&optimized);
+		assert(strcmp(expected, actual) == 0);
+		free(expected);
+		free(actual);
+
+		scallop_lang_script_free(&plain);
+		scallop_lang_script_free(&optimized);
+	}
+}
+
+int main()
+{
+	test_optimize_words();
+	test_optimize_empty_word();
+	test_optimize_fold();
+	test_optimize_merge();
+	test_optimize_hoist();
+	test_optimize_passes_off();
+	test_optimize_equivalent();
+}
@@ -0,0 +1,130 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "scallop-lang/output.h"
+
+typedef struct scallop_lang_output output_t;
+
+static int target = -1;
+
+static void reset(void)
+{
+	char path[] = "/tmp/scallop-output-test-XXXXXX";
+	if (target >= 0)
+		close(target);
+	target = mkstemp(path);
+	assert(target >= 0);
+	unlink(path);
+}
+
+static void assert_written(const char *expected)
+{
+	char buffer[4096] = { 0 };
+	const ssize_t length = pread(target, buffer, sizeof(buffer) - 1, 0);
+	assert(length >= 0);
+	assert(strcmp(buffer, expected) == 0);
+}
+
+static void put(output_t *output, size_t stream, const char *text)
+{
+	assert(scallop_lang_output_write(output, stream, text, strlen(text)) == 0);
+}
+
+void test_output_ordered(void)
+{
+	reset();
+	output_t output = { 0 };
+	assert(scallop_lang_output_init(&output, target, 3, SCALLOP_LANG_OUTPUT_ORDERED, 1024) == 0);
+
+	put(&output, 2, "c1 ");
+	put(&output, 0, "a1 ");
+	put(&output, 1, "b1 ");
+	assert_written("a1 ");
+
+	put(&output, 2, "c2 ");
+	assert(scallop_lang_output_close(&output, 2) == 0);
+	assert_written("a1 ");
+
+	put(&output, 0, "a2 ");
+	assert(scallop_lang_output_close(&output, 0) == 0);
+	assert_written("a1 a2 b1 ");
+
+	// The head stream writes straight through
+	put(&output, 1, "b2 ");
+	assert_written("a1 a2 b1 b2 ");
+	assert(scallop_lang_output_close(&output, 1) == 0);
+	assert_written("a1 a2 b1 b2 c1 c2 ");
+
+	assert(scallop_lang_output_write(&output, 1, "x", 1) == -1);
+	assert(errno == EINVAL);
+	scallop_lang_output_free(&output);
+}
+
+void test_output_spill(void)
+{
+	reset();
+	output_t output = { 0 };
+	assert(scallop_lang_output_init(&output, target, 2, SCALLOP_LANG_OUTPUT_ORDERED, 256) == 0);
+
+	char expected[2048] = { 0 };
+	for (size_t i = 0; i < 100; i++) {
+		char line[16];
+		snprintf(line, sizeof(line), "%zu\n", i);
+		put(&output, 1, line);
+		strcat(expected, line);
+	}
+	assert(output._memory <= 256);
+
+	assert(scallop_lang_output_close(&output, 1) == 0);
+	assert_written("");
+	assert(scallop_lang_output_close(&output, 0) == 0);
+	assert_written(expected);
+	scallop_lang_output_free(&output);
+}
+
+void test_output_lines(void)
+{
+	reset();
+	output_t output = { 0 };
+	assert(scallop_lang_output_init(&output, target, 2, SCALLOP_LANG_OUTPUT_LINES, 1024) == 0);
+
+	put(&output, 1, "b1");
+	put(&output, 0, "a1\na");
+	assert_written("a1\n");
+	put(&output, 1, "\nb2\n");
+	assert_written("a1\nb1\nb2\n");
+	put(&output, 0, "2");
+	assert(scallop_lang_output_close(&output, 0) == 0);
+	assert_written("a1\nb1\nb2\na2");
+	assert(scallop_lang_output_close(&output, 1) == 0);
+	scallop_lang_output_free(&output);
+}
+
+int main()
+{
+	test_output_ordered();
+	test_output_spill();
+	test_output_lines();
+	close(target);
+}
@@ -1,26 +1,202 @@
 /*
  * Scallop - A Shell Language for Parallelization (Language Definition)
  * Copyright (C) 2024  Marcus Harrison
- * 
+ *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
  * the Free Software Foundation, either version 3 of the License, or
  * (at your option) any later version.
- * 
+ *
  * This program is distributed in the hope that it will be useful,
  * but WITHOUT ANY WARRANTY; without even the implied warranty of
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
  * GNU General Public License for more details.
- * 
+ *
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
-
 #include <assert.h>
+#include <errno.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
 #include "scallop-lang/parse.h"
 
+#include <libadt/str.h>
+
+#define lit libadt_str_literal
+typedef struct scallop_lang_parse_event event_t;
+
+/*
+ * Records events as a string: "(" and ")" for statements, the
+ * brackets themselves for blocks and substitutions, and words
+ * between slashes. Statement ends are followed by their length.
+ */
+typedef struct {
+	char events[512];
+	size_t length;
+	size_t max_depth;
+	size_t stop_after;
+} record_t;
+
+static int record(void *user, const event_t *event)
+{
+	record_t *const record = user;
+	char *const out = record->events + record->length;
+	const size_t space = sizeof(record->events) - record->length;
+	const int value_length = (int)event->value.length;
+	const char *const value = event->value.buffer;
+
+	int written = 0;
+	switch (event->type) {
+	case SCALLOP_LANG_PARSE_STATEMENT_BEGIN:
+		assert(event->value.length == 0);
+		written = snprintf(out, space, "(");
+		break;
+	case SCALLOP_LANG_PARSE_STATEMENT_END:
+		written = snprintf(out, space, ")%d", value_length);
+		break;
+	case SCALLOP_LANG_PARSE_WORD:
+		written = snprintf(out, space, "/%.*s/", value_length, value);
+		break;
+	case SCALLOP_LANG_PARSE_BLOCK_BEGIN:
+	case SCALLOP_LANG_PARSE_BLOCK_END:
+	case SCALLOP_LANG_PARSE_SUBSTITUTION_BEGIN:
+	case SCALLOP_LANG_PARSE_SUBSTITUTION_END:
+		assert(event->value.length == 1);
+		written = snprintf(out, space, "%.1s", value);
+		break;
+	}
+	assert(written > 0 && (size_t)written < space);
+	record->length += (size_t)written;
+
+	if (event->depth > record->max_depth)
+		record->max_depth = event->depth;
+	return record->stop_after && record->length >= record->stop_after;
+}
+
+void test_parse_statements(void)
+{
+	record_t result = { 0 };
+	assert(scallop_lang_parse(lit("echo 'a b' $x;\n; ls  # comment\n"), record, &result) == 0);
+	assert(strcmp(result.events, "(/echo//'a b'//$x/)13(/ls/)2") == 0);
+	assert(result.max_depth == 0);
+}
+
+void test_parse_blocks(void)
+{
+	record_t result = { 0 };
+	assert(scallop_lang_parse(lit("if x {a; b [c d]}\nlast"), record, &result) == 0);
+	assert(strcmp(
+		result.events,
+		"(/if//x/{(/a/)1(/b/[(/c//d/)3])7})17(/last/)4"
+	) == 0);
+	assert(result.max_depth == 2);
+}
+
+void test_parse_nested_brackets(void)
+{
+	// Consecutive brackets are lexed as one token
+	record_t result = { 0 };
+	assert(scallop_lang_parse(lit("{{x}}"), record, &result) == 0);
+	assert(strcmp(result.events, "({({(/x/)1})3})5") == 0);
+	assert(result.max_depth == 2);
+}
+
+void test_parse_empty(void)
+{
+	record_t result = { 0 };
+	assert(scallop_lang_parse(lit(" ;\n# only a comment\n"), record, &result) == 0);
+	assert(result.length == 0);
+}
+
+void test_parse_errors(void)
+{
+	record_t result = { 0 };
+	errno = 0;
+	assert(scallop_lang_parse(lit("a {b]"), record, &result) == -1);
+	assert(errno == EINVAL);
+
+	result = (record_t) { 0 };
+	errno = 0;
+	assert(scallop_lang_parse(lit("a }"), record, &result) == -1);
+	assert(errno == EINVAL);
+
+	result = (record_t) { 0 };
+	errno = 0;
+	assert(scallop_lang_parse(lit("a [b"), record, &result) == -1);
+	assert(errno == EINVAL);
+
+	result = (record_t) { 0 };
+	errno = 0;
+	assert(scallop_lang_parse(lit("'unterminated"), record, &result) == -1);
+	assert(errno == EINVAL);
+}
+
+void test_parse_depth_limit(void)
+{
+	char script[2 * (SCALLOP_LANG_PARSE_MAX_DEPTH + 1)] = { 0 };
+	memset(script, '{', SCALLOP_LANG_PARSE_MAX_DEPTH);
+	memset(script + SCALLOP_LANG_PARSE_MAX_DEPTH, '}', SCALLOP_LANG_PARSE_MAX_DEPTH);
+
+	const struct libadt_const_lptr deepest = {
+		.buffer = script,
+		.size = 1,
+		.length = 2 * SCALLOP_LANG_PARSE_MAX_DEPTH,
+	};
+	record_t result = { 0 };
+	assert(scallop_lang_parse(deepest, record, &result) == 0);
+	assert(result.max_depth == SCALLOP_LANG_PARSE_MAX_DEPTH - 1);
+
+	memset(script, '{', SCALLOP_LANG_PARSE_MAX_DEPTH + 1);
+	memset(script + SCALLOP_LANG_PARSE_MAX_DEPTH + 1, '}', SCALLOP_LANG_PARSE_MAX_DEPTH + 1);
+	const struct libadt_const_lptr too_deep = {
+		.buffer = script,
+		.size = 1,
+		.length = 2 * (SCALLOP_LANG_PARSE_MAX_DEPTH + 1),
+	};
+	result = (record_t) { 0 };
+	errno = 0;
+	assert(scallop_lang_parse(too_deep, record, &result) == -1);
+	assert(errno == E2BIG);
+}
+
+void test_parse_stop(void)
+{
+	record_t result = { .stop_after = 1 };
+	assert(scallop_lang_parse(lit("a; b; c"), record, &result) == 1);
+	assert(strcmp(result.events, "(") == 0);
+}
+
+static int count_events(void *user, const event_t *event)
+{
+	(void)event;
+	(*(size_t *)user)++;
+	return 0;
+}
+
+void test_parse_wide(void)
+{
+	const wchar_t script[] = L"a {b}";
+	const struct libadt_const_lptr wide = {
+		.buffer = script,
+		.size = sizeof(wchar_t),
+		.length = sizeof(script) / sizeof(*script) - 1,
+	};
+
+	size_t events = 0;
+	assert(scallop_lang_parse(wide, count_events, &events) == 0);
+	assert(events == 8);
+}
+
 int main()
 {
-	assert(false);
+	test_parse_statements();
+	test_parse_blocks();
+	test_parse_nested_brackets();
+	test_parse_empty();
+	test_parse_errors();
+	test_parse_depth_limit();
+	test_parse_stop();
+	test_parse_wide();
 }
@@ -0,0 +1,222 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "scallop-lang/remote.h"
+
+#include <libadt/str.h>
+
+#define lit libadt_str_literal
+typedef struct scallop_lang_remote_job job_t;
+
+#define WORKERS 3
+
+static char roots[WORKERS][32];
+static int sockets[WORKERS];
+static pid_t pids[WORKERS];
+static struct scallop_lang_remote remote;
+
+typedef struct {
+	char out[8][64];
+	char err[8][64];
+} output_t;
+
+static int collect(
+	void *user,
+	size_t job,
+	enum scallop_lang_remote_stream stream,
+	const void *data,
+	size_t length
+)
+{
+	output_t *const output = user;
+	char *const buffer = stream == SCALLOP_LANG_REMOTE_STDOUT
+		? output->out[job]
+		: output->err[job];
+	const size_t used = strlen(buffer);
+	assert(used + length < 64);
+	memcpy(buffer + used, data, length);
+	return 0;
+}
+
+static void start_workers(void)
+{
+	for (size_t i = 0; i < WORKERS; i++) {
+		snprintf(roots[i], sizeof(roots[i]), "/tmp/scallop-remote-XXXXXX");
+		assert(mkdtemp(roots[i]));
+
+		int pair[2];
+		assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+		pids[i] = fork();
+		assert(pids[i] >= 0);
+		if (pids[i] == 0) {
+			for (size_t j = 0; j < i; j++)
+				close(sockets[j]);
+			close(pair[0]);
+			const int directory = open(roots[i], O_RDONLY | O_DIRECTORY);
+			_exit(scallop_lang_remote_serve(pair[1], directory, i + 1) ? 1 : 0);
+		}
+		close(pair[1]);
+		sockets[i] = pair[0];
+	}
+	assert(scallop_lang_remote_init(&remote, sockets, WORKERS) == 0);
+}
+
+static void stop_workers(void)
+{
+	scallop_lang_remote_free(&remote);
+	for (size_t i = 0; i < WORKERS; i++) {
+		close(sockets[i]);
+		int status = 0;
+		assert(waitpid(pids[i], &status, 0) == pids[i]);
+		assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	}
+}
+
+void test_remote_run(void)
+{
+	static const char input[] = "from the coordinator\n";
+	const struct scallop_lang_remote_file files[] = {
+		{ .path = "inputs/message", .content = input, .length = sizeof(input) - 1 },
+	};
+	char *const environment[] = { "SCALLOP_GREETING=hi", "HOME", NULL };
+
+	job_t jobs[] = {
+		{ .statement = lit("echo hello 'quoted words'") },
+		{ .statement = lit("sh -c 'echo oops >&2; exit 3'\n") },
+		{ .statement = lit("printenv SCALLOP_GREETING"), .environment = environment },
+		{ .statement = lit("cat inputs/message"), .files = files, .files_length = 1 },
+		{ .statement = lit("sh -c 'test -z \"$HOME\"'"), .environment = environment },
+		{ .statement = lit("echo 'unterminated") },
+		{ .statement = lit("echo one; echo two") },
+		{ .statement = lit("cat ../escape"), .files = (struct scallop_lang_remote_file[]) {
+			{ .path = "../escape", .content = "", .length = 0 },
+		}, .files_length = 1 },
+	};
+	const size_t length = sizeof(jobs) / sizeof(*jobs);
+
+	output_t output = { 0 };
+	const struct scallop_lang_remote_options options = {
+		.output = collect,
+		.user = &output,
+	};
+	assert(scallop_lang_remote_run(&remote, jobs, length, &options) == 1);
+
+	assert(WIFEXITED(jobs[0].status) && WEXITSTATUS(jobs[0].status) == 0);
+	assert(strcmp(output.out[0], "hello quoted words\n") == 0);
+
+	assert(WIFEXITED(jobs[1].status) && WEXITSTATUS(jobs[1].status) == 3);
+	assert(strcmp(output.err[1], "oops\n") == 0);
+
+	assert(jobs[2].status == 0);
+	assert(strcmp(output.out[2], "hi\n") == 0);
+	assert(jobs[3].status == 0);
+	assert(strcmp(output.out[3], input) == 0);
+	assert(jobs[4].status == 0);
+
+	for (size_t i = 5; i < length; i++) {
+		assert(jobs[i].status == -1);
+		assert(jobs[i].error == EINVAL);
+	}
+
+	// Every worker got work
+	bool used[WORKERS] = { 0 };
+	for (size_t i = 0; i < length; i++) {
+		assert(jobs[i].worker < WORKERS);
+		used[jobs[i].worker] = true;
+	}
+	for (size_t i = 0; i < WORKERS; i++)
+		assert(used[i]);
+
+	char path[64];
+	snprintf(path, sizeof(path), "%s/inputs/message", roots[jobs[3].worker]);
+	assert(unlink(path) == 0);
+	snprintf(path, sizeof(path), "%s/inputs", roots[jobs[3].worker]);
+	assert(rmdir(path) == 0);
+
+	// Workers keep serving later runs
+	assert(scallop_lang_remote_run(&remote, jobs, 1, NULL) == 0);
+	assert(scallop_lang_remote_run(&remote, NULL, 0, NULL) == 0);
+}
+
+void test_remote_lost(void)
+{
+	int pair[2];
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+	const pid_t pid = fork();
+	assert(pid >= 0);
+	if (pid == 0) {
+		// Its command outlives it, and mustn't keep the other
+		// workers' connections open
+		for (size_t i = 0; i < WORKERS; i++)
+			close(sockets[i]);
+		close(pair[0]);
+		const int directory = open(roots[0], O_RDONLY | O_DIRECTORY);
+		scallop_lang_remote_serve(pair[1], directory, 4);
+		_exit(0);
+	}
+	close(pair[1]);
+
+	// The worker dies while running its job, which fails, and the
+	// remaining jobs have nowhere to run
+	job_t jobs[] = {
+		{ .statement = lit("sleep 2") },
+		{ .statement = lit("true") },
+	};
+	struct scallop_lang_remote lone = { 0 };
+	assert(scallop_lang_remote_init(&lone, pair, 1) == 0);
+	const pid_t killer = fork();
+	if (killer == 0) {
+		usleep(100000);
+		kill(pid, SIGKILL);
+		_exit(0);
+	}
+	assert(scallop_lang_remote_run(&lone, jobs, 1, NULL) == 1);
+	assert(jobs[0].status == -1 && jobs[0].error == ECONNRESET);
+	waitpid(killer, NULL, 0);
+	waitpid(pid, NULL, 0);
+
+	assert(scallop_lang_remote_run(&lone, jobs + 1, 1, NULL) == 1);
+	assert(jobs[1].status == -1 && jobs[1].error == ECONNRESET);
+	scallop_lang_remote_free(&lone);
+	close(pair[0]);
+
+	// A worker that never announces itself can't be used
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+	close(pair[1]);
+	assert(scallop_lang_remote_init(&lone, pair, 1) == -1);
+	close(pair[0]);
+}
+
+int main()
+{
+	start_workers();
+	test_remote_run();
+	test_remote_lost();
+	stop_workers();
+	for (size_t i = 0; i < WORKERS; i++)
+		rmdir(roots[i]);
+}
@@ -0,0 +1,170 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include "scallop-lang/script.h"
+
+#include <libadt/str.h>
+
+#define lit libadt_str_literal
+typedef struct scallop_lang_script script_t;
+typedef struct scallop_lang_script_block block_t;
+typedef struct scallop_lang_script_statement statement_t;
+typedef struct scallop_lang_script_context context_t;
+typedef struct scallop_lang_script_frame frame_t;
+
+static int substitutions = 0;
+
+static const char *get_variable(void *user, const char *name)
+{
+	(void)user;
+	return strcmp(name, "HOME") == 0 ? "/home/user" : NULL;
+}
+
+static char *substitute(void *user, const block_t *block)
+{
+	(void)user;
+	(void)block;
+	substitutions++;
+	return strdup("S");
+}
+
+static const context_t context = {
+	.get_variable = get_variable,
+	.substitute = substitute,
+};
+
+static void assert_arguments(const frame_t *frame, const statement_t *statement, char *const *expected)
+{
+	char **const arguments = scallop_lang_script_arguments(frame, statement, &context);
+	assert(arguments);
+	size_t i = 0;
+	for (; expected[i]; i++) {
+		assert(arguments[i]);
+		assert(strcmp(arguments[i], expected[i]) == 0);
+	}
+	assert(!arguments[i]);
+	scallop_lang_script_arguments_free(arguments);
+}
+
+#define TEST_SCRIPT "echo hello 'quoted word' $HOME $UNSET\n{ a; b }; x[echo y]z"
+
+void test_script_build(void)
+{
+	script_t script = { 0 };
+	assert(scallop_lang_script_build(lit(TEST_SCRIPT), &script) == 0);
+
+	const block_t *const root = script.root;
+	assert(root->statements_length == 3);
+	assert(root->statements[0].words_length == 5);
+	assert(root->statements[0].words[1].pieces_length == 1);
+	assert(root->statements[0].words[1].pieces[0].type == SCALLOP_LANG_SCRIPT_RAW);
+	assert(root->statements[0].words[1].pieces[0].length == sizeof("hello") - 1);
+
+	// A statement of just a block
+	const statement_t *const block = &root->statements[1];
+	assert(block->words_length == 1);
+	assert(block->words[0].pieces_length == 1);
+	assert(block->words[0].pieces[0].type == SCALLOP_LANG_SCRIPT_BLOCK);
+	assert(block->words[0].pieces[0].block->statements_length == 2);
+
+	// Pieces written next to each other make up one word
+	const statement_t *const joined = &root->statements[2];
+	assert(joined->words_length == 1);
+	assert(joined->words[0].pieces_length == 3);
+	assert(joined->words[0].pieces[1].type == SCALLOP_LANG_SCRIPT_SUBSTITUTION);
+	const struct libadt_const_lptr source = joined->words[0].pieces[1].block->source;
+	assert(source.length == sizeof("[echo y]") - 1);
+	assert(memcmp(source.buffer, "[echo y]", (size_t)source.length) == 0);
+
+	scallop_lang_script_free(&script);
+}
+
+void test_script_arguments(void)
+{
+	script_t script = { 0 };
+	assert(scallop_lang_script_build(lit(TEST_SCRIPT), &script) == 0);
+
+	frame_t frame = { 0 };
+	assert(scallop_lang_script_enter(script.root, &context, &frame) == 0);
+
+	assert_arguments(&frame, &script.root->statements[0], (char *[]) {
+		"echo", "hello", "quoted word", "/home/user", "", NULL,
+	});
+
+	substitutions = 0;
+	assert_arguments(&frame, &script.root->statements[2], (char *[]) { "xSz", NULL });
+	assert(substitutions == 1);
+
+	// Blocks aren't arguments
+	errno = 0;
+	assert(!scallop_lang_script_arguments(&frame, &script.root->statements[1], &context));
+	assert(errno == EINVAL);
+
+	scallop_lang_script_leave(&frame);
+	scallop_lang_script_free(&script);
+}
+
+void test_script_intern(void)
+{
+	script_t script = { 0 };
+	assert(scallop_lang_script_build(lit("echo"), &script) == 0);
+
+	const char *const first = scallop_lang_script_intern(&script, "word", 4);
+	assert(first && strcmp(first, "word") == 0);
+	assert(scallop_lang_script_intern(&script, "word", 4) == first);
+	assert(scallop_lang_script_intern(&script, "words", 4) == first);
+	assert(scallop_lang_script_intern(&script, "wor", 3) != first);
+	assert(scallop_lang_script_intern(&script, "a\0b", 3) != scallop_lang_script_intern(&script, "a\0c", 3));
+
+	// Enough strings to grow the pool
+	char buffer[16];
+	for (int i = 0; i < 1000; i++) {
+		const int length = snprintf(buffer, sizeof(buffer), "s%d", i);
+		assert(scallop_lang_script_intern(&script, buffer, (size_t)length));
+	}
+	assert(scallop_lang_script_intern(&script, "word", 4) == first);
+
+	scallop_lang_script_free(&script);
+}
+
+void test_script_invalid(void)
+{
+	script_t script = { 0 };
+	errno = 0;
+	assert(scallop_lang_script_build(lit("echo [a"), &script) == -1);
+	assert(errno == EINVAL);
+
+	const wchar_t wide[] = L"echo";
+	errno = 0;
+	assert(scallop_lang_script_build(libadt_const_lptr_init_array(wide), &script) == -1);
+	assert(errno == EINVAL);
+}
+
+int main()
+{
+	test_script_build();
+	test_script_arguments();
+	test_script_intern();
+	test_script_invalid();
+}
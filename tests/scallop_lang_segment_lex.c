@@ -0,0 +1,208 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+#include <locale.h>
+#include "scallop-lang/segment_lex.h"
+
+#include <libadt/str.h>
+
+#define lit libadt_str_literal
+#define lex_init scallop_lang_segment_lex_init
+#define lex_next scallop_lang_segment_lex_next
+typedef struct scallop_lang_segment_lex lex_t;
+typedef struct libadt_const_lptr const_lptr_t;
+typedef struct libadt_lptr lptr_t;
+
+#define TEST_SCRIPT "word \"quoted word\"\\;  ;\n  next [sub] {block} # comment\n"
+
+static const_lptr_t segments_of(const_lptr_t *array, ssize_t length)
+{
+	return (const_lptr_t) {
+		.buffer = array,
+		.size = sizeof(*array),
+		.length = length,
+	};
+}
+
+static const_lptr_t split(const char *script, ssize_t at, ssize_t length)
+{
+	return (const_lptr_t) {
+		.buffer = script + at,
+		.size = 1,
+		.length = length,
+	};
+}
+
+void test_segment_lex_simple(void)
+{
+	const_lptr_t array[] = {
+		lit("wo"),
+		lit("rd seco"),
+		lit(""),
+		lit("nd_word"),
+	};
+	lex_t lex = lex_init(segments_of(array, 4));
+	char out[32] = { 0 };
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word);
+	assert(scallop_lang_segment_lex_pieces(lex) == 2);
+	assert(scallop_lang_segment_lex_copy(lex, libadt_lptr_init_array(out)) == 4);
+	assert(strcmp(out, "word") == 0);
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word_separator);
+	assert(scallop_lang_segment_lex_pieces(lex) == 1);
+	assert(scallop_lang_segment_lex_piece(lex, 0).length == 1);
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word);
+	memset(out, 0, sizeof(out));
+	assert(scallop_lang_segment_lex_copy(lex, libadt_lptr_init_array(out)) == 11);
+	assert(strcmp(out, "second_word") == 0);
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_end);
+}
+
+void test_segment_lex_single_piece_in_place(void)
+{
+	const_lptr_t array[] = { lit("first "), lit("second") };
+	lex_t lex = lex_init(segments_of(array, 2));
+
+	lex = lex_next(lex);
+	lex = lex_next(lex);
+	lex = lex_next(lex);
+
+	assert(lex.type == scallop_lang_classifier_word);
+	assert(scallop_lang_segment_lex_pieces(lex) == 1);
+	assert(scallop_lang_segment_lex_piece(lex, 0).buffer == array[1].buffer);
+}
+
+/*
+ * Splitting a script at any point must produce the same tokens
+ * as lexing it as a single segment.
+ */
+void test_segment_lex_every_split(void)
+{
+	const char script[] = TEST_SCRIPT;
+	const ssize_t length = sizeof(TEST_SCRIPT) - 1;
+
+	for (ssize_t at = 0; at <= length; at++) {
+		const_lptr_t whole_array[] = { split(script, 0, length) };
+		const_lptr_t split_array[] = {
+			split(script, 0, at),
+			split(script, at, length - at),
+		};
+		lex_t whole = lex_init(segments_of(whole_array, 1));
+		lex_t parts = lex_init(segments_of(split_array, 2));
+
+		do {
+			whole = lex_next(whole);
+			parts = lex_next(parts);
+
+			char whole_out[64] = { 0 };
+			char parts_out[64] = { 0 };
+			assert(whole.type == parts.type);
+			assert(
+				scallop_lang_segment_lex_copy(whole, libadt_lptr_init_array(whole_out))
+				== scallop_lang_segment_lex_copy(parts, libadt_lptr_init_array(parts_out))
+			);
+			assert(strcmp(whole_out, parts_out) == 0);
+		} while (
+			whole.type != scallop_lang_classifier_end
+			&& whole.type != scallop_lang_classifier_unexpected
+		);
+		assert(whole.type == scallop_lang_classifier_end);
+	}
+}
+
+void test_segment_lex_statement_separator_promotion(void)
+{
+	const_lptr_t array[] = { lit("  ;"), lit("\n "), lit(" ;") };
+	lex_t lex = lex_init(segments_of(array, 3));
+	lex = lex_next(lex);
+
+	assert(lex.type == scallop_lang_classifier_statement_separator);
+	assert(scallop_lang_segment_lex_pieces(lex) == 3);
+}
+
+void test_segment_lex_normalize_word(void)
+{
+	const_lptr_t array[] = { lit("\"Hello, \"'wo"), lit("rld'\\"), lit("!") };
+	lex_t lex = lex_init(segments_of(array, 3));
+	char out[255] = { 0 };
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word);
+
+	const ssize_t result = scallop_lang_segment_lex_normalize_word(
+		lex,
+		libadt_lptr_init_array(out)
+	);
+	assert(result == sizeof("Hello, world!") - 1);
+	assert(strcmp(out, "Hello, world!") == 0);
+}
+
+void test_segment_lex_multibyte_boundary(void)
+{
+	if (!setlocale(LC_ALL, "C.UTF-8"))
+		return;
+
+	// "é" is 0xc3 0xa9 in UTF-8
+	const_lptr_t array[] = { lit("caf\xc3"), lit("\xa9 x") };
+	lex_t lex = lex_init(segments_of(array, 2));
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word);
+	assert(scallop_lang_segment_lex_pieces(lex) == 2);
+	assert(scallop_lang_segment_lex_copy(lex, (lptr_t) { 0 }) == 5);
+
+	lex = lex_next(lex);
+	assert(lex.type == scallop_lang_classifier_word_separator);
+
+	setlocale(LC_ALL, "C");
+}
+
+void test_segment_lex_unterminated(void)
+{
+	const_lptr_t array[] = { lit("'never"), lit(" closed") };
+	lex_t lex = lex_init(segments_of(array, 2));
+
+	do
+		lex = lex_next(lex);
+	while (
+		lex.type != scallop_lang_classifier_end
+		&& lex.type != scallop_lang_classifier_unexpected
+	);
+	assert(lex.type == scallop_lang_classifier_unexpected);
+}
+
+int main()
+{
+	test_segment_lex_simple();
+	test_segment_lex_single_piece_in_place();
+	test_segment_lex_every_split();
+	test_segment_lex_statement_separator_promotion();
+	test_segment_lex_normalize_word();
+	test_segment_lex_multibyte_boundary();
+	test_segment_lex_unterminated();
+}
@@ -0,0 +1,156 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// For sched_getaffinity() and the CPU_* macros
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "scallop-lang/topology.h"
+
+typedef struct scallop_lang_topology topology_t;
+
+static char root[] = "/tmp/scallop-topology-XXXXXX";
+
+// The files of a fake /sys/devices/system/cpu, in creation order
+static const char *const files[][2] = {
+	{ "online", "0-3,5\n" },
+	// An SMT pair on a newer kernel
+	{ "cpu0/topology/core_cpus_list", "0,2\n" },
+	{ "cpu2/topology/core_cpus_list", "0,2\n" },
+	// An SMT pair on an older kernel
+	{ "cpu1/topology/thread_siblings_list", "1,3\n" },
+	{ "cpu3/topology/thread_siblings_list", "1,3\n" },
+	// A sibling that's offline
+	{ "cpu5/topology/core_cpus_list", "5-6\n" },
+};
+
+static const char *join(const char *name)
+{
+	static char path[256];
+	snprintf(path, sizeof(path), "%s/%s", root, name);
+	return path;
+}
+
+static void write_file(const char *name, const char *contents)
+{
+	char directory[256];
+	snprintf(directory, sizeof(directory), "%s", join(name));
+	for (char *slash = strchr(directory + strlen(root) + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+		*slash = '\0';
+		mkdir(directory, 0700);
+		*slash = '/';
+	}
+
+	FILE *const file = fopen(join(name), "w");
+	assert(file);
+	assert(fputs(contents, file) >= 0);
+	assert(fclose(file) == 0);
+}
+
+static void remove_files(void)
+{
+	for (size_t i = sizeof(files) / sizeof(*files); i-- > 0;) {
+		unlink(join(files[i][0]));
+		char directory[256];
+		snprintf(directory, sizeof(directory), "%s", files[i][0]);
+		for (char *slash = strrchr(directory, '/'); slash; slash = strrchr(directory, '/')) {
+			*slash = '\0';
+			rmdir(join(directory));
+		}
+	}
+	rmdir(root);
+}
+
+void test_topology_cores(void)
+{
+	topology_t topology = { 0 };
+	assert(scallop_lang_topology_init(&topology, root) == 0);
+
+	assert(topology.cores_length == 3);
+	assert(topology.cores[0].cpus_length == 2);
+	assert(topology.cores[0].cpus[0] == 0 && topology.cores[0].cpus[1] == 2);
+	assert(topology.cores[1].cpus_length == 2);
+	assert(topology.cores[1].cpus[0] == 1 && topology.cores[1].cpus[1] == 3);
+	assert(topology.cores[2].cpus_length == 1);
+	assert(topology.cores[2].cpus[0] == 5);
+
+	scallop_lang_topology_free(&topology);
+	assert(topology.cores == NULL);
+}
+
+void test_topology_system(void)
+{
+	topology_t topology = { 0 };
+	if (scallop_lang_topology_init(&topology, NULL)) {
+		// No sysfs, as in some containers
+		assert(errno == ENOENT);
+		return;
+	}
+	assert(topology.cores_length > 0);
+	assert(scallop_lang_topology_restrict(&topology) == 0);
+
+	// Every CPU left is one this process may run on
+	cpu_set_t allowed;
+	assert(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+	size_t cpus = 0;
+	for (size_t i = 0; i < topology.cores_length; i++) {
+		assert(topology.cores[i].cpus_length > 0);
+		for (size_t j = 0; j < topology.cores[i].cpus_length; j++)
+			assert(CPU_ISSET(topology.cores[i].cpus[j], &allowed));
+		cpus += topology.cores[i].cpus_length;
+	}
+	assert(cpus == (size_t)CPU_COUNT(&allowed));
+
+	scallop_lang_topology_free(&topology);
+}
+
+void test_topology_errors(void)
+{
+	topology_t topology = { 0 };
+	assert(scallop_lang_topology_init(&topology, "/nonexistent/scallop") == -1);
+	assert(errno == ENOENT);
+
+	static const char *const invalid[] = { "", "0-", "3-1", "0,,1", "x", "0 1" };
+	for (size_t i = 0; i < sizeof(invalid) / sizeof(*invalid); i++) {
+		write_file("online", invalid[i]);
+		assert(scallop_lang_topology_init(&topology, root) == -1);
+		assert(errno == EINVAL);
+		assert(topology.cores == NULL);
+	}
+	write_file("online", files[0][1]);
+}
+
+int main()
+{
+	assert(mkdtemp(root));
+	for (size_t i = 0; i < sizeof(files) / sizeof(*files); i++)
+		write_file(files[i][0], files[i][1]);
+
+	test_topology_cores();
+	test_topology_system();
+	test_topology_errors();
+
+	remove_files();
+}
@@ -0,0 +1,245 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "scallop-lang/optimize.h"
+#include "scallop-lang/vm.h"
+
+#include <libadt/str.h>
+
+#define lit libadt_str_literal
+
+typedef struct scallop_lang_script script_t;
+typedef struct scallop_lang_vm_program program_t;
+typedef struct scallop_lang_vm_options options_t;
+
+static struct libadt_const_lptr text_of(const char *text)
+{
+	return (struct libadt_const_lptr) {
+		.buffer = text,
+		.size = 1,
+		.length = (ssize_t)strlen(text),
+	};
+}
+
+/*
+ * Compiles and runs a script, returning its output.
+ */
+static char *run(
+	const char *text,
+	int passes,
+	struct scallop_lang_env *env,
+	struct scallop_lang_commands *commands,
+	int *status
+)
+{
+	script_t script = { 0 };
+	assert(scallop_lang_script_build(text_of(text), &script) == 0);
+	assert(scallop_lang_optimize(&script, passes, NULL) == 0);
+
+	program_t program = { 0 };
+	assert(scallop_lang_vm_compile(&script, &program) == 0);
+
+	FILE *const output = tmpfile();
+	assert(output);
+	const options_t options = {
+		.env = env,
+		.commands = commands,
+		.in = STDIN_FILENO,
+		.out = fileno(output),
+		.err = STDERR_FILENO,
+	};
+	assert(scallop_lang_vm_run(&program, &options, status) == 0);
+
+	char *const result = calloc(4096, 1);
+	assert(result);
+	rewind(output);
+	fread(result, 1, 4095, output);
+	fclose(output);
+
+	scallop_lang_vm_free(&program);
+	scallop_lang_script_free(&script);
+	return result;
+}
+
+static void assert_output(const char *text, const char *expected, int expected_status)
+{
+	struct scallop_lang_env env = { 0 };
+	char *const envp[] = { "X=ex", "Y=why", NULL };
+	assert(scallop_lang_env_init(&env, envp) == 0);
+
+	// The same either way: the compiler normalizes raw words itself
+	const int passes[] = { 0, SCALLOP_LANG_OPTIMIZE_ALL };
+	for (size_t i = 0; i < sizeof(passes) / sizeof(*passes); i++) {
+		struct scallop_lang_env scope = { 0 };
+		scallop_lang_env_fork(&env, &scope);
+
+		int status = -1;
+		char *const output = run(text, passes[i], &scope, NULL, &status);
+		assert(strcmp(output, expected) == 0);
+		assert(status == expected_status);
+		free(output);
+		scallop_lang_env_free(&scope);
+	}
+	scallop_lang_env_free(&env);
+}
+
+static void test_vm_compile(void)
+{
+	script_t script = { 0 };
+	assert(scallop_lang_script_build(lit("echo a $X; echo a $X b; $X a"), &script) == 0);
+
+	program_t program = { 0 };
+	assert(scallop_lang_vm_compile(&script, &program) == 0);
+
+	// echo, a, X and b, each once
+	assert(program.constants_length == 4);
+	assert(program.max_arguments == 4);
+	assert(program.max_stack == 4);
+	assert(program.slots_length == 0);
+	for (size_t i = 0; i < program.constants_length; i++)
+		assert(strlen(program.constants[i].text) == program.constants[i].length);
+
+	scallop_lang_vm_free(&program);
+	assert(program.code == NULL);
+	scallop_lang_script_free(&script);
+}
+
+static void test_vm_compile_hoisted(void)
+{
+	script_t script = { 0 };
+	assert(scallop_lang_script_build(
+		lit("echo [echo $X] [echo $X]; { echo [echo b] [echo b] }"),
+		&script
+	) == 0);
+	assert(scallop_lang_optimize(&script, SCALLOP_LANG_OPTIMIZE_HOIST, NULL) == 0);
+
+	program_t program = { 0 };
+	assert(scallop_lang_vm_compile(&script, &program) == 0);
+	assert(program.slots_length == 2);
+	scallop_lang_vm_free(&program);
+	scallop_lang_script_free(&script);
+}
+
+static void test_vm_compile_invalid(void)
+{
+	const char *const scripts[] = {
+		"echo { a }",
+		"echo 'unterminated",
+	};
+	for (size_t i = 0; i < sizeof(scripts) / sizeof(*scripts); i++) {
+		script_t script = { 0 };
+		if (scallop_lang_script_build(text_of(scripts[i]), &script))
+			continue;
+
+		program_t program = { 0 };
+		errno = 0;
+		assert(scallop_lang_vm_compile(&script, &program) == -1);
+		assert(errno == EINVAL);
+		assert(program.code == NULL);
+		scallop_lang_script_free(&script);
+	}
+}
+
+static void test_vm_builtins(void)
+{
+	assert_output("echo hello 'a b' pre$X\"-$Y\"", "hello a b preex-why\n", 0);
+	assert_output("echo one; echo -n two; echo ''", "one\ntwo\n", 0);
+	assert_output("echo $UNSET''x", "x\n", 0);
+	assert_output("false", "", 1);
+	assert_output("echo a; false; true", "a\n", 0);
+
+	// Command names which aren't constants are looked up at run time
+	assert_output("set CMD echo; $CMD dynamic", "dynamic\n", 0);
+}
+
+static void test_vm_substitutions(void)
+{
+	assert_output("echo a[echo b]c [echo [echo deep]]", "abc deep\n", 0);
+	assert_output("echo [echo one; echo two]", "one\ntwo\n", 0);
+	assert_output("echo [echo $X] [echo $X]", "ex ex\n", 0);
+	assert_output("echo x[false]y [echo -n]", "xy \n", 0);
+	assert_output("{ echo [echo a] [echo a] }; echo b", "a a\nb\n", 0);
+}
+
+static void test_vm_variables(void)
+{
+	assert_output("set X 1; echo $X", "1\n", 0);
+
+	// The first $X is taken before the substitution sets it
+	assert_output("set X 1; echo $X [set X 2]$X", "1 2\n", 0);
+	assert_output("set X $X$Y; set X $X; echo $X", "exwhy\n", 0);
+}
+
+static void test_vm_blocks(void)
+{
+	assert_output("{ echo a; echo b }; echo c", "a\nb\nc\n", 0);
+	assert_output("{ set X 1; { echo $X } }; echo $X", "1\n1\n", 0);
+}
+
+static void test_vm_spawn(void)
+{
+	assert_output("sh -c 'echo $0 $X' spawned", "spawned ex\n", 0);
+	assert_output("echo [sh -c 'echo captured']x", "capturedx\n", 0);
+	assert_output("sh -c 'exit 3'", "", 3);
+	assert_output("sh -c 'kill -TERM $$'", "", 128 + 15);
+	assert_output("scallop-lang-vm-no-such-command", "", 127);
+
+	// Variables set by the script are passed on
+	assert_output("set V value; sh -c 'echo $V'", "value\n", 0);
+}
+
+static void test_vm_commands(void)
+{
+	struct scallop_lang_commands commands = { 0 };
+	assert(scallop_lang_commands_init(&commands, getenv("PATH")) == 0);
+
+	struct scallop_lang_env env = { 0 };
+	assert(scallop_lang_env_init(&env, NULL) == 0);
+
+	int status = -1;
+	char *output = run("sh -c 'exit 4'; hash sh", 0, &env, &commands, &status);
+	assert(strcmp(output, "") == 0);
+	assert(status == 0);
+	free(output);
+
+	output = run("sh -c 'echo cached'; sh -c 'exit 5'", 0, &env, &commands, &status);
+	assert(strcmp(output, "cached\n") == 0);
+	assert(status == 5);
+	free(output);
+
+	scallop_lang_env_free(&env);
+	scallop_lang_commands_free(&commands);
+}
+
+int main()
+{
+	test_vm_compile();
+	test_vm_compile_hoisted();
+	test_vm_compile_invalid();
+	test_vm_builtins();
+	test_vm_substitutions();
+	test_vm_variables();
+	test_vm_blocks();
+	test_vm_spawn();
+	test_vm_commands();
+}
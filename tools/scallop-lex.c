@@ -0,0 +1,866 @@
+/*
+ * Scallop - A Shell Language for Parallelization (Language Definition)
+ * Copyright (C) 2024  Marcus Harrison
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * scallop-lex - tokenizes scripts with scallop_lang_lex_next()
+ *
+ * Output formats:
+ *
+ * human:  one token per line, "offset<TAB>length<TAB>type<TAB>value",
+ *         with the value escaped C-style.
+ * ndjson: one JSON object per token, with the keys "file", "offset",
+ *         "length", "type" and "value".
+ * binary: one record per token: a type byte (see type_id()), followed
+ *         by the value length as an unsigned LEB128 number. Tokens are
+ *         contiguous, so offsets are implied. Each file ends with an
+ *         end or unexpected record.
+ * none:   no output, for use with --stats.
+ *
+ * With --listen, scallop-lex runs as a daemon, and invocations with
+ * --connect are run by it instead, using the client's working
+ * directory, standard streams and locale. The daemon keeps the
+ * tokens of every regular file it lexes, and replays them until the
+ * file changes.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <locale.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <scallop-lang/daemon.h>
+#include <scallop-lang/lex.h>
+
+#define classifier_fn scallop_lang_classifier_fn
+
+extern char **environ;
+
+typedef enum {
+	FORMAT_HUMAN,
+	FORMAT_NDJSON,
+	FORMAT_BINARY,
+	FORMAT_NONE,
+} FORMAT;
+
+typedef struct {
+	FORMAT format;
+	bool stats;
+	bool raw;
+} options_t;
+
+typedef struct {
+	const char *buffer;
+	size_t length;
+	bool mapped;
+} input_t;
+
+typedef struct {
+	FILE *out;
+	FILE *err;
+	int in;
+
+	// The directory relative paths are opened from
+	int cwd;
+
+	// Set when serving invocations as a daemon
+	struct scallop_lang_daemon_cache *cache;
+} io_t;
+
+typedef struct {
+	size_t bytes;
+	size_t tokens;
+	double seconds;
+} stats_t;
+
+static const char *type_name(classifier_fn *type)
+{
+	if (type == scallop_lang_classifier_end)
+		return "end";
+	if (type == scallop_lang_classifier_unexpected)
+		return "unexpected";
+	if (type == scallop_lang_classifier_word)
+		return "word";
+	if (type == scallop_lang_classifier_word_separator)
+		return "word_separator";
+	if (type == scallop_lang_classifier_statement_separator)
+		return "statement_separator";
+	if (type == scallop_lang_classifier_escape)
+		return "escape";
+	if (type == scallop_lang_classifier_single_quote)
+		return "single_quote";
+	if (type == scallop_lang_classifier_single_quote_word)
+		return "single_quote_word";
+	if (type == scallop_lang_classifier_single_quote_end)
+		return "single_quote_end";
+	if (type == scallop_lang_classifier_double_quote)
+		return "double_quote";
+	if (type == scallop_lang_classifier_double_quote_word)
+		return "double_quote_word";
+	if (type == scallop_lang_classifier_double_quote_end)
+		return "double_quote_end";
+	if (type == scallop_lang_classifier_curly_block)
+		return "curly_block";
+	if (type == scallop_lang_classifier_curly_block_end)
+		return "curly_block_end";
+	if (type == scallop_lang_classifier_square_block)
+		return "square_block";
+	if (type == scallop_lang_classifier_square_block_end)
+		return "square_block_end";
+	if (type == scallop_lang_classifier_line_comment)
+		return "line_comment";
+	if (type == scallop_lang_classifier_glob)
+		return "glob";
+	if (type == scallop_lang_classifier_variable)
+		return "variable";
+	if (type == scallop_lang_classifier_variable_name)
+		return "variable_name";
+	if (type == scallop_lang_classifier_double_quote_variable)
+		return "double_quote_variable";
+	if (type == scallop_lang_classifier_double_quote_variable_name)
+		return "double_quote_variable_name";
+	return "unknown";
+}
+
+static unsigned char type_id(classifier_fn *type)
+{
+	// end is a pointer rather than a function, so it can't be in
+	// the table
+	if (type == scallop_lang_classifier_end)
+		return 0;
+
+	// The other types, in the order of their ids
+	static classifier_fn *const types[] = {
+		scallop_lang_classifier_word,
+		scallop_lang_classifier_word_separator,
+		scallop_lang_classifier_statement_separator,
+		scallop_lang_classifier_escape,
+		scallop_lang_classifier_single_quote,
+		scallop_lang_classifier_single_quote_word,
+		scallop_lang_classifier_single_quote_end,
+		scallop_lang_classifier_double_quote,
+		scallop_lang_classifier_double_quote_word,
+		scallop_lang_classifier_double_quote_end,
+		scallop_lang_classifier_curly_block,
+		scallop_lang_classifier_curly_block_end,
+		scallop_lang_classifier_square_block,
+		scallop_lang_classifier_square_block_end,
+		scallop_lang_classifier_line_comment,
+		scallop_lang_classifier_glob,
+		scallop_lang_classifier_variable,
+		scallop_lang_classifier_variable_name,
+		scallop_lang_classifier_double_quote_variable,
+		scallop_lang_classifier_double_quote_variable_name,
+	};
+	for (unsigned char i = 0; i < sizeof(types) / sizeof(*types); i++)
+		if (types[i] == type)
+			return i + 1;
+	return 0xff;
+}
+
+static void print_human_value(FILE *out, const char *value, size_t length)
+{
+	for (size_t i = 0; i < length; i++) {
+		const unsigned char c = (unsigned char)value[i];
+		switch (c) {
+			case '\n':
+				fputs("\\n", out);
+				break;
+			case '\r':
+				fputs("\\r", out);
+				break;
+			case '\t':
+				fputs("\\t", out);
+				break;
+			case '\\':
+				fputs("\\\\", out);
+				break;
+			default:
+				if (c < 0x20 || c == 0x7f)
+					fprintf(out, "\\x%02x", c);
+				else
+					putc(c, out);
+		}
+	}
+}
+
+static void print_json_string(FILE *out, const char *value, size_t length)
+{
+	putc('"', out);
+	for (size_t i = 0; i < length; i++) {
+		const unsigned char c = (unsigned char)value[i];
+		switch (c) {
+			case '"':
+				fputs("\\\"", out);
+				break;
+			case '\\':
+				fputs("\\\\", out);
+				break;
+			case '\n':
+				fputs("\\n", out);
+				break;
+			case '\r':
+				fputs("\\r", out);
+				break;
+			case '\t':
+				fputs("\\t", out);
+				break;
+			default:
+				if (c < 0x20)
+					fprintf(out, "\\u%04x", c);
+				else
+					putc(c, out);
+		}
+	}
+	putc('"', out);
+}
+
+static void print_leb128(FILE *out, size_t value)
+{
+	do {
+		unsigned char byte = value & 0x7f;
+		value >>= 7;
+		if (value)
+			byte |= 0x80;
+		putc(byte, out);
+	} while (value);
+}
+
+static void print_token(
+	FILE *out,
+	FORMAT format,
+	const char *name,
+	const input_t *input,
+	struct scallop_lang_lex token
+)
+{
+	const char *const value = token.value.buffer;
+	const size_t offset = (size_t)(value - input->buffer);
+	const size_t length = (size_t)token.value.length;
+
+	switch (format) {
+		case FORMAT_HUMAN:
+			fprintf(out, "%zu\t%zu\t%s\t", offset, length, type_name(token.type));
+			print_human_value(out, value, length);
+			putc('\n', out);
+			break;
+		case FORMAT_NDJSON:
+			fputs("{\"file\":", out);
+			print_json_string(out, name, strlen(name));
+			fprintf(
+				out,
+				",\"offset\":%zu,\"length\":%zu,\"type\":\"%s\",\"value\":",
+				offset,
+				length,
+				type_name(token.type)
+			);
+			print_json_string(out, value, length);
+			fputs("}\n", out);
+			break;
+		case FORMAT_BINARY:
+			putc(type_id(token.type), out);
+			print_leb128(out, length);
+			break;
+		case FORMAT_NONE:
+			break;
+	}
+}
+
+static int read_input(int fd, input_t *input)
+{
+	*input = (input_t) { 0 };
+
+	struct stat info = { 0 };
+	if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+		void *const mapped = mmap(
+			NULL,
+			(size_t)info.st_size,
+			PROT_READ,
+			MAP_PRIVATE,
+			fd,
+			0
+		);
+		if (mapped != MAP_FAILED) {
+			input->buffer = mapped;
+			input->length = (size_t)info.st_size;
+			input->mapped = true;
+			return 0;
+		}
+	}
+
+	size_t capacity = 0;
+	char *buffer = NULL;
+	for (;;) {
+		if (input->length == capacity) {
+			capacity = capacity ? capacity * 2 : 65536;
+			char *const grown = realloc(buffer, capacity);
+			if (!grown) {
+				free(buffer);
+				return -1;
+			}
+			buffer = grown;
+		}
+
+		const ssize_t amount = read(fd, buffer + input->length, capacity - input->length);
+		if (amount < 0) {
+			if (errno == EINTR)
+				continue;
+			free(buffer);
+			return -1;
+		}
+		if (amount == 0)
+			break;
+		input->length += (size_t)amount;
+	}
+
+	input->buffer = buffer;
+	return 0;
+}
+
+static void free_input(input_t *input)
+{
+	if (input->mapped)
+		munmap((void *)input->buffer, input->length);
+	else
+		free((void *)input->buffer);
+}
+
+static double now(void)
+{
+	struct timespec time = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static void print_stats(FILE *err, const char *name, stats_t stats)
+{
+	const double megabytes = (double)stats.bytes / (1024 * 1024);
+	fprintf(
+		err,
+		"%s: %zu bytes, %zu tokens, %.6f s, %.2f MB/s\n",
+		name,
+		stats.bytes,
+		stats.tokens,
+		stats.seconds,
+		stats.seconds > 0 ? megabytes / stats.seconds : 0
+	);
+}
+
+static struct scallop_lang_lex cached_token(
+	const struct scallop_lang_daemon_script *cached,
+	size_t i
+)
+{
+	const struct scallop_lang_batch_token *const token = &cached->tokens[i];
+	return (struct scallop_lang_lex) {
+		.type = token->type,
+		.script = cached->script,
+		.value = {
+			.buffer = (const char *)cached->script.buffer + token->offset,
+			.size = 1,
+			.length = (ssize_t)token->length,
+		},
+	};
+}
+
+static int lex_file(
+	const io_t *io,
+	const options_t *options,
+	const char *name,
+	int fd,
+	stats_t *total
+)
+{
+	// Regular files are lexed once by a daemon, and replayed from
+	// then on until they change
+	const struct scallop_lang_daemon_script *cached = io->cache
+		? scallop_lang_daemon_cache_get(io->cache, fd, options->raw)
+		: NULL;
+
+	input_t input = { 0 };
+	if (cached) {
+		input.buffer = cached->script.buffer;
+		input.length = (size_t)cached->script.length;
+	} else if (read_input(fd, &input)) {
+		fprintf(io->err, "scallop-lex: %s: %s\n", name, strerror(errno));
+		return 1;
+	}
+
+	stats_t stats = { .bytes = input.length };
+	const struct libadt_const_lptr script = {
+		.buffer = input.buffer,
+		.size = 1,
+		.length = (ssize_t)input.length,
+	};
+
+	int status = 0;
+	const double start = now();
+	struct scallop_lang_lex token = scallop_lang_lex_init(script);
+	for (size_t i = 0;; i++, stats.tokens++) {
+		if (cached)
+			token = cached_token(cached, i);
+		else if (options->raw)
+			token = scallop_lang_lex_next_raw(token);
+		else
+			token = scallop_lang_lex_next(token);
+		print_token(io->out, options->format, name, &input, token);
+
+		if (token.type == scallop_lang_classifier_unexpected) {
+			fprintf(
+				io->err,
+				"scallop-lex: %s: unexpected input at byte %zu\n",
+				name,
+				(size_t)((const char *)token.value.buffer - input.buffer)
+			);
+			status = 1;
+			break;
+		}
+		if (token.type == scallop_lang_classifier_end)
+			break;
+	}
+	stats.seconds = now() - start;
+
+	if (options->stats)
+		print_stats(io->err, name, stats);
+
+	total->bytes += stats.bytes;
+	total->tokens += stats.tokens;
+	total->seconds += stats.seconds;
+
+	if (cached)
+		scallop_lang_daemon_cache_release(io->cache, cached);
+	else
+		free_input(&input);
+	return status;
+}
+
+static void usage(FILE *out)
+{
+	fputs(
+		"Usage: scallop-lex [OPTION]... [FILE]...\n"
+		"  or:  scallop-lex --listen=SOCKET\n"
+		"  or:  scallop-lex --connect=SOCKET [OPTION]... [FILE]...\n"
+		"Tokenize each FILE, or standard input, as a Scallop script.\n"
+		"\n"
+		"  -f, --format=FORMAT  output format: human (default), ndjson,\n"
+		"                       binary or none\n"
+		"  -r, --raw            output raw tokens, from\n"
+		"                       scallop_lang_lex_next_raw()\n"
+		"  -s, --stats          report bytes, tokens, throughput and\n"
+		"                       peak memory use on standard error\n"
+		"  -h, --help           show this help\n"
+		"\n"
+		"  --listen=SOCKET      serve invocations on a Unix socket,\n"
+		"                       keeping lexed files cached between them\n"
+		"  --connect=SOCKET     run this invocation in the daemon on\n"
+		"                       SOCKET, or here if it isn't running\n",
+		out
+	);
+}
+
+static pthread_mutex_t getopt_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Parses the options of an invocation. getopt_long() keeps its
+ * state in globals, so daemon threads take turns.
+ */
+static int parse_options(
+	const io_t *io,
+	int argc,
+	char **argv,
+	options_t *options,
+	int *first
+)
+{
+	static const struct option long_options[] = {
+		{ "format", required_argument, NULL, 'f' },
+		{ "raw", no_argument, NULL, 'r' },
+		{ "stats", no_argument, NULL, 's' },
+		{ "help", no_argument, NULL, 'h' },
+		{ 0 },
+	};
+
+	int result = -1;
+	pthread_mutex_lock(&getopt_mutex);
+
+	// 0 rather than 1 makes glibc start over completely
+	optind = 0;
+	opterr = io->err == stderr;
+	for (
+		int option = getopt_long(argc, argv, "f:rsh", long_options, NULL);
+		option != -1;
+		option = getopt_long(argc, argv, "f:rsh", long_options, NULL)
+	) {
+		switch (option) {
+			case 'f':
+				if (strcmp(optarg, "human") == 0)
+					options->format = FORMAT_HUMAN;
+				else if (strcmp(optarg, "ndjson") == 0)
+					options->format = FORMAT_NDJSON;
+				else if (strcmp(optarg, "binary") == 0)
+					options->format = FORMAT_BINARY;
+				else if (strcmp(optarg, "none") == 0)
+					options->format = FORMAT_NONE;
+				else {
+					fprintf(io->err, "scallop-lex: unknown format: %s\n", optarg);
+					result = 2;
+					goto done;
+				}
+				break;
+			case 'r':
+				options->raw = true;
+				break;
+			case 's':
+				options->stats = true;
+				break;
+			case 'h':
+				usage(io->out);
+				result = 0;
+				goto done;
+			default:
+				usage(io->err);
+				result = 2;
+				goto done;
+		}
+	}
+	*first = optind;
+
+done:
+	pthread_mutex_unlock(&getopt_mutex);
+	return result;
+}
+
+static int run(const io_t *io, int argc, char **argv)
+{
+	options_t options = { 0 };
+	int first = 0;
+	const int result = parse_options(io, argc, argv, &options, &first);
+	if (result >= 0)
+		return result;
+
+	int status = 0;
+	stats_t total = { 0 };
+	if (first == argc) {
+		status |= lex_file(io, &options, "-", io->in, &total);
+	}
+	for (int i = first; i < argc; i++) {
+		if (strcmp(argv[i], "-") == 0) {
+			status |= lex_file(io, &options, "-", io->in, &total);
+			continue;
+		}
+
+		const int fd = openat(io->cwd, argv[i], O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			fprintf(io->err, "scallop-lex: %s: %s\n", argv[i], strerror(errno));
+			status = 1;
+			continue;
+		}
+		status |= lex_file(io, &options, argv[i], fd, &total);
+		close(fd);
+	}
+
+	fflush(io->out);
+
+	if (options.stats) {
+		struct rusage usage = { 0 };
+		getrusage(RUSAGE_SELF, &usage);
+		print_stats(io->err, "total", total);
+		fprintf(io->err, "peak RSS: %ld KiB\n", usage.ru_maxrss);
+	}
+
+	return status;
+}
+
+/*
+ * Daemon
+ */
+
+static int unix_socket(const char *path, struct sockaddr_un *address)
+{
+	*address = (struct sockaddr_un) { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof(address->sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(address->sun_path, path);
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd >= 0)
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+	return fd;
+}
+
+/*
+ * Returns the locale a client asked for with its environment, in
+ * the order setlocale(LC_ALL, "") would look.
+ */
+static const char *request_locale(char *const *envp)
+{
+	static const char *const names[] = { "LC_ALL=", "LC_CTYPE=", "LANG=" };
+	for (size_t i = 0; i < sizeof(names) / sizeof(*names); i++) {
+		const size_t length = strlen(names[i]);
+		for (char *const *variable = envp; *variable; variable++)
+			if (strncmp(*variable, names[i], length) == 0 && (*variable)[length])
+				return *variable + length;
+	}
+	return "C";
+}
+
+typedef struct {
+	int listener;
+	struct scallop_lang_daemon_cache cache;
+} daemon_t;
+
+typedef struct {
+	char name[256];
+	locale_t locale;
+} worker_locale_t;
+
+/*
+ * Switches the calling thread to a client's locale. The last one
+ * is kept, since clients almost always share it.
+ */
+static void use_locale(worker_locale_t *current, const char *name)
+{
+	if (current->locale && strcmp(current->name, name) == 0)
+		return;
+
+	locale_t locale = newlocale(LC_CTYPE_MASK, name, (locale_t)0);
+	if (!locale)
+		locale = newlocale(LC_CTYPE_MASK, "C", (locale_t)0);
+	if (!locale)
+		return;
+
+	uselocale(locale);
+	if (current->locale)
+		freelocale(current->locale);
+	current->locale = locale;
+	snprintf(current->name, sizeof(current->name), "%s", name);
+}
+
+static FILE *open_stream(int fd)
+{
+	const int copy = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (copy < 0)
+		return NULL;
+	FILE *const stream = fdopen(copy, "w");
+	if (!stream)
+		close(copy);
+	return stream;
+}
+
+static void serve(daemon_t *daemon, worker_locale_t *locale, int connection)
+{
+	struct scallop_lang_daemon_request request = { 0 };
+	if (scallop_lang_daemon_receive_request(connection, &request))
+		return;
+
+	use_locale(locale, request_locale(request.envp));
+
+	int status = 1;
+	FILE *const out = open_stream(request.fds[1]);
+	FILE *const err = open_stream(request.fds[2]);
+	if (out && err) {
+		const io_t io = {
+			.out = out,
+			.err = err,
+			.in = request.fds[0],
+			.cwd = request.cwd_fd,
+			.cache = &daemon->cache,
+		};
+		status = run(&io, (int)request.argc, request.argv);
+	}
+	if (out)
+		fclose(out);
+	if (err)
+		fclose(err);
+
+	scallop_lang_daemon_send_status(connection, status);
+	scallop_lang_daemon_request_free(&request);
+}
+
+static void *worker(void *argument)
+{
+	daemon_t *const daemon = argument;
+	worker_locale_t locale = { 0 };
+	for (;;) {
+		const int connection = accept(daemon->listener, NULL, NULL);
+		if (connection < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			perror("scallop-lex: accept");
+			break;
+		}
+		fcntl(connection, F_SETFD, FD_CLOEXEC);
+		serve(daemon, &locale, connection);
+		close(connection);
+	}
+
+	if (locale.locale) {
+		uselocale(LC_GLOBAL_LOCALE);
+		freelocale(locale.locale);
+	}
+	return NULL;
+}
+
+static int listen_on(const char *path)
+{
+	// Clients that go away mid-reply shouldn't stop the daemon
+	signal(SIGPIPE, SIG_IGN);
+
+	daemon_t daemon = { 0 };
+	struct sockaddr_un address;
+	daemon.listener = unix_socket(path, &address);
+	if (daemon.listener < 0) {
+		fprintf(stderr, "scallop-lex: %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	unlink(path);
+	const bool listening = bind(
+			daemon.listener,
+			(struct sockaddr *)&address,
+			sizeof(address)
+		) == 0
+		&& listen(daemon.listener, SOMAXCONN) == 0;
+	if (!listening || scallop_lang_daemon_cache_init(&daemon.cache)) {
+		fprintf(stderr, "scallop-lex: %s: %s\n", path, strerror(errno));
+		close(daemon.listener);
+		return 1;
+	}
+
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads < 1)
+		threads = 1;
+	pthread_t *const workers = calloc((size_t)threads, sizeof(*workers));
+	if (!workers) {
+		perror("scallop-lex");
+		return 1;
+	}
+
+	long started = 0;
+	for (; started < threads; started++)
+		if (pthread_create(&workers[started], NULL, worker, &daemon))
+			break;
+	if (!started) {
+		perror("scallop-lex");
+		return 1;
+	}
+	for (long i = 0; i < started; i++)
+		pthread_join(workers[i], NULL);
+
+	free(workers);
+	scallop_lang_daemon_cache_free(&daemon.cache);
+	close(daemon.listener);
+	unlink(path);
+	return 1;
+}
+
+/*
+ * Runs an invocation in a daemon, returning -1 if there isn't one
+ * to run it.
+ */
+static int connect_to(const char *path, char **argv)
+{
+	struct sockaddr_un address;
+	const int fd = unix_socket(path, &address);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&address, sizeof(address))) {
+		close(fd);
+		return -1;
+	}
+
+	char cwd[PATH_MAX];
+	const int cwd_fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (cwd_fd < 0 || !getcwd(cwd, sizeof(cwd))) {
+		if (cwd_fd >= 0)
+			close(cwd_fd);
+		close(fd);
+		return -1;
+	}
+
+	const int fds[SCALLOP_LANG_DAEMON_FDS] = {
+		STDIN_FILENO,
+		STDOUT_FILENO,
+		STDERR_FILENO,
+	};
+	int status = -1;
+	const bool sent = scallop_lang_daemon_send_request(
+		fd,
+		argv,
+		environ,
+		cwd,
+		cwd_fd,
+		fds
+	) == 0;
+	if (sent && scallop_lang_daemon_receive_status(fd, &status))
+		status = -1;
+
+	close(cwd_fd);
+	close(fd);
+	return status;
+}
+
+int main(int argc, char **argv)
+{
+	static const char listen_option[] = "--listen=";
+	static const char connect_option[] = "--connect=";
+
+	if (argc == 2 && strncmp(argv[1], listen_option, sizeof(listen_option) - 1) == 0)
+		return listen_on(argv[1] + sizeof(listen_option) - 1);
+
+	if (argc > 1 && strncmp(argv[1], connect_option, sizeof(connect_option) - 1) == 0) {
+		const char *const path = argv[1] + sizeof(connect_option) - 1;
+		// Drop the option, so the daemon sees a normal invocation
+		argv[1] = argv[0];
+		argv++;
+		argc--;
+
+		const int status = connect_to(path, argv);
+		if (status >= 0)
+			return status;
+	}
+
+	setlocale(LC_ALL, "");
+
+	static char output_buffer[1 << 16];
+	setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+
+	const io_t io = {
+		.out = stdout,
+		.err = stderr,
+		.in = STDIN_FILENO,
+		.cwd = AT_FDCWD,
+	};
+	return run(&io, argc, argv);
+}